@@ -0,0 +1,131 @@
+/*
+    Multi camera throughput, runs one to CAMERA_MAX_DEVICES camera workers
+    on generated hand scenes paced far faster than any camera so every
+    worker recognises frames back to back, merges their results like the
+    main loop does and reports results per second in total and per camera,
+    so how throughput scales with the cores available can be read off
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "branch.h"
+#include "camera.h"
+#include "types.h"
+
+static const char *const SOURCE = "synthetic:5";
+static const FrameDimensions DIMENSIONS = {
+    .width = 640, .height = 480, .stride = 640 * 2, .pixels = 640 * 480};
+// frames that come due while a worker is busy are skipped, so at this
+// rate a worker never waits on its source
+static const unsigned int PACE_FPS = 2000;
+static const unsigned long long WARMUP = 500000000ULL;
+static const unsigned long long DURATION = 3000000000ULL;
+static const unsigned long long MERGE_WINDOW = 20000000ULL;
+static const int WAIT_MILLISECONDS = 10;
+
+static unsigned long long nowNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((unsigned long long)now.tv_sec * 1000000000ULL) +
+	   (unsigned long long)now.tv_nsec;
+}
+
+// merges until deadline, returns how many results came out
+static unsigned long long mergeUntil(CameraMerger *merger,
+				     const int wakeDescriptor,
+				     const unsigned long long deadline) {
+    unsigned long long merged = 0;
+    struct pollfd wake = {.fd = wakeDescriptor, .events = POLLIN};
+    while (nowNanoseconds() < deadline) {
+	if (poll(&wake, 1, WAIT_MILLISECONDS) > 0) {
+	    uint64_t count = 0;
+	    const ssize_t bytes = read(wakeDescriptor, &count, sizeof(count));
+	    (void)bytes;
+	}
+	while (CameraMerger_next(merger, nowNanoseconds()) != NULL) {
+	    CameraMerger_release(merger);
+	    merged++;
+	}
+    }
+    return merged;
+}
+
+static ErrorCode measure(const int cameraCount, const int wakeDescriptor) {
+    static CameraWorker workers[CAMERA_MAX_DEVICES];
+    CameraMerger merger;
+    CameraMerger_init(&merger, MERGE_WINDOW);
+    int started = 0;
+    ErrorCode error = ERROR_NONE;
+    for (; started < cameraCount && error == ERROR_NONE; ++started) {
+	error = CameraWorker_start(&workers[started], SOURCE, DIMENSIONS,
+				   PACE_FPS, started + 1, NULL, false,
+				   wakeDescriptor);
+	if (LIKELY(error == ERROR_NONE)) {
+	    (void)CameraMerger_add(&merger, &workers[started].queue);
+	}
+    }
+    if (UNLIKELY(error != ERROR_NONE)) {
+	started--;
+    }
+
+    unsigned long long merged = 0;
+    unsigned long long frames = 0;
+    unsigned long long overruns = 0;
+    if (LIKELY(error == ERROR_NONE)) {
+	(void)mergeUntil(&merger, wakeDescriptor, nowNanoseconds() + WARMUP);
+	unsigned long long before = 0;
+	for (int index = 0; index < cameraCount; ++index) {
+	    before += atomic_load(&workers[index].frames);
+	}
+	const unsigned long long start = nowNanoseconds();
+	merged = mergeUntil(&merger, wakeDescriptor, start + DURATION);
+	const double seconds = (double)(nowNanoseconds() - start) / 1e9;
+	for (int index = 0; index < cameraCount; ++index) {
+	    frames += atomic_load(&workers[index].frames);
+	    overruns += atomic_load(&workers[index].queue.overruns);
+	    if (UNLIKELY(CameraWorker_error(&workers[index]) !=
+			 ERROR_NONE)) {
+		error = CameraWorker_error(&workers[index]);
+	    }
+	}
+	frames -= before;
+	(void)printf("%d,%.2f,%llu,%llu,%.1f,%.1f,%llu,%llu\n", cameraCount,
+		     seconds, frames, merged, (double)merged / seconds,
+		     (double)merged / seconds / cameraCount, merger.late,
+		     overruns);
+    }
+
+    for (int index = 0; index < started; ++index) {
+	CameraWorker_stop(&workers[index]);
+    }
+    return error;
+}
+
+int main(void) {
+    const int wakeDescriptor = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (UNLIKELY(wakeDescriptor < 0)) {
+	(void)fprintf(stderr, "Failed to create eventfd\n");
+	return 1;
+    }
+    (void)printf("cameras,seconds,frames,merged,results_per_s,"
+		 "per_camera_per_s,late,overruns\n");
+    ErrorCode error = ERROR_NONE;
+    for (int cameras = 1; cameras <= CAMERA_MAX_DEVICES &&
+			  error == ERROR_NONE;
+	 ++cameras) {
+	error = measure(cameras, wakeDescriptor);
+    }
+    close(wakeDescriptor);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	(void)fprintf(stderr, "Camera failed: ErrorCode %d\n", error);
+	return 1;
+    }
+    return 0;
+}
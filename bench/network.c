@@ -0,0 +1,148 @@
+/*
+    Gesture network inference time on seeded random weights, the model the
+    gesture classifier is sized for and a depthwise variant of it, and with
+    a path argument writes the first as a model file HM_GESTURE_MODEL can
+    load
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "branch.h"
+#include "gesture.h"
+#include "network.h"
+#include "synthetic.h"
+#include "types.h"
+
+#define PATH_LENGTH 64
+#define MAX_RUNS 2001
+
+typedef struct {
+    const char *name;
+    const SyntheticLayer *layers;
+    int layer_count;
+} __attribute__((aligned(32))) Model;
+
+// 32x32 gray crop, three convs, two pools and a dense layer
+static const SyntheticLayer GESTURE_LAYERS[] = {
+    {LAYER_CONV, 3, 1, 16},      {LAYER_MAXPOOL, 2, 0, 0},
+    {LAYER_CONV, 3, 1, 32},      {LAYER_MAXPOOL, 2, 0, 0},
+    {LAYER_CONV, 3, 1, 32},      {LAYER_DENSE, 0, 0, GESTURE_COUNT},
+};
+
+// the middle conv split into depthwise and pointwise
+static const SyntheticLayer DEPTHWISE_LAYERS[] = {
+    {LAYER_CONV, 3, 1, 16},      {LAYER_MAXPOOL, 2, 0, 0},
+    {LAYER_DEPTHWISE, 3, 1, 0},  {LAYER_CONV, 1, 1, 32},
+    {LAYER_MAXPOOL, 2, 0, 0},    {LAYER_CONV, 3, 1, 32},
+    {LAYER_DENSE, 0, 0, GESTURE_COUNT},
+};
+
+static const Model MODELS[] = {
+    {"gesture", GESTURE_LAYERS,
+     (int)(sizeof(GESTURE_LAYERS) / sizeof(GESTURE_LAYERS[0]))},
+    {"depthwise", DEPTHWISE_LAYERS,
+     (int)(sizeof(DEPTHWISE_LAYERS) / sizeof(DEPTHWISE_LAYERS[0]))},
+};
+static const unsigned int INPUT_SIZE = 32;
+static const unsigned int SEED = 42;
+static const int WARMUP_RUNS = 100;
+static const int RUNS = 2001;
+
+static double nowNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((double)now.tv_sec * 1e9) + (double)now.tv_nsec;
+}
+
+static int compareDoubles(const void *first, const void *second) {
+    const double a = *(const double *)first;
+    const double b = *(const double *)second;
+    return (a > b) - (a < b);
+}
+
+static ErrorCode writeModel(const Model *model, const char *path) {
+    const SyntheticNetwork synthetic = {.layers = model->layers,
+					.layer_count = model->layer_count,
+					.input_height = INPUT_SIZE,
+					.input_width = INPUT_SIZE,
+					.input_channels = 1,
+					.seed = SEED};
+    return SyntheticNetwork_write(&synthetic, path);
+}
+
+// a gradient stands in for the palm crop, the time does not depend on it
+static void fillInput(Network *network) {
+    unsigned char *input = Network_input(network);
+    const TensorShape shape = network->input;
+    for (unsigned int y = 0; y < shape.height; ++y) {
+	for (unsigned int x = 0; x < shape.width; ++x) {
+	    input[((y * shape.width) + x) * shape.padded_channels] =
+		(unsigned char)(((x + y) * 2U) & 127U);
+	}
+    }
+}
+
+static ErrorCode measure(const Model *model, const char *path) {
+    static Network network;
+    static double nanoseconds[MAX_RUNS];
+    ErrorCode error = writeModel(model, path);
+    if (LIKELY(error == ERROR_NONE)) {
+	error = Network_load(&network, path);
+    }
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+    fillInput(&network);
+
+    int best = 0;
+    for (int run = 0; run < WARMUP_RUNS; ++run) {
+	(void)Network_run(&network, &best);
+    }
+    for (int run = 0; run < RUNS; ++run) {
+	const double start = nowNanoseconds();
+	(void)Network_run(&network, &best);
+	nanoseconds[run] = nowNanoseconds() - start;
+    }
+    qsort(nanoseconds, (size_t)RUNS, sizeof(double), compareDoubles);
+    (void)printf("%s,%d,%d,%.1f,%.1f,%.1f,%.1f\n", model->name,
+		 network.layer_count, RUNS, nanoseconds[0] / 1e3,
+		 nanoseconds[RUNS / 2] / 1e3,
+		 nanoseconds[(RUNS * 99) / 100] / 1e3,
+		 nanoseconds[RUNS - 1] / 1e3);
+    Network_unload(&network);
+    return ERROR_NONE;
+}
+
+int main(const int argc, char **argv) {
+    if (argc > 1) {
+	const ErrorCode error = writeModel(&MODELS[0], argv[1]);
+	if (UNLIKELY(error != ERROR_NONE)) {
+	    (void)fprintf(stderr, "Failed to write %s: ErrorCode %d\n",
+			  argv[1], error);
+	    return 1;
+	}
+	return 0;
+    }
+
+    char path[PATH_LENGTH];
+    (void)snprintf(path, sizeof(path), "/tmp/hm-network-bench-%d.nn",
+		   (int)getpid());
+    (void)printf("model,layers,runs,min_us,median_us,p99_us,max_us\n");
+    ErrorCode error = ERROR_NONE;
+    for (size_t index = 0;
+	 index < sizeof(MODELS) / sizeof(MODELS[0]) && error == ERROR_NONE;
+	 ++index) {
+	error = measure(&MODELS[index], path);
+    }
+    (void)unlink(path);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	(void)fprintf(stderr, "Failed to run model: ErrorCode %d\n", error);
+	return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+    Shared results latency, publishes a steady stream of results to reader
+    processes, one sleeping on its eventfd, one spinning on the head and
+    one stalling until it has been lapped, and reports publish to read
+    latency per reader and what publishing costs with all of them attached
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "branch.h"
+#include "camera.h"
+#include "latency.h"
+#include "publisher.h"
+#include "reader.h"
+#include "results.h"
+#include "track.h"
+#include "types.h"
+
+#define SOCKET_PATH_LENGTH 64
+
+typedef enum { READER_WAKE, READER_SPIN, READER_STALLED } ReaderMode;
+
+static const char *const MODE_NAMES[] = {"wake", "spin", "stalled"};
+static const int READER_COUNT = 3;
+static const unsigned long long FRAMES = 4000;
+// 2 kHz, far above any camera so the numbers are not all idle wakeups
+static const long PUBLISH_INTERVAL = 500000L;
+static const int CONNECT_ATTEMPTS = 2000;
+static const unsigned int STALL_SECONDS = 3;
+static const int WAIT_MILLISECONDS = 1000;
+static const int FINGERS = 5;
+static const int HULL_POINTS = 24;
+static const FrameDimensions DIMENSIONS = {
+    .width = 640, .height = 480, .stride = 640 * 2, .pixels = 640 * 480};
+
+static unsigned long long nowNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((unsigned long long)now.tv_sec * 1000000000ULL) +
+	   (unsigned long long)now.tv_nsec;
+}
+
+static void sleepNanoseconds(const long nanoseconds) {
+    const struct timespec interval = {.tv_nsec = nanoseconds};
+    (void)nanosleep(&interval, NULL);
+}
+
+static void printRow(const char *mode, const LatencyHistogram *histogram,
+		     const unsigned long long received,
+		     const unsigned long long missed) {
+    (void)printf("%s,%llu,%llu,%.2f,%.2f,%.2f,%.2f\n", mode, received,
+		 missed,
+		 (double)LatencyHistogram_percentile(histogram, 500) / 1e3,
+		 (double)LatencyHistogram_percentile(histogram, 990) / 1e3,
+		 (double)LatencyHistogram_percentile(histogram, 999) / 1e3,
+		 (double)LatencyHistogram_percentile(histogram, 1000) / 1e3);
+    (void)fflush(stdout);
+}
+
+// runs in its own process, stops after the last frame or a quiet second
+static int runReader(const char *socketPath, const ReaderMode mode) {
+    static LatencyHistogram histogram;
+    ResultsReader reader;
+    const ErrorCode error =
+	ResultsReader_open(&reader, socketPath, mode == READER_WAKE);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	(void)fprintf(stderr, "Failed to open reader: ErrorCode %d\n", error);
+	return 1;
+    }
+    LatencyHistogram_reset(&histogram);
+    // the first frames can go out before open reads the head
+    reader.cursor = 0;
+    // comes back long after the publisher lapped it, then catches up
+    if (mode == READER_STALLED) {
+	(void)sleep(STALL_SECONDS);
+    }
+
+    static ResultsSlot slot;
+    unsigned long long received = 0;
+    unsigned long long quietSince = nowNanoseconds();
+    while (received + reader.missed < FRAMES) {
+	if (ResultsReader_next(&reader, &slot)) {
+	    const unsigned long long now = nowNanoseconds();
+	    LatencyHistogram_record(&histogram, now - slot.publish_timestamp);
+	    received++;
+	    quietSince = now;
+	    continue;
+	}
+	if (nowNanoseconds() - quietSince > 1000000000ULL) {
+	    break;
+	}
+	if (mode == READER_WAKE) {
+	    (void)ResultsReader_wait(&reader, WAIT_MILLISECONDS);
+	}
+    }
+    printRow(MODE_NAMES[mode], &histogram, received, reader.missed);
+    ResultsReader_close(&reader);
+    return 0;
+}
+
+static void fillResult(CameraResult *result) {
+    FingertipTracker_init(&result->tracker);
+    for (int finger = 0; finger < FINGERS; ++finger) {
+	FingertipTrack *track = &result->tracker.tracks[finger];
+	track->active = true;
+	track->id = finger;
+	track->position = (Point){.x = 200 + (finger * 40), .y = 150};
+    }
+    for (int point = 0; point < HULL_POINTS; ++point) {
+	result->hull[point] = (Point){.x = 180 + (point * 10), .y = 300};
+    }
+    result->hull_count = HULL_POINTS;
+    result->camera = 0;
+    result->gesture = GESTURE_OPEN_PALM;
+}
+
+static bool waitForReaders(Publisher *publisher) {
+    for (int attempt = 0; attempt < CONNECT_ATTEMPTS; ++attempt) {
+	Publisher_accept(publisher);
+	int ready = 0;
+	for (int index = 0; index < publisher->reader_count; ++index) {
+	    ready += publisher->readers[index].ready ? 1 : 0;
+	}
+	if (ready == READER_COUNT) {
+	    return true;
+	}
+	sleepNanoseconds(1000000L);
+    }
+    return false;
+}
+
+static void publishFrames(Publisher *publisher) {
+    static LatencyHistogram histogram;
+    static CameraResult result;
+    LatencyHistogram_reset(&histogram);
+    fillResult(&result);
+    for (unsigned long long frame = 0; frame < FRAMES; ++frame) {
+	result.timestamp = nowNanoseconds();
+	result.sequence = (unsigned int)frame;
+	Publisher_publish(publisher, &result);
+	LatencyHistogram_record(&histogram,
+				nowNanoseconds() - result.timestamp);
+	sleepNanoseconds(PUBLISH_INTERVAL);
+    }
+    printRow("publish", &histogram, FRAMES, 0);
+}
+
+int main(void) {
+    char socketPath[SOCKET_PATH_LENGTH];
+    (void)snprintf(socketPath, sizeof(socketPath),
+		   "/tmp/hm-publish-bench-%d.sock", (int)getpid());
+    static Publisher publisher;
+    const ErrorCode error =
+	Publisher_create(&publisher, socketPath, DIMENSIONS);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	(void)fprintf(stderr, "Failed to create publisher: ErrorCode %d\n",
+		      error);
+	return 1;
+    }
+
+    (void)printf("reader,received,missed,p50_us,p99_us,p99.9_us,max_us\n");
+    (void)fflush(stdout);
+    for (int mode = 0; mode < READER_COUNT; ++mode) {
+	const pid_t child = fork();
+	if (child == 0) {
+	    _exit(runReader(socketPath, (ReaderMode)mode));
+	}
+    }
+    if (UNLIKELY(!waitForReaders(&publisher))) {
+	(void)fprintf(stderr, "Readers failed to connect\n");
+	Publisher_destroy(&publisher);
+	return 1;
+    }
+    publishFrames(&publisher);
+
+    int failed = 0;
+    int status = 0;
+    while (wait(&status) > 0) {
+	failed += WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+    }
+    Publisher_destroy(&publisher);
+    return failed == 0 ? 0 : 1;
+}
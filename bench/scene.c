@@ -0,0 +1,383 @@
+/*
+    Synthetic hand scenes, how fast the generator renders at each camera
+    resolution and how well HandPipeline's tracks follow the generated
+    fingertips under a few lighting and noise settings, how much the hand
+    mask flickers on a still noisy hand with and without temporal denoise,
+    and with a path argument writes a 640x480 scene as a file HM_REPLAY
+    can play back
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "branch.h"
+#include "denoise.h"
+#include "gray.h"
+#include "pipeline.h"
+#include "recognize.h"
+#include "scene.h"
+#include "track.h"
+#include "types.h"
+#include "yuyv.h"
+
+typedef struct {
+    unsigned int width;
+    unsigned int height;
+} __attribute__((aligned(8))) Resolution;
+
+static const Resolution RESOLUTIONS[] = {
+    {640, 480}, {1280, 720}, {1920, 1080}};
+static const unsigned int RENDER_FRAMES = 300;
+static const unsigned int TRACKED_LAPS = 2;
+// capture timestamps step at the 30 fps a camera would deliver
+static const unsigned long long FRAME_PERIOD = 33333333ULL;
+// a track this close to a true fingertip counts as finding it, in palm
+// radii since a hull vertex sits somewhere on the rounded tip
+static const float MATCH_DISTANCE = 0.5F;
+static const unsigned int FLICKER_FRAMES = 120;
+static const unsigned char FLICKER_NOISE[] = {0, 6, 12, 18};
+// dim enough that the blurred hand sits a few levels over the threshold,
+// and the noisiest skin still short of clipping at 255
+static const unsigned char DIM_SKIN_LUMA = 236;
+static const unsigned char HAND_THRESHOLD = 128;
+static const unsigned int DEFAULT_REPLAY_FRAMES = 300;
+static const int DEFAULT_REPLAY_FINGERS = 5;
+
+typedef struct {
+    const char *name;
+    int fingers;
+    signed char gradient;
+    unsigned char noise;
+    float forearm_width;
+    bool denoise;
+} __attribute__((aligned(16))) Condition;
+
+static const Condition CONDITIONS[] = {
+    {"clean", 5, 0, 0, 0.0F, false},
+    {"default", 5, 0, 4, 0.0F, false},
+    {"noisy", 5, 0, 10, 0.0F, false},
+    {"denoised", 5, 0, 10, 0.0F, true},
+    {"gradient", 5, -12, 4, 0.0F, false},
+    {"forearm", 5, 0, 4, 0.8F, false},
+    {"three", 3, 0, 4, 0.0F, false},
+    {"one", 1, 0, 4, 0.0F, false},
+};
+
+static double nowNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((double)now.tv_sec * 1e9) + (double)now.tv_nsec;
+}
+
+static FrameDimensions dimensionsOf(const Resolution resolution) {
+    return (FrameDimensions){.width = resolution.width,
+			     .height = resolution.height,
+			     .stride = resolution.width * 2,
+			     .pixels = resolution.width * resolution.height};
+}
+
+static unsigned char *allocateFrame(const FrameDimensions dimensions) {
+    const size_t size = (size_t)dimensions.stride * dimensions.height;
+    return (unsigned char *)aligned_alloc(64, (size + 63) & ~(size_t)63);
+}
+
+static ErrorCode measureRender(const Resolution resolution) {
+    const FrameDimensions dimensions = dimensionsOf(resolution);
+    SceneParameters parameters;
+    SceneGenerator generator;
+    SceneGenerator_defaults(&parameters, SCENE_MAX_FINGERS);
+    ErrorCode error =
+	SceneGenerator_create(&generator, &parameters, dimensions);
+    unsigned char *frame = allocateFrame(dimensions);
+    if (UNLIKELY(error != ERROR_NONE || frame == NULL)) {
+	SceneGenerator_destroy(&generator);
+	free(frame);
+	return error != ERROR_NONE ? error : ERROR_ALLOCATION_FAILED;
+    }
+
+    const double start = nowNanoseconds();
+    for (unsigned int index = 0; index < RENDER_FRAMES; ++index) {
+	SceneGenerator_render(&generator, index, frame, NULL);
+    }
+    const double perFrame = (nowNanoseconds() - start) / RENDER_FRAMES;
+    (void)printf("render,%u,%u,%.0f,%.0f,%.2f\n", resolution.width,
+		 resolution.height, perFrame, 1e9 / perFrame,
+		 (double)dimensions.stride * dimensions.height / perFrame);
+    SceneGenerator_destroy(&generator);
+    free(frame);
+    return ERROR_NONE;
+}
+
+// distance from each true fingertip to the nearest active track
+static void scoreFrame(const FingertipTracker *tracker,
+		       const SceneTruth *truth, unsigned int *found,
+		       double *errorSum) {
+    for (int tip = 0; tip < truth->fingertip_count; ++tip) {
+	const ScenePoint truthTip = truth->fingertips[tip];
+	float nearest = INFINITY;
+	for (int index = 0; index < TRACKER_MAX_TRACKS; ++index) {
+	    const FingertipTrack *track = &tracker->tracks[index];
+	    if (!track->active) {
+		continue;
+	    }
+	    const float dx = (float)track->position.x - truthTip.x;
+	    const float dy = (float)track->position.y - truthTip.y;
+	    nearest = fminf(nearest, sqrtf((dx * dx) + (dy * dy)));
+	}
+	if (nearest <= MATCH_DISTANCE * truth->palm_radius) {
+	    (*found)++;
+	    *errorSum += (double)nearest;
+	}
+    }
+}
+
+// a fresh pipeline per condition so no tracks carry over
+static ErrorCode measureTracking(const Condition *condition,
+				 HandPipeline *pipeline, unsigned char *frame,
+				 const FrameDimensions dimensions) {
+    SceneParameters parameters;
+    SceneGenerator generator;
+    SceneGenerator_defaults(&parameters, condition->fingers);
+    parameters.gradient = condition->gradient;
+    parameters.noise = condition->noise;
+    parameters.forearm_width = condition->forearm_width;
+    ErrorCode error =
+	SceneGenerator_create(&generator, &parameters, dimensions);
+    if (LIKELY(error == ERROR_NONE)) {
+	error = HandPipeline_create(pipeline, dimensions);
+	if (LIKELY(error == ERROR_NONE) && condition->denoise) {
+	    error = HandPipeline_enableDenoise(pipeline);
+	    if (UNLIKELY(error != ERROR_NONE)) {
+		HandPipeline_destroy(pipeline);
+	    }
+	}
+	if (UNLIKELY(error != ERROR_NONE)) {
+	    SceneGenerator_destroy(&generator);
+	}
+    }
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+
+    const unsigned int frames = parameters.path_frames * TRACKED_LAPS;
+    unsigned int found = 0;
+    unsigned int expected = 0;
+    double errorSum = 0.0;
+    SceneTruth truth;
+    const double start = nowNanoseconds();
+    for (unsigned int index = 0; index < frames; ++index) {
+	SceneGenerator_render(&generator, index, frame, &truth);
+	(void)HandPipeline_process(pipeline, frame,
+				   (index + 1) * FRAME_PERIOD);
+	// the first lap lets tracks settle in
+	if (index >= parameters.path_frames) {
+	    scoreFrame(&pipeline->tracker, &truth, &found, &errorSum);
+	    expected += (unsigned int)truth.fingertip_count;
+	}
+    }
+    const double perFrame = (nowNanoseconds() - start) / frames;
+    (void)printf("track,%s,%d,%u,%u,%.3f,%.2f,%.0f\n", condition->name,
+		 condition->fingers, frames - parameters.path_frames, expected,
+		 expected > 0 ? (double)found / expected : 0.0,
+		 found > 0 ? errorSum / found : 0.0, 1e9 / perFrame);
+    HandPipeline_destroy(pipeline);
+    SceneGenerator_destroy(&generator);
+    return ERROR_NONE;
+}
+
+typedef struct {
+    TemporalDenoiser denoiser;
+    unsigned char *gray;
+    unsigned char *blurred;
+    unsigned char *binary;
+    unsigned char *previous;
+} __attribute__((aligned(64))) FlickerPlanes;
+
+static unsigned int countToggles(const unsigned char *binary,
+				 const unsigned char *previous,
+				 const size_t pixels, unsigned int *set) {
+    unsigned int toggles = 0;
+    for (size_t index = 0; index < pixels; ++index) {
+	toggles += binary[index] != previous[index] ? 1U : 0U;
+	*set += binary[index] != 0 ? 1U : 0U;
+    }
+    return toggles;
+}
+
+// a hand that never moves, so every mask pixel that changes is noise
+static ErrorCode measureFlicker(FlickerPlanes *planes, unsigned char *frame,
+				const FrameDimensions dimensions,
+				const unsigned char noise,
+				const bool denoise) {
+    SceneParameters parameters;
+    SceneGenerator generator;
+    SceneGenerator_defaults(&parameters, SCENE_MAX_FINGERS);
+    parameters.path_radius = (ScenePoint){.x = 0.0F, .y = 0.0F};
+    parameters.scale_swing = 0.0F;
+    parameters.rotation_swing = 0.0F;
+    parameters.skin[0] = DIM_SKIN_LUMA;
+    parameters.noise = noise;
+    const ErrorCode error =
+	SceneGenerator_create(&generator, &parameters, dimensions);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+
+    TemporalDenoiser_reset(&planes->denoiser);
+    unsigned long long toggles = 0;
+    unsigned int set = 0;
+    double denoiseNanoseconds = 0.0;
+    for (unsigned int index = 0; index < FLICKER_FRAMES; ++index) {
+	SceneGenerator_render(&generator, index, frame, NULL);
+	(void)yuyvToGray(frame, planes->gray, &dimensions);
+	if (denoise) {
+	    const double start = nowNanoseconds();
+	    TemporalDenoiser_filterGray(&planes->denoiser, planes->gray);
+	    denoiseNanoseconds += nowNanoseconds() - start;
+	}
+	(void)boxBlurGray(planes->gray, planes->blurred, &dimensions);
+	thresholdImage(planes->blurred, planes->binary, dimensions,
+		       HAND_THRESHOLD);
+	if (index > 0) {
+	    toggles += countToggles(planes->binary, planes->previous,
+				    dimensions.pixels, &set);
+	}
+	unsigned char *swap = planes->previous;
+	planes->previous = planes->binary;
+	planes->binary = swap;
+    }
+    // the mask size shows the hand was not eroded away instead
+    (void)printf("flicker,%u,%s,%.0f,%.0f,%.0f\n", noise,
+		 denoise ? "on" : "off", (double)set / (FLICKER_FRAMES - 1),
+		 (double)toggles / (FLICKER_FRAMES - 1),
+		 denoiseNanoseconds / FLICKER_FRAMES);
+    SceneGenerator_destroy(&generator);
+    return ERROR_NONE;
+}
+
+static void freeFlickerPlanes(FlickerPlanes *planes) {
+    TemporalDenoiser_destroy(&planes->denoiser);
+    free(planes->gray);
+    free(planes->blurred);
+    free(planes->binary);
+    free(planes->previous);
+}
+
+static ErrorCode runFlicker(const FrameDimensions dimensions,
+			    unsigned char *frame) {
+    FlickerPlanes planes;
+    ErrorCode error = TemporalDenoiser_create(&planes.denoiser, dimensions);
+    planes.gray = allocateFrame(dimensions);
+    planes.blurred = allocateFrame(dimensions);
+    planes.binary = allocateFrame(dimensions);
+    planes.previous = allocateFrame(dimensions);
+    if (UNLIKELY(planes.gray == NULL || planes.blurred == NULL ||
+		 planes.binary == NULL || planes.previous == NULL)) {
+	error = ERROR_ALLOCATION_FAILED;
+    }
+    if (LIKELY(error == ERROR_NONE)) {
+	// the blur leaves its border alone
+	memset(planes.blurred, 0, dimensions.pixels);
+	(void)printf("\nkind,noise,denoise,mask_pixels,toggled_pixels,"
+		     "denoise_ns\n");
+    }
+    for (size_t index = 0; index < sizeof(FLICKER_NOISE) &&
+			    error == ERROR_NONE;
+	 ++index) {
+	error = measureFlicker(&planes, frame, dimensions,
+			       FLICKER_NOISE[index], false);
+	if (LIKELY(error == ERROR_NONE)) {
+	    error = measureFlicker(&planes, frame, dimensions,
+				   FLICKER_NOISE[index], true);
+	}
+    }
+    freeFlickerPlanes(&planes);
+    return error;
+}
+
+static int runBenchmarks(void) {
+    (void)printf("kind,width,height,ns_per_frame,fps,gb_per_s\n");
+    for (size_t index = 0;
+	 index < sizeof(RESOLUTIONS) / sizeof(RESOLUTIONS[0]); ++index) {
+	const ErrorCode error = measureRender(RESOLUTIONS[index]);
+	if (UNLIKELY(error != ERROR_NONE)) {
+	    (void)fprintf(stderr, "Failed to render: ErrorCode %d\n", error);
+	    return 1;
+	}
+    }
+
+    const FrameDimensions dimensions = dimensionsOf(RESOLUTIONS[0]);
+    HandPipeline *pipeline =
+	(HandPipeline *)aligned_alloc(128, sizeof(HandPipeline));
+    unsigned char *frame = allocateFrame(dimensions);
+    ErrorCode error = pipeline != NULL && frame != NULL
+			  ? ERROR_NONE
+			  : ERROR_ALLOCATION_FAILED;
+    // error is the mean distance of found fingertips in pixels, fps
+    // includes rendering
+    (void)printf("\nkind,condition,fingers,frames,fingertips,found,"
+		 "error_px,fps\n");
+    for (size_t index = 0;
+	 index < sizeof(CONDITIONS) / sizeof(CONDITIONS[0]) &&
+	 error == ERROR_NONE;
+	 ++index) {
+	error = measureTracking(&CONDITIONS[index], pipeline, frame,
+				dimensions);
+    }
+    if (LIKELY(error == ERROR_NONE)) {
+	error = runFlicker(dimensions, frame);
+    }
+    free(pipeline);
+    free(frame);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	(void)fprintf(stderr, "Failed to measure: ErrorCode %d\n", error);
+	return 1;
+    }
+    return 0;
+}
+
+// scene <path> [frames] [fingers]
+static int writeReplay(const char *path, const unsigned int frames,
+		       const int fingers) {
+    const FrameDimensions dimensions = dimensionsOf(RESOLUTIONS[0]);
+    const size_t frameBytes = (size_t)dimensions.stride * dimensions.height;
+    SceneParameters parameters;
+    SceneGenerator generator;
+    SceneGenerator_defaults(&parameters, fingers);
+    const ErrorCode error =
+	SceneGenerator_create(&generator, &parameters, dimensions);
+    unsigned char *frame = allocateFrame(dimensions);
+    FILE *file = fopen(path, "wb");
+    int status = error == ERROR_NONE && frame != NULL && file != NULL ? 0 : 1;
+    for (unsigned int index = 0; index < frames && status == 0; ++index) {
+	SceneGenerator_render(&generator, index, frame, NULL);
+	status = fwrite(frame, 1, frameBytes, file) == frameBytes ? 0 : 1;
+    }
+    if (file != NULL && fclose(file) != 0) {
+	status = 1;
+    }
+    if (UNLIKELY(status != 0)) {
+	(void)fprintf(stderr, "Failed to write %s\n", path);
+    }
+    SceneGenerator_destroy(&generator);
+    free(frame);
+    return status;
+}
+
+int main(const int argc, char **argv) {
+    if (argc > 1) {
+	const unsigned int frames =
+	    argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10)
+		     : DEFAULT_REPLAY_FRAMES;
+	const int fingers =
+	    argc > 3 ? atoi(argv[3]) : DEFAULT_REPLAY_FINGERS;
+	return writeReplay(argv[1], frames, fingers);
+    }
+    return runBenchmarks();
+}
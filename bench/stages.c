@@ -0,0 +1,350 @@
+/*
+    Per stage vision kernel timings on a synthetic hand frame at the
+    resolutions cameras actually deliver, one CSV row per kernel and
+    resolution with the median, tail percentiles, TSC cycles per pixel and
+    the bandwidth the kernel moves at its median
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <x86intrin.h>
+
+#include "branch.h"
+#include "denoise.h"
+#include "gray.h"
+#include "pointset.h"
+#include "recognize.h"
+#include "rgb.h"
+#include "types.h"
+#include "yuyv.h"
+
+#define MAX_REPETITIONS 401
+#define MAX_FINGERTIPS 10
+
+static const int WARMUP_RUNS = 20;
+static const int REPETITIONS = 201;
+static const unsigned char HAND_THRESHOLD = 128;
+// the blur keeps about 5/9 of the level, the hand has to stay above the
+// threshold after it like a well lit hand does
+static const unsigned char HAND_LUMA = 245;
+static const unsigned char BACKGROUND_LUMA = 40;
+
+typedef struct {
+    unsigned int width;
+    unsigned int height;
+} __attribute__((aligned(8))) Resolution;
+
+static const Resolution RESOLUTIONS[] = {
+    {640, 480}, {1280, 720}, {1920, 1080}};
+
+typedef struct {
+    FrameDimensions dimensions;
+    unsigned char *yuyv;
+    unsigned char *rgb;
+    unsigned char *flipped;
+    unsigned char *gray;
+    unsigned char *blurred;
+    unsigned char *binary;
+    Point *contour;
+    Point *hull;
+    Point *hull_scratch;
+    PointSet contour_set;
+    PointSet hull_set;
+    TemporalDenoiser denoiser;
+    Point fingertips[MAX_FINGERTIPS];
+    Point palm_centre;
+    int palm_radius;
+    int contour_count;
+    int hull_count;
+    int max_points;
+} __attribute__((aligned(64))) BenchFrame;
+
+// every run returns the bytes it read and wrote, for the bandwidth column
+typedef size_t (*StageRun)(BenchFrame *frame);
+
+typedef struct {
+    const char *name;
+    StageRun run;
+} __attribute__((aligned(16))) Stage;
+
+static size_t runYuyvToRgb(BenchFrame *frame) {
+    (void)yuyvToRgb(frame->yuyv, frame->rgb, &frame->dimensions);
+    return (size_t)frame->dimensions.pixels * (2 + 4);
+}
+
+static size_t runYuyvToGray(BenchFrame *frame) {
+    (void)yuyvToGray(frame->yuyv, frame->gray, &frame->dimensions);
+    return (size_t)frame->dimensions.pixels * (2 + 1);
+}
+
+static size_t runBoxBlurGray(BenchFrame *frame) {
+    (void)boxBlurGray(frame->gray, frame->blurred, &frame->dimensions);
+    return (size_t)frame->dimensions.pixels * (1 + 1);
+}
+
+static size_t runFlipRgbHorizontal(BenchFrame *frame) {
+    (void)flipRgbHorizontal(frame->rgb, frame->flipped, &frame->dimensions);
+    return (size_t)frame->dimensions.pixels * (4 + 4);
+}
+
+static size_t runThresholdImage(BenchFrame *frame) {
+    thresholdImage(frame->blurred, frame->binary, frame->dimensions,
+		   HAND_THRESHOLD);
+    return (size_t)frame->dimensions.pixels * (1 + 1);
+}
+
+// in place, the history is read and rewritten alongside the frame
+static size_t runDenoiseGray(BenchFrame *frame) {
+    TemporalDenoiser_filterGray(&frame->denoiser, frame->gray);
+    return (size_t)frame->dimensions.pixels * (2 + 2);
+}
+
+static size_t runDenoiseYuyv(BenchFrame *frame) {
+    TemporalDenoiser_filterYuyv(&frame->denoiser, frame->yuyv);
+    return (size_t)frame->dimensions.pixels * (4 + 2);
+}
+
+// the scan for the first edge pixel dominates, count the whole mask read
+static size_t runTraceContour(BenchFrame *frame) {
+    frame->contour_count = traceContour(frame->binary, frame->contour,
+					frame->dimensions, frame->max_points);
+    return frame->dimensions.pixels +
+	   ((size_t)frame->contour_count * sizeof(Point));
+}
+
+static size_t runConvexHull(BenchFrame *frame) {
+    frame->hull_count =
+	convexHull(frame->contour, frame->hull, frame->hull_scratch,
+		   frame->contour_count);
+    return ((size_t)frame->contour_count + (size_t)frame->hull_count) *
+	   sizeof(Point);
+}
+
+static size_t runDetectFingertips(BenchFrame *frame) {
+    const int count = detectFingertips(frame->hull, frame->hull_count,
+				       frame->fingertips, MAX_FINGERTIPS);
+    return ((size_t)frame->hull_count + (size_t)count) * sizeof(Point);
+}
+
+static size_t runTraceContourSet(BenchFrame *frame) {
+    traceContourSet(frame->binary, &frame->contour_set, frame->dimensions);
+    return frame->dimensions.pixels +
+	   ((size_t)frame->contour_set.count * 2 * sizeof(int));
+}
+
+static size_t runConvexHullSet(BenchFrame *frame) {
+    convexHullSet(&frame->contour_set, &frame->hull_set);
+    return ((size_t)frame->contour_set.count +
+	    (size_t)frame->hull_set.count) *
+	   2 * sizeof(int);
+}
+
+static size_t runDetectFingertipsPalmSet(BenchFrame *frame) {
+    const int count = detectFingertipsPalmSet(
+	&frame->hull_set, frame->palm_centre, frame->palm_radius,
+	frame->fingertips, MAX_FINGERTIPS);
+    return ((size_t)frame->hull_set.count * 2 * sizeof(int)) +
+	   ((size_t)count * sizeof(Point));
+}
+
+// in pipeline order, each stage's input is the previous stage's output
+static const Stage STAGES[] = {
+    {"yuyvToRgb", runYuyvToRgb},
+    {"flipRgbHorizontal", runFlipRgbHorizontal},
+    {"yuyvToGray", runYuyvToGray},
+    {"boxBlurGray", runBoxBlurGray},
+    {"thresholdImage", runThresholdImage},
+    {"traceContour", runTraceContour},
+    {"convexHull", runConvexHull},
+    {"detectFingertips", runDetectFingertips},
+    // the point set variants are what HandPipeline runs
+    {"traceContourSet", runTraceContourSet},
+    {"convexHullSet", runConvexHullSet},
+    {"detectFingertipsPalmSet", runDetectFingertipsPalmSet},
+    // last, they rewrite the frames the stages above read
+    {"denoiseGray", runDenoiseGray},
+    {"denoiseYuyv", runDenoiseYuyv},
+};
+
+static bool insideHand(const int x, const int y, const int width,
+		       const int height) {
+    const int centreX = width / 2;
+    const int centreY = (height * 2) / 3;
+    const int radius = height / 6;
+    const int dx = x - centreX;
+    const int dy = y - centreY;
+    if ((dx * dx) + (dy * dy) <= radius * radius) {
+	return true;
+    }
+    // five upright fingers spread over the top of the palm
+    const int fingerWidth = height / 30;
+    const int fingerLength = height / 4;
+    for (int finger = 0; finger < 5; ++finger) {
+	const int fingerX = centreX - radius + ((finger * 2 * radius) / 4);
+	const int top = centreY - radius - fingerLength + ((finger % 2) * 20);
+	if (x >= fingerX - fingerWidth && x <= fingerX + fingerWidth &&
+	    y >= top && y <= centreY) {
+	    return true;
+	}
+    }
+    return false;
+}
+
+// a bright hand on a dark background with some noise so no kernel sees
+// perfectly uniform input
+static void fillFrame(BenchFrame *frame) {
+    const int width = (int)frame->dimensions.width;
+    const int height = (int)frame->dimensions.height;
+    unsigned int seed = 1;
+    for (int y = 0; y < height; ++y) {
+	unsigned char *row = frame->yuyv + ((size_t)y * (size_t)width * 2);
+	for (int x = 0; x < width; ++x) {
+	    seed = (seed * 1103515245U) + 12345U;
+	    const int noise = (int)((seed >> 16) & 15U) - 8;
+	    const int luma =
+		(insideHand(x, y, width, height) ? HAND_LUMA
+						 : BACKGROUND_LUMA) +
+		noise;
+	    row[x * 2] = (unsigned char)luma;
+	    row[(x * 2) + 1] = (x & 1) != 0 ? 120 : 140;
+	}
+    }
+}
+
+static void freeFrame(BenchFrame *frame) {
+    free(frame->yuyv);
+    free(frame->rgb);
+    free(frame->flipped);
+    free(frame->gray);
+    free(frame->blurred);
+    free(frame->binary);
+    free(frame->contour);
+    free(frame->hull);
+    free(frame->hull_scratch);
+    PointSet_destroy(&frame->contour_set);
+    PointSet_destroy(&frame->hull_set);
+    TemporalDenoiser_destroy(&frame->denoiser);
+}
+
+static unsigned char *allocateBytes(const size_t size) {
+    return (unsigned char *)aligned_alloc(64, (size + 63) & ~(size_t)63);
+}
+
+static ErrorCode createFrame(BenchFrame *frame, const Resolution resolution) {
+    memset(frame, 0, sizeof(*frame));
+    frame->dimensions =
+	(FrameDimensions){.width = resolution.width,
+			  .height = resolution.height,
+			  .stride = resolution.width * 2,
+			  .pixels = resolution.width * resolution.height};
+    const size_t pixels = frame->dimensions.pixels;
+    frame->max_points = (int)(4 * (resolution.width + resolution.height));
+    frame->yuyv = allocateBytes(pixels * 2);
+    frame->rgb = allocateBytes(pixels * 4);
+    frame->flipped = allocateBytes(pixels * 4);
+    frame->gray = allocateBytes(pixels);
+    frame->blurred = allocateBytes(pixels);
+    frame->binary = allocateBytes(pixels);
+    frame->contour = (Point *)malloc((size_t)frame->max_points * sizeof(Point));
+    // the monotone chain stacks up to two passes over the points
+    frame->hull =
+	(Point *)malloc((size_t)frame->max_points * 2 * sizeof(Point));
+    frame->hull_scratch =
+	(Point *)malloc((size_t)frame->max_points * sizeof(Point));
+    ErrorCode error = PointSet_create(&frame->contour_set, frame->max_points);
+    if (LIKELY(error == ERROR_NONE)) {
+	error = PointSet_create(&frame->hull_set, frame->max_points + 1);
+    }
+    if (LIKELY(error == ERROR_NONE)) {
+	error = TemporalDenoiser_create(&frame->denoiser, frame->dimensions);
+    }
+    if (UNLIKELY(frame->yuyv == NULL || frame->rgb == NULL ||
+		 frame->flipped == NULL || frame->gray == NULL ||
+		 frame->blurred == NULL || frame->binary == NULL ||
+		 frame->contour == NULL || frame->hull == NULL ||
+		 frame->hull_scratch == NULL || error != ERROR_NONE)) {
+	freeFrame(frame);
+	return ERROR_ALLOCATION_FAILED;
+    }
+    fillFrame(frame);
+    frame->palm_centre = (Point){.x = (int)resolution.width / 2,
+				 .y = ((int)resolution.height * 2) / 3};
+    frame->palm_radius = (int)resolution.height / 6;
+    return ERROR_NONE;
+}
+
+static double nowNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((double)now.tv_sec * 1e9) + (double)now.tv_nsec;
+}
+
+static int compareDoubles(const void *first, const void *second) {
+    const double a = *(const double *)first;
+    const double b = *(const double *)second;
+    return (a > b) - (a < b);
+}
+
+// nearest rank on sorted samples
+static double percentile(const double *sorted, const int count,
+			 const int percent) {
+    const int rank = ((percent * count) + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void measure(const Stage *stage, BenchFrame *frame) {
+    double nanoseconds[MAX_REPETITIONS];
+    double cycles[MAX_REPETITIONS];
+    size_t bytes = 0;
+
+    for (int run = 0; run < WARMUP_RUNS; ++run) {
+	bytes = stage->run(frame);
+    }
+    for (int run = 0; run < REPETITIONS; ++run) {
+	const double start = nowNanoseconds();
+	const unsigned long long startCycles = __rdtsc();
+	bytes = stage->run(frame);
+	cycles[run] = (double)(__rdtsc() - startCycles);
+	nanoseconds[run] = nowNanoseconds() - start;
+    }
+    qsort(nanoseconds, (size_t)REPETITIONS, sizeof(double), compareDoubles);
+    qsort(cycles, (size_t)REPETITIONS, sizeof(double), compareDoubles);
+
+    const double median = percentile(nanoseconds, REPETITIONS, 50);
+    (void)printf("%s,%u,%u,%d,%.0f,%.0f,%.0f,%.0f,%.0f,%.3f,%.2f\n",
+		 stage->name, frame->dimensions.width,
+		 frame->dimensions.height, REPETITIONS, nanoseconds[0],
+		 median, percentile(nanoseconds, REPETITIONS, 90),
+		 percentile(nanoseconds, REPETITIONS, 99),
+		 nanoseconds[REPETITIONS - 1],
+		 percentile(cycles, REPETITIONS, 50) /
+		     (double)frame->dimensions.pixels,
+		 (double)bytes / median);
+}
+
+int main(void) {
+    // cycles are TSC ticks, the reference clock rather than the core clock
+    (void)printf("kernel,width,height,repetitions,min_ns,median_ns,p90_ns,"
+		 "p99_ns,max_ns,cycles_per_pixel,gb_per_s\n");
+    for (size_t index = 0;
+	 index < sizeof(RESOLUTIONS) / sizeof(RESOLUTIONS[0]); ++index) {
+	BenchFrame frame;
+	const ErrorCode error = createFrame(&frame, RESOLUTIONS[index]);
+	if (UNLIKELY(error != ERROR_NONE)) {
+	    (void)fprintf(stderr, "Failed to allocate frame: ErrorCode %d\n",
+			  error);
+	    return 1;
+	}
+	for (size_t stage = 0; stage < sizeof(STAGES) / sizeof(STAGES[0]);
+	     ++stage) {
+	    measure(&STAGES[stage], &frame);
+	}
+	freeFrame(&frame);
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+    Synth throughput, renders 64 frame blocks with a growing number of held
+    voices and reports how many voices one core sustains in real time
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "branch.h"
+#include "ring.h"
+#include "synth.h"
+#include "types.h"
+
+static const unsigned int SAMPLE_RATE = 48000;
+static const unsigned int BLOCK_FRAMES = 64;
+static const int WARMUP_BLOCKS = 1000;
+static const int MEASURED_BLOCKS = 20000;
+static const int VOICE_COUNTS[] = {1, 16, 32, 64, 128};
+
+static double nowNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((double)now.tv_sec * 1e9) + (double)now.tv_nsec;
+}
+
+static ErrorCode measure(const SynthInterpolation interpolation,
+			 const int voiceCount, float *block) {
+    Synth synth;
+    const ErrorCode error =
+	Synth_create(&synth, SAMPLE_RATE, BLOCK_FRAMES, interpolation);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+    // spread over five octaves so every mipmap level is exercised
+    for (int voice = 0; voice < voiceCount; ++voice) {
+	const ControlMessage message = {
+	    .type = CONTROL_NOTE_ON,
+	    .voice = voice,
+	    .pitch = 36.0F + (60.0F * (float)voice / (float)voiceCount),
+	    .gain = 0.5F};
+	Synth_control(&synth, &message);
+    }
+    for (int index = 0; index < WARMUP_BLOCKS; ++index) {
+	Synth_render(&synth, block, BLOCK_FRAMES);
+    }
+
+    const double start = nowNanoseconds();
+    for (int index = 0; index < MEASURED_BLOCKS; ++index) {
+	Synth_render(&synth, block, BLOCK_FRAMES);
+    }
+    const double perBlock = (nowNanoseconds() - start) / MEASURED_BLOCKS;
+    const double blockPeriod = 1e9 * BLOCK_FRAMES / SAMPLE_RATE;
+
+    (void)printf("synth,%s,%d,%u,%.1f,%.0f\n",
+		 interpolation == SYNTH_CUBIC ? "cubic" : "linear",
+		 Synth_activeVoices(&synth), BLOCK_FRAMES, perBlock,
+		 voiceCount * blockPeriod / perBlock);
+    Synth_destroy(&synth);
+    return ERROR_NONE;
+}
+
+int main(void) {
+    float *block = (float *)aligned_alloc(32, BLOCK_FRAMES * sizeof(float));
+    if (UNLIKELY(block == NULL)) {
+	(void)fprintf(stderr, "Failed to allocate block\n");
+	return 1;
+    }
+
+    (void)printf("kernel,interpolation,voices,block_frames,ns_per_block,"
+		 "voices_per_core\n");
+    for (size_t index = 0;
+	 index < sizeof(VOICE_COUNTS) / sizeof(VOICE_COUNTS[0]); ++index) {
+	for (int mode = SYNTH_LINEAR; mode <= SYNTH_CUBIC; ++mode) {
+	    const ErrorCode error = measure((SynthInterpolation)mode,
+					    VOICE_COUNTS[index], block);
+	    if (UNLIKELY(error != ERROR_NONE)) {
+		(void)fprintf(stderr, "Failed to create synth: ErrorCode %d\n",
+			      error);
+		free(block);
+		return 1;
+	    }
+	}
+    }
+    free(block);
+    return 0;
+}
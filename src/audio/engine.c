@@ -0,0 +1,186 @@
+/*
+    Real time audio thread, drains control messages at every block boundary,
+    renders one fixed size block and hands it to the output, all buffers are
+    allocated before the thread starts, exposed api is in `engine.h`
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "engine.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "branch.h"
+#include "latency.h"
+#include "loop.h"
+#include "output.h"
+#include "ring.h"
+#include "trace.h"
+#include "types.h"
+
+static const int AUDIO_THREAD_PRIORITY = 70;
+static const unsigned long long NANOSECONDS_PER_SECOND = 1000000000ULL;
+
+static unsigned long long monotonicNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * NANOSECONDS_PER_SECOND +
+	   (unsigned long long)now.tv_nsec;
+}
+
+static void convertBlock(const float *block, short *samples,
+			 const unsigned int frames,
+			 const unsigned int channels) {
+    for (unsigned int frame = 0; frame < frames; ++frame) {
+	float value = block[frame] * 32767.0F;
+	value = value > 32767.0F ? 32767.0F : value;
+	value = value < -32768.0F ? -32768.0F : value;
+	for (unsigned int channel = 0; channel < channels; ++channel) {
+	    samples[(size_t)frame * channels + channel] = (short)value;
+	}
+    }
+}
+
+static void drainControls(AudioEngine *engine) {
+    const unsigned long long now = monotonicNanoseconds();
+    ControlMessage message;
+    while (ControlRing_pop(&engine->ring, &message)) {
+	const unsigned long long waited =
+	    now > message.queued ? now - message.queued : 0;
+	if (waited > atomic_load_explicit(&engine->max_queue_latency,
+					  memory_order_relaxed)) {
+	    atomic_store_explicit(&engine->max_queue_latency, waited,
+				  memory_order_relaxed);
+	}
+	// capture to the block that carries the change reaching the device
+	if (message.timestamp != 0 && now > message.timestamp) {
+	    LatencyHistogram_record(&engine->motion_to_sound,
+				    now - message.timestamp +
+					engine->buffered_latency);
+	}
+	engine->renderer.control(engine->renderer.context, &message);
+    }
+}
+
+static void *renderThread(void *argument) {
+    AudioEngine *engine = (AudioEngine *)argument;
+    const AudioFormat format = engine->output->format;
+
+    while (atomic_load_explicit(&engine->running, memory_order_acquire)) {
+	TRACE_BEGIN(TRACE_AUDIO_RENDER);
+	drainControls(engine);
+	engine->renderer.render(engine->renderer.context, engine->block,
+				format.block_frames);
+	convertBlock(engine->block, engine->samples, format.block_frames,
+		     format.channels);
+	TRACE_END(TRACE_AUDIO_RENDER);
+	const ErrorCode error =
+	    AudioOutput_write(engine->output, engine->samples);
+	if (UNLIKELY(error != ERROR_NONE)) {
+	    atomic_store_explicit(&engine->error, error, memory_order_relaxed);
+	    atomic_store_explicit(&engine->running, false,
+				  memory_order_release);
+	    if (engine->notify_descriptor >= 0) {
+		EventLoop_signal(engine->notify_descriptor);
+	    }
+	    break;
+	}
+	atomic_fetch_add_explicit(&engine->blocks, 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+// notifyDescriptor, an eventfd or -1, is signalled if the thread dies on
+// an output error so the owner learns about it without polling
+ErrorCode AudioEngine_start(AudioEngine *engine, AudioOutput *output,
+			    const AudioRenderer *renderer,
+			    const int notifyDescriptor) {
+    const AudioFormat format = output->format;
+    engine->output = output;
+    engine->renderer = *renderer;
+    engine->notify_descriptor = notifyDescriptor;
+    ControlRing_init(&engine->ring);
+    atomic_init(&engine->running, true);
+    atomic_init(&engine->error, ERROR_NONE);
+    atomic_init(&engine->blocks, 0);
+    atomic_init(&engine->max_queue_latency, 0);
+    atomic_init(&engine->dropped_messages, 0);
+    LatencyHistogram_reset(&engine->motion_to_sound);
+    engine->buffered_latency = (unsigned long long)format.block_frames *
+			       format.buffer_blocks * NANOSECONDS_PER_SECOND /
+			       format.sample_rate;
+
+    // touched here so the audio thread never takes a page fault on them
+    engine->block = (float *)aligned_alloc(
+	32, ((format.block_frames * sizeof(float)) + 31) & ~(size_t)31);
+    engine->samples = (short *)calloc(
+	(size_t)format.block_frames * format.channels, sizeof(short));
+    if (UNLIKELY(engine->block == NULL || engine->samples == NULL)) {
+	free(engine->samples);
+	free(engine->block);
+	engine->samples = NULL;
+	engine->block = NULL;
+	return ERROR_ALLOCATION_FAILED;
+    }
+    memset(engine->block, 0, format.block_frames * sizeof(float));
+
+    if (UNLIKELY(pthread_create(&engine->thread, NULL, renderThread,
+				engine) != 0)) {
+	free(engine->samples);
+	free(engine->block);
+	engine->samples = NULL;
+	engine->block = NULL;
+	return ERROR_UNSUPPORTED_OPERATION;
+    }
+    // needs CAP_SYS_NICE or an rtprio limit, plain scheduling still works
+    const struct sched_param parameters = {.sched_priority =
+					       AUDIO_THREAD_PRIORITY};
+    (void)pthread_setschedparam(engine->thread, SCHED_FIFO, &parameters);
+    return ERROR_NONE;
+}
+
+ErrorCode AudioEngine_error(const AudioEngine *engine) {
+    return (ErrorCode)atomic_load_explicit(&engine->error,
+					   memory_order_relaxed);
+}
+
+void AudioEngine_stop(AudioEngine *engine) {
+    atomic_store_explicit(&engine->running, false, memory_order_release);
+    pthread_join(engine->thread, NULL);
+    free(engine->samples);
+    free(engine->block);
+    engine->samples = NULL;
+    engine->block = NULL;
+}
+
+// vision thread only, never waits, a full ring drops and counts the message
+bool AudioEngine_send(AudioEngine *engine, const ControlMessage *message) {
+    ControlMessage queued = *message;
+    queued.queued = monotonicNanoseconds();
+    if (UNLIKELY(!ControlRing_push(&engine->ring, &queued))) {
+	atomic_fetch_add_explicit(&engine->dropped_messages, 1,
+				  memory_order_relaxed);
+	return false;
+    }
+    return true;
+}
+
+// longest a message waited for a block boundary plus the audio queued
+// ahead of the device, what a gesture adds on top of vision latency
+unsigned long long AudioEngine_worstLatency(const AudioEngine *engine) {
+    return atomic_load_explicit(&engine->max_queue_latency,
+				memory_order_relaxed) +
+	   engine->buffered_latency;
+}
+
+// motion to sound per control message, from the capture timestamp it
+// carries to when its block is expected out of the device
+const LatencyHistogram *AudioEngine_latency(const AudioEngine *engine) {
+    return &engine->motion_to_sound;
+}
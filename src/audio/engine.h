@@ -0,0 +1,48 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "latency.h"
+#include "output.h"
+#include "ring.h"
+#include "types.h"
+
+// callbacks run on the audio thread and must not allocate, lock or block
+typedef struct {
+    void *context;
+    void (*control)(void *context, const ControlMessage *message);
+    void (*render)(void *context, float *block, unsigned int frames);
+} __attribute__((aligned(32))) AudioRenderer;
+
+typedef struct {
+    ControlRing ring;
+    AudioRenderer renderer;
+    AudioOutput *output;
+    float *block;
+    short *samples;
+    pthread_t thread;
+    int notify_descriptor;
+    atomic_bool running;
+    _Atomic int error;
+    _Atomic unsigned long long blocks;
+    _Atomic unsigned long long max_queue_latency;
+    _Atomic unsigned int dropped_messages;
+    unsigned long long buffered_latency;
+    LatencyHistogram motion_to_sound;
+} __attribute__((aligned(64))) AudioEngine;
+
+ErrorCode AudioEngine_start(AudioEngine *engine, AudioOutput *output,
+			    const AudioRenderer *renderer,
+			    int notifyDescriptor);
+
+ErrorCode AudioEngine_error(const AudioEngine *engine);
+
+void AudioEngine_stop(AudioEngine *engine);
+
+bool AudioEngine_send(AudioEngine *engine, const ControlMessage *message);
+
+unsigned long long AudioEngine_worstLatency(const AudioEngine *engine);
+
+const LatencyHistogram *AudioEngine_latency(const AudioEngine *engine);
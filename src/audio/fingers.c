@@ -0,0 +1,76 @@
+/*
+    Fingertip note model, every tracker slot drives one voice, horizontal
+    position sets pitch and height sets loudness, a fist silences the hand,
+    exposed api is in `fingers.h`
+*/
+
+#include "fingers.h"
+
+#include "ring.h"
+#include "track.h"
+#include "types.h"
+
+static const float LOW_NOTE = 48.0F;
+static const float HIGH_NOTE = 84.0F;
+
+// voiceBase offsets the voices so several controls share one synth
+void FingerControl_init(FingerControl *control, const int voiceBase) {
+    for (int index = 0; index < TRACKER_MAX_TRACKS; ++index) {
+	control->voice_ids[index] = -1;
+    }
+    control->voice_base = voiceBase;
+    control->low_note = LOW_NOTE;
+    control->high_note = HIGH_NOTE;
+}
+
+// the window shows the camera mirrored, so pitch rises to the user's right
+static void fillNote(const FingerControl *control, const FingertipTrack *track,
+		     const FrameDimensions dimensions,
+		     ControlMessage *message) {
+    const float across = 1.0F - ((float)track->position.x /
+				 (float)(dimensions.width - 1));
+    const float height =
+	1.0F - ((float)track->position.y / (float)(dimensions.height - 1));
+    const float clampedAcross =
+	across < 0.0F ? 0.0F : (across > 1.0F ? 1.0F : across);
+    const float clampedHeight =
+	height < 0.0F ? 0.0F : (height > 1.0F ? 1.0F : height);
+    message->pitch = control->low_note +
+		     (control->high_note - control->low_note) * clampedAcross;
+    message->gain = clampedHeight;
+}
+
+// writes at most FINGER_MAX_MESSAGES messages, returns how many, the
+// voices of a hand that closes into a fist are released and come back
+// with the same fingers once it opens
+int FingerControl_update(FingerControl *control,
+			 const FingertipTracker *tracker, const Gesture gesture,
+			 const FrameDimensions dimensions,
+			 const unsigned long long timestamp,
+			 ControlMessage *messages) {
+    const bool muted = gesture == GESTURE_FIST;
+    int count = 0;
+    for (int index = 0; index < TRACKER_MAX_TRACKS; ++index) {
+	const FingertipTrack *track = &tracker->tracks[index];
+	const int playing = control->voice_ids[index];
+	const int current = track->active && !muted ? track->id : -1;
+	const int voice = control->voice_base + index;
+
+	if (playing >= 0 && playing != current) {
+	    messages[count++] = (ControlMessage){.type = CONTROL_NOTE_OFF,
+						 .voice = voice,
+						 .timestamp = timestamp};
+	}
+	if (current >= 0) {
+	    ControlMessage *message = &messages[count++];
+	    *message = (ControlMessage){
+		.type = playing == current ? CONTROL_NOTE_UPDATE
+					   : CONTROL_NOTE_ON,
+		.voice = voice,
+		.timestamp = timestamp};
+	    fillNote(control, track, dimensions, message);
+	}
+	control->voice_ids[index] = current;
+    }
+    return count;
+}
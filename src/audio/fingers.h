@@ -0,0 +1,23 @@
+#pragma once
+
+#include "gesture.h"
+#include "ring.h"
+#include "track.h"
+#include "types.h"
+
+#define FINGER_MAX_MESSAGES (TRACKER_MAX_TRACKS * 2)
+
+typedef struct {
+    int voice_ids[TRACKER_MAX_TRACKS];
+    int voice_base;
+    float low_note;
+    float high_note;
+} __attribute__((aligned(64))) FingerControl;
+
+void FingerControl_init(FingerControl *control, int voiceBase);
+
+int FingerControl_update(FingerControl *control,
+			 const FingertipTracker *tracker, Gesture gesture,
+			 FrameDimensions dimensions,
+			 unsigned long long timestamp,
+			 ControlMessage *messages);
@@ -0,0 +1,328 @@
+/*
+    Audio sinks, an ALSA playback device when built with ALSA=1 and a WAV file
+    that can be written as fast as possible or paced like a sound card for
+    headless runs, exposed api is in `output.h`
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "output.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HM_WITH_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+#include "branch.h"
+#include "types.h"
+
+#define WAV_HEADER_SIZE 44
+
+typedef enum { OUTPUT_ALSA, OUTPUT_WAV } OutputKind;
+
+struct AudioOutputInternal {
+#ifdef HM_WITH_ALSA
+    snd_pcm_t *pcm;
+#endif
+    struct timespec deadline;
+    unsigned long long data_bytes;
+    long block_nanoseconds;
+    _Atomic unsigned int underruns;
+    OutputKind kind;
+    int file_descriptor;
+    bool paced;
+} __attribute__((aligned(64)));
+
+static const long NANOSECONDS_PER_SECOND = 1000000000L;
+
+static size_t blockBytes(const AudioFormat format) {
+    return (size_t)format.block_frames * format.channels * sizeof(short);
+}
+
+static bool writeAll(const int fileDescriptor, const void *data,
+		     size_t size) {
+    const unsigned char *cursor = (const unsigned char *)data;
+    while (size > 0) {
+	const ssize_t written = write(fileDescriptor, cursor, size);
+	if (written < 0 && errno == EINTR) {
+	    continue;
+	}
+	if (UNLIKELY(written <= 0)) {
+	    return false;
+	}
+	cursor += written;
+	size -= (size_t)written;
+    }
+    return true;
+}
+
+static void putLittle32(unsigned char *target, const unsigned int value) {
+    target[0] = (unsigned char)(value & 0xFFU);
+    target[1] = (unsigned char)((value >> 8) & 0xFFU);
+    target[2] = (unsigned char)((value >> 16) & 0xFFU);
+    target[3] = (unsigned char)(value >> 24);
+}
+
+static void putLittle16(unsigned char *target, const unsigned int value) {
+    target[0] = (unsigned char)(value & 0xFFU);
+    target[1] = (unsigned char)((value >> 8) & 0xFFU);
+}
+
+// canonical 44 byte PCM header, the sizes are patched once the file closes
+static void fillWavHeader(unsigned char *header, const AudioFormat format,
+			  const unsigned int dataBytes) {
+    const unsigned int frameBytes =
+	format.channels * (unsigned int)sizeof(short);
+    memcpy(header, "RIFF", 4);
+    putLittle32(header + 4, dataBytes + WAV_HEADER_SIZE - 8);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    putLittle32(header + 16, 16);
+    putLittle16(header + 20, 1);
+    putLittle16(header + 22, format.channels);
+    putLittle32(header + 24, format.sample_rate);
+    putLittle32(header + 28, format.sample_rate * frameBytes);
+    putLittle16(header + 32, frameBytes);
+    putLittle16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    putLittle32(header + 40, dataBytes);
+}
+
+static ErrorCode createInternal(AudioOutput *output, const AudioFormat format,
+				const OutputKind kind) {
+    output->format = format;
+    output->internal = NULL;
+    if (UNLIKELY(format.sample_rate == 0 || format.channels == 0 ||
+		 format.block_frames == 0 || format.buffer_blocks == 0)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    output->internal =
+	(AudioOutputInternal *)calloc(1, sizeof(AudioOutputInternal));
+    if (UNLIKELY(output->internal == NULL)) {
+	return ERROR_ALLOCATION_FAILED;
+    }
+    output->internal->kind = kind;
+    output->internal->file_descriptor = -1;
+    output->internal->block_nanoseconds =
+	(long)((long long)format.block_frames * NANOSECONDS_PER_SECOND /
+	       format.sample_rate);
+    atomic_init(&output->internal->underruns, 0);
+    return ERROR_NONE;
+}
+
+ErrorCode AudioOutput_openWav(AudioOutput *output, const char *path,
+			      const AudioFormat format, const bool paced) {
+    const ErrorCode error = createInternal(output, format, OUTPUT_WAV);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+    AudioOutputInternal *internal = output->internal;
+    internal->paced = paced;
+
+    internal->file_descriptor =
+	open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (UNLIKELY(internal->file_descriptor < 0)) {
+	AudioOutput_close(output);
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    unsigned char header[WAV_HEADER_SIZE];
+    fillWavHeader(header, format, 0);
+    if (UNLIKELY(!writeAll(internal->file_descriptor, header,
+			   sizeof(header)))) {
+	AudioOutput_close(output);
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &internal->deadline);
+    return ERROR_NONE;
+}
+
+#ifdef HM_WITH_ALSA
+static ErrorCode configureAlsa(snd_pcm_t *pcm, const AudioFormat format) {
+    snd_pcm_hw_params_t *hardware = NULL;
+    snd_pcm_sw_params_t *software = NULL;
+    ErrorCode result = ERROR_UNSUPPORTED_OPERATION;
+    unsigned int rate = format.sample_rate;
+    snd_pcm_uframes_t period = format.block_frames;
+    snd_pcm_uframes_t buffer =
+	(snd_pcm_uframes_t)format.block_frames * format.buffer_blocks;
+
+    if (UNLIKELY(snd_pcm_hw_params_malloc(&hardware) < 0 ||
+		 snd_pcm_sw_params_malloc(&software) < 0)) {
+	result = ERROR_ALLOCATION_FAILED;
+	goto done;
+    }
+    if (snd_pcm_hw_params_any(pcm, hardware) < 0 ||
+	snd_pcm_hw_params_set_access(pcm, hardware,
+				     SND_PCM_ACCESS_RW_INTERLEAVED) < 0 ||
+	snd_pcm_hw_params_set_format(pcm, hardware, SND_PCM_FORMAT_S16_LE) <
+	    0 ||
+	snd_pcm_hw_params_set_channels(pcm, hardware, format.channels) < 0 ||
+	snd_pcm_hw_params_set_rate_near(pcm, hardware, &rate, NULL) < 0 ||
+	rate != format.sample_rate ||
+	snd_pcm_hw_params_set_period_size_near(pcm, hardware, &period, NULL) <
+	    0 ||
+	snd_pcm_hw_params_set_buffer_size_near(pcm, hardware, &buffer) < 0 ||
+	snd_pcm_hw_params(pcm, hardware) < 0) {
+	goto done;
+    }
+    // start as soon as one period is queued and wake per period after that
+    if (snd_pcm_sw_params_current(pcm, software) < 0 ||
+	snd_pcm_sw_params_set_start_threshold(pcm, software, period) < 0 ||
+	snd_pcm_sw_params_set_avail_min(pcm, software, period) < 0 ||
+	snd_pcm_sw_params(pcm, software) < 0) {
+	goto done;
+    }
+    result = ERROR_NONE;
+
+done:
+    snd_pcm_sw_params_free(software);
+    snd_pcm_hw_params_free(hardware);
+    return result;
+}
+#endif
+
+ErrorCode AudioOutput_openAlsa(AudioOutput *output, const char *deviceName,
+			       const AudioFormat format) {
+#ifdef HM_WITH_ALSA
+    ErrorCode error = createInternal(output, format, OUTPUT_ALSA);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+    AudioOutputInternal *internal = output->internal;
+    if (UNLIKELY(snd_pcm_open(&internal->pcm, deviceName,
+			      SND_PCM_STREAM_PLAYBACK, 0) < 0)) {
+	internal->pcm = NULL;
+	AudioOutput_close(output);
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    error = configureAlsa(internal->pcm, format);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	AudioOutput_close(output);
+	return error;
+    }
+    return ERROR_NONE;
+#else
+    (void)deviceName;
+    output->internal = NULL;
+    output->format = format;
+    return ERROR_UNSUPPORTED_OPERATION;
+#endif
+}
+
+#ifdef HM_WITH_ALSA
+static ErrorCode writeAlsa(AudioOutputInternal *internal,
+			   const AudioFormat format, const short *samples) {
+    snd_pcm_uframes_t remaining = format.block_frames;
+    while (remaining > 0) {
+	snd_pcm_sframes_t written =
+	    snd_pcm_writei(internal->pcm, samples, remaining);
+	if (written < 0) {
+	    if (written == -EPIPE) {
+		atomic_fetch_add_explicit(&internal->underruns, 1,
+					  memory_order_relaxed);
+	    }
+	    if (UNLIKELY(snd_pcm_recover(internal->pcm, (int)written, 1) <
+			 0)) {
+		return ERROR_IOCTL_FAILED;
+	    }
+	    continue;
+	}
+	remaining -= (snd_pcm_uframes_t)written;
+	samples += (size_t)written * format.channels;
+    }
+    return ERROR_NONE;
+}
+#endif
+
+// a paced file consumes one block per block period like a device would, a
+// writer that falls a whole buffer behind counts as an underrun
+static ErrorCode writeWav(AudioOutputInternal *internal,
+			  const AudioFormat format, const short *samples) {
+    const size_t bytes = blockBytes(format);
+    if (UNLIKELY(!writeAll(internal->file_descriptor, samples, bytes))) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    internal->data_bytes += bytes;
+    if (!internal->paced) {
+	return ERROR_NONE;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const long long lag =
+	(long long)(now.tv_sec - internal->deadline.tv_sec) *
+	    NANOSECONDS_PER_SECOND +
+	(now.tv_nsec - internal->deadline.tv_nsec);
+    if (lag > (long long)internal->block_nanoseconds * format.buffer_blocks) {
+	atomic_fetch_add_explicit(&internal->underruns, 1,
+				  memory_order_relaxed);
+	internal->deadline = now;
+    }
+
+    internal->deadline.tv_nsec += internal->block_nanoseconds;
+    while (internal->deadline.tv_nsec >= NANOSECONDS_PER_SECOND) {
+	internal->deadline.tv_nsec -= NANOSECONDS_PER_SECOND;
+	internal->deadline.tv_sec++;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &internal->deadline,
+			   NULL) == EINTR) {
+    }
+    return ERROR_NONE;
+}
+
+// blocks until the sink accepted one block of format.block_frames frames
+ErrorCode AudioOutput_write(AudioOutput *output, const short *samples) {
+    AudioOutputInternal *internal = output->internal;
+    switch (internal->kind) {
+	case OUTPUT_ALSA:
+#ifdef HM_WITH_ALSA
+	    return writeAlsa(internal, output->format, samples);
+#else
+	    return ERROR_UNSUPPORTED_OPERATION;
+#endif
+	case OUTPUT_WAV:
+	    return writeWav(internal, output->format, samples);
+	default:
+	    return ERROR_INVALID_ARGUMENT;
+    }
+}
+
+unsigned int AudioOutput_underruns(const AudioOutput *output) {
+    return atomic_load_explicit(&output->internal->underruns,
+				memory_order_relaxed);
+}
+
+void AudioOutput_close(AudioOutput *output) {
+    AudioOutputInternal *internal = output->internal;
+    if (internal == NULL) {
+	return;
+    }
+#ifdef HM_WITH_ALSA
+    if (internal->pcm != NULL) {
+	snd_pcm_drain(internal->pcm);
+	snd_pcm_close(internal->pcm);
+    }
+#endif
+    if (internal->file_descriptor >= 0) {
+	// sizes past 4 GiB cannot be expressed, keep what the header can hold
+	const unsigned int dataBytes = internal->data_bytes > 0xFFFFFFF0ULL
+					   ? 0xFFFFFFF0U
+					   : (unsigned int)internal->data_bytes;
+	unsigned char header[WAV_HEADER_SIZE];
+	fillWavHeader(header, output->format, dataBytes);
+	// a short write leaves the samples intact, only the declared sizes
+	// stay stale, and there is no one left to report it to
+	const ssize_t written =
+	    pwrite(internal->file_descriptor, header, sizeof(header), 0);
+	(void)written;
+	close(internal->file_descriptor);
+    }
+    free(internal);
+    output->internal = NULL;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "types.h"
+
+typedef struct AudioOutputInternal AudioOutputInternal;
+
+// interleaved signed 16 bit, buffer_blocks blocks of block_frames are queued
+// ahead of the device which bounds the output latency
+typedef struct {
+    unsigned int sample_rate;
+    unsigned int channels;
+    unsigned int block_frames;
+    unsigned int buffer_blocks;
+} __attribute__((aligned(16))) AudioFormat;
+
+typedef struct {
+    AudioOutputInternal *internal;
+    AudioFormat format;
+} __attribute__((aligned(32))) AudioOutput;
+
+ErrorCode AudioOutput_openAlsa(AudioOutput *output, const char *deviceName,
+			       AudioFormat format);
+
+ErrorCode AudioOutput_openWav(AudioOutput *output, const char *path,
+			      AudioFormat format, bool paced);
+
+ErrorCode AudioOutput_write(AudioOutput *output, const short *samples);
+
+unsigned int AudioOutput_underruns(const AudioOutput *output);
+
+void AudioOutput_close(AudioOutput *output);
@@ -0,0 +1,42 @@
+/*
+    Wait free single producer single consumer ring carrying control messages
+    from the vision loop to the audio thread, exposed api is in `ring.h`
+*/
+
+#include "ring.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+void ControlRing_init(ControlRing *ring) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+}
+
+// producer only, a full ring drops the message instead of waiting
+bool ControlRing_push(ControlRing *ring, const ControlMessage *message) {
+    const unsigned int head =
+	atomic_load_explicit(&ring->head, memory_order_relaxed);
+    const unsigned int tail =
+	atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= CONTROL_RING_CAPACITY) {
+	return false;
+    }
+    ring->messages[head % CONTROL_RING_CAPACITY] = *message;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+// consumer only
+bool ControlRing_pop(ControlRing *ring, ControlMessage *message) {
+    const unsigned int tail =
+	atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    const unsigned int head =
+	atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == tail) {
+	return false;
+    }
+    *message = ring->messages[tail % CONTROL_RING_CAPACITY];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
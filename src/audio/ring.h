@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#define CONTROL_RING_CAPACITY 256
+
+typedef enum {
+    CONTROL_NOTE_ON = 1,
+    CONTROL_NOTE_UPDATE = 2,
+    CONTROL_NOTE_OFF = 3
+} ControlType;
+
+// pitch is a fractional midi note, gain is linear in [0, 1], timestamp is
+// CLOCK_MONOTONIC nanoseconds of the frame that produced the message and
+// queued when it entered the ring
+typedef struct {
+    ControlType type;
+    int voice;
+    float pitch;
+    float gain;
+    unsigned long long timestamp;
+    unsigned long long queued;
+} __attribute__((aligned(32))) ControlMessage;
+
+// single producer single consumer, head and tail live on their own cache
+// lines so the vision and audio threads never write the same line
+typedef struct {
+    _Atomic unsigned int head __attribute__((aligned(64)));
+    _Atomic unsigned int tail __attribute__((aligned(64)));
+    ControlMessage messages[CONTROL_RING_CAPACITY]
+	__attribute__((aligned(64)));
+} __attribute__((aligned(64))) ControlRing;
+
+void ControlRing_init(ControlRing *ring);
+
+bool ControlRing_push(ControlRing *ring, const ControlMessage *message);
+
+bool ControlRing_pop(ControlRing *ring, ControlMessage *message);
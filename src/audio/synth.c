@@ -0,0 +1,306 @@
+/*
+    Polyphonic wavetable synth, band limited sawtooth mipmaps read with
+    linear or cubic interpolation eight samples at a time, parameters are
+    smoothed once per block and every voice comes from a fixed pool,
+    exposed api is in `synth.h`
+*/
+
+#include "synth.h"
+
+#include <immintrin.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "branch.h"
+#include "ring.h"
+#include "types.h"
+
+// one guard sample before and two after each cycle, padded to a vector
+static const unsigned int TABLE_STRIDE = SYNTH_TABLE_SIZE + 8;
+static const int PHASE_INDEX_SHIFT = 32 - SYNTH_TABLE_BITS;
+static const int PHASE_FRACTION_SHIFT = 32 - SYNTH_TABLE_BITS - 16;
+static const float PHASE_SCALE = 4294967296.0F;
+static const unsigned int NYQUIST_INCREMENT = 0x80000000U;
+static const float PITCH_SMOOTHING_SECONDS = 0.010F;
+static const float GAIN_SMOOTHING_SECONDS = 0.005F;
+static const float MASTER_GAIN = 0.25F;
+static const float SILENCE = 1e-4F;
+static const float TWO_PI = 6.28318530718F;
+static const float INVERSE_PI = 0.318309886184F;
+
+static float blockCoefficient(const unsigned int blockFrames,
+			      const float sampleRate, const float seconds) {
+    return 1.0F - expf(-(float)blockFrames / (seconds * sampleRate));
+}
+
+// additive sawtooth, level L keeps the (SYNTH_TABLE_SIZE / 2) >> L lowest
+// harmonics so a voice can pick one that stays below nyquist
+static ErrorCode buildTables(Synth *synth) {
+    synth->tables = (float *)aligned_alloc(
+	32, (size_t)SYNTH_TABLE_LEVELS * TABLE_STRIDE * sizeof(float));
+    float *sine = (float *)malloc(SYNTH_TABLE_SIZE * sizeof(float));
+    float *sum = (float *)calloc(SYNTH_TABLE_SIZE, sizeof(float));
+    if (UNLIKELY(synth->tables == NULL || sine == NULL || sum == NULL)) {
+	free(sum);
+	free(sine);
+	return ERROR_ALLOCATION_FAILED;
+    }
+    memset(synth->tables, 0,
+	   (size_t)SYNTH_TABLE_LEVELS * TABLE_STRIDE * sizeof(float));
+    for (unsigned int sample = 0; sample < SYNTH_TABLE_SIZE; ++sample) {
+	sine[sample] =
+	    sinf(TWO_PI * (float)sample / (float)SYNTH_TABLE_SIZE);
+    }
+
+    int level = SYNTH_TABLE_LEVELS - 1;
+    for (unsigned int harmonic = 1; level >= 0; ++harmonic) {
+	const float amplitude = 2.0F * INVERSE_PI / (float)harmonic;
+	for (unsigned int sample = 0; sample < SYNTH_TABLE_SIZE; ++sample) {
+	    sum[sample] +=
+		amplitude * sine[(harmonic * sample) & (SYNTH_TABLE_SIZE - 1)];
+	}
+	if (harmonic != ((SYNTH_TABLE_SIZE / 2U) >> level)) {
+	    continue;
+	}
+	float *table = synth->tables + (size_t)level * TABLE_STRIDE;
+	table[0] = sum[SYNTH_TABLE_SIZE - 1];
+	memcpy(table + 1, sum, SYNTH_TABLE_SIZE * sizeof(float));
+	table[SYNTH_TABLE_SIZE + 1] = sum[0];
+	table[SYNTH_TABLE_SIZE + 2] = sum[1];
+	level--;
+    }
+    free(sum);
+    free(sine);
+    return ERROR_NONE;
+}
+
+ErrorCode Synth_create(Synth *synth, const unsigned int sampleRate,
+		       const unsigned int blockFrames,
+		       const SynthInterpolation interpolation) {
+    memset(synth, 0, sizeof(*synth));
+    if (UNLIKELY(sampleRate == 0 || blockFrames == 0 ||
+		 blockFrames % 8 != 0)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    synth->sample_rate = (float)sampleRate;
+    synth->block_frames = blockFrames;
+    synth->interpolation = interpolation;
+    synth->master_gain = MASTER_GAIN;
+    synth->pitch_smoothing = blockCoefficient(blockFrames, synth->sample_rate,
+					      PITCH_SMOOTHING_SECONDS);
+    synth->gain_smoothing = blockCoefficient(blockFrames, synth->sample_rate,
+					     GAIN_SMOOTHING_SECONDS);
+    for (int index = 0; index < SYNTH_VOICES; ++index) {
+	synth->voices[index].owner = -1;
+    }
+    return buildTables(synth);
+}
+
+void Synth_destroy(Synth *synth) {
+    free(synth->tables);
+    synth->tables = NULL;
+}
+
+static unsigned int pitchToIncrement(const Synth *synth, const float pitch) {
+    const float ratio =
+	440.0F * exp2f((pitch - 69.0F) / 12.0F) / synth->sample_rate;
+    const float clamped = ratio < 0.0F ? 0.0F : (ratio > 0.49F ? 0.49F : ratio);
+    return (unsigned int)(clamped * PHASE_SCALE);
+}
+
+// first free voice, else the quietest released one, else the oldest
+static SynthVoice *allocateVoice(Synth *synth) {
+    SynthVoice *released = NULL;
+    SynthVoice *oldest = &synth->voices[0];
+    for (int index = 0; index < SYNTH_VOICES; ++index) {
+	SynthVoice *voice = &synth->voices[index];
+	if (!voice->active) {
+	    return voice;
+	}
+	if (voice->owner < 0 &&
+	    (released == NULL || voice->gain < released->gain)) {
+	    released = voice;
+	}
+	if (voice->age < oldest->age) {
+	    oldest = voice;
+	}
+    }
+    return released != NULL ? released : oldest;
+}
+
+static SynthVoice *findVoice(Synth *synth, const int owner) {
+    for (int index = 0; index < SYNTH_VOICES; ++index) {
+	SynthVoice *voice = &synth->voices[index];
+	if (voice->active && voice->owner == owner) {
+	    return voice;
+	}
+    }
+    return NULL;
+}
+
+void Synth_control(void *context, const ControlMessage *message) {
+    Synth *synth = (Synth *)context;
+    SynthVoice *voice = findVoice(synth, message->voice);
+
+    switch (message->type) {
+	case CONTROL_NOTE_ON:
+	case CONTROL_NOTE_UPDATE:
+	    // an update without a voice means its note on was dropped or
+	    // the voice was stolen, either way it starts sounding again
+	    if (voice == NULL) {
+		voice = allocateVoice(synth);
+		// cutting a sounding voice to silence would click
+		if (voice->active) {
+		    voice->fade_phase = voice->phase;
+		    voice->fade_increment = voice->increment;
+		    voice->fade_gain = voice->gain;
+		}
+		voice->phase = 0;
+		voice->gain = 0.0F;
+		voice->increment = pitchToIncrement(synth, message->pitch);
+		voice->owner = message->voice;
+		voice->age = synth->clock++;
+		voice->active = true;
+	    }
+	    voice->target_increment = pitchToIncrement(synth, message->pitch);
+	    voice->target_gain = message->gain * synth->master_gain;
+	    break;
+	case CONTROL_NOTE_OFF:
+	    if (voice != NULL) {
+		voice->target_gain = 0.0F;
+		voice->owner = -1;
+	    }
+	    break;
+	default:
+	    break;
+    }
+}
+
+// smallest level whose top harmonic still fits under nyquist
+static const float *selectTable(const Synth *synth,
+				const unsigned int increment) {
+    const unsigned int allowed =
+	NYQUIST_INCREMENT / (increment > 0 ? increment : 1);
+    int level = 0;
+    while (level < SYNTH_TABLE_LEVELS - 1 &&
+	   ((SYNTH_TABLE_SIZE / 2U) >> level) > allowed) {
+	level++;
+    }
+    return synth->tables + (size_t)level * TABLE_STRIDE;
+}
+
+static __m256 interpolateLinear(const float *table, const __m256i index,
+				const __m256 fraction) {
+    const __m256 x0 = _mm256_i32gather_ps(table + 1, index, 4);
+    const __m256 x1 = _mm256_i32gather_ps(table + 2, index, 4);
+    return _mm256_add_ps(x0, _mm256_mul_ps(_mm256_sub_ps(x1, x0), fraction));
+}
+
+// catmull rom through the two neighbours on each side
+static __m256 interpolateCubic(const float *table, const __m256i index,
+			       const __m256 fraction) {
+    const __m256 half = _mm256_set1_ps(0.5F);
+    const __m256 xm1 = _mm256_i32gather_ps(table, index, 4);
+    const __m256 x0 = _mm256_i32gather_ps(table + 1, index, 4);
+    const __m256 x1 = _mm256_i32gather_ps(table + 2, index, 4);
+    const __m256 x2 = _mm256_i32gather_ps(table + 3, index, 4);
+
+    const __m256 c1 = _mm256_mul_ps(half, _mm256_sub_ps(x1, xm1));
+    const __m256 c2 = _mm256_sub_ps(
+	_mm256_add_ps(xm1, _mm256_add_ps(x1, x1)),
+	_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.5F), x0),
+		      _mm256_mul_ps(half, x2)));
+    const __m256 c3 = _mm256_add_ps(
+	_mm256_mul_ps(half, _mm256_sub_ps(x2, xm1)),
+	_mm256_mul_ps(_mm256_set1_ps(1.5F), _mm256_sub_ps(x0, x1)));
+
+    __m256 result = _mm256_add_ps(_mm256_mul_ps(c3, fraction), c2);
+    result = _mm256_add_ps(_mm256_mul_ps(result, fraction), c1);
+    return _mm256_add_ps(_mm256_mul_ps(result, fraction), x0);
+}
+
+// adds one oscillator to block with its gain ramping linearly by gainStep
+// per frame
+static void mixOscillator(const Synth *synth, const unsigned int startPhase,
+			  const unsigned int increment, const float startGain,
+			  const float gainStep, float *block,
+			  const unsigned int frames) {
+    const float *table = selectTable(synth, increment);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i fractionMask = _mm256_set1_epi32(0xFFFF);
+    const __m256 fractionScale = _mm256_set1_ps(1.0F / 65536.0F);
+    const __m256i advance = _mm256_set1_epi32((int)(increment * 8U));
+    const __m256 gainAdvance = _mm256_set1_ps(gainStep * 8.0F);
+    __m256i phase = _mm256_add_epi32(
+	_mm256_set1_epi32((int)startPhase),
+	_mm256_mullo_epi32(_mm256_set1_epi32((int)increment), lanes));
+    __m256 gain = _mm256_add_ps(
+	_mm256_set1_ps(startGain),
+	_mm256_mul_ps(_mm256_set1_ps(gainStep), _mm256_cvtepi32_ps(lanes)));
+
+    for (unsigned int frame = 0; frame < frames; frame += 8) {
+	const __m256i index = _mm256_srli_epi32(phase, PHASE_INDEX_SHIFT);
+	const __m256 fraction = _mm256_mul_ps(
+	    _mm256_cvtepi32_ps(_mm256_and_si256(
+		_mm256_srli_epi32(phase, PHASE_FRACTION_SHIFT), fractionMask)),
+	    fractionScale);
+	const __m256 sample = synth->interpolation == SYNTH_CUBIC
+				  ? interpolateCubic(table, index, fraction)
+				  : interpolateLinear(table, index, fraction);
+	const __m256 mixed = _mm256_add_ps(_mm256_load_ps(block + frame),
+					   _mm256_mul_ps(sample, gain));
+	_mm256_store_ps(block + frame, mixed);
+	phase = _mm256_add_epi32(phase, advance);
+	gain = _mm256_add_ps(gain, gainAdvance);
+    }
+}
+
+static void renderVoice(const Synth *synth, SynthVoice *voice, float *block,
+			const unsigned int frames) {
+    // a stolen note ramps to zero over this block under the new one
+    if (voice->fade_gain > 0.0F) {
+	mixOscillator(synth, voice->fade_phase, voice->fade_increment,
+		      voice->fade_gain, -voice->fade_gain / (float)frames,
+		      block, frames);
+	voice->fade_gain = 0.0F;
+    }
+
+    const long long pitchDelta =
+	(long long)voice->target_increment - (long long)voice->increment;
+    voice->increment = (unsigned int)((long long)voice->increment +
+				      (long long)((float)pitchDelta *
+						  synth->pitch_smoothing));
+    const float startGain = voice->gain;
+    const float endGain =
+	startGain + ((voice->target_gain - startGain) * synth->gain_smoothing);
+    mixOscillator(synth, voice->phase, voice->increment, startGain,
+		  (endGain - startGain) / (float)frames, block, frames);
+
+    voice->phase += voice->increment * frames;
+    voice->gain = endGain;
+    if (voice->target_gain <= 0.0F && voice->gain < SILENCE) {
+	voice->active = false;
+	voice->owner = -1;
+    }
+}
+
+// block has to be 32 byte aligned with frames a multiple of 8
+void Synth_render(void *context, float *block, const unsigned int frames) {
+    Synth *synth = (Synth *)context;
+    memset(block, 0, frames * sizeof(float));
+    for (int index = 0; index < SYNTH_VOICES; ++index) {
+	if (synth->voices[index].active) {
+	    renderVoice(synth, &synth->voices[index], block, frames);
+	}
+    }
+}
+
+int Synth_activeVoices(const Synth *synth) {
+    int count = 0;
+    for (int index = 0; index < SYNTH_VOICES; ++index) {
+	count += synth->voices[index].active ? 1 : 0;
+    }
+    return count;
+}
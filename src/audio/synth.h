@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "ring.h"
+#include "types.h"
+
+#define SYNTH_VOICES 128
+#define SYNTH_TABLE_BITS 11
+#define SYNTH_TABLE_SIZE (1 << SYNTH_TABLE_BITS)
+#define SYNTH_TABLE_LEVELS (SYNTH_TABLE_BITS)
+
+typedef enum {
+    SYNTH_LINEAR = 0,
+    SYNTH_CUBIC = 1
+} SynthInterpolation;
+
+// phase and increment are 32 bit fixed point fractions of one table cycle,
+// the fade fields hold the note a stolen voice was playing until the next
+// block has ramped it out
+typedef struct {
+    unsigned int phase;
+    unsigned int increment;
+    unsigned int target_increment;
+    unsigned int fade_phase;
+    unsigned int fade_increment;
+    unsigned int age;
+    float gain;
+    float target_gain;
+    float fade_gain;
+    int owner;
+    bool active;
+} __attribute__((aligned(64))) SynthVoice;
+
+typedef struct {
+    SynthVoice voices[SYNTH_VOICES];
+    float *tables;
+    float sample_rate;
+    float pitch_smoothing;
+    float gain_smoothing;
+    float master_gain;
+    unsigned int block_frames;
+    unsigned int clock;
+    SynthInterpolation interpolation;
+} __attribute__((aligned(64))) Synth;
+
+ErrorCode Synth_create(Synth *synth, unsigned int sampleRate,
+		       unsigned int blockFrames,
+		       SynthInterpolation interpolation);
+
+void Synth_destroy(Synth *synth);
+
+void Synth_control(void *context, const ControlMessage *message);
+
+void Synth_render(void *context, float *block, unsigned int frames);
+
+int Synth_activeVoices(const Synth *synth);
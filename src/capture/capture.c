@@ -1,8 +1,11 @@
 /*
     Simple no alloc, single buffer, per-frame capture, and capture device
-    creation, using V4L2.
+    creation, using V4L2, plus replay sources that play a raw YUYV file or
+    a generated hand scene at camera pace for reproducible runs.
 */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "capture.h"
 
 // clang-format off
@@ -12,18 +15,27 @@
 #include <fcntl.h>
 #include <linux/videodev2.h>
 #include <sys/ioctl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 
 #include "branch.h"
+#include "scene.h"
 #include "types.h"
 
 ErrorCode CaptureDevice_open(CaptureDevice *device, const char *devicePath,
 			     FrameDimensions dimensions) {
     device->file_descriptor = -1;
+    device->replay_descriptor = -1;
     device->buffer = NULL;
     device->buffer_size = 0;
     device->dimensions = dimensions;
+    device->sequence = 0;
+    device->kind = CAPTURE_V4L2;
     struct v4l2_requestbuffers req = {0};
     struct v4l2_format fmt = {0};
     struct v4l2_buffer buffer = {0};
@@ -80,7 +92,162 @@ error_close_fd:
     return ERROR_IOCTL_FAILED;
 }
 
+static const unsigned long long NANOSECONDS_PER_SECOND = 1000000000ULL;
+
+static unsigned long long monotonicNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((unsigned long long)now.tv_sec * NANOSECONDS_PER_SECOND) +
+	   (unsigned long long)now.tv_nsec;
+}
+
+// shared by the file and generated sources, a timerfd that polls
+// readable once per frame like a camera
+static ErrorCode startPacing(CaptureDevice *device,
+			     const unsigned int framesPerSecond) {
+    device->buffer = (unsigned char *)aligned_alloc(
+	64, (device->buffer_size + 63) & ~(size_t)63);
+    device->file_descriptor = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (UNLIKELY(device->buffer == NULL || device->file_descriptor < 0)) {
+	CaptureDevice_close(device);
+	return ERROR_ALLOCATION_FAILED;
+    }
+
+    device->replay_period = NANOSECONDS_PER_SECOND / framesPerSecond;
+    // a rate of 1 fps is a whole second, which tv_nsec alone cannot hold
+    const struct timespec period = {
+	.tv_sec = (time_t)(device->replay_period / NANOSECONDS_PER_SECOND),
+	.tv_nsec = (long)(device->replay_period % NANOSECONDS_PER_SECOND)};
+    const struct itimerspec schedule = {.it_interval = period,
+					.it_value = period};
+    device->replay_start = monotonicNanoseconds();
+    if (UNLIKELY(timerfd_settime(device->file_descriptor, 0, &schedule,
+				 NULL) < 0)) {
+	CaptureDevice_close(device);
+	return ERROR_IOCTL_FAILED;
+    }
+    return ERROR_NONE;
+}
+
+/*
+    Plays back a file of raw YUYV frames at the given dimensions, e.g. one
+    recorded with `v4l2-ctl --stream-mmap --stream-to=<path>`, looping at
+    the end. A timerfd paces it so the descriptor polls readable once per
+    frame like a camera, and frames that come due while the caller is busy
+    are skipped and show up as sequence gaps, as a camera would drop them.
+*/
+ErrorCode CaptureDevice_openReplay(CaptureDevice *device, const char *path,
+				   const FrameDimensions dimensions,
+				   const unsigned int framesPerSecond) {
+    device->file_descriptor = -1;
+    device->buffer = NULL;
+    device->scene = NULL;
+    device->dimensions = dimensions;
+    device->sequence = 0;
+    device->kind = CAPTURE_REPLAY;
+    device->buffer_size = (size_t)dimensions.stride * dimensions.height;
+    if (UNLIKELY(framesPerSecond == 0 || device->buffer_size == 0)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+
+    device->replay_descriptor = open(path, O_RDONLY | O_CLOEXEC);
+    if (UNLIKELY(device->replay_descriptor < 0)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    struct stat status;
+    if (UNLIKELY(fstat(device->replay_descriptor, &status) < 0 ||
+		 (size_t)status.st_size < device->buffer_size)) {
+	close(device->replay_descriptor);
+	return ERROR_INVALID_ARGUMENT;
+    }
+    device->replay_frames =
+	(unsigned int)((size_t)status.st_size / device->buffer_size);
+
+    return startPacing(device, framesPerSecond);
+}
+
+/*
+    A generated hand scene instead of a file, see SceneGenerator, with
+    the default pose for fingerCount fingers and paced like a replay.
+    Frame n of the source is frame n of the scene, so runs repeat exactly
+    as long as no frame is dropped.
+*/
+ErrorCode CaptureDevice_openSynthetic(CaptureDevice *device,
+				      const int fingerCount,
+				      const FrameDimensions dimensions,
+				      const unsigned int framesPerSecond) {
+    device->file_descriptor = -1;
+    device->replay_descriptor = -1;
+    device->buffer = NULL;
+    device->dimensions = dimensions;
+    device->sequence = 0;
+    device->kind = CAPTURE_SYNTHETIC;
+    device->buffer_size = (size_t)dimensions.stride * dimensions.height;
+    if (UNLIKELY(framesPerSecond == 0 || device->buffer_size == 0)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+
+    device->scene = (SceneGenerator *)aligned_alloc(64, sizeof(SceneGenerator));
+    if (UNLIKELY(device->scene == NULL)) {
+	return ERROR_ALLOCATION_FAILED;
+    }
+    SceneParameters parameters;
+    SceneGenerator_defaults(&parameters, fingerCount);
+    const ErrorCode error =
+	SceneGenerator_create(device->scene, &parameters, dimensions);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	free(device->scene);
+	device->scene = NULL;
+	return error;
+    }
+    return startPacing(device, framesPerSecond);
+}
+
+// "replay:<path>" plays a recorded file, "synthetic:<fingers>" generates
+// a hand scene, anything else is a V4L2 device
+ErrorCode CaptureDevice_openSource(CaptureDevice *device, const char *source,
+				   const FrameDimensions dimensions,
+				   const unsigned int replayFramesPerSecond) {
+    const size_t prefixLength = strlen(CAPTURE_REPLAY_PREFIX);
+    const size_t syntheticLength = strlen(CAPTURE_SYNTHETIC_PREFIX);
+    if (strncmp(source, CAPTURE_REPLAY_PREFIX, prefixLength) == 0) {
+	return CaptureDevice_openReplay(device, source + prefixLength,
+					dimensions, replayFramesPerSecond);
+    }
+    if (strncmp(source, CAPTURE_SYNTHETIC_PREFIX, syntheticLength) == 0) {
+	const char *fingers = source + syntheticLength;
+	char *end = NULL;
+	const long count = strtol(fingers, &end, 10);
+	if (UNLIKELY(end == fingers || *end != '\0' || count < 0 ||
+		     count > SCENE_MAX_FINGERS)) {
+	    return ERROR_INVALID_ARGUMENT;
+	}
+	return CaptureDevice_openSynthetic(device, (int)count, dimensions,
+					   replayFramesPerSecond);
+    }
+    return CaptureDevice_open(device, source, dimensions);
+}
+
 void CaptureDevice_close(CaptureDevice *device) {
+    if (device->kind != CAPTURE_V4L2) {
+	if (device->scene != NULL) {
+	    SceneGenerator_destroy(device->scene);
+	    free(device->scene);
+	    device->scene = NULL;
+	}
+	free(device->buffer);
+	if (device->replay_descriptor >= 0) {
+	    close(device->replay_descriptor);
+	}
+	if (device->file_descriptor >= 0) {
+	    close(device->file_descriptor);
+	}
+	device->replay_descriptor = -1;
+	device->file_descriptor = -1;
+	device->buffer = NULL;
+	device->buffer_size = 0;
+	return;
+    }
     struct v4l2_buffer buffer = {.type = V4L2_BUF_TYPE_VIDEO_CAPTURE};
     ioctl(device->file_descriptor, VIDIOC_STREAMOFF, &buffer.type);
     munmap(device->buffer, device->buffer_size);
@@ -90,19 +257,92 @@ void CaptureDevice_close(CaptureDevice *device) {
     device->buffer_size = 0;
 }
 
-unsigned char *CaptureDevice_getFrame(const CaptureDevice *device) {
+/*
+    The buffer is handed to the driver with queue and comes back filled with
+    dequeue, which blocks unless the descriptor already polls readable, so
+    an event loop queues once, dequeues on readiness and queues again after
+    the frame is consumed.
+*/
+ErrorCode CaptureDevice_queue(const CaptureDevice *device) {
+    if (device->kind != CAPTURE_V4L2) {
+	return ERROR_NONE;
+    }
     struct v4l2_buffer buffer = {0};
     buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     buffer.memory = V4L2_MEMORY_MMAP;
     buffer.index = 0;
 
     if (UNLIKELY(ioctl(device->file_descriptor, VIDIOC_QBUF, &buffer) < 0)) {
-	return NULL;
+	return ERROR_IOCTL_FAILED;
     }
+    return ERROR_NONE;
+}
+
+// the timer's expiration count advances the sequence, content follows it,
+// read from the file or rendered
+static ErrorCode dequeueReplay(CaptureDevice *device, CaptureFrame *frame) {
+    uint64_t expirations = 0;
+    if (UNLIKELY(read(device->file_descriptor, &expirations,
+		      sizeof(expirations)) != (ssize_t)sizeof(expirations))) {
+	return ERROR_IOCTL_FAILED;
+    }
+    device->sequence += (unsigned int)expirations;
+    const unsigned int sequence = device->sequence - 1;
+    if (device->kind == CAPTURE_SYNTHETIC) {
+	SceneGenerator_render(device->scene, sequence, device->buffer, NULL);
+    } else {
+	const off_t offset = (off_t)((size_t)(sequence %
+					      device->replay_frames) *
+				     device->buffer_size);
+	if (UNLIKELY(pread(device->replay_descriptor, device->buffer,
+			   device->buffer_size,
+			   offset) != (ssize_t)device->buffer_size)) {
+	    return ERROR_FILE_OPEN_FAILED;
+	}
+    }
+    frame->data = device->buffer;
+    frame->sequence = sequence;
+    // when the frame was due, which is when a camera would have exposed it
+    frame->timestamp = device->replay_start +
+		       ((unsigned long long)device->sequence *
+			device->replay_period);
+    return ERROR_NONE;
+}
+
+ErrorCode CaptureDevice_dequeue(CaptureDevice *device, CaptureFrame *frame) {
+    if (device->kind != CAPTURE_V4L2) {
+	return dequeueReplay(device, frame);
+    }
+    struct v4l2_buffer buffer = {0};
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = 0;
 
     if (UNLIKELY(ioctl(device->file_descriptor, VIDIOC_DQBUF, &buffer) < 0)) {
-	return NULL;
+	return ERROR_IOCTL_FAILED;
     }
 
+    frame->data = device->buffer;
+    frame->sequence = buffer.sequence;
+    // drivers stamp with CLOCK_MONOTONIC, the rare one that does not gets
+    // the dequeue time instead, later than the truth but never earlier
+    if ((buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+	V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+	frame->timestamp =
+	    ((unsigned long long)buffer.timestamp.tv_sec *
+	     NANOSECONDS_PER_SECOND) +
+	    ((unsigned long long)buffer.timestamp.tv_usec * 1000ULL);
+    } else {
+	frame->timestamp = monotonicNanoseconds();
+    }
+    return ERROR_NONE;
+}
+
+unsigned char *CaptureDevice_getFrame(CaptureDevice *device) {
+    CaptureFrame frame;
+    if (UNLIKELY(CaptureDevice_queue(device) != ERROR_NONE ||
+		 CaptureDevice_dequeue(device, &frame) != ERROR_NONE)) {
+	return NULL;
+    }
     return device->buffer;
 }
@@ -1,16 +1,52 @@
 #pragma once
 #include <stddef.h>
 
+#include "scene.h"
 #include "types.h"
 
+#define CAPTURE_REPLAY_PREFIX "replay:"
+#define CAPTURE_SYNTHETIC_PREFIX "synthetic:"
+
+typedef enum {
+    CAPTURE_V4L2 = 0,
+    CAPTURE_REPLAY = 1,
+    CAPTURE_SYNTHETIC = 2
+} CaptureKind;
+
+// timestamp is CLOCK_MONOTONIC nanoseconds of the capture, sequence counts
+// frames the source produced so gaps are frames that were dropped
+typedef struct {
+    const unsigned char *data;
+    unsigned long long timestamp;
+    unsigned int sequence;
+} __attribute__((aligned(32))) CaptureFrame;
+
 typedef struct {
     int file_descriptor;
+    int replay_descriptor;
     unsigned char *buffer;
+    SceneGenerator *scene;
     size_t buffer_size;
     FrameDimensions dimensions;
+    unsigned long long replay_start;
+    unsigned long long replay_period;
+    unsigned int replay_frames;
+    unsigned int sequence;
+    CaptureKind kind;
 } __attribute__((aligned(64))) CaptureDevice;
 
 ErrorCode CaptureDevice_open(CaptureDevice *device, const char *devicePath,
 			     FrameDimensions dimensions);
+ErrorCode CaptureDevice_openReplay(CaptureDevice *device, const char *path,
+				   FrameDimensions dimensions,
+				   unsigned int framesPerSecond);
+ErrorCode CaptureDevice_openSynthetic(CaptureDevice *device, int fingerCount,
+				      FrameDimensions dimensions,
+				      unsigned int framesPerSecond);
+ErrorCode CaptureDevice_openSource(CaptureDevice *device, const char *source,
+				   FrameDimensions dimensions,
+				   unsigned int replayFramesPerSecond);
 void CaptureDevice_close(CaptureDevice *device);
-unsigned char *CaptureDevice_getFrame(const CaptureDevice *device);
+unsigned char *CaptureDevice_getFrame(CaptureDevice *device);
+ErrorCode CaptureDevice_queue(const CaptureDevice *device);
+ErrorCode CaptureDevice_dequeue(CaptureDevice *device, CaptureFrame *frame);
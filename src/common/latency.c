@@ -0,0 +1,99 @@
+/*
+    Fixed memory log-linear latency histograms in the spirit of HDR
+    histograms, recording is a couple of shifts and a relaxed store so it
+    can sit on the frame and audio paths, exposed api is in `latency.h`
+*/
+
+#include "latency.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+static const unsigned long long LARGEST_VALUE =
+    (1ULL << LATENCY_MAX_BITS) - 1;
+
+void LatencyHistogram_reset(LatencyHistogram *histogram) {
+    for (int index = 0; index < LATENCY_BUCKETS; ++index) {
+	atomic_init(&histogram->counts[index], 0);
+    }
+    atomic_init(&histogram->total, 0);
+    atomic_init(&histogram->maximum, 0);
+}
+
+// values below 2 * LATENCY_HALF are exact, above that every power of two
+// is split into LATENCY_HALF buckets
+static unsigned int bucketOf(unsigned long long value) {
+    value = value > LARGEST_VALUE ? LARGEST_VALUE : value;
+    if (value < 2 * LATENCY_HALF) {
+	return (unsigned int)value;
+    }
+    const unsigned int shift =
+	(unsigned int)(63 - __builtin_clzll(value)) - LATENCY_SUB_BITS + 1;
+    return (shift * LATENCY_HALF) + (unsigned int)(value >> shift);
+}
+
+// the middle of the bucket, the best single guess for what landed in it
+static unsigned long long valueOf(const unsigned int bucket) {
+    if (bucket < 2 * LATENCY_HALF) {
+	return bucket;
+    }
+    const unsigned int shift = (bucket / LATENCY_HALF) - 1;
+    const unsigned long long lowest =
+	(unsigned long long)((bucket % LATENCY_HALF) + LATENCY_HALF) << shift;
+    return lowest + ((1ULL << shift) >> 1);
+}
+
+// single writer, so plain load and store stand in for read-modify-write
+static void increment(_Atomic unsigned long long *counter) {
+    atomic_store_explicit(
+	counter, atomic_load_explicit(counter, memory_order_relaxed) + 1,
+	memory_order_relaxed);
+}
+
+void LatencyHistogram_record(LatencyHistogram *histogram,
+			     const unsigned long long nanoseconds) {
+    increment(&histogram->counts[bucketOf(nanoseconds)]);
+    increment(&histogram->total);
+    if (nanoseconds >
+	atomic_load_explicit(&histogram->maximum, memory_order_relaxed)) {
+	atomic_store_explicit(&histogram->maximum, nanoseconds,
+			      memory_order_relaxed);
+    }
+}
+
+// permille is 500 for the median, 990 for p99 and so on
+unsigned long long LatencyHistogram_percentile(
+    const LatencyHistogram *histogram, const unsigned int permille) {
+    const unsigned long long total =
+	atomic_load_explicit(&histogram->total, memory_order_relaxed);
+    if (total == 0) {
+	return 0;
+    }
+    const unsigned long long rank = ((total * permille) + 999) / 1000;
+    // a bucket midpoint can lie past the largest value actually recorded
+    const unsigned long long maximum =
+	atomic_load_explicit(&histogram->maximum, memory_order_relaxed);
+    unsigned long long seen = 0;
+    for (unsigned int bucket = 0; bucket < LATENCY_BUCKETS; ++bucket) {
+	seen += atomic_load_explicit(&histogram->counts[bucket],
+				     memory_order_relaxed);
+	if (seen >= rank && seen > 0) {
+	    const unsigned long long value = valueOf(bucket);
+	    return value < maximum ? value : maximum;
+	}
+    }
+    return maximum;
+}
+
+void LatencyHistogram_print(const LatencyHistogram *histogram,
+			    const char *name, FILE *file) {
+    (void)fprintf(
+	file, "%-14s %8llu %9.2f %9.2f %9.2f %9.2f\n", name,
+	atomic_load_explicit(&histogram->total, memory_order_relaxed),
+	(double)LatencyHistogram_percentile(histogram, 500) / 1e6,
+	(double)LatencyHistogram_percentile(histogram, 990) / 1e6,
+	(double)LatencyHistogram_percentile(histogram, 999) / 1e6,
+	(double)atomic_load_explicit(&histogram->maximum,
+				     memory_order_relaxed) /
+	    1e6);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+// 2^LATENCY_SUB_BITS linear buckets per power of two keep every recorded
+// value within about 3%, values up to 2^40 ns (about 18 minutes) fit
+#define LATENCY_SUB_BITS 5
+#define LATENCY_MAX_BITS 40
+#define LATENCY_HALF (1 << (LATENCY_SUB_BITS - 1))
+#define LATENCY_BUCKETS \
+    ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 2) * LATENCY_HALF)
+
+// one writing thread, any thread may read while it records
+typedef struct {
+    _Atomic unsigned long long counts[LATENCY_BUCKETS];
+    _Atomic unsigned long long total;
+    _Atomic unsigned long long maximum;
+} __attribute__((aligned(64))) LatencyHistogram;
+
+void LatencyHistogram_reset(LatencyHistogram *histogram);
+
+void LatencyHistogram_record(LatencyHistogram *histogram,
+			     unsigned long long nanoseconds);
+
+unsigned long long LatencyHistogram_percentile(
+    const LatencyHistogram *histogram, unsigned int permille);
+
+void LatencyHistogram_print(const LatencyHistogram *histogram,
+			    const char *name, FILE *file);
@@ -0,0 +1,192 @@
+/*
+    epoll based main loop, every source gets its handler called as soon as
+    its descriptor is ready and the thread sleeps in the kernel otherwise,
+    exposed api is in `loop.h`
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "loop.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "branch.h"
+#include "types.h"
+
+static const unsigned long long NANOSECONDS_PER_SECOND = 1000000000ULL;
+
+ErrorCode EventLoop_create(EventLoop *loop) {
+    memset(loop, 0, sizeof(*loop));
+    loop->epoll_descriptor = epoll_create1(EPOLL_CLOEXEC);
+    if (UNLIKELY(loop->epoll_descriptor < 0)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    return ERROR_NONE;
+}
+
+// timer and wake descriptors belong to the loop, watched ones do not
+void EventLoop_destroy(EventLoop *loop) {
+    for (int index = 0; index < loop->watch_count; ++index) {
+	if (loop->watches[index].kind != WATCH_READABLE) {
+	    close(loop->watches[index].file_descriptor);
+	}
+    }
+    close(loop->epoll_descriptor);
+    loop->epoll_descriptor = -1;
+    loop->watch_count = 0;
+}
+
+static ErrorCode addWatch(EventLoop *loop, const int fileDescriptor,
+			  const WatchKind kind, const EventHandler handler,
+			  void *context) {
+    if (UNLIKELY(loop->watch_count >= EVENT_LOOP_MAX_WATCHES ||
+		 fileDescriptor < 0)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    struct epoll_event event = {.events = EPOLLIN,
+				.data.u32 = (uint32_t)loop->watch_count};
+    if (UNLIKELY(epoll_ctl(loop->epoll_descriptor, EPOLL_CTL_ADD,
+			   fileDescriptor, &event) < 0)) {
+	return ERROR_IOCTL_FAILED;
+    }
+    loop->watches[loop->watch_count++] =
+	(EventWatch){.handler = handler,
+		     .context = context,
+		     .kind = kind,
+		     .file_descriptor = fileDescriptor};
+    return ERROR_NONE;
+}
+
+ErrorCode EventLoop_watch(EventLoop *loop, const int fileDescriptor,
+			  const EventHandler handler, void *context) {
+    return addWatch(loop, fileDescriptor, WATCH_READABLE, handler, context);
+}
+
+ErrorCode EventLoop_addTimer(EventLoop *loop,
+			     const unsigned long long intervalNanoseconds,
+			     const EventHandler handler, void *context) {
+    const int timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (UNLIKELY(timer < 0)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    const struct timespec interval = {
+	.tv_sec = (time_t)(intervalNanoseconds / NANOSECONDS_PER_SECOND),
+	.tv_nsec = (long)(intervalNanoseconds % NANOSECONDS_PER_SECOND)};
+    const struct itimerspec schedule = {.it_interval = interval,
+					.it_value = interval};
+    ErrorCode error = timerfd_settime(timer, 0, &schedule, NULL) < 0
+			  ? ERROR_IOCTL_FAILED
+			  : ERROR_NONE;
+    if (error == ERROR_NONE) {
+	error = addWatch(loop, timer, WATCH_TIMER, handler, context);
+    }
+    if (UNLIKELY(error != ERROR_NONE)) {
+	close(timer);
+    }
+    return error;
+}
+
+// any thread may pass the returned descriptor to EventLoop_signal
+ErrorCode EventLoop_addWake(EventLoop *loop, const EventHandler handler,
+			    void *context, int *wakeDescriptor) {
+    const int wake = eventfd(0, EFD_CLOEXEC);
+    if (UNLIKELY(wake < 0)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    const ErrorCode error = addWatch(loop, wake, WATCH_WAKE, handler, context);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	close(wake);
+	return error;
+    }
+    *wakeDescriptor = wake;
+    return ERROR_NONE;
+}
+
+/*
+    The signal is blocked for the calling thread and delivered through the
+    loop instead, threads started afterwards inherit the mask, so call this
+    before spawning any.
+*/
+ErrorCode EventLoop_addSignal(EventLoop *loop, const int signalNumber,
+			      const EventHandler handler, void *context) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, signalNumber);
+    if (UNLIKELY(pthread_sigmask(SIG_BLOCK, &signals, NULL) != 0)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    const int descriptor = signalfd(-1, &signals, SFD_CLOEXEC);
+    if (UNLIKELY(descriptor < 0)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    const ErrorCode error =
+	addWatch(loop, descriptor, WATCH_SIGNAL, handler, context);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	close(descriptor);
+    }
+    return error;
+}
+
+// runs before every wait, for sources that buffer events in user space
+void EventLoop_setIdle(EventLoop *loop, const EventHandler handler,
+		       void *context) {
+    loop->idle_handler = handler;
+    loop->idle_context = context;
+}
+
+void EventLoop_signal(const int wakeDescriptor) {
+    const uint64_t one = 1;
+    // a failed write means the counter saturated, a wake is already queued
+    const ssize_t written = write(wakeDescriptor, &one, sizeof(one));
+    (void)written;
+}
+
+// timer expirations, wake counts and signals are consumed before the
+// handler runs
+static bool dispatch(const EventWatch *watch) {
+    if (watch->kind != WATCH_READABLE) {
+	struct signalfd_siginfo information;
+	const size_t size = watch->kind == WATCH_SIGNAL
+				? sizeof(information)
+				: sizeof(uint64_t);
+	if (read(watch->file_descriptor, &information, size) < 0 &&
+	    errno != EAGAIN) {
+	    return true;
+	}
+    }
+    return watch->handler(watch->context);
+}
+
+ErrorCode EventLoop_run(EventLoop *loop) {
+    struct epoll_event events[EVENT_LOOP_MAX_WATCHES];
+    for (;;) {
+	if (loop->idle_handler != NULL &&
+	    loop->idle_handler(loop->idle_context)) {
+	    return ERROR_NONE;
+	}
+	const int ready = epoll_wait(loop->epoll_descriptor, events,
+				     EVENT_LOOP_MAX_WATCHES, -1);
+	if (ready < 0) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    return ERROR_IOCTL_FAILED;
+	}
+	for (int index = 0; index < ready; ++index) {
+	    const EventWatch *watch = &loop->watches[events[index].data.u32];
+	    if (dispatch(watch)) {
+		return ERROR_NONE;
+	    }
+	}
+    }
+}
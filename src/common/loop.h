@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "types.h"
+
+#define EVENT_LOOP_MAX_WATCHES 8
+
+// returning true stops the loop
+typedef bool (*EventHandler)(void *context);
+
+typedef enum {
+    WATCH_READABLE = 0,
+    WATCH_TIMER = 1,
+    WATCH_WAKE = 2,
+    WATCH_SIGNAL = 3
+} WatchKind;
+
+typedef struct {
+    EventHandler handler;
+    void *context;
+    WatchKind kind;
+    int file_descriptor;
+} __attribute__((aligned(32))) EventWatch;
+
+typedef struct {
+    EventWatch watches[EVENT_LOOP_MAX_WATCHES];
+    EventHandler idle_handler;
+    void *idle_context;
+    int epoll_descriptor;
+    int watch_count;
+} __attribute__((aligned(64))) EventLoop;
+
+ErrorCode EventLoop_create(EventLoop *loop);
+
+void EventLoop_destroy(EventLoop *loop);
+
+ErrorCode EventLoop_watch(EventLoop *loop, int fileDescriptor,
+			  EventHandler handler, void *context);
+
+ErrorCode EventLoop_addTimer(EventLoop *loop,
+			     unsigned long long intervalNanoseconds,
+			     EventHandler handler, void *context);
+
+ErrorCode EventLoop_addWake(EventLoop *loop, EventHandler handler,
+			    void *context, int *wakeDescriptor);
+
+ErrorCode EventLoop_addSignal(EventLoop *loop, int signalNumber,
+			      EventHandler handler, void *context);
+
+void EventLoop_setIdle(EventLoop *loop, EventHandler handler, void *context);
+
+ErrorCode EventLoop_run(EventLoop *loop);
+
+void EventLoop_signal(int wakeDescriptor);
@@ -0,0 +1,285 @@
+/*
+    Stage tracing, every thread appends begin/end ticks to its own single
+    producer ring and a background thread drains them every interval into
+    a Chrome trace JSON file plus a per stage p50/p99/max summary on
+    stderr, exposed api is in `trace.h`
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "branch.h"
+#include "types.h"
+
+#define TRACE_RING_CAPACITY 8192
+#define TRACE_SUMMARY_CAPACITY 4096
+
+typedef struct {
+    unsigned long long start;
+    unsigned long long end;
+    TraceStage stage;
+} __attribute__((aligned(32))) TraceEvent;
+
+// the owning thread only moves head, the dumper only moves tail
+typedef struct {
+    _Atomic unsigned long long head __attribute__((aligned(64)));
+    _Atomic unsigned long long tail __attribute__((aligned(64)));
+    _Atomic unsigned long long dropped;
+    TraceEvent events[TRACE_RING_CAPACITY];
+} __attribute__((aligned(64))) TraceRing;
+
+typedef struct {
+    unsigned long long durations[TRACE_STAGE_COUNT][TRACE_SUMMARY_CAPACITY];
+    unsigned long long maximum[TRACE_STAGE_COUNT];
+    unsigned int counts[TRACE_STAGE_COUNT];
+    FILE *file;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    unsigned long long base_ticks;
+    unsigned long long base_nanoseconds;
+    unsigned int interval;
+    bool running;
+    bool first_event;
+} __attribute__((aligned(64))) TraceDumper;
+
+static const char *const STAGE_NAMES[TRACE_STAGE_COUNT] = {
+    "frame", "capture", "gray", "denoise", "pyramid", "flow", "blur",
+    "threshold", "distance", "contour", "hull", "fingertips", "gesture",
+    "tracker", "controls", "convert", "overlay", "present",
+    "audio_render"};
+
+static TraceRing rings[TRACE_MAX_THREADS];
+static _Atomic int ringCount = 0;
+static atomic_bool tracing = false;
+static _Thread_local TraceRing *threadRing = NULL;
+static _Thread_local bool threadRegistered = false;
+static TraceDumper *dumper = NULL;
+
+static unsigned long long monotonicNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((unsigned long long)now.tv_sec * 1000000000ULL) +
+	   (unsigned long long)now.tv_nsec;
+}
+
+// a thread past TRACE_MAX_THREADS simply goes untraced
+static TraceRing *registerThread(void) {
+    threadRegistered = true;
+    const int index =
+	atomic_fetch_add_explicit(&ringCount, 1, memory_order_relaxed);
+    if (index < TRACE_MAX_THREADS) {
+	threadRing = &rings[index];
+    }
+    return threadRing;
+}
+
+// never blocks, a full ring drops the event and counts it
+void Trace_record(const TraceStage stage, const unsigned long long start,
+		  const unsigned long long end) {
+    if (!atomic_load_explicit(&tracing, memory_order_relaxed)) {
+	return;
+    }
+    TraceRing *ring = threadRegistered ? threadRing : registerThread();
+    if (UNLIKELY(ring == NULL)) {
+	return;
+    }
+    const unsigned long long head =
+	atomic_load_explicit(&ring->head, memory_order_relaxed);
+    const unsigned long long tail =
+	atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (UNLIKELY(head - tail >= TRACE_RING_CAPACITY)) {
+	atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+	return;
+    }
+    ring->events[head % TRACE_RING_CAPACITY] =
+	(TraceEvent){.start = start, .end = end, .stage = stage};
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static void writeEvent(TraceDumper *state, const TraceEvent *event,
+		       const int thread, const double nanosecondsPerTick) {
+    const double start =
+	(double)(event->start - state->base_ticks) * nanosecondsPerTick;
+    const double duration =
+	(double)(event->end - event->start) * nanosecondsPerTick;
+    (void)fprintf(state->file,
+		  "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+		  "\"ts\":%.3f,\"dur\":%.3f}",
+		  state->first_event ? "" : ",\n", STAGE_NAMES[event->stage],
+		  thread, start / 1e3, duration / 1e3);
+    state->first_event = false;
+
+    const unsigned long long nanoseconds = (unsigned long long)duration;
+    const unsigned int count = state->counts[event->stage]++;
+    if (count < TRACE_SUMMARY_CAPACITY) {
+	state->durations[event->stage][count] = nanoseconds;
+    }
+    if (nanoseconds > state->maximum[event->stage]) {
+	state->maximum[event->stage] = nanoseconds;
+    }
+}
+
+static unsigned long long drainRings(TraceDumper *state,
+				     const double nanosecondsPerTick) {
+    unsigned long long dropped = 0;
+    int count = atomic_load_explicit(&ringCount, memory_order_relaxed);
+    count = count > TRACE_MAX_THREADS ? TRACE_MAX_THREADS : count;
+    for (int thread = 0; thread < count; ++thread) {
+	TraceRing *ring = &rings[thread];
+	const unsigned long long head =
+	    atomic_load_explicit(&ring->head, memory_order_acquire);
+	unsigned long long tail =
+	    atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	for (; tail != head; ++tail) {
+	    writeEvent(state, &ring->events[tail % TRACE_RING_CAPACITY], thread,
+		       nanosecondsPerTick);
+	}
+	atomic_store_explicit(&ring->tail, tail, memory_order_release);
+	dropped += atomic_exchange_explicit(&ring->dropped, 0,
+					    memory_order_relaxed);
+    }
+    return dropped;
+}
+
+static int compareDurations(const void *first, const void *second) {
+    const unsigned long long a = *(const unsigned long long *)first;
+    const unsigned long long b = *(const unsigned long long *)second;
+    return (a > b) - (a < b);
+}
+
+// nearest rank over the kept samples, the maximum is exact either way
+static void printSummary(TraceDumper *state, const unsigned long long dropped) {
+    (void)fprintf(stderr, "trace: %-12s %8s %10s %10s %10s\n", "stage",
+		  "count", "p50 us", "p99 us", "max us");
+    for (int stage = 0; stage < TRACE_STAGE_COUNT; ++stage) {
+	const unsigned int count = state->counts[stage];
+	if (count == 0) {
+	    continue;
+	}
+	const unsigned int kept =
+	    count < TRACE_SUMMARY_CAPACITY ? count : TRACE_SUMMARY_CAPACITY;
+	unsigned long long *durations = state->durations[stage];
+	qsort(durations, kept, sizeof(*durations), compareDurations);
+	const unsigned int median = (kept - 1) / 2;
+	const unsigned int tail = ((kept * 99) + 99) / 100 - 1;
+	(void)fprintf(stderr, "trace: %-12s %8u %10.1f %10.1f %10.1f\n",
+		      STAGE_NAMES[stage], count,
+		      (double)durations[median] / 1e3,
+		      (double)durations[tail] / 1e3,
+		      (double)state->maximum[stage] / 1e3);
+    }
+    if (dropped > 0) {
+	(void)fprintf(stderr, "trace: %llu events dropped, rings full\n",
+		      dropped);
+    }
+    memset(state->counts, 0, sizeof(state->counts));
+    memset(state->maximum, 0, sizeof(state->maximum));
+}
+
+static void dumpInterval(TraceDumper *state) {
+    const unsigned long long ticks = Trace_now();
+    const unsigned long long nanoseconds = monotonicNanoseconds();
+    const double nanosecondsPerTick =
+	ticks > state->base_ticks
+	    ? (double)(nanoseconds - state->base_nanoseconds) /
+		  (double)(ticks - state->base_ticks)
+	    : 1.0;
+    const unsigned long long dropped = drainRings(state, nanosecondsPerTick);
+    (void)fflush(state->file);
+    printSummary(state, dropped);
+}
+
+static void *dumpThread(void *argument) {
+    TraceDumper *state = (TraceDumper *)argument;
+    pthread_mutex_lock(&state->lock);
+    while (state->running) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += (time_t)state->interval;
+	while (state->running &&
+	       pthread_cond_timedwait(&state->wake, &state->lock, &deadline) ==
+		   0) {
+	}
+	pthread_mutex_unlock(&state->lock);
+	dumpInterval(state);
+	pthread_mutex_lock(&state->lock);
+    }
+    pthread_mutex_unlock(&state->lock);
+    return NULL;
+}
+
+/*
+    Starts recording and the dumper, which writes a Chrome trace (open it
+    in Perfetto or chrome://tracing) to path and a summary every
+    intervalSeconds. Only one trace runs at a time.
+*/
+ErrorCode Trace_start(const char *path, const unsigned int intervalSeconds) {
+    if (UNLIKELY(dumper != NULL || intervalSeconds == 0)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    TraceDumper *state = (TraceDumper *)calloc(1, sizeof(TraceDumper));
+    if (UNLIKELY(state == NULL)) {
+	return ERROR_ALLOCATION_FAILED;
+    }
+    state->file = fopen(path, "w");
+    if (UNLIKELY(state->file == NULL)) {
+	free(state);
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    (void)fputs("[\n", state->file);
+    state->interval = intervalSeconds;
+    state->running = true;
+    state->first_event = true;
+    state->base_ticks = Trace_now();
+    state->base_nanoseconds = monotonicNanoseconds();
+
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&state->wake, &attributes);
+    pthread_condattr_destroy(&attributes);
+    pthread_mutex_init(&state->lock, NULL);
+
+    if (UNLIKELY(pthread_create(&state->thread, NULL, dumpThread, state) !=
+		 0)) {
+	pthread_cond_destroy(&state->wake);
+	pthread_mutex_destroy(&state->lock);
+	(void)fclose(state->file);
+	free(state);
+	return ERROR_UNSUPPORTED_OPERATION;
+    }
+    dumper = state;
+    atomic_store_explicit(&tracing, true, memory_order_release);
+    return ERROR_NONE;
+}
+
+// flushes whatever is still queued and closes the JSON array
+void Trace_stop(void) {
+    TraceDumper *state = dumper;
+    if (state == NULL) {
+	return;
+    }
+    atomic_store_explicit(&tracing, false, memory_order_release);
+    pthread_mutex_lock(&state->lock);
+    state->running = false;
+    pthread_cond_signal(&state->wake);
+    pthread_mutex_unlock(&state->lock);
+    pthread_join(state->thread, NULL);
+
+    (void)fputs("\n]\n", state->file);
+    (void)fclose(state->file);
+    pthread_cond_destroy(&state->wake);
+    pthread_mutex_destroy(&state->lock);
+    free(state);
+    dumper = NULL;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#ifdef __x86_64__
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#include "types.h"
+
+#define TRACE_MAX_THREADS 8
+
+typedef enum {
+    TRACE_FRAME = 0,
+    TRACE_CAPTURE,
+    TRACE_GRAY,
+    TRACE_DENOISE,
+    TRACE_PYRAMID,
+    TRACE_FLOW,
+    TRACE_BLUR,
+    TRACE_THRESHOLD,
+    TRACE_DISTANCE,
+    TRACE_CONTOUR,
+    TRACE_HULL,
+    TRACE_FINGERTIPS,
+    TRACE_GESTURE,
+    TRACE_TRACKER,
+    TRACE_CONTROLS,
+    TRACE_CONVERT,
+    TRACE_OVERLAY,
+    TRACE_PRESENT,
+    TRACE_AUDIO_RENDER,
+    TRACE_STAGE_COUNT
+} TraceStage;
+
+// raw ticks, TSC where there is one, the dumper converts them to time
+static inline unsigned long long Trace_now(void) {
+#ifdef __x86_64__
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((unsigned long long)now.tv_sec * 1000000000ULL) +
+	   (unsigned long long)now.tv_nsec;
+#endif
+}
+
+ErrorCode Trace_start(const char *path, unsigned int intervalSeconds);
+
+void Trace_stop(void);
+
+void Trace_record(TraceStage stage, unsigned long long start,
+		  unsigned long long end);
+
+/*
+    Begin/end pairs in the same block, both vanish unless built with
+    TRACE=1 so instrumented hot paths cost nothing by default.
+*/
+#ifdef HM_TRACE
+#define TRACE_BEGIN(stage) \
+    const unsigned long long traceStart_##stage = Trace_now()
+#define TRACE_END(stage) Trace_record(stage, traceStart_##stage, Trace_now())
+#else
+#define TRACE_BEGIN(stage)
+#define TRACE_END(stage)
+#endif
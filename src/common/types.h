@@ -11,6 +11,13 @@ typedef struct {
     unsigned int pixels;
 } __attribute__((aligned(16))) FrameDimensions;
 
+typedef struct {
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+} __attribute__((aligned(16))) FrameRegion;
+
 typedef enum {
     ERROR_NONE = 0,
     ERROR_FILE_OPEN_FAILED = -1,
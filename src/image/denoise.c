@@ -0,0 +1,185 @@
+/*
+    Motion adaptive temporal denoise, one pass per frame reads the frame and
+    the history and writes both, exposed api is in `denoise.h`
+*/
+
+#include "denoise.h"
+
+#include <immintrin.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "branch.h"
+#include "types.h"
+
+// differences up to the noise floor get the full weight, it falls to 0
+// by a difference of 36 which any hand edge against the background exceeds
+static const unsigned short MAX_WEIGHT = 96;
+static const unsigned short NOISE_FLOOR = 12;
+static const unsigned short MOTION_SLOPE = 4;
+static const size_t HISTORY_ALIGNMENT = 64;
+
+typedef struct {
+    __m256i max_weight;
+    __m256i noise_floor;
+    __m256i motion_slope;
+    __m256i round;
+} __attribute__((aligned(128))) BlendVectors;
+
+static void setBlendVectors(BlendVectors *vectors,
+			    const unsigned short maxWeight,
+			    const TemporalDenoiser *denoiser) {
+    vectors->max_weight = _mm256_set1_epi16((short)maxWeight);
+    vectors->noise_floor = _mm256_set1_epi16((short)denoiser->noise_floor);
+    vectors->motion_slope = _mm256_set1_epi16((short)denoiser->motion_slope);
+    vectors->round = _mm256_set1_epi16(1 << (DENOISE_WEIGHT_SHIFT - 1));
+}
+
+// 16 lanes of 0-255 in and out, the product of a difference and a Q7
+// weight stays within 16 bits
+static inline __attribute__((always_inline)) __m256i blendLanes(
+    const __m256i current, const __m256i history,
+    const BlendVectors *vectors) {
+    const __m256i difference = _mm256_sub_epi16(history, current);
+    const __m256i excess =
+	_mm256_subs_epu16(_mm256_abs_epi16(difference), vectors->noise_floor);
+    const __m256i weight = _mm256_subs_epu16(
+	vectors->max_weight, _mm256_mullo_epi16(excess, vectors->motion_slope));
+    const __m256i pull = _mm256_srai_epi16(
+	_mm256_add_epi16(_mm256_mullo_epi16(difference, weight),
+			 vectors->round),
+	DENOISE_WEIGHT_SHIFT);
+    return _mm256_add_epi16(current, pull);
+}
+
+static inline __attribute__((always_inline)) unsigned char blendPixel(
+    const int current, const int history, const int maxWeight,
+    const TemporalDenoiser *denoiser) {
+    const int difference = history - current;
+    int excess = abs(difference) - denoiser->noise_floor;
+    excess = excess > 0 ? excess : 0;
+    int weight = maxWeight - (excess * denoiser->motion_slope);
+    weight = weight > 0 ? weight : 0;
+    const int pull = ((difference * weight) +
+		      (1 << (DENOISE_WEIGHT_SHIFT - 1))) >>
+		     DENOISE_WEIGHT_SHIFT;
+    return (unsigned char)(current + pull);
+}
+
+static void blendGray(unsigned char *gray, unsigned char *history,
+		      const size_t pixels, const BlendVectors *vectors,
+		      const unsigned short maxWeight,
+		      const TemporalDenoiser *denoiser) {
+    const __m256i zero = _mm256_setzero_si256();
+    size_t index = 0;
+    for (; index + 32 <= pixels; index += 32) {
+	const __m256i current =
+	    _mm256_loadu_si256((const __m256i *)(gray + index));
+	const __m256i previous =
+	    _mm256_loadu_si256((const __m256i *)(history + index));
+	const __m256i low =
+	    blendLanes(_mm256_unpacklo_epi8(current, zero),
+		       _mm256_unpacklo_epi8(previous, zero), vectors);
+	const __m256i high =
+	    blendLanes(_mm256_unpackhi_epi8(current, zero),
+		       _mm256_unpackhi_epi8(previous, zero), vectors);
+	const __m256i filtered = _mm256_packus_epi16(low, high);
+	_mm256_storeu_si256((__m256i *)(gray + index), filtered);
+	_mm256_storeu_si256((__m256i *)(history + index), filtered);
+    }
+    for (; index < pixels; ++index) {
+	gray[index] = blendPixel(gray[index], history[index], maxWeight,
+				 denoiser);
+	history[index] = gray[index];
+    }
+}
+
+// luma sits in the low byte of each 16 bit YUYV pair, masking the chroma
+// off gives the lanes blendLanes wants without any shuffling
+static void blendYuyvRow(unsigned char *yuyv, unsigned char *history,
+			 const unsigned int width,
+			 const BlendVectors *vectors,
+			 const unsigned short maxWeight,
+			 const TemporalDenoiser *denoiser) {
+    const __m256i lumaMask = _mm256_set1_epi16(0x00FF);
+    unsigned int column = 0;
+    for (; column + 16 <= width; column += 16) {
+	const __m256i pairs =
+	    _mm256_loadu_si256((const __m256i *)(yuyv + (column * 2)));
+	const __m256i previous = _mm256_cvtepu8_epi16(
+	    _mm_loadu_si128((const __m128i *)(history + column)));
+	const __m256i filtered = blendLanes(
+	    _mm256_and_si256(pairs, lumaMask), previous, vectors);
+	_mm256_storeu_si256(
+	    (__m256i *)(yuyv + (column * 2)),
+	    _mm256_or_si256(_mm256_andnot_si256(lumaMask, pairs), filtered));
+	// packing puts each lane's 8 bytes in its low quarter
+	const __m256i packed = _mm256_permute4x64_epi64(
+	    _mm256_packus_epi16(filtered, filtered), 0x08);
+	_mm_storeu_si128((__m128i *)(history + column),
+			 _mm256_castsi256_si128(packed));
+    }
+    for (; column < width; ++column) {
+	yuyv[column * 2] = blendPixel(yuyv[column * 2], history[column],
+				      maxWeight, denoiser);
+	history[column] = yuyv[column * 2];
+    }
+}
+
+ErrorCode TemporalDenoiser_create(TemporalDenoiser *denoiser,
+				  const FrameDimensions dimensions) {
+    memset(denoiser, 0, sizeof(*denoiser));
+    if (UNLIKELY(dimensions.pixels == 0 ||
+		 dimensions.stride < dimensions.width * 2)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    denoiser->history = (unsigned char *)aligned_alloc(
+	HISTORY_ALIGNMENT, (dimensions.pixels + HISTORY_ALIGNMENT - 1) &
+			       ~(size_t)(HISTORY_ALIGNMENT - 1));
+    if (UNLIKELY(denoiser->history == NULL)) {
+	return ERROR_ALLOCATION_FAILED;
+    }
+    denoiser->dimensions = dimensions;
+    denoiser->max_weight = MAX_WEIGHT;
+    denoiser->noise_floor = NOISE_FLOOR;
+    denoiser->motion_slope = MOTION_SLOPE;
+    return ERROR_NONE;
+}
+
+void TemporalDenoiser_destroy(TemporalDenoiser *denoiser) {
+    free(denoiser->history);
+    denoiser->history = NULL;
+}
+
+void TemporalDenoiser_reset(TemporalDenoiser *denoiser) {
+    denoiser->primed = false;
+}
+
+// the first frame after a reset passes through unchanged and becomes the
+// history, a zero weight gives exactly that with the same pass
+void TemporalDenoiser_filterGray(TemporalDenoiser *denoiser,
+				 unsigned char *gray) {
+    const unsigned short maxWeight =
+	denoiser->primed ? denoiser->max_weight : 0;
+    BlendVectors vectors;
+    setBlendVectors(&vectors, maxWeight, denoiser);
+    blendGray(gray, denoiser->history, denoiser->dimensions.pixels, &vectors,
+	      maxWeight, denoiser);
+    denoiser->primed = true;
+}
+
+void TemporalDenoiser_filterYuyv(TemporalDenoiser *denoiser,
+				 unsigned char *yuyv) {
+    const FrameDimensions dimensions = denoiser->dimensions;
+    const unsigned short maxWeight =
+	denoiser->primed ? denoiser->max_weight : 0;
+    BlendVectors vectors;
+    setBlendVectors(&vectors, maxWeight, denoiser);
+    for (unsigned int row = 0; row < dimensions.height; ++row) {
+	blendYuyvRow(yuyv + ((size_t)row * dimensions.stride),
+		     denoiser->history + ((size_t)row * dimensions.width),
+		     dimensions.width, &vectors, maxWeight, denoiser);
+    }
+    denoiser->primed = true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "types.h"
+
+// history weights are Q7, 128 would keep the history and ignore the frame
+#define DENOISE_WEIGHT_SHIFT 7
+
+/*
+    Recursive per pixel filter, each luma value is pulled towards the
+    filtered value of the frame before by max_weight, less the further the
+    two differ beyond noise_floor, motion_slope weight steps per level, so
+    moving edges pass through while static sensor noise averages out
+*/
+typedef struct {
+    unsigned char *history;
+    FrameDimensions dimensions;
+    unsigned short max_weight;
+    unsigned short noise_floor;
+    unsigned short motion_slope;
+    bool primed;
+} __attribute__((aligned(64))) TemporalDenoiser;
+
+ErrorCode TemporalDenoiser_create(TemporalDenoiser *denoiser,
+				  FrameDimensions dimensions);
+
+void TemporalDenoiser_destroy(TemporalDenoiser *denoiser);
+
+// the next frame starts a fresh history, e.g. after the camera changed
+void TemporalDenoiser_reset(TemporalDenoiser *denoiser);
+
+// both filter in place, the YUYV one only touches luma
+void TemporalDenoiser_filterGray(TemporalDenoiser *denoiser,
+				 unsigned char *gray);
+
+void TemporalDenoiser_filterYuyv(TemporalDenoiser *denoiser,
+				 unsigned char *yuyv);
@@ -25,7 +25,8 @@ ErrorCode boxBlurGray(const unsigned char *const grayInput,
     }
 
     for (unsigned int row = 1; row < dimensions->height - 1; row++) {
-	for (unsigned int column = 1; column <= dimensions->width - 33;
+	// the left taps read column - 2, starting at 1 would wrap the index
+	for (unsigned int column = 2; column <= dimensions->width - 33;
 	     column += 32) {
 	    __m256i top = _mm256_loadu_si256((const __m256i *)&grayInput[(
 		((row - 1) * dimensions->width) + column - 1)]);
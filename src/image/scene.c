@@ -0,0 +1,368 @@
+/*
+    Deterministic synthetic hand scenes in YUYV, a palm circle with finger
+    capsules and an optional forearm rasterised as one span per shape and
+    row over gradient lit background and skin rows, with table noise on
+    the luma, every frame comes with its exact fingertips, exposed api is
+    in `scene.h`
+*/
+
+#include "scene.h"
+
+#include <float.h>
+#include <immintrin.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "branch.h"
+#include "types.h"
+
+#define SCENE_MAX_CAPSULES (SCENE_MAX_FINGERS + 1)
+
+// a power of two, rows start at hashed even offsets into it
+static const unsigned int NOISE_LENGTH = 1U << 16;
+static const float TWO_PI = 6.28318530718F;
+// fingers root this far into the palm so they always join it
+static const float FINGER_ROOT = 0.5F;
+// the noise table holds 0 to 2 * noise in a byte
+static const unsigned char MAX_NOISE = 127;
+
+typedef struct {
+    ScenePoint start;
+    ScenePoint end;
+    float radius;
+} __attribute__((aligned(32))) Capsule;
+
+typedef struct {
+    Capsule capsules[SCENE_MAX_CAPSULES];
+    ScenePoint palm_centre;
+    float palm_radius;
+    int capsule_count;
+} __attribute__((aligned(64))) ScenePose;
+
+// an open hand fanned over about 100 degrees, outer fingers shorter
+void SceneGenerator_defaults(SceneParameters *parameters, int fingerCount) {
+    memset(parameters, 0, sizeof(*parameters));
+    fingerCount = fingerCount < 0 ? 0 : fingerCount;
+    fingerCount =
+	fingerCount > SCENE_MAX_FINGERS ? SCENE_MAX_FINGERS : fingerCount;
+    parameters->finger_count = fingerCount;
+    for (int finger = 0; finger < fingerCount; ++finger) {
+	const float angle =
+	    fingerCount > 1
+		? -0.9F + (1.8F * (float)finger / (float)(fingerCount - 1))
+		: 0.0F;
+	parameters->fingers[finger] =
+	    (SceneFinger){.angle = angle,
+			  .length = 1.5F - (0.4F * fabsf(angle)),
+			  .width = 0.22F};
+    }
+    parameters->centre = (ScenePoint){.x = 0.5F, .y = 0.62F};
+    parameters->path_radius = (ScenePoint){.x = 0.12F, .y = 0.06F};
+    parameters->palm_radius = 1.0F / 7.0F;
+    parameters->scale_swing = 0.1F;
+    parameters->rotation_swing = 0.25F;
+    parameters->path_frames = 150;
+    parameters->seed = 1;
+    // bright enough to stay above the hand threshold after the blur
+    parameters->skin[0] = 250;
+    parameters->skin[1] = 110;
+    parameters->skin[2] = 150;
+    parameters->background[0] = 40;
+    parameters->background[1] = 128;
+    parameters->background[2] = 128;
+    parameters->noise = 4;
+}
+
+static unsigned char clampByte(const float value) {
+    return value < 0.0F     ? 0
+	   : value > 255.0F ? 255
+			    : (unsigned char)(value + 0.5F);
+}
+
+// one row of a flat colour with the lighting gradient baked into its luma
+static void fillTemplate(unsigned char *row, const unsigned char colour[3],
+			 const signed char gradient,
+			 const unsigned int width) {
+    const float step =
+	width > 1 ? (float)gradient / (float)(width - 1) : 0.0F;
+    for (unsigned int x = 0; x < width; ++x) {
+	const float luma =
+	    (float)colour[0] + (step * (float)x) - ((float)gradient * 0.5F);
+	row[x * 2] = clampByte(luma);
+	row[(x * 2) + 1] = (x & 1U) == 0 ? colour[1] : colour[2];
+    }
+}
+
+// luma bytes hold 0 to 2 * amplitude, chroma bytes stay 0 so adding a
+// row of it and taking amplitude back off leaves the chroma alone
+static void fillNoise(unsigned char *noise, const size_t length,
+		      const unsigned char amplitude, unsigned int seed) {
+    const unsigned int range = (2U * amplitude) + 1U;
+    seed = seed != 0 ? seed : 1;
+    for (size_t index = 0; index < length; ++index) {
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	noise[index] = (index & 1U) == 0 ? (unsigned char)(seed % range) : 0;
+    }
+}
+
+static unsigned char *allocateRow(const size_t size) {
+    return (unsigned char *)aligned_alloc(64, (size + 63) & ~(size_t)63);
+}
+
+ErrorCode SceneGenerator_create(SceneGenerator *generator,
+				const SceneParameters *parameters,
+				const FrameDimensions dimensions) {
+    memset(generator, 0, sizeof(*generator));
+    if (UNLIKELY(dimensions.width < 2 || dimensions.height == 0 ||
+		 dimensions.stride < dimensions.width * 2 ||
+		 parameters->path_frames == 0 ||
+		 parameters->finger_count < 0 ||
+		 parameters->finger_count > SCENE_MAX_FINGERS ||
+		 parameters->noise > MAX_NOISE)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    generator->parameters = *parameters;
+    generator->dimensions = dimensions;
+
+    const size_t rowBytes = (size_t)dimensions.width * 2;
+    generator->background_row = allocateRow(rowBytes);
+    generator->skin_row = allocateRow(rowBytes);
+    generator->noise = allocateRow(NOISE_LENGTH + rowBytes);
+    if (UNLIKELY(generator->background_row == NULL ||
+		 generator->skin_row == NULL || generator->noise == NULL)) {
+	SceneGenerator_destroy(generator);
+	return ERROR_ALLOCATION_FAILED;
+    }
+    fillTemplate(generator->background_row, parameters->background,
+		 parameters->gradient, dimensions.width);
+    fillTemplate(generator->skin_row, parameters->skin, parameters->gradient,
+		 dimensions.width);
+    fillNoise(generator->noise, NOISE_LENGTH + rowBytes, parameters->noise,
+	      parameters->seed);
+    generator->noise_mask = NOISE_LENGTH - 2;
+    return ERROR_NONE;
+}
+
+void SceneGenerator_destroy(SceneGenerator *generator) {
+    free(generator->background_row);
+    free(generator->skin_row);
+    free(generator->noise);
+    generator->background_row = NULL;
+    generator->skin_row = NULL;
+    generator->noise = NULL;
+}
+
+static ScenePoint along(const ScenePoint origin, const ScenePoint direction,
+			const float distance) {
+    return (ScenePoint){.x = origin.x + (direction.x * distance),
+			.y = origin.y + (direction.y * distance)};
+}
+
+// up is -y, angles turn clockwise on screen
+static ScenePoint direction(const float angle) {
+    return (ScenePoint){.x = sinf(angle), .y = -cosf(angle)};
+}
+
+static void poseFor(const SceneGenerator *generator, const unsigned int frame,
+		    ScenePose *pose, SceneTruth *truth) {
+    const SceneParameters *parameters = &generator->parameters;
+    const float width = (float)generator->dimensions.width;
+    const float height = (float)generator->dimensions.height;
+    const float phase = TWO_PI * (float)(frame % parameters->path_frames) /
+			(float)parameters->path_frames;
+    const float swing = sinf(phase);
+    const float rotation =
+	parameters->rotation + (parameters->rotation_swing * swing);
+    const float radius = parameters->palm_radius * height *
+			 (1.0F + (parameters->scale_swing * swing));
+    const ScenePoint path = parameters->path_radius;
+    const ScenePoint centre = {
+	.x = (parameters->centre.x + (path.x * cosf(phase))) * width,
+	.y = (parameters->centre.y + (path.y * swing)) * height};
+
+    pose->palm_centre = centre;
+    pose->palm_radius = radius;
+    pose->capsule_count = 0;
+    for (int finger = 0; finger < parameters->finger_count; ++finger) {
+	const SceneFinger *shape = &parameters->fingers[finger];
+	const ScenePoint axis = direction(rotation + shape->angle);
+	const float capsuleRadius = shape->width * radius;
+	const ScenePoint tip =
+	    along(centre, axis, radius * (1.0F + shape->length));
+	pose->capsules[pose->capsule_count++] =
+	    (Capsule){.start = along(centre, axis, radius * FINGER_ROOT),
+		      .end = along(tip, axis, -capsuleRadius),
+		      .radius = capsuleRadius};
+	if (truth != NULL) {
+	    truth->fingertips[finger] = tip;
+	}
+    }
+    if (parameters->forearm_width > 0.0F) {
+	// long enough to leave the frame whichever way it points
+	const ScenePoint axis = direction(rotation + (TWO_PI * 0.5F));
+	pose->capsules[pose->capsule_count++] =
+	    (Capsule){.start = centre,
+		      .end = along(centre, axis, width + height),
+		      .radius = parameters->forearm_width * radius};
+    }
+    if (truth != NULL) {
+	truth->palm_centre = centre;
+	truth->palm_radius = radius;
+	truth->fingertip_count = parameters->finger_count;
+    }
+}
+
+static bool circleSpan(const ScenePoint centre, const float radius,
+		       const float y, float *left, float *right) {
+    const float offset = y - centre.y;
+    if (offset * offset > radius * radius) {
+	return false;
+    }
+    const float half = sqrtf((radius * radius) - (offset * offset));
+    *left = fminf(*left, centre.x - half);
+    *right = fmaxf(*right, centre.x + half);
+    return true;
+}
+
+static void edgeSpan(const ScenePoint from, const ScenePoint to,
+		     const float y, float *left, float *right) {
+    if ((from.y > y && to.y > y) || (from.y < y && to.y < y)) {
+	return;
+    }
+    const float rise = to.y - from.y;
+    if (fabsf(rise) < FLT_EPSILON) {
+	*left = fminf(*left, fminf(from.x, to.x));
+	*right = fmaxf(*right, fmaxf(from.x, to.x));
+	return;
+    }
+    const float x = from.x + ((y - from.y) * (to.x - from.x) / rise);
+    *left = fminf(*left, x);
+    *right = fmaxf(*right, x);
+}
+
+// a capsule is convex, so a row crosses it in one span, the union of
+// where it crosses both end circles and the rectangle between them
+static bool capsuleSpan(const Capsule *capsule, const float y, float *left,
+			float *right) {
+    *left = FLT_MAX;
+    *right = -FLT_MAX;
+    (void)circleSpan(capsule->start, capsule->radius, y, left, right);
+    (void)circleSpan(capsule->end, capsule->radius, y, left, right);
+
+    const float dx = capsule->end.x - capsule->start.x;
+    const float dy = capsule->end.y - capsule->start.y;
+    const float length = sqrtf((dx * dx) + (dy * dy));
+    if (length > FLT_EPSILON) {
+	const ScenePoint normal = {.x = -dy * capsule->radius / length,
+				   .y = dx * capsule->radius / length};
+	const ScenePoint corners[4] = {
+	    along(capsule->start, normal, 1.0F),
+	    along(capsule->end, normal, 1.0F),
+	    along(capsule->end, normal, -1.0F),
+	    along(capsule->start, normal, -1.0F)};
+	for (int corner = 0; corner < 4; ++corner) {
+	    edgeSpan(corners[corner], corners[(corner + 1) % 4], y, left,
+		     right);
+	}
+    }
+    return *left <= *right;
+}
+
+// pixels whose centres lie inside [left, right] take the skin row's bytes
+static void paintSpan(unsigned char *row, const unsigned char *skinRow,
+		      const float left, const float right, const int width) {
+    int first = (int)ceilf(left - 0.5F);
+    int last = (int)floorf(right - 0.5F);
+    first = first < 0 ? 0 : first;
+    last = last >= width ? width - 1 : last;
+    if (first <= last) {
+	memcpy(row + ((size_t)first * 2), skinRow + ((size_t)first * 2),
+	       (size_t)(last - first + 1) * 2);
+    }
+}
+
+static void copyRow(unsigned char *row, const unsigned char *source,
+		    const size_t bytes) {
+    size_t index = 0;
+    for (; index + 32 <= bytes; index += 32) {
+	_mm256_storeu_si256(
+	    (__m256i *)(row + index),
+	    _mm256_load_si256((const __m256i *)(source + index)));
+    }
+    memcpy(row + index, source + index, bytes - index);
+}
+
+// saturating add of 0 to 2 * amplitude then subtract of amplitude, the
+// bias is amplitude in luma bytes and 0 in chroma ones like the noise
+static void addNoise(unsigned char *row, const unsigned char *noise,
+		     const unsigned char amplitude, const size_t bytes) {
+    const __m256i bias = _mm256_set1_epi16((short)amplitude);
+    size_t index = 0;
+    for (; index + 32 <= bytes; index += 32) {
+	const __m256i pixels =
+	    _mm256_loadu_si256((const __m256i *)(row + index));
+	const __m256i offsets =
+	    _mm256_loadu_si256((const __m256i *)(noise + index));
+	_mm256_storeu_si256(
+	    (__m256i *)(row + index),
+	    _mm256_subs_epu8(_mm256_adds_epu8(pixels, offsets), bias));
+    }
+    for (; index < bytes; index += 2) {
+	const int sum = row[index] + noise[index];
+	const int value = (sum > 255 ? 255 : sum) - amplitude;
+	row[index] = (unsigned char)(value < 0 ? 0 : value);
+    }
+}
+
+static unsigned int noiseOffset(const SceneGenerator *generator,
+				const unsigned int frame,
+				const unsigned int row) {
+    unsigned int hash = (frame * 0x9E3779B1U) ^ (row * 0x85EBCA77U);
+    hash ^= hash >> 15;
+    hash *= 0x2C1B3C6DU;
+    hash ^= hash >> 12;
+    return hash & generator->noise_mask;
+}
+
+/*
+    Renders frame number frame of the scene into yuyv, which holds
+    dimensions.height rows of dimensions.stride bytes, and the same frame
+    number always renders the same image. truth may be NULL.
+*/
+void SceneGenerator_render(const SceneGenerator *generator,
+			   const unsigned int frame, unsigned char *yuyv,
+			   SceneTruth *truth) {
+    const FrameDimensions dimensions = generator->dimensions;
+    const size_t rowBytes = (size_t)dimensions.width * 2;
+    const int width = (int)dimensions.width;
+    const unsigned char amplitude = generator->parameters.noise;
+    ScenePose pose;
+    poseFor(generator, frame, &pose, truth);
+
+    for (unsigned int y = 0; y < dimensions.height; ++y) {
+	unsigned char *row = yuyv + ((size_t)y * dimensions.stride);
+	const float centreY = (float)y + 0.5F;
+	float left = FLT_MAX;
+	float right = -FLT_MAX;
+	copyRow(row, generator->background_row, rowBytes);
+	if (circleSpan(pose.palm_centre, pose.palm_radius, centreY, &left,
+		       &right)) {
+	    paintSpan(row, generator->skin_row, left, right, width);
+	}
+	for (int capsule = 0; capsule < pose.capsule_count; ++capsule) {
+	    if (capsuleSpan(&pose.capsules[capsule], centreY, &left,
+			    &right)) {
+		paintSpan(row, generator->skin_row, left, right, width);
+	    }
+	}
+	if (amplitude != 0) {
+	    addNoise(row, generator->noise + noiseOffset(generator, frame, y),
+		     amplitude, rowBytes);
+	}
+    }
+}
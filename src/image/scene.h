@@ -0,0 +1,69 @@
+#pragma once
+
+#include "types.h"
+
+#define SCENE_MAX_FINGERS 5
+
+typedef struct {
+    float x;
+    float y;
+} __attribute__((aligned(8))) ScenePoint;
+
+// a capsule from inside the palm outwards, angle is radians clockwise from
+// the hand's up direction, length past the palm rim and width (the
+// capsule's radius) are in palm radii
+typedef struct {
+    float angle;
+    float length;
+    float width;
+} __attribute__((aligned(16))) SceneFinger;
+
+// positions are fractions of the frame, the hand laps an ellipse around
+// centre every path_frames frames while its scale and rotation swing
+// along, colours are Y, U, V
+typedef struct {
+    SceneFinger fingers[SCENE_MAX_FINGERS];
+    ScenePoint centre;
+    ScenePoint path_radius;
+    float palm_radius;  // fraction of the frame height
+    float scale_swing;
+    float rotation;
+    float rotation_swing;
+    float forearm_width;  // palm radii, 0 for a hand without an arm
+    unsigned int path_frames;
+    unsigned int seed;
+    int finger_count;
+    unsigned char skin[3];
+    unsigned char background[3];
+    unsigned char noise;  // luma noise either way, at most 127
+    signed char gradient;  // luma change from the left edge to the right
+} __attribute__((aligned(64))) SceneParameters;
+
+// exact, in pixels of the frame it came with
+typedef struct {
+    ScenePoint fingertips[SCENE_MAX_FINGERS];
+    ScenePoint palm_centre;
+    float palm_radius;
+    int fingertip_count;
+} __attribute__((aligned(64))) SceneTruth;
+
+typedef struct {
+    SceneParameters parameters;
+    FrameDimensions dimensions;
+    unsigned char *background_row;
+    unsigned char *skin_row;
+    unsigned char *noise;
+    unsigned int noise_mask;
+} __attribute__((aligned(64))) SceneGenerator;
+
+void SceneGenerator_defaults(SceneParameters *parameters, int fingerCount);
+
+ErrorCode SceneGenerator_create(SceneGenerator *generator,
+				const SceneParameters *parameters,
+				FrameDimensions dimensions);
+
+void SceneGenerator_destroy(SceneGenerator *generator);
+
+void SceneGenerator_render(const SceneGenerator *generator,
+			   unsigned int frame, unsigned char *yuyv,
+			   SceneTruth *truth);
@@ -0,0 +1,541 @@
+/*
+    Tiny int8 CNN inference, weights are mmapped straight from the model file
+    and every activation lives in one arena planned at load time so running
+    a frame never allocates, exposed api is in `network.h`
+*/
+
+#include "network.h"
+
+#include <fcntl.h>
+#include <immintrin.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "branch.h"
+#include "types.h"
+
+static const unsigned int MAX_EXTENT = 256;
+static const unsigned int MAX_CHANNELS = 256;
+static const unsigned int MAX_KERNEL = 7;
+static const unsigned int DEPTHWISE_KERNEL = 3;
+static const unsigned int DEPTHWISE_PAIRS = 5;
+static const unsigned int CHANNEL_ALIGNMENT = NETWORK_ALIGNMENT;
+static const int ACTIVATION_MAX = 127;
+
+static unsigned int padChannels(const unsigned int channels) {
+    return (channels + CHANNEL_ALIGNMENT - 1) & ~(CHANNEL_ALIGNMENT - 1);
+}
+
+static size_t tensorBytes(const TensorShape shape) {
+    return (size_t)shape.height * shape.width * shape.padded_channels;
+}
+
+// blob [offset, offset + bytes) has to sit inside the file and stay aligned
+static const void *blobAt(const Network *network, const unsigned int offset,
+			  const size_t bytes) {
+    if (UNLIKELY(offset % CHANNEL_ALIGNMENT != 0 ||
+		 offset > network->mapping_size ||
+		 bytes > network->mapping_size - offset)) {
+	return NULL;
+    }
+    return (const unsigned char *)network->mapping + offset;
+}
+
+// fills in shapes and blob pointers for one layer, its input shape is set
+static ErrorCode planLayer(const Network *network, NetworkLayer *layer,
+			   const NetworkLayerRecord *record) {
+    const TensorShape input = layer->input;
+    size_t weightBytes = 0;
+
+    layer->flags = record->flags;
+    layer->kernel = record->kernel;
+    layer->stride = record->stride;
+    layer->scale = record->scale;
+    if (UNLIKELY(!(record->scale > 0.0F) ||
+		 record->output_channels > MAX_CHANNELS)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+
+    switch (record->type) {
+	case LAYER_CONV:
+	    if (UNLIKELY(layer->kernel == 0 || layer->kernel % 2 == 0 ||
+			 layer->kernel > MAX_KERNEL || layer->stride == 0 ||
+			 record->output_channels == 0)) {
+		return ERROR_INVALID_ARGUMENT;
+	    }
+	    layer->type = LAYER_CONV;
+	    layer->output.height =
+		(input.height + layer->stride - 1) / layer->stride;
+	    layer->output.width =
+		(input.width + layer->stride - 1) / layer->stride;
+	    layer->output.channels = record->output_channels;
+	    weightBytes = (size_t)record->output_channels * layer->kernel *
+			  layer->kernel * input.padded_channels;
+	    break;
+	case LAYER_DEPTHWISE:
+	    if (UNLIKELY(layer->kernel != DEPTHWISE_KERNEL ||
+			 layer->stride == 0 ||
+			 record->output_channels != input.channels)) {
+		return ERROR_INVALID_ARGUMENT;
+	    }
+	    layer->type = LAYER_DEPTHWISE;
+	    layer->output.height =
+		(input.height + layer->stride - 1) / layer->stride;
+	    layer->output.width =
+		(input.width + layer->stride - 1) / layer->stride;
+	    layer->output.channels = input.channels;
+	    weightBytes = (size_t)DEPTHWISE_PAIRS * input.padded_channels * 2;
+	    break;
+	case LAYER_MAXPOOL:
+	    if (UNLIKELY(layer->kernel < 2 || layer->kernel > input.height ||
+			 layer->kernel > input.width)) {
+		return ERROR_INVALID_ARGUMENT;
+	    }
+	    layer->type = LAYER_MAXPOOL;
+	    layer->stride = layer->kernel;
+	    layer->output.height = input.height / layer->kernel;
+	    layer->output.width = input.width / layer->kernel;
+	    layer->output.channels = input.channels;
+	    break;
+	case LAYER_DENSE:
+	    if (UNLIKELY(record->output_channels == 0)) {
+		return ERROR_INVALID_ARGUMENT;
+	    }
+	    layer->type = LAYER_DENSE;
+	    layer->output.height = 1;
+	    layer->output.width = 1;
+	    layer->output.channels = record->output_channels;
+	    weightBytes = (size_t)record->output_channels * tensorBytes(input);
+	    break;
+	default:
+	    return ERROR_INVALID_ARGUMENT;
+    }
+    layer->output.padded_channels = padChannels(layer->output.channels);
+
+    if (layer->type != LAYER_MAXPOOL) {
+	layer->weights = (const signed char *)blobAt(
+	    network, record->weight_offset, weightBytes);
+	layer->biases = (const int *)blobAt(
+	    network, record->bias_offset,
+	    (size_t)layer->output.padded_channels * sizeof(int));
+	if (UNLIKELY(layer->weights == NULL || layer->biases == NULL)) {
+	    return ERROR_INVALID_ARGUMENT;
+	}
+    }
+    return ERROR_NONE;
+}
+
+static ErrorCode planNetwork(Network *network) {
+    NetworkHeader header;
+    if (UNLIKELY(network->mapping_size < sizeof(header))) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    memcpy(&header, network->mapping, sizeof(header));
+    if (UNLIKELY(memcmp(header.magic, NETWORK_MAGIC, sizeof(header.magic)) !=
+		     0 ||
+		 header.version != NETWORK_VERSION || header.layer_count == 0 ||
+		 header.layer_count > NETWORK_MAX_LAYERS ||
+		 header.class_count == 0 ||
+		 header.class_count > NETWORK_MAX_CLASSES ||
+		 header.input_height == 0 || header.input_height > MAX_EXTENT ||
+		 header.input_width == 0 || header.input_width > MAX_EXTENT ||
+		 header.input_channels == 0 ||
+		 header.input_channels > MAX_CHANNELS ||
+		 network->mapping_size <
+		     sizeof(header) +
+			 header.layer_count * sizeof(NetworkLayerRecord))) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+
+    network->layer_count = (int)header.layer_count;
+    network->class_count = (int)header.class_count;
+    network->input = (TensorShape){
+	.height = header.input_height,
+	.width = header.input_width,
+	.channels = header.input_channels,
+	.padded_channels = padChannels(header.input_channels)};
+
+    TensorShape shape = network->input;
+    for (int index = 0; index < network->layer_count; ++index) {
+	NetworkLayerRecord record;
+	memcpy(&record,
+	       (const unsigned char *)network->mapping + sizeof(header) +
+		   (size_t)index * sizeof(record),
+	       sizeof(record));
+
+	NetworkLayer *layer = &network->layers[index];
+	layer->input = shape;
+	const ErrorCode error = planLayer(network, layer, &record);
+	if (UNLIKELY(error != ERROR_NONE)) {
+	    return error;
+	}
+	shape = layer->output;
+    }
+
+    // only the final dense layer may keep raw accumulators
+    const NetworkLayer *last = &network->layers[network->layer_count - 1];
+    for (int index = 0; index < network->layer_count - 1; ++index) {
+	if (UNLIKELY((network->layers[index].flags & LAYER_FLAG_LOGITS) != 0)) {
+	    return ERROR_INVALID_ARGUMENT;
+	}
+    }
+    if (UNLIKELY(last->type != LAYER_DENSE ||
+		 (last->flags & LAYER_FLAG_LOGITS) == 0 ||
+		 last->output.channels != header.class_count)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    return ERROR_NONE;
+}
+
+// one allocation holding the input, ping pong activations, the im2col patch
+// and a row of accumulators, each sized to the largest use across all layers
+static ErrorCode planArena(Network *network) {
+    const size_t inputBytes =
+	(tensorBytes(network->input) + CHANNEL_ALIGNMENT - 1) &
+	~(size_t)(CHANNEL_ALIGNMENT - 1);
+    size_t activationBytes = CHANNEL_ALIGNMENT;
+    size_t patchBytes = CHANNEL_ALIGNMENT;
+    size_t accumulatorCount = CHANNEL_ALIGNMENT;
+    for (int index = 0; index < network->layer_count; ++index) {
+	const NetworkLayer *layer = &network->layers[index];
+	const size_t outputBytes = tensorBytes(layer->output);
+	const size_t kernelBytes = (size_t)layer->kernel * layer->kernel *
+				   layer->input.padded_channels;
+	activationBytes =
+	    outputBytes > activationBytes ? outputBytes : activationBytes;
+	if (layer->type == LAYER_CONV && kernelBytes > patchBytes) {
+	    patchBytes = kernelBytes;
+	}
+	if (layer->output.padded_channels > accumulatorCount) {
+	    accumulatorCount = layer->output.padded_channels;
+	}
+    }
+    activationBytes = (activationBytes + CHANNEL_ALIGNMENT - 1) &
+		      ~(size_t)(CHANNEL_ALIGNMENT - 1);
+
+    network->arena = (unsigned char *)aligned_alloc(
+	CHANNEL_ALIGNMENT, inputBytes + activationBytes * 2 + patchBytes +
+			       accumulatorCount * sizeof(int));
+    if (UNLIKELY(network->arena == NULL)) {
+	return ERROR_ALLOCATION_FAILED;
+    }
+    network->input_tensor = network->arena;
+    network->activations[0] = network->arena + inputBytes;
+    network->activations[1] = network->activations[0] + activationBytes;
+    network->patch = network->activations[1] + activationBytes;
+    network->accumulators = (int *)(void *)(network->patch + patchBytes);
+    return ERROR_NONE;
+}
+
+ErrorCode Network_load(Network *network, const char *path) {
+    memset(network, 0, sizeof(*network));
+
+    const int fileDescriptor = open(path, O_RDONLY);
+    if (UNLIKELY(fileDescriptor < 0)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    struct stat status;
+    if (UNLIKELY(fstat(fileDescriptor, &status) < 0 || status.st_size <= 0)) {
+	close(fileDescriptor);
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    network->mapping_size = (size_t)status.st_size;
+    network->mapping = mmap(NULL, network->mapping_size, PROT_READ,
+			    MAP_PRIVATE, fileDescriptor, 0);
+    close(fileDescriptor);
+    if (UNLIKELY(network->mapping == MAP_FAILED)) {
+	network->mapping = NULL;
+	return ERROR_MMAP_FAILED;
+    }
+
+    ErrorCode error = planNetwork(network);
+    if (error == ERROR_NONE) {
+	error = planArena(network);
+    }
+    if (UNLIKELY(error != ERROR_NONE)) {
+	Network_unload(network);
+	return error;
+    }
+    return ERROR_NONE;
+}
+
+void Network_unload(Network *network) {
+    free(network->arena);
+    network->arena = NULL;
+    if (network->mapping != NULL) {
+	munmap(network->mapping, network->mapping_size);
+	network->mapping = NULL;
+    }
+}
+
+// the input has its own buffer so a filled input survives repeated runs
+unsigned char *Network_input(Network *network) {
+    memset(network->input_tensor, 0, tensorBytes(network->input));
+    return network->input_tensor;
+}
+
+static int horizontalSum(const __m256i vector) {
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(vector),
+				_mm256_extracti128_si256(vector, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+// activations never exceed 127 so the u8 x s8 pair sums cannot saturate
+static int dotProduct(const unsigned char *activations,
+		      const signed char *weights, const size_t length) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum0 = _mm256_setzero_si256();
+    __m256i sum1 = _mm256_setzero_si256();
+    size_t index = 0;
+    for (; index + 64 <= length; index += 64) {
+	const __m256i products0 = _mm256_maddubs_epi16(
+	    _mm256_load_si256((const __m256i *)(activations + index)),
+	    _mm256_loadu_si256((const __m256i *)(weights + index)));
+	const __m256i products1 = _mm256_maddubs_epi16(
+	    _mm256_load_si256((const __m256i *)(activations + index + 32)),
+	    _mm256_loadu_si256((const __m256i *)(weights + index + 32)));
+	sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(products0, ones));
+	sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(products1, ones));
+    }
+    if (index < length) {
+	const __m256i products = _mm256_maddubs_epi16(
+	    _mm256_load_si256((const __m256i *)(activations + index)),
+	    _mm256_loadu_si256((const __m256i *)(weights + index)));
+	sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(products, ones));
+    }
+    return horizontalSum(_mm256_add_epi32(sum0, sum1));
+}
+
+// (accumulator + bias) * scale rounded and clamped into [0, 127], padded
+// channels carry zero accumulators and biases so they stay zero
+static void requantize(const int *accumulators, const int *biases,
+		       const float scale, unsigned char *output,
+		       const unsigned int count) {
+    const __m256 scales = _mm256_set1_ps(scale);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i limit = _mm256_set1_epi32(ACTIVATION_MAX);
+    const __m256i gather = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+    for (unsigned int index = 0; index < count; index += 8) {
+	__m256i values = _mm256_add_epi32(
+	    _mm256_load_si256((const __m256i *)(accumulators + index)),
+	    _mm256_loadu_si256((const __m256i *)(biases + index)));
+	values = _mm256_cvtps_epi32(
+	    _mm256_mul_ps(_mm256_cvtepi32_ps(values), scales));
+	values = _mm256_min_epi32(_mm256_max_epi32(values, zero), limit);
+	values = _mm256_packs_epi32(values, values);
+	values = _mm256_packus_epi16(values, values);
+	values = _mm256_permutevar8x32_epi32(values, gather);
+	_mm_storel_epi64((__m128i *)(output + index),
+			 _mm256_castsi256_si128(values));
+    }
+}
+
+static void runConv(const NetworkLayer *layer, const unsigned char *input,
+		    unsigned char *output, unsigned char *patch,
+		    int *accumulators) {
+    const TensorShape in = layer->input;
+    const TensorShape out = layer->output;
+    const int pad = (int)layer->kernel / 2;
+    const size_t kernelBytes =
+	(size_t)layer->kernel * layer->kernel * in.padded_channels;
+
+    memset(accumulators, 0, out.padded_channels * sizeof(int));
+    for (unsigned int y = 0; y < out.height; ++y) {
+	for (unsigned int x = 0; x < out.width; ++x) {
+	    unsigned char *cursor = patch;
+	    for (unsigned int ky = 0; ky < layer->kernel; ++ky) {
+		const int sourceY = (int)(y * layer->stride + ky) - pad;
+		for (unsigned int kx = 0; kx < layer->kernel; ++kx) {
+		    const int sourceX = (int)(x * layer->stride + kx) - pad;
+		    if (sourceY < 0 || sourceY >= (int)in.height ||
+			sourceX < 0 || sourceX >= (int)in.width) {
+			memset(cursor, 0, in.padded_channels);
+		    } else {
+			memcpy(cursor,
+			       input + ((size_t)sourceY * in.width +
+					(size_t)sourceX) *
+					   in.padded_channels,
+			       in.padded_channels);
+		    }
+		    cursor += in.padded_channels;
+		}
+	    }
+
+	    for (unsigned int channel = 0; channel < out.channels; ++channel) {
+		accumulators[channel] =
+		    dotProduct(patch, layer->weights + channel * kernelBytes,
+			       kernelBytes);
+	    }
+	    const size_t pixel = (size_t)y * out.width + x;
+	    requantize(accumulators, layer->biases, layer->scale,
+		       output + pixel * out.padded_channels,
+		       out.padded_channels);
+	}
+    }
+}
+
+// 16 channels of one output pixel, the two taps of a pair are byte
+// interleaved so one maddubs applies both weights of every channel at once
+static void depthwiseBlock(const unsigned char *const *taps,
+			   const signed char *weights,
+			   const unsigned int paddedChannels,
+			   const unsigned int channel, int *accumulators) {
+    __m256i low = _mm256_setzero_si256();
+    __m256i high = _mm256_setzero_si256();
+    for (unsigned int pair = 0; pair < DEPTHWISE_PAIRS; ++pair) {
+	const unsigned char *first = taps[pair * 2];
+	const unsigned char *second = taps[pair * 2 + 1];
+	const __m128i a =
+	    first == NULL
+		? _mm_setzero_si128()
+		: _mm_load_si128((const __m128i *)(first + channel));
+	const __m128i b =
+	    second == NULL
+		? _mm_setzero_si128()
+		: _mm_load_si128((const __m128i *)(second + channel));
+	const __m256i interleaved = _mm256_set_m128i(_mm_unpackhi_epi8(a, b),
+						     _mm_unpacklo_epi8(a, b));
+	const signed char *pairWeights =
+	    weights + ((size_t)pair * paddedChannels + channel) * 2;
+	const __m256i products = _mm256_maddubs_epi16(
+	    interleaved, _mm256_loadu_si256((const __m256i *)pairWeights));
+	low = _mm256_add_epi32(
+	    low, _mm256_cvtepi16_epi32(_mm256_castsi256_si128(products)));
+	high = _mm256_add_epi32(
+	    high, _mm256_cvtepi16_epi32(_mm256_extracti128_si256(products, 1)));
+    }
+    _mm256_store_si256((__m256i *)(accumulators + channel), low);
+    _mm256_store_si256((__m256i *)(accumulators + channel + 8), high);
+}
+
+static void runDepthwise(const NetworkLayer *layer, const unsigned char *input,
+			 unsigned char *output, int *accumulators) {
+    const TensorShape in = layer->input;
+    const TensorShape out = layer->output;
+
+    for (unsigned int y = 0; y < out.height; ++y) {
+	for (unsigned int x = 0; x < out.width; ++x) {
+	    // tap 9 only pads the last pair and always reads as zero
+	    const unsigned char *taps[10] = {NULL};
+	    for (unsigned int tap = 0; tap < 9; ++tap) {
+		const int sourceY = (int)(y * layer->stride + tap / 3) - 1;
+		const int sourceX = (int)(x * layer->stride + tap % 3) - 1;
+		if (sourceY >= 0 && sourceY < (int)in.height && sourceX >= 0 &&
+		    sourceX < (int)in.width) {
+		    taps[tap] = input + ((size_t)sourceY * in.width +
+					 (size_t)sourceX) *
+					    in.padded_channels;
+		}
+	    }
+
+	    for (unsigned int channel = 0; channel < in.padded_channels;
+		 channel += 16) {
+		depthwiseBlock(taps, layer->weights, in.padded_channels,
+			       channel, accumulators);
+	    }
+	    const size_t pixel = (size_t)y * out.width + x;
+	    requantize(accumulators, layer->biases, layer->scale,
+		       output + pixel * out.padded_channels,
+		       out.padded_channels);
+	}
+    }
+}
+
+static void runMaxPool(const NetworkLayer *layer, const unsigned char *input,
+		       unsigned char *output) {
+    const TensorShape in = layer->input;
+    const TensorShape out = layer->output;
+
+    for (unsigned int y = 0; y < out.height; ++y) {
+	for (unsigned int x = 0; x < out.width; ++x) {
+	    unsigned char *target =
+		output + ((size_t)y * out.width + x) * out.padded_channels;
+	    for (unsigned int channel = 0; channel < in.padded_channels;
+		 channel += 32) {
+		__m256i maximum = _mm256_setzero_si256();
+		for (unsigned int ky = 0; ky < layer->kernel; ++ky) {
+		    const unsigned char *row =
+			input + ((size_t)(y * layer->kernel + ky) * in.width +
+				 (size_t)x * layer->kernel) *
+				    in.padded_channels;
+		    for (unsigned int kx = 0; kx < layer->kernel; ++kx) {
+			const unsigned char *source =
+			    row + kx * in.padded_channels + channel;
+			const __m256i values =
+			    _mm256_load_si256((const __m256i *)source);
+			maximum = _mm256_max_epu8(maximum, values);
+		    }
+		}
+		_mm256_store_si256((__m256i *)(target + channel), maximum);
+	    }
+	}
+    }
+}
+
+static void runDense(const NetworkLayer *layer, const unsigned char *input,
+		     unsigned char *output, int *accumulators, int *logits) {
+    const size_t inputBytes = tensorBytes(layer->input);
+    const TensorShape out = layer->output;
+    const bool keepLogits = (layer->flags & LAYER_FLAG_LOGITS) != 0;
+
+    memset(accumulators, 0, out.padded_channels * sizeof(int));
+    for (unsigned int channel = 0; channel < out.channels; ++channel) {
+	const signed char *weights = layer->weights + channel * inputBytes;
+	accumulators[channel] = dotProduct(input, weights, inputBytes);
+    }
+    if (keepLogits) {
+	for (unsigned int channel = 0; channel < out.channels; ++channel) {
+	    logits[channel] = accumulators[channel] + layer->biases[channel];
+	}
+	return;
+    }
+    requantize(accumulators, layer->biases, layer->scale, output,
+	       out.padded_channels);
+}
+
+ErrorCode Network_run(Network *network, int *bestClass) {
+    if (UNLIKELY(network->arena == NULL)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+
+    for (int index = 0; index < network->layer_count; ++index) {
+	const NetworkLayer *layer = &network->layers[index];
+	const unsigned char *input =
+	    index == 0 ? network->input_tensor
+		       : network->activations[(index + 1) & 1];
+	unsigned char *output = network->activations[index & 1];
+	switch (layer->type) {
+	    case LAYER_CONV:
+		runConv(layer, input, output, network->patch,
+			network->accumulators);
+		break;
+	    case LAYER_DEPTHWISE:
+		runDepthwise(layer, input, output, network->accumulators);
+		break;
+	    case LAYER_MAXPOOL:
+		runMaxPool(layer, input, output);
+		break;
+	    case LAYER_DENSE:
+		runDense(layer, input, output, network->accumulators,
+			 network->logits);
+		break;
+	    default:
+		return ERROR_INVALID_ARGUMENT;
+	}
+    }
+
+    int best = 0;
+    for (int index = 1; index < network->class_count; ++index) {
+	if (network->logits[index] > network->logits[best]) {
+	    best = index;
+	}
+    }
+    *bestClass = best;
+    return ERROR_NONE;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "types.h"
+
+#define NETWORK_MAX_LAYERS 16
+#define NETWORK_MAX_CLASSES 32
+#define NETWORK_MAGIC "HMNN"
+#define NETWORK_VERSION 1U
+// channel padding and blob offset alignment
+#define NETWORK_ALIGNMENT 32U
+
+/*
+    Weight file layout, little endian, every offset 32 byte aligned:
+
+    NetworkHeader, then layer_count NetworkLayerRecord, then blobs.
+
+    Activations are HWC uint8 in [0, 127] with channels padded to 32, every
+    layer but the last applies ReLU by clamping its requantized output
+    (accumulator * scale) to that range, the last layer sets
+    LAYER_FLAG_LOGITS and keeps its int32 accumulators.
+    conv/dense weights are [out][k] int8 with k = kernel * kernel * padded
+    input channels (dense: height * width * padded channels), depthwise
+    weights are 3x3 as [5 tap pairs][padded channels][2] int8 (tap 9 is zero),
+    biases are int32 per padded output channel and zero in the padding.
+    maxpool has no blobs and uses its kernel as stride.
+*/
+typedef struct {
+    char magic[4];
+    unsigned int version;
+    unsigned int layer_count;
+    unsigned int input_height;
+    unsigned int input_width;
+    unsigned int input_channels;
+    unsigned int class_count;
+    unsigned int reserved;
+} __attribute__((aligned(32))) NetworkHeader;
+
+typedef struct {
+    unsigned int type;
+    unsigned int flags;
+    unsigned int kernel;
+    unsigned int stride;
+    unsigned int output_channels;
+    float scale;
+    unsigned int weight_offset;
+    unsigned int bias_offset;
+} __attribute__((aligned(32))) NetworkLayerRecord;
+
+typedef enum {
+    LAYER_CONV = 1,
+    LAYER_DEPTHWISE = 2,
+    LAYER_MAXPOOL = 3,
+    LAYER_DENSE = 4
+} LayerType;
+
+typedef enum { LAYER_FLAG_LOGITS = 1 } LayerFlags;
+
+typedef struct {
+    unsigned int height;
+    unsigned int width;
+    unsigned int channels;
+    unsigned int padded_channels;
+} __attribute__((aligned(16))) TensorShape;
+
+typedef struct {
+    const signed char *weights;
+    const int *biases;
+    TensorShape input;
+    TensorShape output;
+    LayerType type;
+    unsigned int flags;
+    unsigned int kernel;
+    unsigned int stride;
+    float scale;
+} __attribute__((aligned(64))) NetworkLayer;
+
+typedef struct {
+    NetworkLayer layers[NETWORK_MAX_LAYERS];
+    int logits[NETWORK_MAX_CLASSES];
+    void *mapping;
+    size_t mapping_size;
+    unsigned char *arena;
+    unsigned char *input_tensor;
+    unsigned char *activations[2];
+    unsigned char *patch;
+    int *accumulators;
+    TensorShape input;
+    int layer_count;
+    int class_count;
+} __attribute__((aligned(64))) Network;
+
+ErrorCode Network_load(Network *network, const char *path);
+
+void Network_unload(Network *network);
+
+unsigned char *Network_input(Network *network);
+
+ErrorCode Network_run(Network *network, int *bestClass);
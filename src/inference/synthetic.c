@@ -0,0 +1,222 @@
+/*
+    Seeded random int8 model files for benchmarks and tests, exposed api is
+    in `synthetic.h`
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "synthetic.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "branch.h"
+#include "network.h"
+#include "types.h"
+
+// weights stay well inside int8 so the pairwise maddubs sums have room
+static const int WEIGHT_RANGE = 48;
+static const unsigned int DEPTHWISE_TAPS = 9;
+static const unsigned int DEPTHWISE_PAIRS = 5;
+
+typedef struct {
+    TensorShape input;
+    TensorShape output;
+    size_t weight_bytes;
+    unsigned int fan_in;
+    unsigned int weight_offset;
+    unsigned int bias_offset;
+} __attribute__((aligned(64))) LayerPlan;
+
+static unsigned int padChannels(const unsigned int channels) {
+    return (channels + NETWORK_ALIGNMENT - 1) & ~(NETWORK_ALIGNMENT - 1);
+}
+
+static size_t alignOffset(const size_t offset) {
+    return (offset + NETWORK_ALIGNMENT - 1) &
+	   ~(size_t)(NETWORK_ALIGNMENT - 1);
+}
+
+static unsigned int nextRandom(unsigned int *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static int randomBetween(unsigned int *state, const int range) {
+    return (int)(nextRandom(state) % (unsigned int)((2 * range) + 1)) - range;
+}
+
+// the shapes Network_load will plan, mirrored so blobs can be sized
+static bool planLayer(const SyntheticLayer *layer, LayerPlan *plan) {
+    const TensorShape input = plan->input;
+    TensorShape *output = &plan->output;
+    switch (layer->type) {
+	case LAYER_CONV:
+	    output->height = (input.height + layer->stride - 1) / layer->stride;
+	    output->width = (input.width + layer->stride - 1) / layer->stride;
+	    output->channels = layer->output_channels;
+	    plan->fan_in = layer->kernel * layer->kernel * input.channels;
+	    plan->weight_bytes = (size_t)output->channels * layer->kernel *
+				 layer->kernel * input.padded_channels;
+	    break;
+	case LAYER_DEPTHWISE:
+	    output->height = (input.height + layer->stride - 1) / layer->stride;
+	    output->width = (input.width + layer->stride - 1) / layer->stride;
+	    output->channels = input.channels;
+	    plan->fan_in = DEPTHWISE_TAPS;
+	    plan->weight_bytes =
+		(size_t)DEPTHWISE_PAIRS * input.padded_channels * 2;
+	    break;
+	case LAYER_MAXPOOL:
+	    if (UNLIKELY(layer->kernel < 2)) {
+		return false;
+	    }
+	    output->height = input.height / layer->kernel;
+	    output->width = input.width / layer->kernel;
+	    output->channels = input.channels;
+	    break;
+	case LAYER_DENSE:
+	    output->height = 1;
+	    output->width = 1;
+	    output->channels = layer->output_channels;
+	    plan->fan_in = input.height * input.width * input.channels;
+	    plan->weight_bytes = (size_t)output->channels * input.height *
+				 input.width * input.padded_channels;
+	    break;
+	default:
+	    return false;
+    }
+    output->padded_channels = padChannels(output->channels);
+    return output->height > 0 && output->width > 0;
+}
+
+// one weight per real input channel, the padding stays zero like the
+// activations it multiplies
+static void fillWeights(const SyntheticLayer *layer, const LayerPlan *plan,
+			signed char *weights, unsigned int *state) {
+    const TensorShape input = plan->input;
+    if (layer->type == LAYER_DEPTHWISE) {
+	for (unsigned int tap = 0; tap < DEPTHWISE_TAPS; ++tap) {
+	    for (unsigned int channel = 0; channel < input.channels;
+		 ++channel) {
+		const size_t pair =
+		    ((size_t)(tap / 2) * input.padded_channels) + channel;
+		weights[(pair * 2) + (tap % 2)] =
+		    (signed char)randomBetween(state, WEIGHT_RANGE);
+	    }
+	}
+	return;
+    }
+    const size_t rowBytes = plan->weight_bytes / plan->output.channels;
+    for (size_t index = 0; index < plan->weight_bytes; ++index) {
+	const size_t channel = (index % rowBytes) % input.padded_channels;
+	if (channel < input.channels) {
+	    weights[index] = (signed char)randomBetween(state, WEIGHT_RANGE);
+	}
+    }
+}
+
+/*
+    A weighted sum of fan_in inputs spread over 0..127 has a standard
+    deviation near sqrt(fan_in) * WEIGHT_RANGE * 43, scaling by the inverse
+    keeps about a third of the activation range in use layer after layer
+*/
+static float layerScale(const LayerPlan *plan) {
+    return 1.0F / (sqrtf((float)plan->fan_in) * (float)WEIGHT_RANGE);
+}
+
+static void fillBiases(const LayerPlan *plan, int *biases,
+		       unsigned int *state) {
+    const int range =
+	(int)(sqrtf((float)plan->fan_in) * (float)WEIGHT_RANGE * 8.0F);
+    for (unsigned int channel = 0; channel < plan->output.channels;
+	 ++channel) {
+	biases[channel] = randomBetween(state, range);
+    }
+}
+
+ErrorCode SyntheticNetwork_write(const SyntheticNetwork *network,
+				 const char *path) {
+    const int layerCount = network->layer_count;
+    if (UNLIKELY(layerCount <= 0 || layerCount > NETWORK_MAX_LAYERS ||
+		 network->layers[layerCount - 1].type != LAYER_DENSE)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+
+    LayerPlan plans[NETWORK_MAX_LAYERS];
+    memset(plans, 0, sizeof(plans));
+    TensorShape shape = {.height = network->input_height,
+			 .width = network->input_width,
+			 .channels = network->input_channels};
+    shape.padded_channels = padChannels(shape.channels);
+    size_t offset = sizeof(NetworkHeader) +
+		    ((size_t)layerCount * sizeof(NetworkLayerRecord));
+    for (int index = 0; index < layerCount; ++index) {
+	LayerPlan *plan = &plans[index];
+	plan->input = shape;
+	if (UNLIKELY(!planLayer(&network->layers[index], plan))) {
+	    return ERROR_INVALID_ARGUMENT;
+	}
+	if (plan->weight_bytes > 0) {
+	    offset = alignOffset(offset);
+	    plan->weight_offset = (unsigned int)offset;
+	    offset = alignOffset(offset + plan->weight_bytes);
+	    plan->bias_offset = (unsigned int)offset;
+	    offset += (size_t)plan->output.padded_channels * sizeof(int);
+	}
+	shape = plan->output;
+    }
+
+    unsigned char *file = (unsigned char *)calloc(1, alignOffset(offset));
+    if (UNLIKELY(file == NULL)) {
+	return ERROR_ALLOCATION_FAILED;
+    }
+    NetworkHeader header = {
+	.version = NETWORK_VERSION,
+	.layer_count = (unsigned int)layerCount,
+	.input_height = network->input_height,
+	.input_width = network->input_width,
+	.input_channels = network->input_channels,
+	.class_count = shape.channels};
+    memcpy(header.magic, NETWORK_MAGIC, sizeof(header.magic));
+    memcpy(file, &header, sizeof(header));
+
+    unsigned int state = network->seed != 0 ? network->seed : 1;
+    for (int index = 0; index < layerCount; ++index) {
+	const SyntheticLayer *layer = &network->layers[index];
+	const LayerPlan *plan = &plans[index];
+	const bool last = index == layerCount - 1;
+	NetworkLayerRecord record = {
+	    .type = layer->type,
+	    .flags = last ? LAYER_FLAG_LOGITS : 0,
+	    .kernel = layer->kernel,
+	    .stride = layer->stride,
+	    .output_channels = plan->output.channels,
+	    .scale = plan->weight_bytes > 0 ? layerScale(plan) : 1.0F,
+	    .weight_offset = plan->weight_offset,
+	    .bias_offset = plan->bias_offset};
+	memcpy(file + sizeof(header) + ((size_t)index * sizeof(record)),
+	       &record, sizeof(record));
+	if (plan->weight_bytes > 0) {
+	    fillWeights(layer, plan,
+			(signed char *)(file + plan->weight_offset), &state);
+	    fillBiases(plan, (int *)(void *)(file + plan->bias_offset),
+		       &state);
+	}
+    }
+
+    FILE *output = fopen(path, "wb");
+    bool written = output != NULL &&
+		   fwrite(file, 1, alignOffset(offset), output) ==
+		       alignOffset(offset);
+    if (output != NULL && fclose(output) != 0) {
+	written = false;
+    }
+    free(file);
+    return written ? ERROR_NONE : ERROR_FILE_OPEN_FAILED;
+}
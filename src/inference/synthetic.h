@@ -0,0 +1,32 @@
+#pragma once
+
+#include "network.h"
+#include "types.h"
+
+// kernel and stride as in NetworkLayerRecord, output_channels is ignored
+// for depthwise and maxpool layers, they keep their input's
+typedef struct {
+    LayerType type;
+    unsigned int kernel;
+    unsigned int stride;
+    unsigned int output_channels;
+} __attribute__((aligned(16))) SyntheticLayer;
+
+/*
+    A model file with seeded random weights for a layer list, scaled so
+    activations spread over their range instead of saturating or dying out,
+    the last layer has to be dense and becomes the logits. Nothing it
+    classifies means anything, it exists to time Network_run and check it
+    against a reference without a trained model in the tree.
+*/
+typedef struct {
+    const SyntheticLayer *layers;
+    int layer_count;
+    unsigned int input_height;
+    unsigned int input_width;
+    unsigned int input_channels;
+    unsigned int seed;
+} __attribute__((aligned(32))) SyntheticNetwork;
+
+ErrorCode SyntheticNetwork_write(const SyntheticNetwork *network,
+				 const char *path);
@@ -1,109 +1,845 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "branch.h"
+#include "camera.h"
 #include "capture.h"
+#include "engine.h"
+#include "fingers.h"
+#include "latency.h"
+#include "loop.h"
+#include "mapping.h"
+#include "output.h"
+#include "overlay.h"
+#include "pipeline.h"
+#include "publisher.h"
 #include "rgb.h"
+#include "sink.h"
+#include "synth.h"
+#include "trace.h"
 #include "types.h"
 #include "window.h"
 #include "yuyv.h"
 
 #define DEVICE_PATH "/dev/video0"
+#define GESTURE_MODEL_VARIABLE "HM_GESTURE_MODEL"
+#define AUDIO_DEVICE "default"
+#define AUDIO_WAV_VARIABLE "HM_AUDIO_WAV"
+#define MIDI_VARIABLE "HM_MIDI"
+#define MIDI_MAP_VARIABLE "HM_MIDI_MAP"
+#define MIDI_ALSA_TARGET "alsa"
+#define MIDI_CLIENT_NAME "Hand Music"
+#define SINK_VARIABLE "HM_VIDEO_SINK"
+#define OVERLAY_VARIABLE "HM_OVERLAY"
+#define REPLAY_VARIABLE "HM_REPLAY"
+#define CAMERAS_VARIABLE "HM_CAMERAS"
+#define CAMERA_SEPARATOR ","
+#define PUBLISH_VARIABLE "HM_PUBLISH"
+#define DENOISE_VARIABLE "HM_DENOISE"
+#define TRACE_FILE_VARIABLE "HM_TRACE_FILE"
+#define TRACE_DEFAULT_FILE "hm-trace.json"
+#define SINK_NULL_NAME "null"
+#define SINK_STREAM_PREFIX "raw:"
+#define SINK_SNAPSHOT_PREFIX "ppm:"
+#define STATS_NAME_LENGTH 32
 
 static const unsigned short int FRAME_WIDTH = 640;
 static const unsigned short int FRAME_HEIGHT = 480;
+// replays play at the rate the camera delivers
+static const unsigned int REPLAY_FPS = 30;
+
+// one snapshot a second at the camera's 30 fps
+static const unsigned int SNAPSHOT_INTERVAL = 30;
+
+#ifdef HM_TRACE
+// seconds between trace dumps and summaries
+static const unsigned int TRACE_INTERVAL = 5;
+#endif
+
+// how often a stalled camera is looked for
+static const unsigned long long WATCHDOG_INTERVAL = 1000000000ULL;
+// longest a camera's result waits for an older one from a slower camera,
+// also how often waiting results are looked at again
+static const unsigned long long MERGE_WINDOW = 20000000ULL;
+
+// 64 frame blocks with three queued keep audio under 5 ms behind a gesture
+static const AudioFormat AUDIO_FORMAT = {.sample_rate = 48000,
+					 .channels = 2,
+					 .block_frames = 64,
+					 .buffer_blocks = 3};
+
+static unsigned long long toNanoseconds(const struct timespec *time) {
+    return ((unsigned long long)time->tv_sec * 1000000000ULL) +
+	   (unsigned long long)time->tv_nsec;
+}
+
+// sound is optional, without a device the app keeps running silently
+static ErrorCode startAudio(AudioOutput *output, AudioEngine *engine,
+			    Synth *synth, const int notifyDescriptor) {
+    const char *wavPath = getenv(AUDIO_WAV_VARIABLE);
+    ErrorCode error =
+	wavPath != NULL
+	    ? AudioOutput_openWav(output, wavPath, AUDIO_FORMAT, true)
+	    : AudioOutput_openAlsa(output, AUDIO_DEVICE, AUDIO_FORMAT);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+    error = Synth_create(synth, AUDIO_FORMAT.sample_rate,
+			 AUDIO_FORMAT.block_frames, SYNTH_CUBIC);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	AudioOutput_close(output);
+	return error;
+    }
+    const AudioRenderer renderer = {
+	.context = synth, .control = Synth_control, .render = Synth_render};
+    error = AudioEngine_start(engine, output, &renderer, notifyDescriptor);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	Synth_destroy(synth);
+	AudioOutput_close(output);
+    }
+    return error;
+}
+
+// HM_MIDI names a .mid file or "alsa" for a sequencer port, HM_MIDI_MAP an
+// optional mapping table replacing the default one
+static ErrorCode startMidi(MidiSink *sink, MidiMapper *mapper) {
+    const char *target = getenv(MIDI_VARIABLE);
+    const char *mapPath = getenv(MIDI_MAP_VARIABLE);
+    MidiMapping table[MIDI_MAX_MAPPINGS];
+    int count = 0;
+    const MidiMapping *mappings = MidiMapper_defaultTable(&count);
+
+    if (target == NULL) {
+	return ERROR_UNSUPPORTED_OPERATION;
+    }
+    if (mapPath != NULL) {
+	const ErrorCode error =
+	    MidiMapper_loadTable(mapPath, table, MIDI_MAX_MAPPINGS, &count);
+	if (UNLIKELY(error != ERROR_NONE)) {
+	    return error;
+	}
+	mappings = table;
+    }
+    const ErrorCode error = MidiMapper_init(mapper, mappings, count);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+    return strcmp(target, MIDI_ALSA_TARGET) == 0
+	       ? MidiSink_openAlsa(sink, MIDI_CLIENT_NAME)
+	       : MidiSink_openFile(sink, target);
+}
+
+// HM_VIDEO_SINK picks where frames go: unset for the X11 window, "null",
+// "raw:<path>" for a BGRA stream ("raw:-" is stdout) or "ppm:<prefix>" for
+// periodic snapshots, headless sinks need no display server at all
+static ErrorCode openDisplay(WindowState *window,
+			     const FrameDimensions dimensions) {
+    const char *sink = getenv(SINK_VARIABLE);
+    const size_t streamLength = strlen(SINK_STREAM_PREFIX);
+    const size_t snapshotLength = strlen(SINK_SNAPSHOT_PREFIX);
+
+    if (sink == NULL) {
+	return Window_create(window, "Hand Music", dimensions);
+    }
+    if (strcmp(sink, SINK_NULL_NAME) == 0) {
+	return Window_openNull(window, dimensions);
+    }
+    if (strncmp(sink, SINK_STREAM_PREFIX, streamLength) == 0) {
+	return Window_openStream(window, sink + streamLength, dimensions);
+    }
+    if (strncmp(sink, SINK_SNAPSHOT_PREFIX, snapshotLength) == 0) {
+	return Window_openSnapshots(window, sink + snapshotLength,
+				    SNAPSHOT_INTERVAL, dimensions);
+    }
+    return ERROR_INVALID_ARGUMENT;
+}
+
+static unsigned long long nowNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return toNanoseconds(&now);
+}
+
+static float secondsSince(struct timespec *last) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const float elapsed = (float)(now.tv_sec - last->tv_sec) +
+			  ((float)(now.tv_nsec - last->tv_nsec) * 1e-9F);
+    *last = now;
+    return elapsed;
+}
+
+// capture-relative ones are measured from the frame's capture timestamp,
+// the rest are how long that step itself took
+typedef enum {
+    LATENCY_CAPTURE = 0,  // capture to dequeue
+    LATENCY_RECOGNITION,
+    LATENCY_TRIGGER,  // capture to controls sent
+    LATENCY_PRESENT,
+    LATENCY_DISPLAY,  // capture to presented
+    LATENCY_STAGE_COUNT
+} LatencyStage;
+
+static const char *const LATENCY_NAMES[LATENCY_STAGE_COUNT] = {
+    "capture", "recognition", "trigger", "present", "display"};
+
+// everything the loop handlers share, owned by main
+typedef struct {
+    LatencyHistogram latencies[LATENCY_STAGE_COUNT];
+    CameraWorker workers[CAMERA_MAX_DEVICES - 1];
+    CameraQueue queue;
+    CameraMerger merger;
+    CaptureDevice capture;
+    WindowState window;
+    HandPipeline pipeline;
+    AudioOutput audio_output;
+    AudioEngine audio_engine;
+    Synth synth;
+    FingerControl finger_controls[CAMERA_MAX_DEVICES];
+    MidiSink midi_sink;
+    MidiMapper midi_mapper;
+    MidiBatch midi_batch;
+    Publisher publisher;
+    CaptureFrame frame;
+    FrameDimensions dimensions;
+    const char *sources[CAMERA_MAX_DEVICES];
+    char *camera_list;
+    unsigned char *rgb_buffer;
+    unsigned long long frames;
+    unsigned long long dropped_frames;
+    unsigned int frames_since_tick;
+    ErrorCode audio_err;
+    ErrorCode midi_err;
+    ErrorCode publish_err;
+    ErrorCode worker_err[CAMERA_MAX_DEVICES - 1];
+    int camera_count;
+    bool worker_failed[CAMERA_MAX_DEVICES - 1];
+    bool gesture_reported[CAMERA_MAX_DEVICES];
+    bool overlay;
+    bool stalled;
+    bool sequenced;
+} __attribute__((aligned(64))) Application;
+
+// milliseconds, safe while frames and audio keep recording
+static void printStats(const Application *app) {
+    (void)fprintf(stderr, "%-14s %8s %9s %9s %9s %9s\n", "latency ms",
+		  "count", "p50", "p99", "p99.9", "max");
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; ++stage) {
+	LatencyHistogram_print(&app->latencies[stage], LATENCY_NAMES[stage],
+			       stderr);
+    }
+    if (app->audio_err == ERROR_NONE) {
+	LatencyHistogram_print(AudioEngine_latency(&app->audio_engine),
+			       "motion-sound", stderr);
+    }
+    (void)fprintf(stderr,
+		  "camera 0: %llu frames, %llu dropped, %llu without gesture\n",
+		  app->frames, app->dropped_frames,
+		  app->pipeline.gesture_failures);
+    for (int index = 0; index < app->camera_count - 1; ++index) {
+	const CameraWorker *worker = &app->workers[index];
+	if (app->worker_err[index] != ERROR_NONE) {
+	    continue;
+	}
+	char name[STATS_NAME_LENGTH];
+	(void)snprintf(name, sizeof(name), "recognition %d", index + 1);
+	LatencyHistogram_print(&worker->recognition, name, stderr);
+	(void)fprintf(
+	    stderr,
+	    "camera %d: %llu frames, %llu dropped, %llu overrun, %llu "
+	    "without gesture\n",
+	    index + 1,
+	    atomic_load_explicit(&worker->frames, memory_order_relaxed),
+	    atomic_load_explicit(&worker->dropped_frames, memory_order_relaxed),
+	    atomic_load_explicit(&worker->queue.overruns, memory_order_relaxed),
+	    atomic_load_explicit(&worker->gesture_failures,
+				 memory_order_relaxed));
+    }
+    if (app->camera_count > 1) {
+	(void)fprintf(stderr, "%llu results merged too late\n",
+		      app->merger.late);
+    }
+}
+
+static void recordSince(Application *app, const LatencyStage stage,
+			const unsigned long long start,
+			const unsigned long long end) {
+    LatencyHistogram_record(&app->latencies[stage],
+			    end > start ? end - start : 0);
+}
+
+// HM_CAMERAS is a comma separated list of sources, see
+// CaptureDevice_openSource, the first is shown and drives midi, without it
+// the replay file or the default device is the only camera
+static void parseSources(Application *app, const char *replayPath) {
+    const char *list = getenv(CAMERAS_VARIABLE);
+    app->camera_count = 1;
+    app->sources[0] = replayPath != NULL ? replayPath : DEVICE_PATH;
+    if (list == NULL || (app->camera_list = strdup(list)) == NULL) {
+	return;
+    }
+    char *state = NULL;
+    app->camera_count = 0;
+    for (char *source = strtok_r(app->camera_list, CAMERA_SEPARATOR, &state);
+	 source != NULL && app->camera_count < CAMERA_MAX_DEVICES;
+	 source = strtok_r(NULL, CAMERA_SEPARATOR, &state)) {
+	app->sources[app->camera_count++] = source;
+    }
+    if (app->camera_count == 0) {
+	free(app->camera_list);
+	app->camera_list = NULL;
+	app->camera_count = 1;
+    }
+}
+
+static void stopAudio(Application *app) {
+    (void)fprintf(stderr, "Audio latency over vision: worst %llu us\n",
+		  AudioEngine_worstLatency(&app->audio_engine) / 1000ULL);
+    AudioEngine_stop(&app->audio_engine);
+    Synth_destroy(&app->synth);
+    AudioOutput_close(&app->audio_output);
+}
+
+// the flip lands straight in the window's buffer, a frame is only skipped
+// on screen while the server still reads both buffers
+static bool presentFrame(Application *app) {
+    const unsigned char *yuyvFrame = app->frame.data;
+    unsigned char *windowPixels = Window_frameBuffer(&app->window);
+    if (windowPixels == NULL) {
+	return false;
+    }
+    TRACE_BEGIN(TRACE_CONVERT);
+    ErrorCode error = yuyvToRgb(yuyvFrame, app->rgb_buffer, &app->dimensions);
+    if (error != ERROR_NONE) {
+	(void)fprintf(stderr, "Failed to convert YUYV to RGB: ErrorCode %d\n",
+		      error);
+	TRACE_END(TRACE_CONVERT);
+	return true;
+    }
+    error = flipRgbHorizontal(app->rgb_buffer, windowPixels, &app->dimensions);
+    if (error != ERROR_NONE) {
+	(void)fprintf(stderr, "Failed to flip RGB horizontally: ErrorCode %d\n",
+		      error);
+	TRACE_END(TRACE_CONVERT);
+	return true;
+    }
+    TRACE_END(TRACE_CONVERT);
+    if (app->overlay) {
+	TRACE_BEGIN(TRACE_OVERLAY);
+	const OverlayTarget target = {.pixels = windowPixels,
+				      .dimensions = app->dimensions,
+				      .mirrored = true};
+	Overlay_drawPipeline(&target, &app->pipeline);
+	TRACE_END(TRACE_OVERLAY);
+    }
+    TRACE_BEGIN(TRACE_PRESENT);
+    Window_present(&app->window);
+    TRACE_END(TRACE_PRESENT);
+    return false;
+}
+
+static void sendVoices(Application *app, const int camera,
+		       const FingertipTracker *tracker, const Gesture gesture,
+		       const unsigned long long timestamp) {
+    ControlMessage messages[FINGER_MAX_MESSAGES];
+    const int messageCount =
+	FingerControl_update(&app->finger_controls[camera], tracker, gesture,
+			     app->dimensions, timestamp, messages);
+    for (int index = 0; index < messageCount; ++index) {
+	AudioEngine_send(&app->audio_engine, &messages[index]);
+    }
+}
+
+// every camera plays its own voices, the midi mapping table addresses the
+// fingers of one view so only the main camera drives midi
+static void sendControls(Application *app, const CameraResult *result) {
+    const unsigned long long timestamp = result->timestamp;
+    if (LIKELY(app->audio_err == ERROR_NONE)) {
+	sendVoices(app, result->camera, &result->tracker, result->gesture,
+		   timestamp);
+    }
+
+    if (app->midi_err == ERROR_NONE && result->camera == 0) {
+	MidiMapper_update(&app->midi_mapper, &result->tracker,
+			  result->gesture, app->dimensions, timestamp,
+			  &app->midi_batch);
+	app->midi_err = MidiSink_write(&app->midi_sink, &app->midi_batch);
+	if (UNLIKELY(app->midi_err != ERROR_NONE)) {
+	    (void)fprintf(stderr, "Failed to write midi: ErrorCode %d\n",
+			  app->midi_err);
+	    MidiSink_close(&app->midi_sink);
+	}
+    }
+}
+
+// hands every settled result from all cameras on in capture order
+static void deliverResults(Application *app) {
+    const CameraResult *result = NULL;
+    while ((result = CameraMerger_next(&app->merger, nowNanoseconds())) !=
+	   NULL) {
+	TRACE_BEGIN(TRACE_CONTROLS);
+	sendControls(app, result);
+	TRACE_END(TRACE_CONTROLS);
+	recordSince(app, LATENCY_TRIGGER, result->timestamp,
+		    nowNanoseconds());
+	// after the sound, other processes are never ahead of it
+	if (app->publish_err == ERROR_NONE) {
+	    Publisher_publish(&app->publisher, result);
+	}
+	CameraMerger_release(&app->merger);
+    }
+}
+
+// a failing classifier costs its frames their gesture and nothing else,
+// the first failure per camera is reported and the stats count the rest
+static void reportGesture(Application *app, const int camera,
+			  const unsigned long long failures,
+			  const ErrorCode error) {
+    if (LIKELY(failures == 0 || app->gesture_reported[camera])) {
+	return;
+    }
+    app->gesture_reported[camera] = true;
+    (void)fprintf(stderr,
+		  "Failed to classify gesture on camera %d: ErrorCode %d, "
+		  "continuing without gestures on those frames\n",
+		  camera, error);
+}
+
+// a gap in the sequence is frames the driver dropped while we were busy
+static void countDropped(Application *app, const unsigned int sequence,
+			 const unsigned int previous) {
+    if (app->sequenced && sequence - previous > 1) {
+	app->dropped_frames += sequence - previous - 1;
+    }
+    app->sequenced = true;
+}
+
+// capture descriptor readable, a filled buffer is waiting, every stage
+// after this works on app->frame and its capture timestamp, camera 0 is
+// recognised right here so the workers' results wait while it runs
+static bool onFrame(void *context) {
+    Application *app = (Application *)context;
+    const unsigned int previous = app->frame.sequence;
+    TRACE_BEGIN(TRACE_FRAME);
+    TRACE_BEGIN(TRACE_CAPTURE);
+    ErrorCode error = CaptureDevice_dequeue(&app->capture, &app->frame);
+    TRACE_END(TRACE_CAPTURE);
+    if (error != ERROR_NONE) {
+	(void)fprintf(stderr,
+		      "Failed to get frame from capture device: ErrorCode %d\n",
+		      error);
+	TRACE_END(TRACE_FRAME);
+	return true;
+    }
+    const unsigned long long dequeued = nowNanoseconds();
+    recordSince(app, LATENCY_CAPTURE, app->frame.timestamp, dequeued);
+    countDropped(app, app->frame.sequence, previous);
+    CameraQueue_begin(&app->queue, app->frame.timestamp);
+
+    error = HandPipeline_process(&app->pipeline, app->frame.data,
+				 app->frame.timestamp);
+    if (error != ERROR_NONE) {
+	(void)fprintf(stderr, "Failed to recognize hand: ErrorCode %d\n",
+		      error);
+	TRACE_END(TRACE_FRAME);
+	return true;
+    }
+    const unsigned long long recognized = nowNanoseconds();
+    recordSince(app, LATENCY_RECOGNITION, dequeued, recognized);
+    reportGesture(app, 0, app->pipeline.gesture_failures,
+		  app->pipeline.gesture_err);
+
+    (void)CameraQueue_push(&app->queue, &app->pipeline, &app->frame, 0);
+    deliverResults(app);
+    const unsigned long long triggered = nowNanoseconds();
+
+    // after recognition so the overlay matches the frame it is drawn on
+    if (presentFrame(app)) {
+	TRACE_END(TRACE_FRAME);
+	return true;
+    }
+    const unsigned long long presented = nowNanoseconds();
+    recordSince(app, LATENCY_PRESENT, triggered, presented);
+    recordSince(app, LATENCY_DISPLAY, app->frame.timestamp, presented);
+
+    app->frames++;
+    app->frames_since_tick++;
+    if (UNLIKELY(CaptureDevice_queue(&app->capture) != ERROR_NONE)) {
+	(void)fprintf(stderr, "Failed to requeue capture buffer\n");
+	TRACE_END(TRACE_FRAME);
+	return true;
+    }
+    TRACE_END(TRACE_FRAME);
+    return false;
+}
+
+// also run before every wait, Xlib may have read events off the socket
+// already and those would not wake epoll again
+static bool onDisplay(void *context) {
+    Application *app = (Application *)context;
+    return Window_pollEvents(&app->window);
+}
+
+// the loop no longer runs at camera rate, so a camera that stops
+// delivering is reported instead of freezing the app silently
+static bool onWatchdog(void *context) {
+    Application *app = (Application *)context;
+    if (app->frames_since_tick == 0 && !app->stalled) {
+	(void)fprintf(stderr, "No frames from %s, still waiting\n",
+		      app->sources[0]);
+    }
+    app->stalled = app->frames_since_tick == 0;
+    app->frames_since_tick = 0;
+    return false;
+}
+
+// SIGUSR1 prints the live latency stats, `kill -USR1 <pid>`
+static bool onStats(void *context) {
+    printStats((const Application *)context);
+    return false;
+}
+
+// readers connecting to HM_PUBLISH's socket
+static bool onReader(void *context) {
+    Publisher_accept(&((Application *)context)->publisher);
+    return false;
+}
+
+// results that waited on a slower camera are due once the window passed
+static bool onMerge(void *context) {
+    deliverResults((Application *)context);
+    return false;
+}
+
+// a failed camera's fingers must not keep sounding, its queued results
+// are dropped first so none of them can start a note after the release
+static void checkCamera(Application *app, const int index) {
+    static const FingertipTracker NO_FINGERS;
+    CameraWorker *worker = &app->workers[index];
+    const ErrorCode error = CameraWorker_error(worker);
+    if (app->worker_failed[index] || error == ERROR_NONE) {
+	return;
+    }
+    app->worker_failed[index] = true;
+    (void)fprintf(stderr,
+		  "Camera %s failed: ErrorCode %d, continuing without it\n",
+		  worker->source, error);
+    CameraMerger_remove(&app->merger, &worker->queue);
+    if (app->audio_err == ERROR_NONE) {
+	sendVoices(app, index + 1, &NO_FINGERS, GESTURE_NONE,
+		   nowNanoseconds());
+    }
+}
+
+// a worker has results ready or finished on its own
+static bool onWorker(void *context) {
+    Application *app = (Application *)context;
+    for (int index = 0; index < app->camera_count - 1; ++index) {
+	if (app->worker_err[index] == ERROR_NONE) {
+	    checkCamera(app, index);
+	    const CameraWorker *worker = &app->workers[index];
+	    reportGesture(app, index + 1,
+			  atomic_load_explicit(&worker->gesture_failures,
+					       memory_order_relaxed),
+			  (ErrorCode)atomic_load_explicit(
+			      &worker->gesture_err, memory_order_relaxed));
+	}
+    }
+    deliverResults(app);
+    if (app->audio_err == ERROR_NONE &&
+	AudioEngine_error(&app->audio_engine) != ERROR_NONE) {
+	app->audio_err = AudioEngine_error(&app->audio_engine);
+	(void)fprintf(stderr,
+		      "Audio output failed: ErrorCode %d, continuing without "
+		      "sound\n",
+		      app->audio_err);
+	stopAudio(app);
+    }
+    return false;
+}
+
+static ErrorCode setupLoop(EventLoop *loop, Application *app,
+			   int *wakeDescriptor) {
+    ErrorCode error = EventLoop_create(loop);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+    error = EventLoop_watch(loop, app->capture.file_descriptor, onFrame, app);
+    if (LIKELY(error == ERROR_NONE && Window_connection(&app->window) >= 0)) {
+	error = EventLoop_watch(loop, Window_connection(&app->window),
+				onDisplay, app);
+    }
+    if (LIKELY(error == ERROR_NONE)) {
+	error = EventLoop_addTimer(loop, WATCHDOG_INTERVAL, onWatchdog, app);
+    }
+    if (LIKELY(error == ERROR_NONE)) {
+	error = EventLoop_addWake(loop, onWorker, app, wakeDescriptor);
+    }
+    if (LIKELY(error == ERROR_NONE)) {
+	error = EventLoop_addSignal(loop, SIGUSR1, onStats, app);
+    }
+    if (LIKELY(error == ERROR_NONE && app->camera_count > 1)) {
+	error = EventLoop_addTimer(loop, MERGE_WINDOW, onMerge, app);
+    }
+    if (LIKELY(error == ERROR_NONE && app->publish_err == ERROR_NONE)) {
+	error = EventLoop_watch(loop, Publisher_descriptor(&app->publisher),
+				onReader, app);
+    }
+    if (UNLIKELY(error != ERROR_NONE)) {
+	EventLoop_destroy(loop);
+	return error;
+    }
+    EventLoop_setIdle(loop, onDisplay, app);
+    return ERROR_NONE;
+}
 
 int main(void) {
-    FrameDimensions dimensions = {
+    static Application app;
+    app.dimensions = (FrameDimensions){
 	.width = FRAME_WIDTH,
 	.height = FRAME_HEIGHT,
 	.stride = FRAME_WIDTH * 2,  // YUYV format is 2 bytes per pixel
 	.pixels = FRAME_WIDTH * FRAME_HEIGHT};
 
-    CaptureDevice captureDevice = {0};
     ErrorCode capture_err = ERROR_NONE;
-    WindowState windowState = {0};
     ErrorCode window_err = ERROR_NONE;
-    unsigned char *rgbBuffer = NULL;
-    unsigned char *flippedRgbBuffer = NULL;
-    unsigned char *yuyvFrame = NULL;
-    bool quit = false;
+    ErrorCode pipeline_err = ERROR_ALLOCATION_FAILED;
+    ErrorCode loop_err = ERROR_UNSUPPORTED_OPERATION;
+    const char *modelPath = NULL;
+    const char *replayPath = getenv(REPLAY_VARIABLE);
+    const char *publishPath = getenv(PUBLISH_VARIABLE);
+    const bool denoise = getenv(DENOISE_VARIABLE) != NULL;
+    EventLoop loop;
+    int wakeDescriptor = -1;
+    struct timespec startTime;
 
-    capture_err = CaptureDevice_open(&captureDevice, DEVICE_PATH, dimensions);
+    app.audio_err = ERROR_UNSUPPORTED_OPERATION;
+    app.midi_err = ERROR_UNSUPPORTED_OPERATION;
+    app.publish_err = ERROR_UNSUPPORTED_OPERATION;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; ++stage) {
+	LatencyHistogram_reset(&app.latencies[stage]);
+    }
+    app.overlay = getenv(OVERLAY_VARIABLE) != NULL;
+    parseSources(&app, replayPath);
+    CameraQueue_init(&app.queue);
+    CameraMerger_init(&app.merger, MERGE_WINDOW);
+    (void)CameraMerger_add(&app.merger, &app.queue);
+    for (int index = 0; index < CAMERA_MAX_DEVICES; ++index) {
+	FingerControl_init(&app.finger_controls[index],
+			   index * TRACKER_MAX_TRACKS);
+    }
+    for (int index = 0; index < CAMERA_MAX_DEVICES - 1; ++index) {
+	app.worker_err[index] = ERROR_UNSUPPORTED_OPERATION;
+    }
+    // a stream reader going away must fail the write, not kill us
+    (void)signal(SIGPIPE, SIG_IGN);
+
+    // a recorded yuyv file instead of the camera, for repeatable runs
+    if (app.camera_list != NULL) {
+	capture_err = CaptureDevice_openSource(&app.capture, app.sources[0],
+					       app.dimensions, REPLAY_FPS);
+    } else if (replayPath != NULL) {
+	capture_err = CaptureDevice_openReplay(&app.capture, replayPath,
+					       app.dimensions, REPLAY_FPS);
+    } else {
+	capture_err =
+	    CaptureDevice_open(&app.capture, DEVICE_PATH, app.dimensions);
+    }
     if (UNLIKELY(capture_err != ERROR_NONE)) {
 	(void)fprintf(stderr,
 		      "Failed to open capture device %s: ErrorCode %d\n",
-		      DEVICE_PATH, capture_err);
+		      app.sources[0], capture_err);
 	goto cleanup;
     }
 
-    window_err = Window_create(&windowState, "Hand Music", dimensions);
+    window_err = openDisplay(&app.window, app.dimensions);
     if (UNLIKELY(window_err != ERROR_NONE)) {
-	(void)fprintf(stderr, "Failed to create window: ErrorCode %d\n",
+	(void)fprintf(stderr, "Failed to open video sink: ErrorCode %d\n",
 		      window_err);
 	goto cleanup;
     }
 
-    rgbBuffer = (unsigned char *)malloc((size_t)FRAME_WIDTH * FRAME_HEIGHT * 4);
-    if (UNLIKELY(rgbBuffer == NULL)) {
+    app.rgb_buffer =
+	(unsigned char *)malloc((size_t)FRAME_WIDTH * FRAME_HEIGHT * 4);
+    if (UNLIKELY(app.rgb_buffer == NULL)) {
 	(void)fprintf(stderr, "Failed to allocate RGB buffer\n");
 	goto cleanup;
     }
 
-    flippedRgbBuffer =
-	(unsigned char *)malloc((size_t)FRAME_WIDTH * FRAME_HEIGHT * 4);
-    if (UNLIKELY(flippedRgbBuffer == NULL)) {
-	(void)fprintf(stderr, "Failed to allocate flipped RGB buffer\n");
+    pipeline_err = HandPipeline_create(&app.pipeline, app.dimensions);
+    if (UNLIKELY(pipeline_err != ERROR_NONE)) {
+	(void)fprintf(stderr,
+		      "Failed to create recognition pipeline: ErrorCode %d\n",
+		      pipeline_err);
 	goto cleanup;
     }
 
-    while (!quit) {
-	yuyvFrame = CaptureDevice_getFrame(&captureDevice);
-	if (yuyvFrame == NULL) {
-	    (void)fprintf(stderr, "Failed to get frame from capture device\n");
-	    quit = true;
-	    continue;
+    modelPath = getenv(GESTURE_MODEL_VARIABLE);
+    if (modelPath != NULL) {
+	const ErrorCode model_err =
+	    HandPipeline_loadGestureModel(&app.pipeline, modelPath);
+	if (UNLIKELY(model_err != ERROR_NONE)) {
+	    (void)fprintf(stderr,
+			  "Failed to load gesture model %s: ErrorCode %d, "
+			  "continuing without gestures\n",
+			  modelPath, model_err);
 	}
+    }
+    // HM_DENOISE, for cameras noisy enough that the hand mask flickers
+    if (denoise) {
+	const ErrorCode denoise_err =
+	    HandPipeline_enableDenoise(&app.pipeline);
+	if (UNLIKELY(denoise_err != ERROR_NONE)) {
+	    (void)fprintf(stderr,
+			  "Failed to enable denoise: ErrorCode %d, "
+			  "continuing without\n",
+			  denoise_err);
+	}
+    }
 
-	ErrorCode process_err = yuyvToRgb(yuyvFrame, rgbBuffer, &dimensions);
-	if (process_err != ERROR_NONE) {
+    // HM_PUBLISH names the socket other local processes connect to for
+    // the shared results segment
+    if (publishPath != NULL) {
+	app.publish_err =
+	    Publisher_create(&app.publisher, publishPath, app.dimensions);
+	if (UNLIKELY(app.publish_err != ERROR_NONE)) {
 	    (void)fprintf(stderr,
-			  "Failed to convert YUYV to RGB: ErrorCode %d\n",
-			  process_err);
-	    quit = true;
-	    continue;
+			  "Failed to publish results on %s: ErrorCode %d, "
+			  "continuing without\n",
+			  publishPath, app.publish_err);
+	}
+    }
+
+    loop_err = setupLoop(&loop, &app, &wakeDescriptor);
+    if (UNLIKELY(loop_err != ERROR_NONE)) {
+	(void)fprintf(stderr, "Failed to set up event loop: ErrorCode %d\n",
+		      loop_err);
+	goto cleanup;
+    }
+    // after the loop blocked its signals so the dumper thread inherits that
+#ifdef HM_TRACE
+    {
+	const char *tracePath = getenv(TRACE_FILE_VARIABLE);
+	tracePath = tracePath != NULL ? tracePath : TRACE_DEFAULT_FILE;
+	const ErrorCode trace_err = Trace_start(tracePath, TRACE_INTERVAL);
+	if (UNLIKELY(trace_err != ERROR_NONE)) {
+	    (void)fprintf(stderr,
+			  "Failed to start tracing to %s: ErrorCode %d\n",
+			  tracePath, trace_err);
 	}
+    }
+#endif
 
-	process_err =
-	    flipRgbHorizontal(rgbBuffer, flippedRgbBuffer, &dimensions);
-	if (process_err != ERROR_NONE) {
+    app.audio_err = startAudio(&app.audio_output, &app.audio_engine,
+			       &app.synth, wakeDescriptor);
+    if (UNLIKELY(app.audio_err != ERROR_NONE)) {
+	(void)fprintf(stderr,
+		      "Failed to start audio: ErrorCode %d, continuing "
+		      "without sound\n",
+		      app.audio_err);
+    }
+    // the rest after the loop blocked its signals, a camera that fails to
+    // open is left out and the others carry on
+    for (int index = 0; index < app.camera_count - 1; ++index) {
+	app.worker_err[index] = CameraWorker_start(
+	    &app.workers[index], app.sources[index + 1], app.dimensions,
+	    REPLAY_FPS, index + 1, modelPath, denoise, wakeDescriptor);
+	if (UNLIKELY(app.worker_err[index] != ERROR_NONE)) {
 	    (void)fprintf(stderr,
-			  "Failed to flip RGB horizontally: ErrorCode %d\n",
-			  process_err);
-	    quit = true;
+			  "Failed to start camera %s: ErrorCode %d, continuing "
+			  "without it\n",
+			  app.sources[index + 1], app.worker_err[index]);
 	    continue;
 	}
-	Window_draw(&windowState, flippedRgbBuffer);
+	(void)CameraMerger_add(&app.merger, &app.workers[index].queue);
+    }
 
-	quit = Window_pollEvents(&windowState);
+    app.midi_err = startMidi(&app.midi_sink, &app.midi_mapper);
+    if (UNLIKELY(app.midi_err != ERROR_NONE &&
+		 getenv(MIDI_VARIABLE) != NULL)) {
+	(void)fprintf(stderr,
+		      "Failed to start midi output: ErrorCode %d, continuing "
+		      "without midi\n",
+		      app.midi_err);
+    }
+
+    if (UNLIKELY(CaptureDevice_queue(&app.capture) != ERROR_NONE)) {
+	(void)fprintf(stderr, "Failed to queue capture buffer\n");
+	goto cleanup;
+    }
+    // camera 0 is recognised on this thread, off the workers' cores
+    CameraWorker_pinCaller(0);
+    // blocks until the window closes or a frame fails
+    {
+	const ErrorCode run_err = EventLoop_run(&loop);
+	if (UNLIKELY(run_err != ERROR_NONE)) {
+	    (void)fprintf(stderr, "Event loop failed: ErrorCode %d\n",
+			  run_err);
+	}
+	const float elapsed = secondsSince(&startTime);
+	unsigned long long frames = app.frames;
+	for (int index = 0; index < app.camera_count - 1; ++index) {
+	    frames += app.worker_err[index] == ERROR_NONE
+			  ? atomic_load_explicit(&app.workers[index].frames,
+						 memory_order_relaxed)
+			  : 0;
+	}
+	(void)fprintf(stderr, "%llu frames in %.1f s, %.1f fps\n", frames,
+		      (double)elapsed, (double)((float)frames / elapsed));
+	printStats(&app);
     }
 
 cleanup:
-    if (LIKELY(flippedRgbBuffer != NULL)) {
-	free(flippedRgbBuffer);
+    // before the loop goes, they signal its wake descriptor
+    for (int index = 0; index < app.camera_count - 1; ++index) {
+	if (app.worker_err[index] == ERROR_NONE) {
+	    CameraWorker_stop(&app.workers[index]);
+	}
+    }
+    if (app.midi_err == ERROR_NONE) {
+	const unsigned long long lastTime =
+	    app.frames > 0 ? app.frame.timestamp : nowNanoseconds();
+	MidiMapper_flush(&app.midi_mapper, lastTime, &app.midi_batch);
+	(void)MidiSink_write(&app.midi_sink, &app.midi_batch);
+	MidiSink_close(&app.midi_sink);
+    }
+    if (LIKELY(app.audio_err == ERROR_NONE)) {
+	stopAudio(&app);
+    }
+    // after audio, its thread may still signal the wake descriptor
+    if (LIKELY(loop_err == ERROR_NONE)) {
+	EventLoop_destroy(&loop);
+    }
+    if (app.publish_err == ERROR_NONE) {
+	Publisher_destroy(&app.publisher);
+    }
+    if (LIKELY(pipeline_err == ERROR_NONE)) {
+	HandPipeline_destroy(&app.pipeline);
     }
-    if (LIKELY(rgbBuffer != NULL)) {
-	free(rgbBuffer);
+    if (LIKELY(app.rgb_buffer != NULL)) {
+	free(app.rgb_buffer);
     }
 
     if (LIKELY(window_err == ERROR_NONE)) {
-	Window_destroy(&windowState);
+	Window_destroy(&app.window);
     }
 
     if (LIKELY(capture_err == ERROR_NONE)) {
-	CaptureDevice_close(&captureDevice);
+	CaptureDevice_close(&app.capture);
     }
+    free(app.camera_list);
+#ifdef HM_TRACE
+    Trace_stop();
+#endif
 
     return (capture_err != ERROR_NONE && window_err != ERROR_NONE &&
-	    rgbBuffer == NULL && flippedRgbBuffer == NULL);
+	    app.rgb_buffer == NULL);
 }
@@ -0,0 +1,17 @@
+#pragma once
+
+#define MIDI_MAX_BATCH 64
+
+// raw channel message, timestamp is CLOCK_MONOTONIC nanoseconds of the
+// capture that produced it
+typedef struct {
+    unsigned long long timestamp;
+    unsigned char status;
+    unsigned char data1;
+    unsigned char data2;
+} __attribute__((aligned(16))) MidiEvent;
+
+typedef struct {
+    MidiEvent events[MIDI_MAX_BATCH];
+    int count;
+} __attribute__((aligned(64))) MidiBatch;
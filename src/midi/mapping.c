@@ -0,0 +1,338 @@
+/*
+    Fingertip tracks to midi channel messages through a mapping table, one
+    batch per frame with redundant controller and bend updates dropped,
+    exposed api is in `mapping.h`
+*/
+
+#include "mapping.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "branch.h"
+#include "event.h"
+#include "track.h"
+#include "types.h"
+
+#define TABLE_LINE_LENGTH 256
+#define TABLE_WORD_LENGTH 16
+
+static const unsigned char NOTE_OFF = 0x80;
+static const unsigned char NOTE_ON = 0x90;
+static const unsigned char CONTROL_CHANGE = 0xB0;
+static const unsigned char PITCH_BEND = 0xE0;
+static const int MAX_DATA = 127;
+static const int MAX_BEND = 16383;
+
+// one voice per tracker slot on its own channel so bends and timbre stay
+// per finger, slot 9 skips to channel 11 since general midi keeps channel
+// 10 for drums, channel 1 modulation follows how many fingers are up and
+// controller 20 which gesture the hand makes
+static const MidiMapping DEFAULT_TABLE[] = {
+    {MIDI_SOURCE_POSITION_X, MIDI_TARGET_NOTE, 0, 0.0F, 1.0F, 0, 48, 24, 100},
+    {MIDI_SOURCE_POSITION_X, MIDI_TARGET_NOTE, 1, 0.0F, 1.0F, 1, 48, 24, 100},
+    {MIDI_SOURCE_POSITION_X, MIDI_TARGET_NOTE, 2, 0.0F, 1.0F, 2, 48, 24, 100},
+    {MIDI_SOURCE_POSITION_X, MIDI_TARGET_NOTE, 3, 0.0F, 1.0F, 3, 48, 24, 100},
+    {MIDI_SOURCE_POSITION_X, MIDI_TARGET_NOTE, 4, 0.0F, 1.0F, 4, 48, 24, 100},
+    {MIDI_SOURCE_POSITION_X, MIDI_TARGET_NOTE, 5, 0.0F, 1.0F, 5, 48, 24, 100},
+    {MIDI_SOURCE_POSITION_X, MIDI_TARGET_NOTE, 6, 0.0F, 1.0F, 6, 48, 24, 100},
+    {MIDI_SOURCE_POSITION_X, MIDI_TARGET_NOTE, 7, 0.0F, 1.0F, 7, 48, 24, 100},
+    {MIDI_SOURCE_POSITION_X, MIDI_TARGET_NOTE, 8, 0.0F, 1.0F, 8, 48, 24, 100},
+    {MIDI_SOURCE_POSITION_X, MIDI_TARGET_NOTE, 9, 0.0F, 1.0F, 10, 48, 24, 100},
+    {MIDI_SOURCE_POSITION_Y, MIDI_TARGET_CONTROL, 0, 0.0F, 1.0F, 0, 74, 0, 0},
+    {MIDI_SOURCE_POSITION_Y, MIDI_TARGET_CONTROL, 1, 0.0F, 1.0F, 1, 74, 0, 0},
+    {MIDI_SOURCE_POSITION_Y, MIDI_TARGET_CONTROL, 2, 0.0F, 1.0F, 2, 74, 0, 0},
+    {MIDI_SOURCE_POSITION_Y, MIDI_TARGET_CONTROL, 3, 0.0F, 1.0F, 3, 74, 0, 0},
+    {MIDI_SOURCE_POSITION_Y, MIDI_TARGET_CONTROL, 4, 0.0F, 1.0F, 4, 74, 0, 0},
+    {MIDI_SOURCE_POSITION_Y, MIDI_TARGET_CONTROL, 5, 0.0F, 1.0F, 5, 74, 0, 0},
+    {MIDI_SOURCE_POSITION_Y, MIDI_TARGET_CONTROL, 6, 0.0F, 1.0F, 6, 74, 0, 0},
+    {MIDI_SOURCE_POSITION_Y, MIDI_TARGET_CONTROL, 7, 0.0F, 1.0F, 7, 74, 0, 0},
+    {MIDI_SOURCE_POSITION_Y, MIDI_TARGET_CONTROL, 8, 0.0F, 1.0F, 8, 74, 0, 0},
+    {MIDI_SOURCE_POSITION_Y, MIDI_TARGET_CONTROL, 9, 0.0F, 1.0F, 10, 74, 0, 0},
+    {MIDI_SOURCE_FINGER_COUNT, MIDI_TARGET_CONTROL, 0, 0.0F, 5.0F, 0, 1, 0,
+     0},
+    {MIDI_SOURCE_GESTURE, MIDI_TARGET_CONTROL, 0, (float)GESTURE_OPEN_PALM,
+     (float)GESTURE_POINT, 0, 20, 0, 0},
+};
+_Static_assert(TRACKER_MAX_TRACKS == 10,
+	       "DEFAULT_TABLE has a note and a control row per tracker slot");
+
+const MidiMapping *MidiMapper_defaultTable(int *count) {
+    *count = (int)(sizeof(DEFAULT_TABLE) / sizeof(DEFAULT_TABLE[0]));
+    return DEFAULT_TABLE;
+}
+
+static bool parseTarget(const char *word, MidiTarget *target) {
+    if (strcmp(word, "note") == 0) {
+	*target = MIDI_TARGET_NOTE;
+    } else if (strcmp(word, "cc") == 0) {
+	*target = MIDI_TARGET_CONTROL;
+    } else if (strcmp(word, "bend") == 0) {
+	*target = MIDI_TARGET_PITCH_BEND;
+    } else {
+	return false;
+    }
+    return true;
+}
+
+static bool parseSource(const char *word, MidiSource *source) {
+    if (strcmp(word, "x") == 0) {
+	*source = MIDI_SOURCE_POSITION_X;
+    } else if (strcmp(word, "y") == 0) {
+	*source = MIDI_SOURCE_POSITION_Y;
+    } else if (strcmp(word, "vx") == 0) {
+	*source = MIDI_SOURCE_VELOCITY_X;
+    } else if (strcmp(word, "vy") == 0) {
+	*source = MIDI_SOURCE_VELOCITY_Y;
+    } else if (strcmp(word, "count") == 0) {
+	*source = MIDI_SOURCE_FINGER_COUNT;
+    } else if (strcmp(word, "gesture") == 0) {
+	*source = MIDI_SOURCE_GESTURE;
+    } else {
+	return false;
+    }
+    return true;
+}
+
+/*
+    One mapping per line, `#` starts a comment:
+
+	target source finger channel number range velocity minimum maximum
+
+    target is note, cc or bend, source is x, y, vx, vy, count or gesture,
+    the gesture ranging from 1 for an open palm to 4 for pointing, channel
+    is 1 to 16, number is the lowest note or the controller, range is how
+    many notes above it a note mapping spans and velocity its note on
+    velocity, both unused by other targets.
+*/
+ErrorCode MidiMapper_loadTable(const char *path, MidiMapping *table,
+			       const int capacity, int *count) {
+    FILE *file = fopen(path, "r");
+    if (UNLIKELY(file == NULL)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+
+    char line[TABLE_LINE_LENGTH];
+    ErrorCode result = ERROR_NONE;
+    *count = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+	char *comment = strchr(line, '#');
+	if (comment != NULL) {
+	    *comment = '\0';
+	}
+	char targetWord[TABLE_WORD_LENGTH];
+	char sourceWord[TABLE_WORD_LENGTH];
+	int finger = 0;
+	int channel = 0;
+	int number = 0;
+	int range = 0;
+	int velocity = 0;
+	float minimum = 0.0F;
+	float maximum = 0.0F;
+	const int fields =
+	    sscanf(line, "%15s %15s %d %d %d %d %d %f %f", targetWord,
+		   sourceWord, &finger, &channel, &number, &range, &velocity,
+		   &minimum, &maximum);
+	if (fields <= 0) {
+	    continue;
+	}
+
+	MidiMapping *mapping = &table[*count];
+	if (UNLIKELY(fields != 9 || *count >= capacity ||
+		     !parseTarget(targetWord, &mapping->target) ||
+		     !parseSource(sourceWord, &mapping->source) ||
+		     finger < 0 || finger >= TRACKER_MAX_TRACKS ||
+		     channel < 1 || channel > MIDI_CHANNELS || number < 0 ||
+		     number > MAX_DATA || range < 0 || range > MAX_DATA ||
+		     velocity < 0 || velocity > MAX_DATA ||
+		     !(maximum > minimum))) {
+	    result = ERROR_INVALID_ARGUMENT;
+	    break;
+	}
+	mapping->finger = finger;
+	mapping->channel = (unsigned char)(channel - 1);
+	mapping->number = (unsigned char)number;
+	mapping->range = (unsigned char)range;
+	mapping->velocity = (unsigned char)velocity;
+	mapping->minimum = minimum;
+	mapping->maximum = maximum;
+	(*count)++;
+    }
+    (void)fclose(file);
+    return result;
+}
+
+ErrorCode MidiMapper_init(MidiMapper *mapper, const MidiMapping *table,
+			  const int count) {
+    if (UNLIKELY(count < 0 || count > MIDI_MAX_MAPPINGS)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    // finger indexes the tracker's slots directly when the table is used
+    for (int index = 0; index < count; ++index) {
+	if (UNLIKELY(table[index].finger < 0 ||
+		     table[index].finger >= TRACKER_MAX_TRACKS ||
+		     table[index].channel >= MIDI_CHANNELS ||
+		     table[index].number > MAX_DATA)) {
+	    return ERROR_INVALID_ARGUMENT;
+	}
+    }
+    memset(mapper, 0, sizeof(*mapper));
+    memcpy(mapper->mappings, table, (size_t)count * sizeof(*table));
+    mapper->mapping_count = count;
+    for (int index = 0; index < MIDI_MAX_MAPPINGS; ++index) {
+	mapper->sounding[index] = -1;
+    }
+    for (int channel = 0; channel < MIDI_CHANNELS; ++channel) {
+	for (int controller = 0; controller < MIDI_CONTROLLERS; ++controller) {
+	    mapper->controllers[channel][controller] = -1;
+	}
+	mapper->bends[channel] = -1;
+    }
+    return ERROR_NONE;
+}
+
+static void pushEvent(MidiBatch *batch, const unsigned long long timestamp,
+		      const unsigned char status, const int data1,
+		      const int data2) {
+    if (UNLIKELY(batch->count >= MIDI_MAX_BATCH)) {
+	return;
+    }
+    batch->events[batch->count++] =
+	(MidiEvent){.timestamp = timestamp,
+		    .status = status,
+		    .data1 = (unsigned char)data1,
+		    .data2 = (unsigned char)data2};
+}
+
+// false when the mapped finger is not tracked this frame or no gesture
+// is recognised
+static bool sourceValue(const MidiMapping *mapping,
+			const FingertipTracker *tracker, const Gesture gesture,
+			const FrameDimensions dimensions,
+			const int activeCount, float *value) {
+    if (mapping->source == MIDI_SOURCE_FINGER_COUNT) {
+	*value = (float)activeCount;
+	return true;
+    }
+    if (mapping->source == MIDI_SOURCE_GESTURE) {
+	*value = (float)gesture;
+	return gesture != GESTURE_NONE;
+    }
+    const FingertipTrack *track = &tracker->tracks[mapping->finger];
+    if (!track->active) {
+	return false;
+    }
+    const float width = (float)dimensions.width;
+    switch (mapping->source) {
+	case MIDI_SOURCE_POSITION_X:
+	    *value = 1.0F - ((float)track->position.x / (width - 1.0F));
+	    break;
+	case MIDI_SOURCE_POSITION_Y:
+	    *value = 1.0F - ((float)track->position.y /
+			     ((float)dimensions.height - 1.0F));
+	    break;
+	case MIDI_SOURCE_VELOCITY_X:
+	    *value = -track->velocity_x / width;
+	    break;
+	case MIDI_SOURCE_VELOCITY_Y:
+	    *value = -track->velocity_y / width;
+	    break;
+	case MIDI_SOURCE_FINGER_COUNT:
+	case MIDI_SOURCE_GESTURE:
+	default:
+	    return false;
+    }
+    return true;
+}
+
+static int scaleValue(const MidiMapping *mapping, const float value,
+		      const int span) {
+    float normalized =
+	(value - mapping->minimum) / (mapping->maximum - mapping->minimum);
+    normalized = normalized < 0.0F ? 0.0F : normalized;
+    normalized = normalized > 1.0F ? 1.0F : normalized;
+    return (int)((normalized * (float)span) + 0.5F);
+}
+
+static void updateMapping(MidiMapper *mapper, const int index,
+			  const bool present, const float value,
+			  const unsigned long long timestamp,
+			  MidiBatch *batch) {
+    const MidiMapping *mapping = &mapper->mappings[index];
+    const unsigned char channel = mapping->channel;
+
+    switch (mapping->target) {
+	case MIDI_TARGET_NOTE: {
+	    int note = -1;
+	    if (present) {
+		note = mapping->number + scaleValue(mapping, value,
+						    mapping->range);
+		note = note > MAX_DATA ? MAX_DATA : note;
+	    }
+	    if (note == mapper->sounding[index]) {
+		break;
+	    }
+	    if (mapper->sounding[index] >= 0) {
+		pushEvent(batch, timestamp, NOTE_OFF | channel,
+			  mapper->sounding[index], 0);
+	    }
+	    if (note >= 0) {
+		pushEvent(batch, timestamp, NOTE_ON | channel, note,
+			  mapping->velocity);
+	    }
+	    mapper->sounding[index] = (short)note;
+	    break;
+	}
+	case MIDI_TARGET_CONTROL: {
+	    const int level = scaleValue(mapping, value, MAX_DATA);
+	    short *last = &mapper->controllers[channel][mapping->number];
+	    if (present && level != *last) {
+		pushEvent(batch, timestamp, CONTROL_CHANGE | channel,
+			  mapping->number, level);
+		*last = (short)level;
+	    }
+	    break;
+	}
+	case MIDI_TARGET_PITCH_BEND: {
+	    const int bend = scaleValue(mapping, value, MAX_BEND);
+	    if (present && bend != mapper->bends[channel]) {
+		pushEvent(batch, timestamp, PITCH_BEND | channel, bend & 0x7F,
+			  bend >> 7);
+		mapper->bends[channel] = bend;
+	    }
+	    break;
+	}
+	default:
+	    break;
+    }
+}
+
+// replaces the batch with this frame's events, nothing is emitted for
+// values that did not change since they were last sent
+void MidiMapper_update(MidiMapper *mapper, const FingertipTracker *tracker,
+		       const Gesture gesture, const FrameDimensions dimensions,
+		       const unsigned long long timestamp, MidiBatch *batch) {
+    int activeCount = 0;
+    for (int index = 0; index < TRACKER_MAX_TRACKS; ++index) {
+	activeCount += tracker->tracks[index].active ? 1 : 0;
+    }
+
+    batch->count = 0;
+    for (int index = 0; index < mapper->mapping_count; ++index) {
+	float value = 0.0F;
+	const bool present =
+	    sourceValue(&mapper->mappings[index], tracker, gesture,
+			dimensions, activeCount, &value);
+	updateMapping(mapper, index, present, value, timestamp, batch);
+    }
+}
+
+// releases every sounding note, for shutdown so no note hangs
+void MidiMapper_flush(MidiMapper *mapper, const unsigned long long timestamp,
+		      MidiBatch *batch) {
+    batch->count = 0;
+    for (int index = 0; index < mapper->mapping_count; ++index) {
+	updateMapping(mapper, index, false, 0.0F, timestamp, batch);
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "event.h"
+#include "gesture.h"
+#include "track.h"
+#include "types.h"
+
+#define MIDI_MAX_MAPPINGS 32
+#define MIDI_CHANNELS 16
+#define MIDI_CONTROLLERS 128
+
+typedef enum {
+    MIDI_SOURCE_POSITION_X = 0,
+    MIDI_SOURCE_POSITION_Y = 1,
+    MIDI_SOURCE_VELOCITY_X = 2,
+    MIDI_SOURCE_VELOCITY_Y = 3,
+    MIDI_SOURCE_FINGER_COUNT = 4,
+    MIDI_SOURCE_GESTURE = 5
+} MidiSource;
+
+typedef enum {
+    MIDI_TARGET_NOTE = 0,
+    MIDI_TARGET_CONTROL = 1,
+    MIDI_TARGET_PITCH_BEND = 2
+} MidiTarget;
+
+// the source value is mapped from [minimum, maximum] onto the target range,
+// positions are in [0, 1] with x mirrored like the window and y rising
+// upwards, velocities are frame widths per second, the gesture is its
+// Gesture value and absent while none is recognised, finger selects a
+// tracker slot below TRACKER_MAX_TRACKS and is ignored by the finger count
+// and the gesture
+typedef struct {
+    MidiSource source;
+    MidiTarget target;
+    int finger;
+    float minimum;
+    float maximum;
+    unsigned char channel;
+    unsigned char number;
+    unsigned char range;
+    unsigned char velocity;
+} __attribute__((aligned(32))) MidiMapping;
+
+typedef struct {
+    MidiMapping mappings[MIDI_MAX_MAPPINGS];
+    short sounding[MIDI_MAX_MAPPINGS];
+    short controllers[MIDI_CHANNELS][MIDI_CONTROLLERS];
+    int bends[MIDI_CHANNELS];
+    int mapping_count;
+} __attribute__((aligned(64))) MidiMapper;
+
+const MidiMapping *MidiMapper_defaultTable(int *count);
+
+ErrorCode MidiMapper_loadTable(const char *path, MidiMapping *table,
+			       int capacity, int *count);
+
+ErrorCode MidiMapper_init(MidiMapper *mapper, const MidiMapping *table,
+			  int count);
+
+void MidiMapper_update(MidiMapper *mapper, const FingertipTracker *tracker,
+		       Gesture gesture, FrameDimensions dimensions,
+		       unsigned long long timestamp, MidiBatch *batch);
+
+void MidiMapper_flush(MidiMapper *mapper, unsigned long long timestamp,
+		      MidiBatch *batch);
@@ -0,0 +1,294 @@
+/*
+    Midi event sinks, a null sink that only counts, a format 0 Standard
+    MIDI File with millisecond ticks from the capture timestamps and an
+    ALSA sequencer port when built with ALSA=1, exposed api is in `sink.h`
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HM_WITH_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+#include "branch.h"
+#include "event.h"
+#include "types.h"
+
+#define FILE_BUFFER_SIZE 4096
+// delta time, status and two data bytes at most
+#define MAX_EVENT_BYTES 7
+
+typedef enum { SINK_NULL, SINK_FILE, SINK_ALSA } SinkKind;
+
+struct MidiSinkInternal {
+#ifdef HM_WITH_ALSA
+    snd_seq_t *sequencer;
+    int port;
+#endif
+    unsigned char buffer[FILE_BUFFER_SIZE];
+    unsigned long long first_timestamp;
+    unsigned long long last_tick;
+    unsigned int buffered;
+    unsigned int track_bytes;
+    SinkKind kind;
+    int file_descriptor;
+    bool started;
+    bool failed;
+} __attribute__((aligned(64)));
+
+// 1000 ticks per quarter at one quarter per second makes a tick 1 ms
+static const unsigned char FILE_HEADER[] = {
+    'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0x03, 0xE8,
+    'M', 'T', 'r', 'k', 0, 0, 0, 0, 0, 0xFF, 0x51, 0x03, 0x0F, 0x42, 0x40};
+static const unsigned char END_OF_TRACK[] = {0, 0xFF, 0x2F, 0};
+static const unsigned int TRACK_LENGTH_OFFSET = 18;
+static const unsigned int TRACK_DATA_OFFSET = 22;
+static const unsigned long long NANOSECONDS_PER_TICK = 1000000ULL;
+
+static ErrorCode createInternal(MidiSink *sink, const SinkKind kind) {
+    sink->events_written = 0;
+    sink->internal = (MidiSinkInternal *)calloc(1, sizeof(MidiSinkInternal));
+    if (UNLIKELY(sink->internal == NULL)) {
+	return ERROR_ALLOCATION_FAILED;
+    }
+    sink->internal->kind = kind;
+    sink->internal->file_descriptor = -1;
+    return ERROR_NONE;
+}
+
+ErrorCode MidiSink_openNull(MidiSink *sink) {
+    return createInternal(sink, SINK_NULL);
+}
+
+static bool writeAll(const int fileDescriptor, const unsigned char *data,
+		     size_t size) {
+    while (size > 0) {
+	const ssize_t written = write(fileDescriptor, data, size);
+	if (written < 0 && errno == EINTR) {
+	    continue;
+	}
+	if (UNLIKELY(written <= 0)) {
+	    return false;
+	}
+	data += written;
+	size -= (size_t)written;
+    }
+    return true;
+}
+
+static void flushBuffer(MidiSinkInternal *internal) {
+    if (!internal->failed &&
+	!writeAll(internal->file_descriptor, internal->buffer,
+		  internal->buffered)) {
+	internal->failed = true;
+    }
+    internal->buffered = 0;
+}
+
+static void appendBytes(MidiSinkInternal *internal, const unsigned char *data,
+			const unsigned int size) {
+    if (internal->buffered + size > FILE_BUFFER_SIZE) {
+	flushBuffer(internal);
+    }
+    memcpy(internal->buffer + internal->buffered, data, size);
+    internal->buffered += size;
+    internal->track_bytes += size;
+}
+
+ErrorCode MidiSink_openFile(MidiSink *sink, const char *path) {
+    const ErrorCode error = createInternal(sink, SINK_FILE);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+    MidiSinkInternal *internal = sink->internal;
+    internal->file_descriptor =
+	open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (UNLIKELY(internal->file_descriptor < 0)) {
+	MidiSink_close(sink);
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    appendBytes(internal, FILE_HEADER, sizeof(FILE_HEADER));
+    internal->track_bytes = sizeof(FILE_HEADER) - TRACK_DATA_OFFSET;
+    return ERROR_NONE;
+}
+
+ErrorCode MidiSink_openAlsa(MidiSink *sink, const char *clientName) {
+#ifdef HM_WITH_ALSA
+    const ErrorCode error = createInternal(sink, SINK_ALSA);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+    MidiSinkInternal *internal = sink->internal;
+    if (UNLIKELY(snd_seq_open(&internal->sequencer, "default",
+			      SND_SEQ_OPEN_OUTPUT, 0) < 0)) {
+	internal->sequencer = NULL;
+	MidiSink_close(sink);
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    (void)snd_seq_set_client_name(internal->sequencer, clientName);
+    internal->port = snd_seq_create_simple_port(
+	internal->sequencer, clientName,
+	SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+	SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+    if (UNLIKELY(internal->port < 0)) {
+	MidiSink_close(sink);
+	return ERROR_UNSUPPORTED_OPERATION;
+    }
+    return ERROR_NONE;
+#else
+    (void)clientName;
+    sink->internal = NULL;
+    sink->events_written = 0;
+    return ERROR_UNSUPPORTED_OPERATION;
+#endif
+}
+
+// variable length quantity, at most four bytes for 28 bit values
+static unsigned int encodeDelta(unsigned long long delta,
+				unsigned char *target) {
+    delta = delta > 0x0FFFFFFFULL ? 0x0FFFFFFFULL : delta;
+    unsigned char reversed[4];
+    unsigned int length = 0;
+    do {
+	reversed[length++] = (unsigned char)(delta & 0x7FU);
+	delta >>= 7;
+    } while (delta > 0);
+    for (unsigned int index = 0; index < length; ++index) {
+	target[index] = reversed[length - 1 - index];
+	target[index] |= index + 1 < length ? 0x80U : 0U;
+    }
+    return length;
+}
+
+static void writeFileEvent(MidiSinkInternal *internal,
+			   const MidiEvent *event) {
+    if (!internal->started) {
+	internal->first_timestamp = event->timestamp;
+	internal->started = true;
+    }
+    // timestamps never run backwards within the file
+    const unsigned long long elapsed =
+	event->timestamp > internal->first_timestamp
+	    ? event->timestamp - internal->first_timestamp
+	    : 0;
+    unsigned long long tick = elapsed / NANOSECONDS_PER_TICK;
+    tick = tick < internal->last_tick ? internal->last_tick : tick;
+
+    unsigned char bytes[MAX_EVENT_BYTES];
+    unsigned int length = encodeDelta(tick - internal->last_tick, bytes);
+    internal->last_tick = tick;
+    bytes[length++] = event->status;
+    bytes[length++] = event->data1;
+    bytes[length++] = event->data2;
+    appendBytes(internal, bytes, length);
+}
+
+#ifdef HM_WITH_ALSA
+// delivered directly, the events describe a frame that already happened
+static void writeAlsaEvent(MidiSinkInternal *internal,
+			   const MidiEvent *event) {
+    const unsigned char channel = event->status & 0x0FU;
+    snd_seq_event_t sequencerEvent;
+    snd_seq_ev_clear(&sequencerEvent);
+    snd_seq_ev_set_source(&sequencerEvent, internal->port);
+    snd_seq_ev_set_subs(&sequencerEvent);
+    snd_seq_ev_set_direct(&sequencerEvent);
+    switch (event->status & 0xF0U) {
+	case 0x80:
+	    snd_seq_ev_set_noteoff(&sequencerEvent, channel, event->data1,
+				   event->data2);
+	    break;
+	case 0x90:
+	    snd_seq_ev_set_noteon(&sequencerEvent, channel, event->data1,
+				  event->data2);
+	    break;
+	case 0xB0:
+	    snd_seq_ev_set_controller(&sequencerEvent, channel, event->data1,
+				      event->data2);
+	    break;
+	case 0xE0:
+	    snd_seq_ev_set_pitchbend(
+		&sequencerEvent, channel,
+		((event->data2 << 7) | event->data1) - 8192);
+	    break;
+	default:
+	    return;
+    }
+    (void)snd_seq_event_output(internal->sequencer, &sequencerEvent);
+}
+#endif
+
+// a frame's batch goes out together, the sequencer drains once per batch
+ErrorCode MidiSink_write(MidiSink *sink, const MidiBatch *batch) {
+    MidiSinkInternal *internal = sink->internal;
+    switch (internal->kind) {
+	case SINK_NULL:
+	    break;
+	case SINK_FILE:
+	    for (int index = 0; index < batch->count; ++index) {
+		writeFileEvent(internal, &batch->events[index]);
+	    }
+	    if (UNLIKELY(internal->failed)) {
+		return ERROR_FILE_OPEN_FAILED;
+	    }
+	    break;
+	case SINK_ALSA:
+#ifdef HM_WITH_ALSA
+	    for (int index = 0; index < batch->count; ++index) {
+		writeAlsaEvent(internal, &batch->events[index]);
+	    }
+	    if (batch->count > 0 &&
+		UNLIKELY(snd_seq_drain_output(internal->sequencer) < 0)) {
+		return ERROR_IOCTL_FAILED;
+	    }
+	    break;
+#else
+	    return ERROR_UNSUPPORTED_OPERATION;
+#endif
+	default:
+	    return ERROR_INVALID_ARGUMENT;
+    }
+    sink->events_written += (unsigned long long)batch->count;
+    return ERROR_NONE;
+}
+
+static void closeFile(MidiSinkInternal *internal) {
+    appendBytes(internal, END_OF_TRACK, sizeof(END_OF_TRACK));
+    flushBuffer(internal);
+    const unsigned char length[4] = {
+	(unsigned char)(internal->track_bytes >> 24),
+	(unsigned char)((internal->track_bytes >> 16) & 0xFFU),
+	(unsigned char)((internal->track_bytes >> 8) & 0xFFU),
+	(unsigned char)(internal->track_bytes & 0xFFU)};
+    // a short write leaves the events intact, only the declared track
+    // length is stale, and there is no one left to report it to
+    const ssize_t written = pwrite(internal->file_descriptor, length,
+				   sizeof(length), TRACK_LENGTH_OFFSET);
+    (void)written;
+}
+
+void MidiSink_close(MidiSink *sink) {
+    MidiSinkInternal *internal = sink->internal;
+    if (internal == NULL) {
+	return;
+    }
+#ifdef HM_WITH_ALSA
+    if (internal->sequencer != NULL) {
+	snd_seq_close(internal->sequencer);
+    }
+#endif
+    if (internal->file_descriptor >= 0) {
+	closeFile(internal);
+	close(internal->file_descriptor);
+    }
+    free(internal);
+    sink->internal = NULL;
+}
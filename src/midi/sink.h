@@ -0,0 +1,21 @@
+#pragma once
+
+#include "event.h"
+#include "types.h"
+
+typedef struct MidiSinkInternal MidiSinkInternal;
+
+typedef struct {
+    MidiSinkInternal *internal;
+    unsigned long long events_written;
+} __attribute__((aligned(16))) MidiSink;
+
+ErrorCode MidiSink_openNull(MidiSink *sink);
+
+ErrorCode MidiSink_openFile(MidiSink *sink, const char *path);
+
+ErrorCode MidiSink_openAlsa(MidiSink *sink, const char *clientName);
+
+ErrorCode MidiSink_write(MidiSink *sink, const MidiBatch *batch);
+
+void MidiSink_close(MidiSink *sink);
@@ -0,0 +1,375 @@
+/*
+    Publishes every merged result into a shared memory ring other local
+    processes map read only, a reader connects to a unix socket once to
+    get the segment and optionally hands over an eventfd to be woken
+    through, nothing here ever waits on a reader, exposed api is in
+    `publisher.h`
+*/
+
+// memfd_create, accept4 and MSG_CMSG_CLOEXEC
+#define _GNU_SOURCE
+
+#include "publisher.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "branch.h"
+#include "camera.h"
+#include "loop.h"
+#include "results.h"
+#include "track.h"
+#include "types.h"
+
+#define PROC_PATH_LENGTH 64
+
+static const unsigned long long NANOSECONDS_PER_SECOND = 1000000000ULL;
+
+static unsigned long long monotonicNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((unsigned long long)now.tv_sec * NANOSECONDS_PER_SECOND) +
+	   (unsigned long long)now.tv_nsec;
+}
+
+static void initSegment(ResultsSegment *segment,
+			const FrameDimensions dimensions) {
+    segment->magic = RESULTS_MAGIC;
+    segment->version = RESULTS_VERSION;
+    segment->header_size = (uint32_t)offsetof(ResultsSegment, slots);
+    segment->slot_size = (uint32_t)sizeof(ResultsSlot);
+    segment->slot_count = RESULTS_SLOTS;
+    segment->width = dimensions.width;
+    segment->height = dimensions.height;
+    segment->max_fingertips = RESULTS_MAX_FINGERTIPS;
+    segment->max_hull = RESULTS_MAX_HULL;
+    atomic_init(&segment->head, 0);
+    for (unsigned int index = 0; index < RESULTS_SLOTS; ++index) {
+	atomic_init(&segment->slots[index].sequence, 0);
+    }
+}
+
+/*
+    Sealed at its size so a reader can keep its mapping without fearing a
+    SIGBUS, and against future writes once our own writable mapping exists,
+    so a reader that reopens what it was handed through /proc read write
+    still cannot map or write it. Readers only ever get the read only
+    reopening on top, without /proc to make one publishing fails.
+*/
+static ErrorCode createSegment(Publisher *publisher,
+			       const FrameDimensions dimensions) {
+    publisher->memory_descriptor = memfd_create(
+	"hand-music-results", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (UNLIKELY(publisher->memory_descriptor < 0)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    if (UNLIKELY(ftruncate(publisher->memory_descriptor,
+			   (off_t)sizeof(ResultsSegment)) < 0)) {
+	return ERROR_ALLOCATION_FAILED;
+    }
+    void *mapping =
+	mmap(NULL, sizeof(ResultsSegment), PROT_READ | PROT_WRITE, MAP_SHARED,
+	     publisher->memory_descriptor, 0);
+    if (UNLIKELY(mapping == MAP_FAILED)) {
+	return ERROR_MMAP_FAILED;
+    }
+    publisher->segment = (ResultsSegment *)mapping;
+    initSegment(publisher->segment, dimensions);
+    if (UNLIKELY(fcntl(publisher->memory_descriptor, F_ADD_SEALS,
+		       F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE |
+			   F_SEAL_SEAL) < 0)) {
+	return ERROR_UNSUPPORTED_OPERATION;
+    }
+
+    char path[PROC_PATH_LENGTH];
+    (void)snprintf(path, sizeof(path), "/proc/self/fd/%d",
+		   publisher->memory_descriptor);
+    publisher->share_descriptor = open(path, O_RDONLY | O_CLOEXEC);
+    if (UNLIKELY(publisher->share_descriptor < 0)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    return ERROR_NONE;
+}
+
+// only a socket nobody listens on any more refuses the connection, one a
+// running instance still serves would lose its readers to us
+static bool staleSocket(const struct sockaddr_un *address) {
+    const int probe =
+	socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (UNLIKELY(probe < 0)) {
+	return false;
+    }
+    const bool refused = connect(probe, (const struct sockaddr *)address,
+				 sizeof(*address)) < 0 &&
+			 errno == ECONNREFUSED;
+    close(probe);
+    return refused;
+}
+
+static ErrorCode createSocket(Publisher *publisher, const char *socketPath) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    const size_t length = strlen(socketPath);
+    if (UNLIKELY(length == 0 || length >= sizeof(address.sun_path))) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    memcpy(address.sun_path, socketPath, length + 1);
+
+    publisher->listen_descriptor =
+	socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (UNLIKELY(publisher->listen_descriptor < 0)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    // a socket left behind by a run that crashed would fail the bind, it
+    // is removed, anything else at the path is not ours to delete
+    struct stat existing;
+    if (lstat(socketPath, &existing) == 0) {
+	if (UNLIKELY(!S_ISSOCK(existing.st_mode) || !staleSocket(&address))) {
+	    return ERROR_INVALID_ARGUMENT;
+	}
+	(void)unlink(socketPath);
+    }
+    if (UNLIKELY(bind(publisher->listen_descriptor,
+		      (const struct sockaddr *)&address,
+		      sizeof(address)) < 0)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    publisher->socket_path = socketPath;
+    if (UNLIKELY(listen(publisher->listen_descriptor, PUBLISH_MAX_READERS) <
+		 0)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    return ERROR_NONE;
+}
+
+// socketPath has to outlive the publisher, it is unlinked on destroy
+ErrorCode Publisher_create(Publisher *publisher, const char *socketPath,
+			   const FrameDimensions dimensions) {
+    memset(publisher, 0, sizeof(*publisher));
+    publisher->memory_descriptor = -1;
+    publisher->share_descriptor = -1;
+    publisher->listen_descriptor = -1;
+
+    ErrorCode error = createSegment(publisher, dimensions);
+    if (LIKELY(error == ERROR_NONE)) {
+	error = createSocket(publisher, socketPath);
+    }
+    if (UNLIKELY(error != ERROR_NONE)) {
+	Publisher_destroy(publisher);
+    }
+    return error;
+}
+
+static void dropReader(Publisher *publisher, const int index) {
+    PublishReader *reader = &publisher->readers[index];
+    close(reader->connection);
+    if (reader->wake_descriptor >= 0) {
+	close(reader->wake_descriptor);
+    }
+    *reader = publisher->readers[--publisher->reader_count];
+}
+
+void Publisher_destroy(Publisher *publisher) {
+    while (publisher->reader_count > 0) {
+	dropReader(publisher, publisher->reader_count - 1);
+    }
+    if (publisher->listen_descriptor >= 0) {
+	close(publisher->listen_descriptor);
+	publisher->listen_descriptor = -1;
+    }
+    if (publisher->socket_path != NULL) {
+	(void)unlink(publisher->socket_path);
+	publisher->socket_path = NULL;
+    }
+    if (publisher->segment != NULL) {
+	munmap(publisher->segment, sizeof(ResultsSegment));
+	publisher->segment = NULL;
+    }
+    if (publisher->share_descriptor >= 0) {
+	close(publisher->share_descriptor);
+	publisher->share_descriptor = -1;
+    }
+    if (publisher->memory_descriptor >= 0) {
+	close(publisher->memory_descriptor);
+	publisher->memory_descriptor = -1;
+    }
+}
+
+// readable when readers are waiting to connect
+int Publisher_descriptor(const Publisher *publisher) {
+    return publisher->listen_descriptor;
+}
+
+// a reader that went away only shows as a hung up connection, looked for
+// when its place is needed instead of on every frame
+static void dropClosedReaders(Publisher *publisher) {
+    for (int index = publisher->reader_count - 1; index >= 0; --index) {
+	unsigned char byte = 0;
+	const ssize_t received =
+	    recv(publisher->readers[index].connection, &byte, sizeof(byte),
+		 MSG_PEEK | MSG_DONTWAIT);
+	if (received == 0 || (received < 0 && errno != EAGAIN)) {
+	    dropReader(publisher, index);
+	}
+    }
+}
+
+// false once the reader should be dropped, a hello that has not arrived
+// yet leaves it waiting for the next try
+static bool answerReader(const Publisher *publisher, PublishReader *reader) {
+    union {
+	char buffer[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr align;
+    } control;
+    unsigned char hello = 0;
+    struct iovec vector = {.iov_base = &hello, .iov_len = sizeof(hello)};
+    struct msghdr message = {.msg_iov = &vector,
+			     .msg_iovlen = 1,
+			     .msg_control = control.buffer,
+			     .msg_controllen = sizeof(control.buffer)};
+    const ssize_t received = recvmsg(reader->connection, &message,
+				     MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (received < 0 && errno == EAGAIN) {
+	return true;
+    }
+    if (UNLIKELY(received <= 0)) {
+	return false;
+    }
+    const struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header != NULL && header->cmsg_level == SOL_SOCKET &&
+	header->cmsg_type == SCM_RIGHTS) {
+	int descriptor = -1;
+	memcpy(&descriptor, CMSG_DATA(header), sizeof(descriptor));
+	// a reader that never drains its eventfd must not block us once
+	// the counter saturates, whatever flags it created it with
+	if ((hello & RESULTS_HELLO_WAKE) != 0 &&
+	    fcntl(descriptor, F_SETFL, O_NONBLOCK) == 0) {
+	    reader->wake_descriptor = descriptor;
+	} else {
+	    close(descriptor);
+	}
+    }
+
+    const int shared = publisher->share_descriptor;
+    unsigned char version = (unsigned char)RESULTS_VERSION;
+    vector = (struct iovec){.iov_base = &version, .iov_len = sizeof(version)};
+    memset(&control, 0, sizeof(control));
+    message = (struct msghdr){.msg_iov = &vector,
+			      .msg_iovlen = 1,
+			      .msg_control = control.buffer,
+			      .msg_controllen = sizeof(control.buffer)};
+    struct cmsghdr *reply = CMSG_FIRSTHDR(&message);
+    reply->cmsg_level = SOL_SOCKET;
+    reply->cmsg_type = SCM_RIGHTS;
+    reply->cmsg_len = CMSG_LEN(sizeof(shared));
+    memcpy(CMSG_DATA(reply), &shared, sizeof(shared));
+    if (UNLIKELY(sendmsg(reader->connection, &message,
+			 MSG_DONTWAIT | MSG_NOSIGNAL) < 0)) {
+	return false;
+    }
+    reader->ready = true;
+    return true;
+}
+
+static void answerReaders(Publisher *publisher) {
+    for (int index = publisher->reader_count - 1; index >= 0; --index) {
+	PublishReader *reader = &publisher->readers[index];
+	if (!reader->ready && !answerReader(publisher, reader)) {
+	    dropReader(publisher, index);
+	}
+    }
+}
+
+// listening descriptor readable, takes every waiting connection
+void Publisher_accept(Publisher *publisher) {
+    int connection = -1;
+    while ((connection = accept4(publisher->listen_descriptor, NULL, NULL,
+				 SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+	if (publisher->reader_count == PUBLISH_MAX_READERS) {
+	    dropClosedReaders(publisher);
+	}
+	if (UNLIKELY(publisher->reader_count == PUBLISH_MAX_READERS)) {
+	    close(connection);
+	    publisher->rejected++;
+	    continue;
+	}
+	publisher->readers[publisher->reader_count++] = (PublishReader){
+	    .connection = connection, .wake_descriptor = -1, .ready = false};
+    }
+    answerReaders(publisher);
+}
+
+static void copyFingertips(ResultsSlot *slot,
+			   const FingertipTracker *tracker) {
+    uint32_t count = 0;
+    for (int index = 0; index < TRACKER_MAX_TRACKS; ++index) {
+	const FingertipTrack *track = &tracker->tracks[index];
+	if (!track->active || count == RESULTS_MAX_FINGERTIPS) {
+	    continue;
+	}
+	slot->fingertips[count++] =
+	    (ResultsFingertip){.id = track->id,
+			       .x = track->position.x,
+			       .y = track->position.y,
+			       .velocity_x = track->velocity_x,
+			       .velocity_y = track->velocity_y,
+			       .reserved = 0};
+    }
+    slot->fingertip_count = count;
+}
+
+static void wakeReaders(const Publisher *publisher) {
+    for (int index = 0; index < publisher->reader_count; ++index) {
+	const int descriptor = publisher->readers[index].wake_descriptor;
+	if (descriptor >= 0) {
+	    EventLoop_signal(descriptor);
+	}
+    }
+}
+
+// seqlock write, the slot reads odd while it changes and the head only
+// moves once it is whole again
+void Publisher_publish(Publisher *publisher, const CameraResult *result) {
+    ResultsSegment *segment = publisher->segment;
+    const unsigned long long index = publisher->published;
+    ResultsSlot *slot = &segment->slots[index % RESULTS_SLOTS];
+    const uint32_t sequence =
+	atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, sequence + 1,
+			  memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->camera = (uint32_t)result->camera;
+    slot->index = index;
+    slot->capture_timestamp = result->timestamp;
+    slot->gesture = (uint32_t)result->gesture;
+    copyFingertips(slot, &result->tracker);
+    const int hullCount = result->hull_count < (int)RESULTS_MAX_HULL
+			      ? result->hull_count
+			      : (int)RESULTS_MAX_HULL;
+    for (int point = 0; point < hullCount; ++point) {
+	slot->hull[point] = (ResultsPoint){.x = result->hull[point].x,
+					   .y = result->hull[point].y};
+    }
+    slot->hull_count = (uint32_t)hullCount;
+    slot->publish_timestamp = monotonicNanoseconds();
+
+    atomic_store_explicit(&slot->sequence, sequence + 2,
+			  memory_order_release);
+    atomic_store_explicit(&segment->head, index + 1, memory_order_release);
+    publisher->published = index + 1;
+
+    wakeReaders(publisher);
+    answerReaders(publisher);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "camera.h"
+#include "results.h"
+#include "types.h"
+
+#define PUBLISH_MAX_READERS 8
+
+typedef struct {
+    int connection;
+    int wake_descriptor;  // -1 for a reader that polls
+    bool ready;           // hello answered
+} __attribute__((aligned(16))) PublishReader;
+
+typedef struct {
+    PublishReader readers[PUBLISH_MAX_READERS];
+    ResultsSegment *segment;
+    const char *socket_path;
+    unsigned long long published;
+    unsigned long long rejected;
+    int memory_descriptor;
+    int share_descriptor;  // read only reopening of the segment
+    int listen_descriptor;
+    int reader_count;
+} __attribute__((aligned(64))) Publisher;
+
+ErrorCode Publisher_create(Publisher *publisher, const char *socketPath,
+			   FrameDimensions dimensions);
+
+void Publisher_destroy(Publisher *publisher);
+
+int Publisher_descriptor(const Publisher *publisher);
+
+void Publisher_accept(Publisher *publisher);
+
+void Publisher_publish(Publisher *publisher, const CameraResult *result);
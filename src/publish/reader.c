@@ -0,0 +1,265 @@
+/*
+    Reader side of the shared tracking results, meant to be dropped into
+    other programs along with `results.h`, maps the publisher's segment
+    read only and copies slots out under their seqlock, never writes to
+    anything the publisher looks at, exposed api is in `reader.h`
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "reader.h"
+
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "branch.h"
+#include "results.h"
+#include "types.h"
+
+// the publisher answers from its event loop, normally within a frame
+static const time_t OPEN_TIMEOUT_SECONDS = 2;
+// a writer rewrites a slot in well under a microsecond, failing this
+// many times in a row means it was lapped again or the publisher died
+static const int READ_ATTEMPTS = 64;
+
+static ErrorCode connectTo(ResultsReader *reader, const char *socketPath) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    const size_t length = strlen(socketPath);
+    if (UNLIKELY(length == 0 || length >= sizeof(address.sun_path))) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    memcpy(address.sun_path, socketPath, length + 1);
+
+    reader->connection = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (UNLIKELY(reader->connection < 0)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    const struct timeval timeout = {.tv_sec = OPEN_TIMEOUT_SECONDS};
+    if (UNLIKELY(setsockopt(reader->connection, SOL_SOCKET, SO_RCVTIMEO,
+			    &timeout, sizeof(timeout)) < 0 ||
+		 connect(reader->connection,
+			 (const struct sockaddr *)&address,
+			 sizeof(address)) < 0)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    return ERROR_NONE;
+}
+
+// one byte each way, the hello carries our eventfd when we want wakeups
+// and the reply carries the segment
+static ErrorCode exchange(ResultsReader *reader, int *memoryDescriptor) {
+    union {
+	char buffer[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    unsigned char byte = reader->wake_descriptor >= 0 ? RESULTS_HELLO_WAKE : 0;
+    struct iovec vector = {.iov_base = &byte, .iov_len = sizeof(byte)};
+    struct msghdr message = {.msg_iov = &vector, .msg_iovlen = 1};
+    if (reader->wake_descriptor >= 0) {
+	message.msg_control = control.buffer;
+	message.msg_controllen = sizeof(control.buffer);
+	struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+	header->cmsg_level = SOL_SOCKET;
+	header->cmsg_type = SCM_RIGHTS;
+	header->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(header), &reader->wake_descriptor, sizeof(int));
+    }
+    if (UNLIKELY(sendmsg(reader->connection, &message, MSG_NOSIGNAL) < 0)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+
+    memset(&control, 0, sizeof(control));
+    message = (struct msghdr){.msg_iov = &vector,
+			      .msg_iovlen = 1,
+			      .msg_control = control.buffer,
+			      .msg_controllen = sizeof(control.buffer)};
+    if (UNLIKELY(recvmsg(reader->connection, &message, 0) <= 0)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    const struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (UNLIKELY(header == NULL || header->cmsg_level != SOL_SOCKET ||
+		 header->cmsg_type != SCM_RIGHTS)) {
+	return ERROR_FILE_OPEN_FAILED;
+    }
+    memcpy(memoryDescriptor, CMSG_DATA(header), sizeof(int));
+    return byte == RESULTS_VERSION ? ERROR_NONE
+				   : ERROR_UNSUPPORTED_OPERATION;
+}
+
+static bool validSegment(const ResultsSegment *segment) {
+    return segment->magic == RESULTS_MAGIC &&
+	   segment->version == RESULTS_VERSION &&
+	   segment->header_size == offsetof(ResultsSegment, slots) &&
+	   segment->slot_size == sizeof(ResultsSlot) &&
+	   segment->slot_count == RESULTS_SLOTS &&
+	   segment->max_fingertips == RESULTS_MAX_FINGERTIPS &&
+	   segment->max_hull == RESULTS_MAX_HULL;
+}
+
+static ErrorCode mapSegment(ResultsReader *reader,
+			    const int memoryDescriptor) {
+    void *mapping = mmap(NULL, sizeof(ResultsSegment), PROT_READ,
+			 MAP_SHARED, memoryDescriptor, 0);
+    if (UNLIKELY(mapping == MAP_FAILED)) {
+	return ERROR_MMAP_FAILED;
+    }
+    reader->segment = (const ResultsSegment *)mapping;
+    if (UNLIKELY(!validSegment(reader->segment))) {
+	return ERROR_UNSUPPORTED_OPERATION;
+    }
+    return ERROR_NONE;
+}
+
+// starts at the newest publication, wakeups ask the publisher to signal
+// an eventfd of ours after every one
+ErrorCode ResultsReader_open(ResultsReader *reader, const char *socketPath,
+			     const bool wakeups) {
+    memset(reader, 0, sizeof(*reader));
+    reader->connection = -1;
+    reader->wake_descriptor = -1;
+    int memoryDescriptor = -1;
+
+    ErrorCode error = connectTo(reader, socketPath);
+    if (LIKELY(error == ERROR_NONE) && wakeups) {
+	reader->wake_descriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	error = reader->wake_descriptor >= 0 ? ERROR_NONE
+					     : ERROR_FILE_OPEN_FAILED;
+    }
+    if (LIKELY(error == ERROR_NONE)) {
+	error = exchange(reader, &memoryDescriptor);
+    }
+    if (LIKELY(memoryDescriptor >= 0)) {
+	if (LIKELY(error == ERROR_NONE)) {
+	    error = mapSegment(reader, memoryDescriptor);
+	}
+	close(memoryDescriptor);
+    }
+    if (UNLIKELY(error != ERROR_NONE)) {
+	ResultsReader_close(reader);
+	return error;
+    }
+    reader->cursor =
+	atomic_load_explicit(&reader->segment->head, memory_order_acquire);
+    return ERROR_NONE;
+}
+
+// the publisher notices the closed connection when it needs the place
+void ResultsReader_close(ResultsReader *reader) {
+    if (reader->segment != NULL) {
+	munmap((void *)(uintptr_t)reader->segment, sizeof(ResultsSegment));
+	reader->segment = NULL;
+    }
+    if (reader->wake_descriptor >= 0) {
+	close(reader->wake_descriptor);
+	reader->wake_descriptor = -1;
+    }
+    if (reader->connection >= 0) {
+	close(reader->connection);
+	reader->connection = -1;
+    }
+}
+
+// seqlock read, the copy only counts if the sequence was even and the
+// same on both sides of it
+static bool copySlot(const ResultsSlot *slot, ResultsSlot *copy) {
+    for (int attempt = 0; attempt < READ_ATTEMPTS; ++attempt) {
+	const uint32_t before =
+	    atomic_load_explicit(&slot->sequence, memory_order_acquire);
+	if ((before & 1U) != 0) {
+	    continue;
+	}
+	memcpy(copy, slot, sizeof(*copy));
+	atomic_thread_fence(memory_order_acquire);
+	if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) ==
+	    before) {
+	    return true;
+	}
+    }
+    return false;
+}
+
+// in publication order, results the publisher lapped before we got to
+// them are skipped and counted in missed
+bool ResultsReader_next(ResultsReader *reader, ResultsSlot *slot) {
+    const ResultsSegment *segment = reader->segment;
+    const unsigned long long head =
+	atomic_load_explicit(&segment->head, memory_order_acquire);
+    if (head - reader->cursor > RESULTS_SLOTS) {
+	reader->missed += head - RESULTS_SLOTS - reader->cursor;
+	reader->cursor = head - RESULTS_SLOTS;
+    }
+    while (reader->cursor != head) {
+	const unsigned long long index = reader->cursor++;
+	if (LIKELY(copySlot(&segment->slots[index % RESULTS_SLOTS], slot) &&
+		   slot->index == index)) {
+	    return true;
+	}
+	reader->missed++;
+    }
+    return false;
+}
+
+// only the newest result, for readers that draw rather than log
+bool ResultsReader_latest(ResultsReader *reader, ResultsSlot *slot) {
+    const unsigned long long head =
+	atomic_load_explicit(&reader->segment->head, memory_order_acquire);
+    if (head - reader->cursor > 1) {
+	reader->missed += head - 1 - reader->cursor;
+	reader->cursor = head - 1;
+    }
+    return ResultsReader_next(reader, slot);
+}
+
+static void drainWakes(const ResultsReader *reader) {
+    uint64_t count = 0;
+    // nothing pending fails the read, the descriptor is non blocking
+    const ssize_t bytes = read(reader->wake_descriptor, &count, sizeof(count));
+    (void)bytes;
+}
+
+static bool hasUnread(const ResultsReader *reader) {
+    return atomic_load_explicit(&reader->segment->head,
+				memory_order_acquire) != reader->cursor;
+}
+
+static long long monotonicMilliseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((long long)now.tv_sec * 1000LL) + (now.tv_nsec / 1000000L);
+}
+
+// true once something is unread, false after sleeping on the eventfd for
+// timeoutMilliseconds, a reader without wakeups only checks
+bool ResultsReader_wait(ResultsReader *reader,
+			const int timeoutMilliseconds) {
+    if (reader->wake_descriptor < 0) {
+	return hasUnread(reader);
+    }
+    const long long deadline = monotonicMilliseconds() + timeoutMilliseconds;
+    struct pollfd descriptor = {.fd = reader->wake_descriptor,
+				.events = POLLIN};
+    for (;;) {
+	// a wake can trail the head it announces, so it may be for a
+	// result next already handed out
+	drainWakes(reader);
+	if (hasUnread(reader)) {
+	    return true;
+	}
+	const long long remaining = deadline - monotonicMilliseconds();
+	if (remaining <= 0 || poll(&descriptor, 1, (int)remaining) <= 0) {
+	    return false;
+	}
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "results.h"
+#include "types.h"
+
+typedef struct {
+    const ResultsSegment *segment;
+    unsigned long long cursor;  // next publication to hand out
+    unsigned long long missed;  // lapped by the publisher before read
+    int connection;
+    int wake_descriptor;  // -1 without wakeups
+} __attribute__((aligned(32))) ResultsReader;
+
+ErrorCode ResultsReader_open(ResultsReader *reader, const char *socketPath,
+			     bool wakeups);
+
+void ResultsReader_close(ResultsReader *reader);
+
+bool ResultsReader_next(ResultsReader *reader, ResultsSlot *slot);
+
+bool ResultsReader_latest(ResultsReader *reader, ResultsSlot *slot);
+
+bool ResultsReader_wait(ResultsReader *reader, int timeoutMilliseconds);
@@ -0,0 +1,68 @@
+/*
+    Layout of the shared tracking results segment, the only thing a reader
+    in another process has to agree on with the publisher, fixed width
+    fields and explicit padding so any compiler and language maps it the
+    same way, bump RESULTS_VERSION on any change
+*/
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define RESULTS_MAGIC 0x52534D48U  // "HMSR" little endian
+#define RESULTS_VERSION 1U
+// a power of two, a reader more than this many frames behind loses some
+#define RESULTS_SLOTS 64U
+#define RESULTS_MAX_FINGERTIPS 10U
+#define RESULTS_MAX_HULL 64U
+
+// hello and reply on the publisher's socket, the hello may carry the
+// reader's eventfd and the reply always carries the segment
+#define RESULTS_HELLO_WAKE 1U
+
+typedef struct {
+    int32_t id;
+    int32_t x;
+    int32_t y;
+    float velocity_x;
+    float velocity_y;
+    int32_t reserved;
+} __attribute__((aligned(8))) ResultsFingertip;
+
+typedef struct {
+    int32_t x;
+    int32_t y;
+} __attribute__((aligned(8))) ResultsPoint;
+
+// sequence is a seqlock, odd while the publisher rewrites the slot, index
+// counts publications from zero so a reader can tell it was lapped
+typedef struct {
+    _Atomic uint32_t sequence;
+    uint32_t camera;
+    uint64_t index;
+    uint64_t capture_timestamp;  // CLOCK_MONOTONIC ns
+    uint64_t publish_timestamp;  // CLOCK_MONOTONIC ns
+    uint32_t gesture;
+    uint32_t fingertip_count;
+    uint32_t hull_count;
+    uint32_t reserved;
+    ResultsFingertip fingertips[RESULTS_MAX_FINGERTIPS];
+    ResultsPoint hull[RESULTS_MAX_HULL];
+} __attribute__((aligned(64))) ResultsSlot;
+
+// head is the number of publications so far, slot index % RESULTS_SLOTS
+// holds publication index once head has passed it
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t slot_size;
+    uint32_t slot_count;
+    uint32_t width;
+    uint32_t height;
+    uint32_t max_fingertips;
+    uint32_t max_hull;
+    _Atomic uint64_t head __attribute__((aligned(64)));
+    ResultsSlot slots[RESULTS_SLOTS] __attribute__((aligned(64)));
+} __attribute__((aligned(64))) ResultsSegment;
@@ -0,0 +1,467 @@
+/*
+    Extra cameras, each captured and recognised on its own thread pinned to
+    its own core, handing results to the main loop through a single
+    producer queue that a merger drains in capture timestamp order,
+    exposed api is in `camera.h`
+*/
+
+// pthread_setaffinity_np and the cpu_set_t macros
+#define _GNU_SOURCE
+
+#include "camera.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "branch.h"
+#include "capture.h"
+#include "latency.h"
+#include "loop.h"
+#include "pipeline.h"
+#include "pointset.h"
+#include "recognize.h"
+#include "trace.h"
+#include "types.h"
+
+static const unsigned long long NANOSECONDS_PER_SECOND = 1000000000ULL;
+// longest a frame sits captured in the driver before an idle camera
+// thread dequeues it, an idle camera can still deliver anything older
+static const unsigned long long IDLE_SLACK = 2000000ULL;
+
+static unsigned long long monotonicNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((unsigned long long)now.tv_sec * NANOSECONDS_PER_SECOND) +
+	   (unsigned long long)now.tv_nsec;
+}
+
+void CameraQueue_init(CameraQueue *queue) {
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->in_flight, 0);
+    atomic_init(&queue->overruns, 0);
+}
+
+// producer only, marks a dequeued frame that will show up as a result
+void CameraQueue_begin(CameraQueue *queue, const unsigned long long timestamp) {
+    atomic_store_explicit(&queue->in_flight, timestamp, memory_order_release);
+}
+
+// keeps every vertex of a small hull, a larger one keeps evenly spaced ones
+static void copyHull(CameraResult *result, const PointSet *hull) {
+    const int count =
+	hull->count < CAMERA_HULL_POINTS ? hull->count : CAMERA_HULL_POINTS;
+    for (int index = 0; index < count; ++index) {
+	const int source = (index * hull->count) / count;
+	result->hull[index].x = hull->x[source];
+	result->hull[index].y = hull->y[source];
+    }
+    result->hull_count = count;
+}
+
+// producer only, a full queue drops the result instead of waiting so a
+// slow consumer never stalls the camera
+bool CameraQueue_push(CameraQueue *queue, const HandPipeline *pipeline,
+		      const CaptureFrame *frame, const int camera) {
+    const unsigned int head =
+	atomic_load_explicit(&queue->head, memory_order_relaxed);
+    const unsigned int tail =
+	atomic_load_explicit(&queue->tail, memory_order_acquire);
+    bool pushed = false;
+    if (LIKELY(head - tail < CAMERA_QUEUE_CAPACITY)) {
+	CameraResult *result = &queue->results[head % CAMERA_QUEUE_CAPACITY];
+	result->tracker = pipeline->tracker;
+	result->timestamp = frame->timestamp;
+	result->sequence = frame->sequence;
+	result->camera = camera;
+	copyHull(result, &pipeline->hull);
+	result->gesture = pipeline->classifier.loaded
+			      ? pipeline->classifier.gesture
+			      : GESTURE_NONE;
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+	pushed = true;
+    } else {
+	atomic_fetch_add_explicit(&queue->overruns, 1, memory_order_relaxed);
+    }
+    // after the head, whoever sees the frame finished also sees its result
+    atomic_store_explicit(&queue->in_flight, 0, memory_order_release);
+    return pushed;
+}
+
+// consumer only, NULL when empty, the result stays valid until released
+const CameraResult *CameraQueue_peek(CameraQueue *queue) {
+    const unsigned int tail =
+	atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    const unsigned int head =
+	atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (head == tail) {
+	return NULL;
+    }
+    return &queue->results[tail % CAMERA_QUEUE_CAPACITY];
+}
+
+// consumer only
+void CameraQueue_release(CameraQueue *queue) {
+    const unsigned int tail =
+	atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+}
+
+// the worker's buffers are all allocated after this, so first touch keeps
+// them on the memory node of the core it runs on
+static void pinToCore(const int core) {
+    cpu_set_t cores;
+    CPU_ZERO(&cores);
+    CPU_SET((size_t)core, &cores);
+    // a restricted cpuset only loses the placement, not the camera
+    (void)pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores);
+}
+
+// camera modulo the online cores, -1 leaves a single core machine alone
+static int coreFor(const int camera) {
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 1 ? (int)(camera % cores) : -1;
+}
+
+/*
+    Pins the calling thread to the core CameraWorker_start gives camera,
+    for the main loop to claim core 0 for camera 0. Call it after every
+    other thread started, they would inherit the mask.
+*/
+void CameraWorker_pinCaller(const int camera) {
+    const int core = coreFor(camera);
+    if (core >= 0) {
+	pinToCore(core);
+    }
+}
+
+// released so whoever sees the error also sees every result pushed before
+static bool failWorker(CameraWorker *worker, const ErrorCode error) {
+    atomic_store_explicit(&worker->error, error, memory_order_release);
+    atomic_store_explicit(&worker->queue.in_flight, 0, memory_order_release);
+    EventLoop_signal(worker->notify_descriptor);
+    return true;
+}
+
+static bool onCameraFrame(void *context) {
+    CameraWorker *worker = (CameraWorker *)context;
+    const unsigned int previous = worker->frame.sequence;
+    TRACE_BEGIN(TRACE_CAPTURE);
+    ErrorCode error = CaptureDevice_dequeue(&worker->capture, &worker->frame);
+    TRACE_END(TRACE_CAPTURE);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return failWorker(worker, error);
+    }
+    const unsigned long long dequeued = monotonicNanoseconds();
+    CameraQueue_begin(&worker->queue, worker->frame.timestamp);
+    if (worker->sequenced && worker->frame.sequence - previous > 1) {
+	atomic_fetch_add_explicit(&worker->dropped_frames,
+				  worker->frame.sequence - previous - 1,
+				  memory_order_relaxed);
+    }
+    worker->sequenced = true;
+
+    error = HandPipeline_process(worker->pipeline, worker->frame.data,
+				 worker->frame.timestamp);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return failWorker(worker, error);
+    }
+    LatencyHistogram_record(&worker->recognition,
+			    monotonicNanoseconds() - dequeued);
+    atomic_store_explicit(&worker->gesture_err, worker->pipeline->gesture_err,
+			  memory_order_relaxed);
+    atomic_store_explicit(&worker->gesture_failures,
+			  worker->pipeline->gesture_failures,
+			  memory_order_relaxed);
+    (void)CameraQueue_push(&worker->queue, worker->pipeline, &worker->frame,
+			   worker->camera);
+    EventLoop_signal(worker->notify_descriptor);
+    atomic_fetch_add_explicit(&worker->frames, 1, memory_order_relaxed);
+
+    error = CaptureDevice_queue(&worker->capture);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return failWorker(worker, error);
+    }
+    return false;
+}
+
+static bool onStop(void *context) {
+    (void)context;
+    return true;
+}
+
+// runs on the worker thread, undoes itself on failure
+static ErrorCode openWorker(CameraWorker *worker) {
+    ErrorCode error =
+	CaptureDevice_openSource(&worker->capture, worker->source,
+				 worker->dimensions, worker->replay_rate);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+    // the pipeline's own state is as hot as its buffers, so it is
+    // allocated here as well rather than inside the worker
+    worker->pipeline =
+	(HandPipeline *)aligned_alloc(_Alignof(HandPipeline),
+				      sizeof(HandPipeline));
+    if (UNLIKELY(worker->pipeline == NULL)) {
+	error = ERROR_ALLOCATION_FAILED;
+	goto error_close_capture;
+    }
+    error = HandPipeline_create(worker->pipeline, worker->dimensions);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	goto error_free_pipeline;
+    }
+    if (worker->model_path != NULL) {
+	// without the model this camera still reports fingertips
+	(void)HandPipeline_loadGestureModel(worker->pipeline,
+					    worker->model_path);
+    }
+    if (worker->denoise) {
+	(void)HandPipeline_enableDenoise(worker->pipeline);
+    }
+
+    error = EventLoop_create(&worker->loop);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	goto error_destroy_pipeline;
+    }
+    error = EventLoop_watch(&worker->loop, worker->capture.file_descriptor,
+			    onCameraFrame, worker);
+    if (LIKELY(error == ERROR_NONE)) {
+	error = EventLoop_addWake(&worker->loop, onStop, worker,
+				  &worker->stop_descriptor);
+    }
+    if (LIKELY(error == ERROR_NONE)) {
+	error = CaptureDevice_queue(&worker->capture);
+    }
+    if (UNLIKELY(error != ERROR_NONE)) {
+	goto error_destroy_loop;
+    }
+    return ERROR_NONE;
+
+error_destroy_loop:
+    EventLoop_destroy(&worker->loop);
+error_destroy_pipeline:
+    HandPipeline_destroy(worker->pipeline);
+error_free_pipeline:
+    free(worker->pipeline);
+    worker->pipeline = NULL;
+error_close_capture:
+    CaptureDevice_close(&worker->capture);
+    return error;
+}
+
+static void *cameraThread(void *argument) {
+    CameraWorker *worker = (CameraWorker *)argument;
+    if (worker->core >= 0) {
+	pinToCore(worker->core);
+    }
+    const ErrorCode error = openWorker(worker);
+
+    pthread_mutex_lock(&worker->lock);
+    atomic_store_explicit(&worker->error, error, memory_order_relaxed);
+    worker->ready = true;
+    pthread_cond_signal(&worker->ready_signal);
+    pthread_mutex_unlock(&worker->lock);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return NULL;
+    }
+
+    const ErrorCode run_err = EventLoop_run(&worker->loop);
+    if (UNLIKELY(run_err != ERROR_NONE)) {
+	(void)failWorker(worker, run_err);
+    }
+    return NULL;
+}
+
+/*
+    Opens source (see CaptureDevice_openSource) and its pipeline on a new
+    thread pinned to core camera modulo the online cores. Camera 0 has no
+    worker, the main loop recognises it on core 0 next to drawing, midi,
+    publishing and delivering every camera's results, so until cores run
+    out no worker shares a core, but a slow camera 0 frame still delays
+    the results the workers already queued.
+    notifyDescriptor, an eventfd, is signalled for every result and when
+    the camera fails. denoise turns on the pipeline's temporal filter.
+    Must be called after the caller blocked the signals it handles
+    through signalfd, the thread inherits the mask.
+*/
+ErrorCode CameraWorker_start(CameraWorker *worker, const char *source,
+			     const FrameDimensions dimensions,
+			     const unsigned int replayRate, const int camera,
+			     const char *modelPath, const bool denoise,
+			     const int notifyDescriptor) {
+    worker->source = source;
+    worker->model_path = modelPath;
+    worker->denoise = denoise;
+    worker->dimensions = dimensions;
+    worker->replay_rate = replayRate;
+    worker->camera = camera;
+    worker->core = coreFor(camera);
+    worker->notify_descriptor = notifyDescriptor;
+    worker->stop_descriptor = -1;
+    worker->sequenced = false;
+    worker->ready = false;
+    memset(&worker->frame, 0, sizeof(worker->frame));
+    CameraQueue_init(&worker->queue);
+    LatencyHistogram_reset(&worker->recognition);
+    atomic_init(&worker->frames, 0);
+    atomic_init(&worker->dropped_frames, 0);
+    atomic_init(&worker->gesture_failures, 0);
+    atomic_init(&worker->gesture_err, ERROR_NONE);
+    atomic_init(&worker->error, ERROR_NONE);
+
+    pthread_mutex_init(&worker->lock, NULL);
+    pthread_cond_init(&worker->ready_signal, NULL);
+    if (UNLIKELY(pthread_create(&worker->thread, NULL, cameraThread,
+				worker) != 0)) {
+	pthread_cond_destroy(&worker->ready_signal);
+	pthread_mutex_destroy(&worker->lock);
+	return ERROR_UNSUPPORTED_OPERATION;
+    }
+    pthread_mutex_lock(&worker->lock);
+    while (!worker->ready) {
+	pthread_cond_wait(&worker->ready_signal, &worker->lock);
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    const ErrorCode error = CameraWorker_error(worker);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	pthread_join(worker->thread, NULL);
+	pthread_cond_destroy(&worker->ready_signal);
+	pthread_mutex_destroy(&worker->lock);
+    }
+    return error;
+}
+
+// also after the camera failed on its own, its thread is still joined
+void CameraWorker_stop(CameraWorker *worker) {
+    EventLoop_signal(worker->stop_descriptor);
+    pthread_join(worker->thread, NULL);
+    EventLoop_destroy(&worker->loop);
+    CaptureDevice_close(&worker->capture);
+    HandPipeline_destroy(worker->pipeline);
+    free(worker->pipeline);
+    worker->pipeline = NULL;
+    pthread_cond_destroy(&worker->ready_signal);
+    pthread_mutex_destroy(&worker->lock);
+}
+
+ErrorCode CameraWorker_error(const CameraWorker *worker) {
+    return (ErrorCode)atomic_load_explicit(&worker->error,
+					   memory_order_acquire);
+}
+
+// window bounds how long a result waits for a slower camera's older one
+void CameraMerger_init(CameraMerger *merger,
+		       const unsigned long long window) {
+    memset(merger, 0, sizeof(*merger));
+    merger->window = window;
+    merger->current = -1;
+}
+
+ErrorCode CameraMerger_add(CameraMerger *merger, CameraQueue *queue) {
+    if (UNLIKELY(merger->queue_count >= CAMERA_MAX_DEVICES)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    merger->queues[merger->queue_count++] = queue;
+    return ERROR_NONE;
+}
+
+// true once no other camera can still deliver something older, in flight
+// is read before the queue so a result pushed in between is not missed
+static bool settled(const CameraMerger *merger, const int oldest,
+		    const unsigned long long timestamp,
+		    const unsigned long long now) {
+    if (now >= timestamp + merger->window) {
+	return true;
+    }
+    for (int index = 0; index < merger->queue_count; ++index) {
+	if (index == oldest) {
+	    continue;
+	}
+	CameraQueue *queue = merger->queues[index];
+	const unsigned long long inFlight =
+	    atomic_load_explicit(&queue->in_flight, memory_order_acquire);
+	if (CameraQueue_peek(queue) != NULL) {
+	    continue;
+	}
+	if (inFlight != 0 ? inFlight < timestamp
+			  : now < timestamp + IDLE_SLACK) {
+	    return false;
+	}
+    }
+    return true;
+}
+
+/*
+    The oldest result across every camera once it is settled, else NULL
+    and the caller tries again on the next result or tick. Results older
+    than one already handed out arrived after the window gave up on them,
+    they are dropped and counted as late so the stream stays in order.
+*/
+const CameraResult *CameraMerger_next(CameraMerger *merger,
+				      const unsigned long long now) {
+    for (;;) {
+	const CameraResult *oldest = NULL;
+	int oldestIndex = -1;
+	for (int index = 0; index < merger->queue_count; ++index) {
+	    const CameraResult *head = CameraQueue_peek(merger->queues[index]);
+	    if (head != NULL &&
+		(oldest == NULL || head->timestamp < oldest->timestamp)) {
+		oldest = head;
+		oldestIndex = index;
+	    }
+	}
+	if (oldest == NULL) {
+	    return NULL;
+	}
+	if (UNLIKELY(oldest->timestamp < merger->last_timestamp)) {
+	    CameraQueue_release(merger->queues[oldestIndex]);
+	    merger->late++;
+	    continue;
+	}
+	if (!settled(merger, oldestIndex, oldest->timestamp, now)) {
+	    return NULL;
+	}
+	merger->current = oldestIndex;
+	merger->last_timestamp = oldest->timestamp;
+	return oldest;
+    }
+}
+
+// hands the last result from CameraMerger_next back to its queue
+void CameraMerger_release(CameraMerger *merger) {
+    if (merger->current >= 0) {
+	CameraQueue_release(merger->queues[merger->current]);
+	merger->current = -1;
+    }
+}
+
+/*
+    Stops merging queue, for a camera that failed. Its pending results are
+    dropped rather than handed out after the caller released its fingers,
+    and the other cameras no longer wait on it. Must not be called between
+    CameraMerger_next and CameraMerger_release.
+*/
+void CameraMerger_remove(CameraMerger *merger, CameraQueue *queue) {
+    int index = 0;
+    while (index < merger->queue_count && merger->queues[index] != queue) {
+	index++;
+    }
+    if (index == merger->queue_count) {
+	return;
+    }
+    while (CameraQueue_peek(queue) != NULL) {
+	CameraQueue_release(queue);
+    }
+    merger->queue_count--;
+    for (; index < merger->queue_count; ++index) {
+	merger->queues[index] = merger->queues[index + 1];
+    }
+}
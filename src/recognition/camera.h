@@ -0,0 +1,110 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "capture.h"
+#include "gesture.h"
+#include "latency.h"
+#include "loop.h"
+#include "pipeline.h"
+#include "track.h"
+#include "types.h"
+
+#define CAMERA_MAX_DEVICES 4
+#define CAMERA_QUEUE_CAPACITY 8
+#define CAMERA_HULL_POINTS 64
+
+// one recognised frame, copied out so its camera can go on to the next,
+// the hull is the last detected one thinned to at most CAMERA_HULL_POINTS
+typedef struct {
+    FingertipTracker tracker;
+    Point hull[CAMERA_HULL_POINTS];
+    unsigned long long timestamp;
+    unsigned int sequence;
+    int camera;
+    int hull_count;
+    Gesture gesture;
+} __attribute__((aligned(64))) CameraResult;
+
+// single producer single consumer, in_flight is the capture timestamp of
+// the frame the producer is working on, zero while it waits for one
+typedef struct {
+    _Atomic unsigned int head __attribute__((aligned(64)));
+    _Atomic unsigned int tail __attribute__((aligned(64)));
+    _Atomic unsigned long long in_flight;
+    _Atomic unsigned long long overruns;
+    CameraResult results[CAMERA_QUEUE_CAPACITY];
+} __attribute__((aligned(64))) CameraQueue;
+
+void CameraQueue_init(CameraQueue *queue);
+
+void CameraQueue_begin(CameraQueue *queue, unsigned long long timestamp);
+
+bool CameraQueue_push(CameraQueue *queue, const HandPipeline *pipeline,
+		      const CaptureFrame *frame, int camera);
+
+const CameraResult *CameraQueue_peek(CameraQueue *queue);
+
+void CameraQueue_release(CameraQueue *queue);
+
+typedef struct {
+    CameraQueue queue;
+    LatencyHistogram recognition;
+    HandPipeline *pipeline;
+    CaptureDevice capture;
+    EventLoop loop;
+    CaptureFrame frame;
+    FrameDimensions dimensions;
+    const char *source;
+    const char *model_path;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready_signal;
+    _Atomic unsigned long long frames;
+    _Atomic unsigned long long dropped_frames;
+    _Atomic unsigned long long gesture_failures;
+    _Atomic int gesture_err;
+    _Atomic int error;
+    unsigned int replay_rate;
+    int camera;
+    int core;
+    int notify_descriptor;
+    int stop_descriptor;
+    bool denoise;
+    bool sequenced;
+    bool ready;
+} __attribute__((aligned(128))) CameraWorker;
+
+ErrorCode CameraWorker_start(CameraWorker *worker, const char *source,
+			     FrameDimensions dimensions,
+			     unsigned int replayRate, int camera,
+			     const char *modelPath, bool denoise,
+			     int notifyDescriptor);
+
+void CameraWorker_stop(CameraWorker *worker);
+
+void CameraWorker_pinCaller(int camera);
+
+ErrorCode CameraWorker_error(const CameraWorker *worker);
+
+typedef struct {
+    CameraQueue *queues[CAMERA_MAX_DEVICES];
+    unsigned long long window;
+    unsigned long long last_timestamp;
+    unsigned long long late;
+    int queue_count;
+    int current;
+} __attribute__((aligned(64))) CameraMerger;
+
+void CameraMerger_init(CameraMerger *merger, unsigned long long window);
+
+ErrorCode CameraMerger_add(CameraMerger *merger, CameraQueue *queue);
+
+const CameraResult *CameraMerger_next(CameraMerger *merger,
+				      unsigned long long now);
+
+void CameraMerger_release(CameraMerger *merger);
+
+void CameraMerger_remove(CameraMerger *merger, CameraQueue *queue);
@@ -0,0 +1,240 @@
+/*
+    Exact euclidean distance transform (Felzenszwalb & Huttenlocher) over a
+    binary mask region, its maximum is the palm centre and radius, exposed api
+    is in `distance.h`
+*/
+
+#include "distance.h"
+
+#include <immintrin.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "branch.h"
+#include "recognize.h"
+#include "types.h"
+
+static inline size_t roundUp(const size_t value, const size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+static inline int integerSqrt(const int value) {
+    int root = 0;
+    while ((root + 1) * (root + 1) <= value) {
+	root++;
+    }
+    return root;
+}
+
+ErrorCode DistanceTransform_create(DistanceTransform *transform,
+				   const FrameDimensions dimensions) {
+    memset(transform, 0, sizeof(*transform));
+    if (UNLIKELY(dimensions.width == 0 || dimensions.height == 0)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+
+    const size_t paddedWidth = roundUp(dimensions.width, 16);
+    transform->padded_width = (unsigned int)paddedWidth;
+    transform->capacity_width = dimensions.width;
+    transform->capacity_height = dimensions.height;
+
+    transform->squared_distance = (int *)aligned_alloc(
+	32, roundUp(paddedWidth * dimensions.height * sizeof(int), 32));
+    transform->vertical_distance = (short *)aligned_alloc(
+	32, roundUp(paddedWidth * dimensions.height * sizeof(short), 32));
+    transform->samples = (unsigned char *)aligned_alloc(32, paddedWidth);
+    transform->envelope_sites = (int *)malloc(paddedWidth * sizeof(int));
+    transform->envelope_bounds =
+	(float *)malloc((paddedWidth + 1) * sizeof(float));
+    if (UNLIKELY(transform->squared_distance == NULL ||
+		 transform->vertical_distance == NULL ||
+		 transform->samples == NULL ||
+		 transform->envelope_sites == NULL ||
+		 transform->envelope_bounds == NULL)) {
+	DistanceTransform_destroy(transform);
+	return ERROR_ALLOCATION_FAILED;
+    }
+    return ERROR_NONE;
+}
+
+void DistanceTransform_destroy(DistanceTransform *transform) {
+    free(transform->squared_distance);
+    free(transform->vertical_distance);
+    free(transform->samples);
+    free(transform->envelope_sites);
+    free(transform->envelope_bounds);
+    memset(transform, 0, sizeof(*transform));
+}
+
+static void sampleRow(const unsigned char *binaryRow, unsigned char *samples,
+		      const unsigned int mapWidth, const unsigned int step) {
+    if (step == 1) {
+	memcpy(samples, binaryRow, mapWidth);
+	return;
+    }
+    for (unsigned int column = 0; column < mapWidth; ++column) {
+	samples[column] = binaryRow[(size_t)column * step];
+    }
+}
+
+// distance to the nearest background pixel along each column, 16 columns per
+// iteration, rows outside the region count as background
+static void verticalPass(DistanceTransform *transform,
+			 const unsigned char *binaryInput,
+			 const FrameDimensions dimensions,
+			 const FrameRegion region, const unsigned int step) {
+    const unsigned int mapWidth = transform->map_width;
+    const unsigned int mapHeight = transform->map_height;
+    const size_t paddedWidth = transform->padded_width;
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i foreground = _mm256_set1_epi8((char)0xFF);
+
+    memset(transform->samples + mapWidth, 0, paddedWidth - mapWidth);
+    for (unsigned int row = 0; row < mapHeight; ++row) {
+	const unsigned char *binaryRow =
+	    binaryInput +
+	    ((size_t)(region.y + (row * step)) * dimensions.width) + region.x;
+	sampleRow(binaryRow, transform->samples, mapWidth, step);
+
+	short *current = transform->vertical_distance + (row * paddedWidth);
+	const short *previous = row == 0 ? NULL : current - paddedWidth;
+	for (size_t column = 0; column < paddedWidth; column += 16) {
+	    const __m128i sampled = _mm_load_si128(
+		(const __m128i *)(transform->samples + column));
+	    const __m256i mask = _mm256_cvtepi8_epi16(
+		_mm_cmpeq_epi8(sampled, _mm256_castsi256_si128(foreground)));
+	    const __m256i above =
+		previous == NULL
+		    ? _mm256_setzero_si256()
+		    : _mm256_load_si256((const __m256i *)(previous + column));
+	    _mm256_store_si256((__m256i *)(current + column),
+			       _mm256_and_si256(_mm256_add_epi16(above, one),
+						mask));
+	}
+    }
+
+    // an implicit background row below the map, as row 0 has one above
+    short *last =
+	transform->vertical_distance + ((size_t)(mapHeight - 1) * paddedWidth);
+    for (size_t column = 0; column < paddedWidth; column += 16) {
+	const __m256i bottom =
+	    _mm256_load_si256((const __m256i *)(last + column));
+	_mm256_store_si256((__m256i *)(last + column),
+			   _mm256_min_epi16(bottom, one));
+    }
+    for (unsigned int row = mapHeight - 1; row-- > 0;) {
+	short *current = transform->vertical_distance + (row * paddedWidth);
+	const short *below = current + paddedWidth;
+	for (size_t column = 0; column < paddedWidth; column += 16) {
+	    const __m256i here =
+		_mm256_load_si256((const __m256i *)(current + column));
+	    const __m256i next = _mm256_add_epi16(
+		_mm256_load_si256((const __m256i *)(below + column)), one);
+	    _mm256_store_si256((__m256i *)(current + column),
+			       _mm256_min_epi16(here, next));
+	}
+    }
+}
+
+static inline float parabolaIntersection(const short *vertical,
+					 const int site, const int column) {
+    const int columnCost =
+	(vertical[column] * vertical[column]) + (column * column);
+    const int siteCost = (vertical[site] * vertical[site]) + (site * site);
+    return (float)(columnCost - siteCost) / (float)(2 * (column - site));
+}
+
+// 1D squared distance over the lower envelope of parabolas rooted at each
+// column, columns outside the region count as background
+static void horizontalPass(DistanceTransform *transform,
+			   const unsigned int row) {
+    const int mapWidth = (int)transform->map_width;
+    const short *vertical =
+	transform->vertical_distance + ((size_t)row * transform->padded_width);
+    int *output =
+	transform->squared_distance + ((size_t)row * transform->padded_width);
+    int *sites = transform->envelope_sites;
+    float *bounds = transform->envelope_bounds;
+
+    int envelope = 0;
+    sites[0] = 0;
+    bounds[0] = -1e20F;
+    bounds[1] = 1e20F;
+    for (int column = 1; column < mapWidth; ++column) {
+	float intersection =
+	    parabolaIntersection(vertical, sites[envelope], column);
+	// bounds[0] is -inf so the envelope never empties
+	while (intersection <= bounds[envelope]) {
+	    envelope--;
+	    intersection =
+		parabolaIntersection(vertical, sites[envelope], column);
+	}
+	envelope++;
+	sites[envelope] = column;
+	bounds[envelope] = intersection;
+	bounds[envelope + 1] = 1e20F;
+    }
+
+    envelope = 0;
+    for (int column = 0; column < mapWidth; ++column) {
+	while (bounds[envelope + 1] < (float)column) {
+	    envelope++;
+	}
+	const int site = sites[envelope];
+	const int offset = column - site;
+	int distance = (offset * offset) + (vertical[site] * vertical[site]);
+
+	const int left = (column + 1) * (column + 1);
+	const int right = (mapWidth - column) * (mapWidth - column);
+	distance = left < distance ? left : distance;
+	distance = right < distance ? right : distance;
+	output[column] = distance;
+    }
+}
+
+ErrorCode DistanceTransform_compute(DistanceTransform *transform,
+				    const unsigned char *binaryInput,
+				    const FrameDimensions dimensions,
+				    const FrameRegion region,
+				    const unsigned int step,
+				    PalmEstimate *palm) {
+    if (UNLIKELY(transform == NULL || binaryInput == NULL || palm == NULL ||
+		 step == 0)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    if (UNLIKELY(region.width == 0 || region.height == 0 ||
+		 region.x + region.width > dimensions.width ||
+		 region.y + region.height > dimensions.height)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    if (UNLIKELY(region.width > transform->capacity_width ||
+		 region.height > transform->capacity_height)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+
+    transform->map_width = (region.width + step - 1) / step;
+    transform->map_height = (region.height + step - 1) / step;
+
+    verticalPass(transform, binaryInput, dimensions, region, step);
+
+    int best = 0;
+    unsigned int bestColumn = 0;
+    unsigned int bestRow = 0;
+    for (unsigned int row = 0; row < transform->map_height; ++row) {
+	horizontalPass(transform, row);
+	const int *distances = transform->squared_distance +
+			       ((size_t)row * transform->padded_width);
+	for (unsigned int column = 0; column < transform->map_width; ++column) {
+	    if (distances[column] > best) {
+		best = distances[column];
+		bestColumn = column;
+		bestRow = row;
+	    }
+	}
+    }
+
+    palm->centre.x = (int)(region.x + (bestColumn * step));
+    palm->centre.y = (int)(region.y + (bestRow * step));
+    palm->radius = integerSqrt(best) * (int)step;
+    return ERROR_NONE;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "recognize.h"
+#include "types.h"
+
+typedef struct {
+    Point centre;
+    int radius;
+} __attribute__((aligned(16))) PalmEstimate;
+
+typedef struct {
+    int *squared_distance;
+    short *vertical_distance;
+    unsigned char *samples;
+    int *envelope_sites;
+    float *envelope_bounds;
+    unsigned int map_width;
+    unsigned int map_height;
+    unsigned int padded_width;
+    unsigned int capacity_width;
+    unsigned int capacity_height;
+} __attribute__((aligned(64))) DistanceTransform;
+
+ErrorCode DistanceTransform_create(DistanceTransform *transform,
+				   FrameDimensions dimensions);
+
+void DistanceTransform_destroy(DistanceTransform *transform);
+
+ErrorCode DistanceTransform_compute(DistanceTransform *transform,
+				    const unsigned char *binaryInput,
+				    FrameDimensions dimensions,
+				    FrameRegion region, unsigned int step,
+				    PalmEstimate *palm);
@@ -0,0 +1,424 @@
+/*
+    Sparse pyramidal Lucas-Kanade optical flow (Bouguet) in fixed point, meant
+    for a handful of fingertips between full detections, exposed api is in
+    `flow.h`
+*/
+
+#include "flow.h"
+
+#include <immintrin.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "branch.h"
+#include "types.h"
+
+#define FLOW_WINDOW 16
+#define FLOW_HALF_WINDOW 8
+#define FLOW_ITERATIONS 10
+#define FLOW_WEIGHT_BITS 14
+
+// intensities are kept in Q5, scharr gradients are brought down to 2x the
+// true derivative so every product fits a 16 bit madd
+static const int INTENSITY_SHIFT = FLOW_WEIGHT_BITS - 5;
+static const int GRADIENT_SHIFT = FLOW_WEIGHT_BITS + 4;
+// minimum eigenvalue of the scaled structure tensor, about one gray level
+// per pixel over the whole window
+static const int64_t MIN_EIGENVALUE = 4LL * FLOW_WINDOW * FLOW_WINDOW;
+// |delta| in Q8 under which the iteration has converged
+static const int64_t CONVERGED = 2;
+
+ErrorCode GrayPyramid_create(GrayPyramid *pyramid,
+			     const FrameDimensions dimensions,
+			     const int levels) {
+    memset(pyramid, 0, sizeof(*pyramid));
+    if (UNLIKELY(levels <= 0 || levels > FLOW_MAX_LEVELS)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+
+    // every level lives in one block, gradients first to keep them aligned,
+    // with a vector of slack after each image so row tails load unmasked
+    size_t gradientBytes = 0;
+    size_t imageBytes = 0;
+    for (int level = 0; level < levels; ++level) {
+	const unsigned int width = dimensions.width >> level;
+	const unsigned int height = dimensions.height >> level;
+	if (UNLIKELY(width < 2 * FLOW_WINDOW || height < 2 * FLOW_WINDOW)) {
+	    return ERROR_INVALID_ARGUMENT;
+	}
+	pyramid->dimensions[level] = (FrameDimensions){
+	    .width = width, .height = height, .stride = width,
+	    .pixels = width * height};
+	gradientBytes += 2 * ((size_t)width * height + 16) * sizeof(short);
+	imageBytes += (size_t)width * height + 32;
+    }
+
+    unsigned char *storage =
+	(unsigned char *)malloc(gradientBytes + imageBytes);
+    if (UNLIKELY(storage == NULL)) {
+	return ERROR_ALLOCATION_FAILED;
+    }
+    pyramid->storage = storage;
+
+    short *gradients = (short *)storage;
+    unsigned char *images = storage + gradientBytes;
+    for (int level = 0; level < levels; ++level) {
+	const size_t pixels = pyramid->dimensions[level].pixels;
+	pyramid->gradient_x[level] = gradients;
+	pyramid->gradient_y[level] = gradients + pixels + 16;
+	pyramid->image[level] = images;
+	gradients += 2 * (pixels + 16);
+	images += pixels + 32;
+    }
+    pyramid->level_count = levels;
+    return ERROR_NONE;
+}
+
+void GrayPyramid_destroy(GrayPyramid *pyramid) {
+    free(pyramid->storage);
+    memset(pyramid, 0, sizeof(*pyramid));
+}
+
+static void downsample(const unsigned char *input,
+		       const FrameDimensions *inputDimensions,
+		       unsigned char *output,
+		       const FrameDimensions *outputDimensions) {
+    const __m256i ones = _mm256_set1_epi8(1);
+    const __m256i bias = _mm256_set1_epi16(1);
+
+    for (unsigned int row = 0; row < outputDimensions->height; ++row) {
+	const unsigned char *top =
+	    input + ((size_t)row * 2 * inputDimensions->width);
+	const unsigned char *bottom = top + inputDimensions->width;
+	unsigned char *outputRow =
+	    output + ((size_t)row * outputDimensions->width);
+
+	unsigned int column = 0;
+	for (; column + 16 <= outputDimensions->width; column += 16) {
+	    const __m256i vertical = _mm256_avg_epu8(
+		_mm256_loadu_si256((const __m256i *)(top + (column * 2))),
+		_mm256_loadu_si256((const __m256i *)(bottom + (column * 2))));
+	    const __m256i sums = _mm256_maddubs_epi16(vertical, ones);
+	    const __m256i pairs =
+		_mm256_srli_epi16(_mm256_add_epi16(sums, bias), 1);
+	    const __m256i packed = _mm256_permute4x64_epi64(
+		_mm256_packus_epi16(pairs, pairs), _MM_SHUFFLE(3, 1, 2, 0));
+	    _mm_storeu_si128((__m128i *)(outputRow + column),
+			     _mm256_castsi256_si128(packed));
+	}
+	for (; column < outputDimensions->width; ++column) {
+	    const unsigned int sum =
+		(unsigned int)top[column * 2] + top[(column * 2) + 1] +
+		bottom[column * 2] + bottom[(column * 2) + 1];
+	    outputRow[column] = (unsigned char)((sum + 2) >> 2);
+	}
+    }
+}
+
+static inline short scharrX(const unsigned char *center,
+			    const ptrdiff_t stride) {
+    return (short)((3 * (center[1 - stride] - center[-1 - stride])) +
+		   (10 * (center[1] - center[-1])) +
+		   (3 * (center[1 + stride] - center[-1 + stride])));
+}
+
+static inline short scharrY(const unsigned char *center,
+			    const ptrdiff_t stride) {
+    return (short)((3 * (center[stride - 1] - center[-1 - stride])) +
+		   (10 * (center[stride] - center[-stride])) +
+		   (3 * (center[stride + 1] - center[1 - stride])));
+}
+
+static inline __m256i loadWidened(const unsigned char *source) {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)source));
+}
+
+static void scharrGradients(const unsigned char *image,
+			    const FrameDimensions *dimensions,
+			    short *gradientX, short *gradientY) {
+    const size_t width = dimensions->width;
+    const size_t height = dimensions->height;
+    const __m256i three = _mm256_set1_epi16(3);
+    const __m256i ten = _mm256_set1_epi16(10);
+
+    memset(gradientX, 0, width * sizeof(short));
+    memset(gradientY, 0, width * sizeof(short));
+    memset(gradientX + ((height - 1) * width), 0, width * sizeof(short));
+    memset(gradientY + ((height - 1) * width), 0, width * sizeof(short));
+
+    for (size_t row = 1; row + 1 < height; ++row) {
+	const unsigned char *above = image + ((row - 1) * width);
+	const unsigned char *middle = above + width;
+	const unsigned char *below = middle + width;
+	short *outputX = gradientX + (row * width);
+	short *outputY = gradientY + (row * width);
+	outputX[0] = outputY[0] = 0;
+	outputX[width - 1] = outputY[width - 1] = 0;
+
+	size_t column = 1;
+	for (; column + 17 <= width; column += 16) {
+	    const __m256i aboveLeft = loadWidened(above + column - 1);
+	    const __m256i aboveRight = loadWidened(above + column + 1);
+	    const __m256i belowLeft = loadWidened(below + column - 1);
+	    const __m256i belowRight = loadWidened(below + column + 1);
+
+	    const __m256i horizontal = _mm256_add_epi16(
+		_mm256_mullo_epi16(
+		    _mm256_add_epi16(_mm256_sub_epi16(aboveRight, aboveLeft),
+				     _mm256_sub_epi16(belowRight, belowLeft)),
+		    three),
+		_mm256_mullo_epi16(
+		    _mm256_sub_epi16(loadWidened(middle + column + 1),
+				     loadWidened(middle + column - 1)),
+		    ten));
+	    const __m256i vertical = _mm256_add_epi16(
+		_mm256_mullo_epi16(
+		    _mm256_add_epi16(_mm256_sub_epi16(belowLeft, aboveLeft),
+				     _mm256_sub_epi16(belowRight, aboveRight)),
+		    three),
+		_mm256_mullo_epi16(
+		    _mm256_sub_epi16(loadWidened(below + column),
+				     loadWidened(above + column)),
+		    ten));
+	    _mm256_storeu_si256((__m256i *)(outputX + column), horizontal);
+	    _mm256_storeu_si256((__m256i *)(outputY + column), vertical);
+	}
+	for (; column + 1 < width; ++column) {
+	    outputX[column] = scharrX(middle + column, (ptrdiff_t)width);
+	    outputY[column] = scharrY(middle + column, (ptrdiff_t)width);
+	}
+    }
+}
+
+ErrorCode GrayPyramid_build(GrayPyramid *pyramid, const unsigned char *gray) {
+    if (UNLIKELY(pyramid == NULL || gray == NULL ||
+		 pyramid->level_count == 0)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+
+    memcpy(pyramid->image[0], gray, pyramid->dimensions[0].pixels);
+    for (int level = 1; level < pyramid->level_count; ++level) {
+	downsample(pyramid->image[level - 1], &pyramid->dimensions[level - 1],
+		   pyramid->image[level], &pyramid->dimensions[level]);
+    }
+    for (int level = 0; level < pyramid->level_count; ++level) {
+	scharrGradients(pyramid->image[level], &pyramid->dimensions[level],
+			pyramid->gradient_x[level], pyramid->gradient_y[level]);
+    }
+    return ERROR_NONE;
+}
+
+typedef struct {
+    __m256i top;
+    __m256i bottom;
+} __attribute__((aligned(64))) BilinearWeights;
+
+// Q14 weights packed as (left, right) pairs for _mm256_madd_epi16
+static inline void BilinearWeights_init(BilinearWeights *weights,
+					const int fractionX,
+					const int fractionY) {
+    // truncating the first three keeps the remainder weight non-negative
+    const int weight00 = ((256 - fractionX) * (256 - fractionY)) >> 2;
+    const int weight01 = (fractionX * (256 - fractionY)) >> 2;
+    const int weight10 = ((256 - fractionX) * fractionY) >> 2;
+    const int weight11 =
+	(1 << FLOW_WEIGHT_BITS) - weight00 - weight01 - weight10;
+    weights->top = _mm256_set1_epi32((weight01 << 16) | weight00);
+    weights->bottom = _mm256_set1_epi32((weight11 << 16) | weight10);
+}
+
+static inline __m256i interpolate(const __m256i topLeft, const __m256i topRight,
+				  const __m256i bottomLeft,
+				  const __m256i bottomRight,
+				  const BilinearWeights *weights,
+				  const int shift) {
+    const __m256i round = _mm256_set1_epi32(1 << (shift - 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    __m256i low = _mm256_add_epi32(
+	_mm256_madd_epi16(_mm256_unpacklo_epi16(topLeft, topRight),
+			  weights->top),
+	_mm256_madd_epi16(_mm256_unpacklo_epi16(bottomLeft, bottomRight),
+			  weights->bottom));
+    __m256i high = _mm256_add_epi32(
+	_mm256_madd_epi16(_mm256_unpackhi_epi16(topLeft, topRight),
+			  weights->top),
+	_mm256_madd_epi16(_mm256_unpackhi_epi16(bottomLeft, bottomRight),
+			  weights->bottom));
+    low = _mm256_sra_epi32(_mm256_add_epi32(low, round), count);
+    high = _mm256_sra_epi32(_mm256_add_epi32(high, round), count);
+    // unpack then pack restores the original lane order
+    return _mm256_packs_epi32(low, high);
+}
+
+static inline __m256i interpolateBytes(const unsigned char *row,
+				       const size_t stride,
+				       const BilinearWeights *weights) {
+    return interpolate(loadWidened(row), loadWidened(row + 1),
+		       loadWidened(row + stride), loadWidened(row + stride + 1),
+		       weights, INTENSITY_SHIFT);
+}
+
+static inline __m256i interpolateShorts(const short *row, const size_t stride,
+					const BilinearWeights *weights) {
+    return interpolate(
+	_mm256_loadu_si256((const __m256i *)row),
+	_mm256_loadu_si256((const __m256i *)(row + 1)),
+	_mm256_loadu_si256((const __m256i *)(row + stride)),
+	_mm256_loadu_si256((const __m256i *)(row + stride + 1)), weights,
+	GRADIENT_SHIFT);
+}
+
+static inline int64_t horizontalSum(const __m256i vector) {
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(vector),
+				_mm256_extracti128_si256(vector, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+static inline bool windowInside(const int x, const int y,
+				const FrameDimensions *dimensions) {
+    return x >= FLOW_HALF_WINDOW + 1 && y >= FLOW_HALF_WINDOW + 1 &&
+	   x + FLOW_HALF_WINDOW + 2 < (int)dimensions->width &&
+	   y + FLOW_HALF_WINDOW + 2 < (int)dimensions->height;
+}
+
+static inline int64_t absolute(const int64_t value) {
+    return value < 0 ? -value : value;
+}
+
+static void trackPoint(const GrayPyramid *previous, const GrayPyramid *next,
+		       FlowPoint *point) {
+    __m256i intensity[FLOW_WINDOW];
+    __m256i gradientX[FLOW_WINDOW];
+    __m256i gradientY[FLOW_WINDOW];
+    BilinearWeights weights;
+    int64_t guessX = 0;
+    int64_t guessY = 0;
+    int64_t flowX = 0;
+    int64_t flowY = 0;
+    int64_t errorSum = 0;
+
+    point->tracked = false;
+    for (int level = previous->level_count - 1; level >= 0; --level) {
+	const FrameDimensions *dimensions = &previous->dimensions[level];
+	const size_t stride = dimensions->width;
+	const int levelX = point->x >> level;
+	const int levelY = point->y >> level;
+	const int originX = (levelX >> FLOW_SHIFT) - FLOW_HALF_WINDOW;
+	const int originY = (levelY >> FLOW_SHIFT) - FLOW_HALF_WINDOW;
+	if (!windowInside(levelX >> FLOW_SHIFT, levelY >> FLOW_SHIFT,
+			  dimensions)) {
+	    return;
+	}
+
+	BilinearWeights_init(&weights, levelX & 0xFF, levelY & 0xFF);
+	__m256i sumXX = _mm256_setzero_si256();
+	__m256i sumXY = _mm256_setzero_si256();
+	__m256i sumYY = _mm256_setzero_si256();
+	for (int row = 0; row < FLOW_WINDOW; ++row) {
+	    const size_t offset =
+		((size_t)(originY + row) * stride) + (size_t)originX;
+	    intensity[row] = interpolateBytes(previous->image[level] + offset,
+					      stride, &weights);
+	    gradientX[row] = interpolateShorts(
+		previous->gradient_x[level] + offset, stride, &weights);
+	    gradientY[row] = interpolateShorts(
+		previous->gradient_y[level] + offset, stride, &weights);
+	    sumXX = _mm256_add_epi32(
+		sumXX, _mm256_madd_epi16(gradientX[row], gradientX[row]));
+	    sumXY = _mm256_add_epi32(
+		sumXY, _mm256_madd_epi16(gradientX[row], gradientY[row]));
+	    sumYY = _mm256_add_epi32(
+		sumYY, _mm256_madd_epi16(gradientY[row], gradientY[row]));
+	}
+
+	const int64_t tensorXX = horizontalSum(sumXX);
+	const int64_t tensorXY = horizontalSum(sumXY);
+	const int64_t tensorYY = horizontalSum(sumYY);
+	const int64_t determinant =
+	    (tensorXX * tensorYY) - (tensorXY * tensorXY);
+	// smallest eigenvalue >= t  <=>  G - tI is positive semi-definite
+	if (tensorXX < MIN_EIGENVALUE ||
+	    ((tensorXX - MIN_EIGENVALUE) * (tensorYY - MIN_EIGENVALUE)) -
+		    (tensorXY * tensorXY) <
+		0 ||
+	    determinant == 0) {
+	    return;
+	}
+
+	flowX = 0;
+	flowY = 0;
+	for (int iteration = 0; iteration < FLOW_ITERATIONS; ++iteration) {
+	    const int64_t nextX = levelX + guessX + flowX;
+	    const int64_t nextY = levelY + guessY + flowY;
+	    if (!windowInside((int)(nextX >> FLOW_SHIFT),
+			      (int)(nextY >> FLOW_SHIFT), dimensions)) {
+		return;
+	    }
+
+	    BilinearWeights_init(&weights, (int)(nextX & 0xFF),
+				 (int)(nextY & 0xFF));
+	    const size_t nextOrigin =
+		((size_t)((nextY >> FLOW_SHIFT) - FLOW_HALF_WINDOW) * stride) +
+		(size_t)((nextX >> FLOW_SHIFT) - FLOW_HALF_WINDOW);
+	    __m256i mismatchX = _mm256_setzero_si256();
+	    __m256i mismatchY = _mm256_setzero_si256();
+	    __m256i errors = _mm256_setzero_si256();
+	    for (int row = 0; row < FLOW_WINDOW; ++row) {
+		const __m256i warped = interpolateBytes(
+		    next->image[level] + nextOrigin + ((size_t)row * stride),
+		    stride, &weights);
+		const __m256i difference =
+		    _mm256_sub_epi16(intensity[row], warped);
+		mismatchX = _mm256_add_epi32(
+		    mismatchX, _mm256_madd_epi16(difference, gradientX[row]));
+		mismatchY = _mm256_add_epi32(
+		    mismatchY, _mm256_madd_epi16(difference, gradientY[row]));
+		errors = _mm256_add_epi32(
+		    errors, _mm256_madd_epi16(_mm256_abs_epi16(difference),
+					      _mm256_set1_epi16(1)));
+	    }
+
+	    // delta = G^-1 b, the 1/16 of the gradient and intensity scales
+	    // folds with the Q8 output into a factor of 16
+	    const int64_t mismatchSumX = horizontalSum(mismatchX);
+	    const int64_t mismatchSumY = horizontalSum(mismatchY);
+	    const int64_t deltaX =
+		(16 * ((tensorYY * mismatchSumX) - (tensorXY * mismatchSumY))) /
+		determinant;
+	    const int64_t deltaY =
+		(16 * ((tensorXX * mismatchSumY) - (tensorXY * mismatchSumX))) /
+		determinant;
+	    flowX += deltaX;
+	    flowY += deltaY;
+	    errorSum = horizontalSum(errors);
+	    if (absolute(deltaX) <= CONVERGED &&
+		absolute(deltaY) <= CONVERGED) {
+		break;
+	    }
+	}
+
+	if (level > 0) {
+	    guessX = 2 * (guessX + flowX);
+	    guessY = 2 * (guessY + flowY);
+	}
+    }
+
+    point->x += (int)(guessX + flowX);
+    point->y += (int)(guessY + flowY);
+    // mean absolute difference in gray levels, intensities are Q5
+    point->error = (int)(errorSum / (FLOW_WINDOW * FLOW_WINDOW * 32));
+    point->tracked = true;
+}
+
+void opticalFlowLK(const GrayPyramid *previous, const GrayPyramid *next,
+		   FlowPoint *points, const int pointCount) {
+    for (int index = 0; index < pointCount; ++index) {
+	trackPoint(previous, next, &points[index]);
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "types.h"
+
+#define FLOW_MAX_LEVELS 4
+#define FLOW_SHIFT 8
+
+typedef struct {
+    void *storage;
+    unsigned char *image[FLOW_MAX_LEVELS];
+    short *gradient_x[FLOW_MAX_LEVELS];
+    short *gradient_y[FLOW_MAX_LEVELS];
+    FrameDimensions dimensions[FLOW_MAX_LEVELS];
+    int level_count;
+} __attribute__((aligned(128))) GrayPyramid;
+
+// positions are fixed point with FLOW_SHIFT fractional bits
+typedef struct {
+    int x;
+    int y;
+    int error;
+    bool tracked;
+} __attribute__((aligned(16))) FlowPoint;
+
+ErrorCode GrayPyramid_create(GrayPyramid *pyramid, FrameDimensions dimensions,
+			     int levels);
+
+void GrayPyramid_destroy(GrayPyramid *pyramid);
+
+ErrorCode GrayPyramid_build(GrayPyramid *pyramid, const unsigned char *gray);
+
+void opticalFlowLK(const GrayPyramid *previous, const GrayPyramid *next,
+		   FlowPoint *points, int pointCount);
@@ -0,0 +1,94 @@
+/*
+    Hand pose classification, crops a square around the palm estimate and
+    feeds it to the int8 network, exposed api is in `gesture.h`
+*/
+
+#include "gesture.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "branch.h"
+#include "distance.h"
+#include "network.h"
+#include "types.h"
+
+// crop side in quarter palm radii, wide enough to keep extended fingers
+static const int CROP_QUARTER_RADII = 10;
+
+ErrorCode GestureClassifier_open(GestureClassifier *classifier,
+				 const char *modelPath) {
+    memset(classifier, 0, sizeof(*classifier));
+    const ErrorCode error = Network_load(&classifier->network, modelPath);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+    if (UNLIKELY(classifier->network.input.channels != 1 ||
+		 classifier->network.class_count != GESTURE_COUNT)) {
+	Network_unload(&classifier->network);
+	return ERROR_INVALID_ARGUMENT;
+    }
+    classifier->loaded = true;
+    return ERROR_NONE;
+}
+
+void GestureClassifier_close(GestureClassifier *classifier) {
+    if (classifier->loaded) {
+	Network_unload(&classifier->network);
+	classifier->loaded = false;
+    }
+}
+
+// nearest neighbour resample of the crop into channel 0, halved to stay in
+// the 0..127 activation range, samples outside the frame read as zero
+static void fillInput(GestureClassifier *classifier,
+		      const unsigned char *gray,
+		      const FrameDimensions dimensions,
+		      const PalmEstimate palm) {
+    const TensorShape shape = classifier->network.input;
+    unsigned char *input = Network_input(&classifier->network);
+    const int side = palm.radius * CROP_QUARTER_RADII / 4;
+    const int left = palm.centre.x - side / 2;
+    const int top = palm.centre.y - side / 2;
+
+    for (unsigned int y = 0; y < shape.height; ++y) {
+	const int sourceY = top + (int)(y * (unsigned int)side / shape.height);
+	if (sourceY < 0 || sourceY >= (int)dimensions.height) {
+	    continue;
+	}
+	const unsigned char *row = gray + (size_t)sourceY * dimensions.width;
+	unsigned char *target =
+	    input + (size_t)y * shape.width * shape.padded_channels;
+	for (unsigned int x = 0; x < shape.width; ++x) {
+	    const int sourceX =
+		left + (int)(x * (unsigned int)side / shape.width);
+	    if (sourceX >= 0 && sourceX < (int)dimensions.width) {
+		target[(size_t)x * shape.padded_channels] =
+		    (unsigned char)(row[sourceX] >> 1);
+	    }
+	}
+    }
+}
+
+ErrorCode GestureClassifier_classify(GestureClassifier *classifier,
+				     const unsigned char *gray,
+				     const FrameDimensions dimensions,
+				     const PalmEstimate palm) {
+    if (UNLIKELY(!classifier->loaded)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    if (palm.radius <= 0) {
+	classifier->gesture = GESTURE_NONE;
+	return ERROR_NONE;
+    }
+
+    fillInput(classifier, gray, dimensions, palm);
+    int bestClass = 0;
+    const ErrorCode error = Network_run(&classifier->network, &bestClass);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	classifier->gesture = GESTURE_NONE;
+	return error;
+    }
+    classifier->gesture = (Gesture)bestClass;
+    return ERROR_NONE;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "distance.h"
+#include "network.h"
+#include "types.h"
+
+typedef enum {
+    GESTURE_NONE = 0,
+    GESTURE_OPEN_PALM = 1,
+    GESTURE_FIST = 2,
+    GESTURE_PINCH = 3,
+    GESTURE_POINT = 4,
+    GESTURE_COUNT = 5
+} Gesture;
+
+typedef struct {
+    Network network;
+    Gesture gesture;
+    bool loaded;
+} __attribute__((aligned(64))) GestureClassifier;
+
+ErrorCode GestureClassifier_open(GestureClassifier *classifier,
+				 const char *modelPath);
+
+void GestureClassifier_close(GestureClassifier *classifier);
+
+ErrorCode GestureClassifier_classify(GestureClassifier *classifier,
+				     const unsigned char *gray,
+				     FrameDimensions dimensions,
+				     PalmEstimate palm);
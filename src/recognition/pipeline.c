@@ -0,0 +1,299 @@
+/*
+    Per camera recognition pipeline, full threshold -> contour -> hull
+    detection every few frames with optical flow tracking in between,
+    exposed api is in `pipeline.h`
+*/
+
+#include "pipeline.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "branch.h"
+#include "denoise.h"
+#include "distance.h"
+#include "flow.h"
+#include "gesture.h"
+#include "gray.h"
+#include "pointset.h"
+#include "recognize.h"
+#include "trace.h"
+#include "track.h"
+#include "types.h"
+#include "yuyv.h"
+
+static const unsigned char HAND_THRESHOLD = 128;
+static const unsigned int SEARCH_MARGIN = 96;
+static const int MAX_CONTOUR_POINTS = 8192;
+static const unsigned int PALM_SAMPLE_STEP = 2;
+static const int PYRAMID_LEVELS = 3;
+static const int DETECTION_INTERVAL = 4;
+static const int MAX_FLOW_ERROR = 24;
+// assumed for the very first frame, nothing came before it to measure
+static const float FIRST_FRAME_TIME = 1.0F / 30.0F;
+static const size_t PLANE_ALIGNMENT = 64;
+
+// cache line aligned, so the vector kernels start every plane on a line
+static unsigned char *allocatePlane(const size_t size) {
+    return (unsigned char *)aligned_alloc(PLANE_ALIGNMENT,
+					  (size + PLANE_ALIGNMENT - 1) &
+					      ~(size_t)(PLANE_ALIGNMENT - 1));
+}
+
+ErrorCode HandPipeline_create(HandPipeline *pipeline,
+			      const FrameDimensions dimensions) {
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->dimensions = dimensions;
+    pipeline->detection_interval = DETECTION_INTERVAL;
+    pipeline->max_flow_error = MAX_FLOW_ERROR;
+    FingertipTracker_init(&pipeline->tracker);
+
+    pipeline->gray = allocatePlane(dimensions.pixels);
+    pipeline->blurred = allocatePlane(dimensions.pixels);
+    pipeline->binary = allocatePlane(dimensions.pixels);
+    if (UNLIKELY(pipeline->gray == NULL || pipeline->blurred == NULL ||
+		 pipeline->binary == NULL)) {
+	HandPipeline_destroy(pipeline);
+	return ERROR_ALLOCATION_FAILED;
+    }
+    // the blur leaves its border untouched, keep it defined
+    memset(pipeline->blurred, 0, dimensions.pixels);
+
+    ErrorCode error = PointSet_create(&pipeline->contour, MAX_CONTOUR_POINTS);
+    if (error == ERROR_NONE) {
+	error = PointSet_create(&pipeline->hull, MAX_CONTOUR_POINTS + 1);
+    }
+    if (error == ERROR_NONE) {
+	error = DistanceTransform_create(&pipeline->distance, dimensions);
+    }
+    if (error == ERROR_NONE) {
+	error = GrayPyramid_create(&pipeline->pyramids[0], dimensions,
+				   PYRAMID_LEVELS);
+    }
+    if (error == ERROR_NONE) {
+	error = GrayPyramid_create(&pipeline->pyramids[1], dimensions,
+				   PYRAMID_LEVELS);
+    }
+    if (UNLIKELY(error != ERROR_NONE)) {
+	HandPipeline_destroy(pipeline);
+	return error;
+    }
+    return ERROR_NONE;
+}
+
+void HandPipeline_destroy(HandPipeline *pipeline) {
+    GestureClassifier_close(&pipeline->classifier);
+    TemporalDenoiser_destroy(&pipeline->denoiser);
+    GrayPyramid_destroy(&pipeline->pyramids[1]);
+    GrayPyramid_destroy(&pipeline->pyramids[0]);
+    DistanceTransform_destroy(&pipeline->distance);
+    PointSet_destroy(&pipeline->hull);
+    PointSet_destroy(&pipeline->contour);
+    free(pipeline->binary);
+    free(pipeline->blurred);
+    free(pipeline->gray);
+    pipeline->binary = NULL;
+    pipeline->blurred = NULL;
+    pipeline->gray = NULL;
+}
+
+// optional, without a model the pipeline only reports fingertips
+ErrorCode HandPipeline_loadGestureModel(HandPipeline *pipeline,
+					const char *modelPath) {
+    GestureClassifier_close(&pipeline->classifier);
+    return GestureClassifier_open(&pipeline->classifier, modelPath);
+}
+
+// optional as well, for noisy cameras, the gray plane is filtered against
+// the frames before it so the threshold and the flow see less flicker
+ErrorCode HandPipeline_enableDenoise(HandPipeline *pipeline) {
+    if (pipeline->denoiser.history != NULL) {
+	return ERROR_NONE;
+    }
+    return TemporalDenoiser_create(&pipeline->denoiser, pipeline->dimensions);
+}
+
+// follows every confirmed track with optical flow, false means confidence
+// dropped and a full detection is needed
+static bool trackWithFlow(HandPipeline *pipeline) {
+    const GrayPyramid *previous =
+	&pipeline->pyramids[pipeline->current_pyramid ^ 1];
+    const GrayPyramid *current = &pipeline->pyramids[pipeline->current_pyramid];
+
+    int count = 0;
+    for (int index = 0; index < TRACKER_MAX_TRACKS; ++index) {
+	const FingertipTrack *track = &pipeline->tracker.tracks[index];
+	if (!track->active) {
+	    continue;
+	}
+	if (track->missed > 0) {
+	    return false;
+	}
+	pipeline->flow_points[count].x = track->position.x << FLOW_SHIFT;
+	pipeline->flow_points[count].y = track->position.y << FLOW_SHIFT;
+	count++;
+    }
+    if (count == 0) {
+	return false;
+    }
+
+    opticalFlowLK(previous, current, pipeline->flow_points, count);
+    for (int index = 0; index < count; ++index) {
+	const FlowPoint *point = &pipeline->flow_points[index];
+	if (!point->tracked || point->error > pipeline->max_flow_error) {
+	    return false;
+	}
+	pipeline->fingertips[index].x =
+	    (point->x + (1 << (FLOW_SHIFT - 1))) >> FLOW_SHIFT;
+	pipeline->fingertips[index].y =
+	    (point->y + (1 << (FLOW_SHIFT - 1))) >> FLOW_SHIFT;
+    }
+    pipeline->fingertip_count = count;
+    return true;
+}
+
+// fingertip predictions alone would crop the palm out of the mask
+static void includePalm(FrameRegion *region, const PalmEstimate *palm,
+			const FrameDimensions dimensions) {
+    const int reach = palm->radius + (int)SEARCH_MARGIN;
+    int left = palm->centre.x - reach;
+    int top = palm->centre.y - reach;
+    int right = palm->centre.x + reach;
+    int bottom = palm->centre.y + reach;
+
+    left = left < (int)region->x ? left : (int)region->x;
+    top = top < (int)region->y ? top : (int)region->y;
+    right = right > (int)(region->x + region->width)
+		? right
+		: (int)(region->x + region->width);
+    bottom = bottom > (int)(region->y + region->height)
+		 ? bottom
+		 : (int)(region->y + region->height);
+
+    left = left < 0 ? 0 : left;
+    top = top < 0 ? 0 : top;
+    right = right > (int)dimensions.width ? (int)dimensions.width : right;
+    bottom = bottom > (int)dimensions.height ? (int)dimensions.height : bottom;
+
+    region->x = (unsigned int)left;
+    region->y = (unsigned int)top;
+    region->width = (unsigned int)(right - left);
+    region->height = (unsigned int)(bottom - top);
+}
+
+static ErrorCode detect(HandPipeline *pipeline) {
+    const FrameDimensions dimensions = pipeline->dimensions;
+    TRACE_BEGIN(TRACE_BLUR);
+    const ErrorCode error =
+	boxBlurGray(pipeline->gray, pipeline->blurred, &dimensions);
+    TRACE_END(TRACE_BLUR);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+
+    TRACE_BEGIN(TRACE_THRESHOLD);
+
+    if (FingertipTracker_searchRegion(&pipeline->tracker, SEARCH_MARGIN,
+				      dimensions, &pipeline->search_region) &&
+	pipeline->palm.radius > 0) {
+	includePalm(&pipeline->search_region, &pipeline->palm, dimensions);
+	thresholdImageRegion(pipeline->blurred, pipeline->binary, dimensions,
+			     pipeline->search_region, HAND_THRESHOLD);
+    } else {
+	thresholdImage(pipeline->blurred, pipeline->binary, dimensions,
+		       HAND_THRESHOLD);
+	pipeline->search_region = (FrameRegion){.width = dimensions.width,
+						.height = dimensions.height};
+    }
+    TRACE_END(TRACE_THRESHOLD);
+
+    TRACE_BEGIN(TRACE_DISTANCE);
+    DistanceTransform_compute(&pipeline->distance, pipeline->binary,
+			      dimensions, pipeline->search_region,
+			      PALM_SAMPLE_STEP, &pipeline->palm);
+    TRACE_END(TRACE_DISTANCE);
+
+    TRACE_BEGIN(TRACE_CONTOUR);
+    traceContourSet(pipeline->binary, &pipeline->contour, dimensions);
+    TRACE_END(TRACE_CONTOUR);
+    TRACE_BEGIN(TRACE_HULL);
+    convexHullSet(&pipeline->contour, &pipeline->hull);
+    TRACE_END(TRACE_HULL);
+    TRACE_BEGIN(TRACE_FINGERTIPS);
+    pipeline->fingertip_count = detectFingertipsPalmSet(
+	&pipeline->hull, pipeline->palm.centre, pipeline->palm.radius,
+	pipeline->fingertips, TRACKER_MAX_TRACKS);
+    TRACE_END(TRACE_FINGERTIPS);
+
+    // the palm estimate only refreshes here so classifying more often
+    // would just repeat the same crop drifting behind the hand, a frame the
+    // classifier fails on has no gesture but its fingertips still count
+    if (pipeline->classifier.loaded) {
+	TRACE_BEGIN(TRACE_GESTURE);
+	const ErrorCode gesture_err = GestureClassifier_classify(
+	    &pipeline->classifier, pipeline->gray, dimensions, pipeline->palm);
+	TRACE_END(TRACE_GESTURE);
+	if (UNLIKELY(gesture_err != ERROR_NONE)) {
+	    pipeline->gesture_err = gesture_err;
+	    pipeline->gesture_failures++;
+	}
+    }
+    return ERROR_NONE;
+}
+
+/*
+    timestamp is the frame's capture time in CLOCK_MONOTONIC nanoseconds,
+    the tracker steps by capture intervals so processing jitter and dropped
+    frames do not skew its motion model.
+*/
+ErrorCode HandPipeline_process(HandPipeline *pipeline,
+			       const unsigned char *yuyvFrame,
+			       const unsigned long long timestamp) {
+    const float deltaTime =
+	pipeline->timestamp != 0 && timestamp > pipeline->timestamp
+	    ? (float)(timestamp - pipeline->timestamp) * 1e-9F
+	    : FIRST_FRAME_TIME;
+    pipeline->timestamp = timestamp;
+
+    TRACE_BEGIN(TRACE_GRAY);
+    ErrorCode error =
+	yuyvToGray(yuyvFrame, pipeline->gray, &pipeline->dimensions);
+    TRACE_END(TRACE_GRAY);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+    if (pipeline->denoiser.history != NULL) {
+	TRACE_BEGIN(TRACE_DENOISE);
+	TemporalDenoiser_filterGray(&pipeline->denoiser, pipeline->gray);
+	TRACE_END(TRACE_DENOISE);
+    }
+
+    TRACE_BEGIN(TRACE_PYRAMID);
+    pipeline->current_pyramid ^= 1;
+    error = GrayPyramid_build(&pipeline->pyramids[pipeline->current_pyramid],
+			      pipeline->gray);
+    TRACE_END(TRACE_PYRAMID);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+
+    TRACE_BEGIN(TRACE_FLOW);
+    pipeline->detected =
+	++pipeline->frames_since_detection >= pipeline->detection_interval ||
+	!trackWithFlow(pipeline);
+    TRACE_END(TRACE_FLOW);
+    if (pipeline->detected) {
+	error = detect(pipeline);
+	if (UNLIKELY(error != ERROR_NONE)) {
+	    return error;
+	}
+	pipeline->frames_since_detection = 0;
+    }
+
+    TRACE_BEGIN(TRACE_TRACKER);
+    FingertipTracker_update(&pipeline->tracker, pipeline->fingertips,
+			    pipeline->fingertip_count, deltaTime);
+    TRACE_END(TRACE_TRACKER);
+    return ERROR_NONE;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "denoise.h"
+#include "distance.h"
+#include "flow.h"
+#include "gesture.h"
+#include "pointset.h"
+#include "recognize.h"
+#include "track.h"
+#include "types.h"
+
+typedef struct {
+    FrameDimensions dimensions;
+    unsigned char *gray;
+    unsigned char *blurred;
+    unsigned char *binary;
+    PointSet contour;
+    PointSet hull;
+    DistanceTransform distance;
+    GrayPyramid pyramids[2];
+    TemporalDenoiser denoiser;
+    FingertipTracker tracker;
+    GestureClassifier classifier;
+    FlowPoint flow_points[TRACKER_MAX_TRACKS];
+    Point fingertips[TRACKER_MAX_TRACKS];
+    PalmEstimate palm;
+    FrameRegion search_region;
+    unsigned long long timestamp;
+    unsigned long long gesture_failures;
+    ErrorCode gesture_err;  // the last failure, kept for the log
+    int fingertip_count;
+    int current_pyramid;
+    int frames_since_detection;
+    int detection_interval;
+    int max_flow_error;
+    bool detected;
+} __attribute__((aligned(128))) HandPipeline;
+
+ErrorCode HandPipeline_create(HandPipeline *pipeline,
+			      FrameDimensions dimensions);
+
+void HandPipeline_destroy(HandPipeline *pipeline);
+
+ErrorCode HandPipeline_loadGestureModel(HandPipeline *pipeline,
+					const char *modelPath);
+
+ErrorCode HandPipeline_enableDenoise(HandPipeline *pipeline);
+
+ErrorCode HandPipeline_process(HandPipeline *pipeline,
+			       const unsigned char *yuyvFrame,
+			       unsigned long long timestamp);
@@ -0,0 +1,180 @@
+/*
+    Structure of arrays point storage with AVX2 geometry kernels, 8 points per
+    instruction, exposed api is in `pointset.h`
+*/
+
+#include "pointset.h"
+
+#include <immintrin.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "branch.h"
+#include "recognize.h"
+#include "types.h"
+
+static inline __m256i tailMask(const int remaining) {
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(remaining),
+			      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+static inline int horizontalSum(const __m256i vector) {
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(vector),
+				_mm256_extracti128_si256(vector, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+static inline int horizontalMin(const __m256i vector) {
+    __m128i lanes = _mm_min_epi32(_mm256_castsi256_si128(vector),
+				  _mm256_extracti128_si256(vector, 1));
+    lanes = _mm_min_epi32(lanes,
+			  _mm_shuffle_epi32(lanes, _MM_SHUFFLE(1, 0, 3, 2)));
+    lanes = _mm_min_epi32(lanes,
+			  _mm_shuffle_epi32(lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(lanes);
+}
+
+static inline int horizontalMax(const __m256i vector) {
+    __m128i lanes = _mm_max_epi32(_mm256_castsi256_si128(vector),
+				  _mm256_extracti128_si256(vector, 1));
+    lanes = _mm_max_epi32(lanes,
+			  _mm_shuffle_epi32(lanes, _MM_SHUFFLE(1, 0, 3, 2)));
+    lanes = _mm_max_epi32(lanes,
+			  _mm_shuffle_epi32(lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(lanes);
+}
+
+ErrorCode PointSet_create(PointSet *set, const int capacity) {
+    memset(set, 0, sizeof(*set));
+    if (UNLIKELY(capacity <= 0)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+
+    // padded to a whole vector so kernels never need a scalar tail
+    const int padded = (capacity + 7) & ~7;
+    const size_t bytes = (size_t)padded * sizeof(int);
+    set->x = (int *)aligned_alloc(32, bytes);
+    set->y = (int *)aligned_alloc(32, bytes);
+    set->scratch = (int *)aligned_alloc(32, bytes);
+    if (UNLIKELY(set->x == NULL || set->y == NULL || set->scratch == NULL)) {
+	PointSet_destroy(set);
+	return ERROR_ALLOCATION_FAILED;
+    }
+    memset(set->x, 0, bytes);
+    memset(set->y, 0, bytes);
+    set->capacity = padded;
+    return ERROR_NONE;
+}
+
+void PointSet_destroy(PointSet *set) {
+    free(set->x);
+    free(set->y);
+    free(set->scratch);
+    memset(set, 0, sizeof(*set));
+}
+
+void PointSet_fromPoints(PointSet *set, const Point *points, int count) {
+    count = count < set->capacity ? count : set->capacity;
+    const __m256i deinterleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+    int index = 0;
+    for (; index + 8 <= count; index += 8) {
+	const __m256i low = _mm256_permutevar8x32_epi32(
+	    _mm256_loadu_si256((const __m256i *)&points[index]), deinterleave);
+	const __m256i high = _mm256_permutevar8x32_epi32(
+	    _mm256_loadu_si256((const __m256i *)&points[index + 4]),
+	    deinterleave);
+	_mm256_store_si256((__m256i *)&set->x[index],
+			   _mm256_permute2x128_si256(low, high, 0x20));
+	_mm256_store_si256((__m256i *)&set->y[index],
+			   _mm256_permute2x128_si256(low, high, 0x31));
+    }
+    for (; index < count; ++index) {
+	set->x[index] = points[index].x;
+	set->y[index] = points[index].y;
+    }
+    set->count = count;
+}
+
+void PointSet_centroid(const PointSet *set, Point *centroid) {
+    if (UNLIKELY(set->count == 0)) {
+	centroid->x = 0;
+	centroid->y = 0;
+	return;
+    }
+
+    __m256i sumX = _mm256_setzero_si256();
+    __m256i sumY = _mm256_setzero_si256();
+    for (int index = 0; index < set->count; index += 8) {
+	const __m256i valid = tailMask(set->count - index);
+	const __m256i pointX =
+	    _mm256_load_si256((const __m256i *)&set->x[index]);
+	const __m256i pointY =
+	    _mm256_load_si256((const __m256i *)&set->y[index]);
+	sumX = _mm256_add_epi32(sumX, _mm256_and_si256(valid, pointX));
+	sumY = _mm256_add_epi32(sumY, _mm256_and_si256(valid, pointY));
+    }
+    centroid->x = horizontalSum(sumX) / set->count;
+    centroid->y = horizontalSum(sumY) / set->count;
+}
+
+void PointSet_distanceSquared(const PointSet *set, const Point origin,
+			      int *output) {
+    const __m256i originX = _mm256_set1_epi32(origin.x);
+    const __m256i originY = _mm256_set1_epi32(origin.y);
+    for (int index = 0; index < set->count; index += 8) {
+	const __m256i distanceX = _mm256_sub_epi32(
+	    _mm256_load_si256((const __m256i *)&set->x[index]), originX);
+	const __m256i distanceY = _mm256_sub_epi32(
+	    _mm256_load_si256((const __m256i *)&set->y[index]), originY);
+	_mm256_storeu_si256(
+	    (__m256i *)&output[index],
+	    _mm256_add_epi32(_mm256_mullo_epi32(distanceX, distanceX),
+			     _mm256_mullo_epi32(distanceY, distanceY)));
+    }
+}
+
+void PointSet_boundingBox(const PointSet *set, Point *minimum,
+			  Point *maximum) {
+    __m256i minX = _mm256_set1_epi32(INT_MAX);
+    __m256i minY = _mm256_set1_epi32(INT_MAX);
+    __m256i maxX = _mm256_set1_epi32(INT_MIN);
+    __m256i maxY = _mm256_set1_epi32(INT_MIN);
+    for (int index = 0; index < set->count; index += 8) {
+	const __m256i valid = tailMask(set->count - index);
+	const __m256i pointX =
+	    _mm256_load_si256((const __m256i *)&set->x[index]);
+	const __m256i pointY =
+	    _mm256_load_si256((const __m256i *)&set->y[index]);
+	minX = _mm256_min_epi32(minX, _mm256_blendv_epi8(minX, pointX, valid));
+	minY = _mm256_min_epi32(minY, _mm256_blendv_epi8(minY, pointY, valid));
+	maxX = _mm256_max_epi32(maxX, _mm256_blendv_epi8(maxX, pointX, valid));
+	maxY = _mm256_max_epi32(maxY, _mm256_blendv_epi8(maxY, pointY, valid));
+    }
+    minimum->x = horizontalMin(minX);
+    minimum->y = horizontalMin(minY);
+    maximum->x = horizontalMax(maxX);
+    maximum->y = horizontalMax(maxY);
+}
+
+// same sign convention as crossProduct(from, to, point) in recognize.c
+void PointSet_orientation(const PointSet *set, const Point from,
+			  const Point to, int *output) {
+    const __m256i fromX = _mm256_set1_epi32(from.x);
+    const __m256i fromY = _mm256_set1_epi32(from.y);
+    const __m256i edgeX = _mm256_set1_epi32(to.x - from.x);
+    const __m256i edgeY = _mm256_set1_epi32(to.y - from.y);
+    for (int index = 0; index < set->count; index += 8) {
+	const __m256i relativeX = _mm256_sub_epi32(
+	    _mm256_load_si256((const __m256i *)&set->x[index]), fromX);
+	const __m256i relativeY = _mm256_sub_epi32(
+	    _mm256_load_si256((const __m256i *)&set->y[index]), fromY);
+	_mm256_storeu_si256(
+	    (__m256i *)&output[index],
+	    _mm256_sub_epi32(_mm256_mullo_epi32(edgeX, relativeY),
+			     _mm256_mullo_epi32(edgeY, relativeX)));
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "recognize.h"
+#include "types.h"
+
+struct PointSet {
+    int *x;
+    int *y;
+    int *scratch;
+    int count;
+    int capacity;
+} __attribute__((aligned(32)));
+
+ErrorCode PointSet_create(PointSet *set, int capacity);
+
+void PointSet_destroy(PointSet *set);
+
+void PointSet_fromPoints(PointSet *set, const Point *points, int count);
+
+void PointSet_centroid(const PointSet *set, Point *centroid);
+
+void PointSet_distanceSquared(const PointSet *set, Point origin, int *output);
+
+void PointSet_boundingBox(const PointSet *set, Point *minimum, Point *maximum);
+
+void PointSet_orientation(const PointSet *set, Point from, Point to,
+			  int *output);
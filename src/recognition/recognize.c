@@ -2,9 +2,13 @@
 
 #include "recognize.h"
 
+#include <immintrin.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "branch.h"
+#include "pointset.h"
 #include "types.h"
 
 static inline double crossProduct(const Point po1, const Point po2,
@@ -28,24 +32,73 @@ static int comparePoints(const void *poA, const void *poB) {
     return pointA->x - pointB->x;
 }
 
+// 32 pixels a step, x > threshold exactly when the saturating x - threshold
+// is non zero, which unlike comparing against threshold + 1 holds at 255
+static inline __attribute__((always_inline)) void thresholdPixels(
+    const unsigned char *const grayInput, unsigned char *const binaryOutput,
+    const size_t pixels, const unsigned char threshold) {
+    const __m256i level = _mm256_set1_epi8((char)threshold);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi8(-1);
+    size_t index = 0;
+    for (; index + 32 <= pixels; index += 32) {
+	const __m256i gray =
+	    _mm256_loadu_si256((const __m256i *)(grayInput + index));
+	const __m256i below =
+	    _mm256_cmpeq_epi8(_mm256_subs_epu8(gray, level), zero);
+	_mm256_storeu_si256((__m256i *)(binaryOutput + index),
+			    _mm256_xor_si256(below, ones));
+    }
+    for (; index < pixels; ++index) {
+	binaryOutput[index] = (grayInput[index] > threshold) ? 255 : 0;
+    }
+}
+
 void thresholdImage(const unsigned char *const grayInput,
 		    unsigned char *const binaryOutput,
 		    const FrameDimensions dimensions,
 		    const unsigned char threshold) {
+    thresholdPixels(grayInput, binaryOutput,
+		    (size_t)dimensions.width * dimensions.height, threshold);
+}
+
+void thresholdImageRegion(const unsigned char *const grayInput,
+			  unsigned char *const binaryOutput,
+			  const FrameDimensions dimensions,
+			  const FrameRegion region,
+			  const unsigned char threshold) {
     const unsigned int width = dimensions.width;
-    const unsigned int height = dimensions.height;
+    const unsigned int regionEnd = region.x + region.width;
 
-    for (unsigned int row = 0; row < height; ++row) {
-	for (unsigned int column = 0; column < width; ++column) {
-	    const unsigned int index = (row * width) + column;
-	    binaryOutput[index] = (grayInput[index] > threshold) ? 255 : 0;
-	}
+    // everything outside the region is cleared so contour tracing stays valid
+    memset(binaryOutput, 0, (size_t)region.y * width);
+    for (unsigned int row = region.y; row < region.y + region.height; ++row) {
+	unsigned char *const outputRow = binaryOutput + ((size_t)row * width);
+	const unsigned char *const inputRow = grayInput + ((size_t)row * width);
+	memset(outputRow, 0, region.x);
+	thresholdPixels(inputRow + region.x, outputRow + region.x,
+			region.width, threshold);
+	memset(outputRow + regionEnd, 0, width - regionEnd);
     }
+    memset(binaryOutput + ((size_t)(region.y + region.height) * width), 0,
+	   (size_t)(dimensions.height - region.y - region.height) * width);
 }
 
-int traceContour(const unsigned char *const binaryInput,
-		 Point *const contourOutput, const FrameDimensions dimensions,
-		 const int maxPoints) {
+static int compareKeys(const void *keA, const void *keB) {
+    return *(const int *)keA - *(const int *)keB;
+}
+
+// writes through strided coordinate pointers so both Point arrays and
+// PointSet columns can be filled by the same walk, no room for even the
+// first point is ERROR_INVALID_ARGUMENT
+static int traceContourInto(const unsigned char *const binaryInput,
+			    int *const outputX, int *const outputY,
+			    const size_t outputStride,
+			    const FrameDimensions dimensions,
+			    const int maxPoints) {
+    if (UNLIKELY(maxPoints <= 0)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
     Point startPoint = {-1, -1};
 
     for (int row = 0; row < (int)dimensions.height && startPoint.x == -1;
@@ -65,20 +118,27 @@ int traceContour(const unsigned char *const binaryInput,
 	return 0;
     }
 
+    // clockwise from east
     static const Point neighborOffsets[8] = {
 	{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1}};
 
     int contourCount = 0;
-    int neighborIndex = 0;
+    // the start point is the first in raster order so its west is
+    // background, treat it as entered moving east
+    int direction = 0;
     Point currentPoint = startPoint;
 
+    // moore neighbour tracing, every step starts scanning just clockwise of
+    // the pixel we came from and the walk ends back at the start
     do {
-	if (contourCount < maxPoints) {
-	    contourOutput[contourCount++] = currentPoint;
-	}
+	outputX[(size_t)contourCount * outputStride] = currentPoint.x;
+	outputY[(size_t)contourCount * outputStride] = currentPoint.y;
+	contourCount++;
+
+	const int firstIndex = (direction + 5) % 8;
 	int foundNext = 0;
 	for (int i = 0; i < 8; ++i) {
-	    int testIndex = (neighborIndex + i) % 8;
+	    const int testIndex = (firstIndex + i) % 8;
 	    Point neighbor = {0};
 
 	    neighbor.x = currentPoint.x + neighborOffsets[testIndex].x;
@@ -90,6 +150,7 @@ int traceContour(const unsigned char *const binaryInput,
 			    neighbor.x] == 255) {
 		currentPoint.x = neighbor.x;
 		currentPoint.y = neighbor.y;
+		direction = testIndex;
 		foundNext = 1;
 		break;
 	    }
@@ -98,35 +159,60 @@ int traceContour(const unsigned char *const binaryInput,
 	if (!foundNext) {
 	    break;
 	}
-    } while (currentPoint.x != -1 && currentPoint.y != -1);
+    } while ((currentPoint.x != startPoint.x ||
+	      currentPoint.y != startPoint.y) &&
+	     contourCount < maxPoints);
 
     return contourCount;
 }
 
+int traceContour(const unsigned char *const binaryInput,
+		 Point *const contourOutput, const FrameDimensions dimensions,
+		 const int maxPoints) {
+    return traceContourInto(binaryInput, &contourOutput->x, &contourOutput->y,
+			    sizeof(Point) / sizeof(int), dimensions, maxPoints);
+}
+
+int traceContourSet(const unsigned char *const binaryInput,
+		    PointSet *const contourOutput,
+		    const FrameDimensions dimensions) {
+    const int count =
+	traceContourInto(binaryInput, contourOutput->x, contourOutput->y, 1,
+			 dimensions, contourOutput->capacity);
+    contourOutput->count = count > 0 ? count : 0;
+    return count;
+}
+
+// the upper pass walks the sorted points again after the lower pass has
+// overwritten the start of the output, so they are sorted into the
+// caller's scratch, which keeps the per frame path free of allocation
 int convexHull(const Point *const contourInput, Point *const convexHullOutput,
-	       const int pointCount) {
-    memcpy(convexHullOutput, contourInput, (size_t)pointCount * sizeof(Point));
-    qsort(convexHullOutput, (size_t)pointCount, sizeof(Point), &comparePoints);
+	       Point *const scratch, const int pointCount) {
+    if (pointCount <= 0) {
+	return 0;
+    }
+    Point *const sorted = scratch;
+    memcpy(sorted, contourInput, (size_t)pointCount * sizeof(Point));
+    qsort(sorted, (size_t)pointCount, sizeof(Point), &comparePoints);
 
     int hullIndex = 0;
     for (int i = 0; i < pointCount; i++) {
 	while (hullIndex >= 2 && crossProduct(convexHullOutput[hullIndex - 2],
 					      convexHullOutput[hullIndex - 1],
-					      convexHullOutput[i]) <= 0) {
+					      sorted[i]) <= 0) {
 	    hullIndex--;
 	}
-	convexHullOutput[hullIndex++] = convexHullOutput[i];
+	convexHullOutput[hullIndex++] = sorted[i];
     }
 
     int lower_size = hullIndex;
     for (int i = pointCount - 2; i >= 0; i--) {
 	while (hullIndex > lower_size &&
 	       crossProduct(convexHullOutput[hullIndex - 2],
-			    convexHullOutput[hullIndex - 1],
-			    convexHullOutput[i]) <= 0) {
+			    convexHullOutput[hullIndex - 1], sorted[i]) <= 0) {
 	    hullIndex--;
 	}
-	convexHullOutput[hullIndex++] = convexHullOutput[i];
+	convexHullOutput[hullIndex++] = sorted[i];
     }
     return hullIndex > 1 ? hullIndex - 1 : hullIndex;
 }
@@ -154,3 +240,180 @@ int detectFingertips(const Point *inputConvexHull, int pointCount,
     }
     return fingertipIndex;
 }
+
+int detectFingertipsPalm(const Point *inputConvexHull, int pointCount,
+			 const Point palmCentre, const int palmRadius,
+			 Point *fingertipOutput, int fingertipCount) {
+    if (pointCount < 3 || palmRadius <= 0) {
+	return 0;
+    }
+
+    // extended fingers reach well past the inscribed palm circle, 1.6r keeps
+    // knuckles and the wrist out
+    const double reach = (double)palmRadius * 1.6;
+    const double reachSquared = reach * reach;
+
+    int fingertipIndex = 0;
+    for (int i = 0; i < pointCount && fingertipIndex < fingertipCount; i++) {
+	if (distanceSquared(palmCentre, inputConvexHull[i]) > reachSquared) {
+	    fingertipOutput[fingertipIndex++] = inputConvexHull[i];
+	}
+    }
+    return fingertipIndex;
+}
+
+static int findPoint(const PointSet *set, const int *coordinates,
+		     const int value) {
+    const __m256i target = _mm256_set1_epi32(value);
+    for (int index = 0; index < set->count; index += 8) {
+	const unsigned int hits = (unsigned int)_mm256_movemask_ps(
+	    _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+		_mm256_load_si256((const __m256i *)&coordinates[index]),
+		target)));
+	if (hits != 0) {
+	    return index + __builtin_ctz(hits);
+	}
+    }
+    return 0;
+}
+
+static inline int64_t crossProductKeys(const PointSet *hull, const int top,
+				       const int key) {
+    const int64_t originX = hull->x[top - 2];
+    const int64_t originY = hull->y[top - 2];
+    return ((hull->x[top - 1] - originX) * ((key & 0xFFFF) - originY)) -
+	   ((hull->y[top - 1] - originY) * ((key >> 16) - originX));
+}
+
+int convexHullSet(PointSet *const contourInput, PointSet *const hullOutput) {
+    const int pointCount = contourInput->count;
+    hullOutput->count = 0;
+    if (pointCount == 0 || hullOutput->capacity < pointCount + 1) {
+	return 0;
+    }
+
+    // Akl-Toussaint: points strictly inside the quadrilateral spanned by the
+    // extreme points can never be on the hull, drop them before sorting
+    Point minimum;
+    Point maximum;
+    PointSet_boundingBox(contourInput, &minimum, &maximum);
+    const int extremes[4] = {
+	findPoint(contourInput, contourInput->x, minimum.x),
+	findPoint(contourInput, contourInput->y, minimum.y),
+	findPoint(contourInput, contourInput->x, maximum.x),
+	findPoint(contourInput, contourInput->y, maximum.y)};
+    Point quad[4];
+    for (int i = 0; i < 4; ++i) {
+	quad[i].x = contourInput->x[extremes[i]];
+	quad[i].y = contourInput->y[extremes[i]];
+    }
+
+    int inside = 0;
+    for (int i = 0; i < 4 && inside == 0; ++i) {
+	const double turn =
+	    crossProduct(quad[i], quad[(i + 1) % 4], quad[(i + 2) % 4]);
+	inside = turn > 0 ? 1 : (turn < 0 ? -1 : 0);
+    }
+
+    int *outside = hullOutput->x;
+    for (int index = 0; index < pointCount; ++index) {
+	outside[index] = inside == 0;
+    }
+    for (int edge = 0; edge < 4 && inside != 0; ++edge) {
+	int *orientation = contourInput->scratch;
+	PointSet_orientation(contourInput, quad[edge], quad[(edge + 1) % 4],
+			     orientation);
+	for (int index = 0; index < pointCount; ++index) {
+	    outside[index] |= orientation[index] * inside <= 0;
+	}
+    }
+
+    int *keys = hullOutput->scratch;
+    int keyCount = 0;
+    for (int index = 0; index < pointCount; ++index) {
+	if (outside[index]) {
+	    keys[keyCount++] =
+		(contourInput->x[index] << 16) | contourInput->y[index];
+	}
+    }
+    qsort(keys, (size_t)keyCount, sizeof(int), &compareKeys);
+
+    int hullIndex = 0;
+    for (int i = 0; i < keyCount; i++) {
+	while (hullIndex >= 2 &&
+	       crossProductKeys(hullOutput, hullIndex, keys[i]) <= 0) {
+	    hullIndex--;
+	}
+	hullOutput->x[hullIndex] = keys[i] >> 16;
+	hullOutput->y[hullIndex] = keys[i] & 0xFFFF;
+	hullIndex++;
+    }
+
+    const int lowerSize = hullIndex;
+    for (int i = keyCount - 2; i >= 0; i--) {
+	while (hullIndex > lowerSize &&
+	       crossProductKeys(hullOutput, hullIndex, keys[i]) <= 0) {
+	    hullIndex--;
+	}
+	hullOutput->x[hullIndex] = keys[i] >> 16;
+	hullOutput->y[hullIndex] = keys[i] & 0xFFFF;
+	hullIndex++;
+    }
+    hullOutput->count = hullIndex > 1 ? hullIndex - 1 : hullIndex;
+    return hullOutput->count;
+}
+
+static int selectBeyond(PointSet *const hull, const Point origin,
+			const int thresholdSquared, Point *fingertipOutput,
+			const int fingertipCount) {
+    int *distances = hull->scratch;
+    PointSet_distanceSquared(hull, origin, distances);
+
+    const __m256i threshold = _mm256_set1_epi32(thresholdSquared);
+    int fingertipIndex = 0;
+    for (int index = 0; index < hull->count; index += 8) {
+	const __m256i valid = _mm256_cmpgt_epi32(
+	    _mm256_set1_epi32(hull->count - index),
+	    _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	const __m256i beyond = _mm256_and_si256(
+	    valid,
+	    _mm256_cmpgt_epi32(
+		_mm256_load_si256((const __m256i *)&distances[index]),
+		threshold));
+	unsigned int hits = (unsigned int)_mm256_movemask_ps(
+	    _mm256_castsi256_ps(beyond));
+	while (hits != 0 && fingertipIndex < fingertipCount) {
+	    const int lane = index + __builtin_ctz(hits);
+	    fingertipOutput[fingertipIndex].x = hull->x[lane];
+	    fingertipOutput[fingertipIndex].y = hull->y[lane];
+	    fingertipIndex++;
+	    hits &= hits - 1;
+	}
+    }
+    return fingertipIndex;
+}
+
+int detectFingertipsSet(PointSet *const inputConvexHull,
+			Point *fingertipOutput, const int fingertipCount) {
+    if (inputConvexHull->count < 3) {
+	return 0;
+    }
+
+    Point centroidPoint;
+    PointSet_centroid(inputConvexHull, &centroidPoint);
+    return selectBeyond(inputConvexHull, centroidPoint, 2000, fingertipOutput,
+			fingertipCount);
+}
+
+int detectFingertipsPalmSet(PointSet *const inputConvexHull,
+			    const Point palmCentre, const int palmRadius,
+			    Point *fingertipOutput, const int fingertipCount) {
+    if (inputConvexHull->count < 3 || palmRadius <= 0) {
+	return 0;
+    }
+
+    // (1.6r)^2 in integers, see detectFingertipsPalm
+    return selectBeyond(inputConvexHull, palmCentre,
+			(palmRadius * palmRadius * 64) / 25, fingertipOutput,
+			fingertipCount);
+}
@@ -6,14 +6,40 @@ typedef struct {
     int y;
 } __attribute__((aligned(8))) Point;
 
+typedef struct PointSet PointSet;
+
 void thresholdImage(const unsigned char* grayInput, unsigned char* binaryOutput,
 		    FrameDimensions dimensions, unsigned char threshold);
 
+void thresholdImageRegion(const unsigned char* grayInput,
+			  unsigned char* binaryOutput,
+			  FrameDimensions dimensions, FrameRegion region,
+			  unsigned char threshold);
+
+// the point count, or ERROR_INVALID_ARGUMENT when maxPoints is not positive
 int traceContour(const unsigned char* binaryInput, Point* contourOutput,
 		 FrameDimensions dimensions, int maxPoints);
 
+// the output needs room for pointCount + 1 points and scratch, which must
+// not overlap either, for pointCount, returns the hull's point count
 int convexHull(const Point* contourInput, Point* convexHullOutput,
-	       int pointCount);
+	       Point* scratch, int pointCount);
 
 int detectFingertips(const Point* inputConvexHull, int pointCount,
 		     Point* fingertipOutput, int fingertipCount);
+
+int detectFingertipsPalm(const Point* inputConvexHull, int pointCount,
+			 Point palmCentre, int palmRadius,
+			 Point* fingertipOutput, int fingertipCount);
+
+int traceContourSet(const unsigned char* binaryInput, PointSet* contourOutput,
+		    FrameDimensions dimensions);
+
+int convexHullSet(PointSet* contourInput, PointSet* hullOutput);
+
+int detectFingertipsSet(PointSet* inputConvexHull, Point* fingertipOutput,
+			int fingertipCount);
+
+int detectFingertipsPalmSet(PointSet* inputConvexHull, Point palmCentre,
+			    int palmRadius, Point* fingertipOutput,
+			    int fingertipCount);
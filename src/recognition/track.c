@@ -0,0 +1,247 @@
+/*
+    Frame to frame fingertip association with stable ids, each track is
+    smoothed by a constant velocity kalman filter, exposed api is in `track.h`
+*/
+
+#include "track.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "branch.h"
+#include "recognize.h"
+#include "types.h"
+
+#define MAX_CANDIDATES (TRACKER_MAX_TRACKS * TRACKER_MAX_TRACKS)
+
+typedef struct {
+    int distance_squared;
+    int track;
+    int detection;
+} __attribute__((aligned(16))) Candidate;
+
+static inline int roundToInt(const float value) {
+    return (int)(value < 0.0F ? value - 0.5F : value + 0.5F);
+}
+
+static int compareCandidates(const void *caA, const void *caB) {
+    const Candidate *candidateA = (const Candidate *)caA;
+    const Candidate *candidateB = (const Candidate *)caB;
+    return candidateA->distance_squared - candidateB->distance_squared;
+}
+
+static inline void KalmanAxis_reset(KalmanAxis *axis, const float position,
+				    const float measurementNoise) {
+    axis->position = position;
+    axis->velocity = 0.0F;
+    axis->variance_position = measurementNoise;
+    axis->covariance = 0.0F;
+    axis->variance_velocity = 1000.0F;
+}
+
+// x' = F x, P' = F P F^T + Q with a white noise acceleration model
+static inline void KalmanAxis_predict(KalmanAxis *axis, const float deltaTime,
+				      const float processNoise) {
+    const float dt2 = deltaTime * deltaTime;
+    const float dt3 = dt2 * deltaTime;
+    const float dt4 = dt3 * deltaTime;
+
+    axis->position += axis->velocity * deltaTime;
+    axis->variance_position += (deltaTime * 2.0F * axis->covariance) +
+			       (dt2 * axis->variance_velocity) +
+			       (processNoise * dt4 * 0.25F);
+    axis->covariance += (deltaTime * axis->variance_velocity) +
+			(processNoise * dt3 * 0.5F);
+    axis->variance_velocity += processNoise * dt2;
+}
+
+// H = [1 0], only the position is measured
+static inline void KalmanAxis_correct(KalmanAxis *axis, const float measured,
+				      const float measurementNoise) {
+    const float innovation = measured - axis->position;
+    const float inverse = 1.0F / (axis->variance_position + measurementNoise);
+    const float gainPosition = axis->variance_position * inverse;
+    const float gainVelocity = axis->covariance * inverse;
+
+    axis->position += gainPosition * innovation;
+    axis->velocity += gainVelocity * innovation;
+    axis->variance_velocity -= gainVelocity * axis->covariance;
+    axis->variance_position *= 1.0F - gainPosition;
+    axis->covariance *= 1.0F - gainPosition;
+}
+
+static void FingertipTrack_publish(FingertipTrack *track,
+				   const float deltaTime) {
+    track->position.x = roundToInt(track->axis_x.position);
+    track->position.y = roundToInt(track->axis_y.position);
+    track->velocity_x = track->axis_x.velocity;
+    track->velocity_y = track->axis_y.velocity;
+    track->predicted.x =
+	roundToInt(track->axis_x.position + (track->velocity_x * deltaTime));
+    track->predicted.y =
+	roundToInt(track->axis_y.position + (track->velocity_y * deltaTime));
+}
+
+void FingertipTracker_init(FingertipTracker *tracker) {
+    memset(tracker, 0, sizeof(*tracker));
+    tracker->process_noise = 4000.0F;
+    tracker->measurement_noise = 4.0F;
+    tracker->gate_distance_squared = 60 * 60;
+    tracker->max_missed = 5;
+    tracker->next_id = 1;
+}
+
+int FingertipTracker_update(FingertipTracker *tracker, const Point *fingertips,
+			    int fingertipCount, const float deltaTime) {
+    if (UNLIKELY(fingertipCount > TRACKER_MAX_TRACKS)) {
+	fingertipCount = TRACKER_MAX_TRACKS;
+    }
+
+    for (int trackIndex = 0; trackIndex < TRACKER_MAX_TRACKS; ++trackIndex) {
+	FingertipTrack *track = &tracker->tracks[trackIndex];
+	if (track->active) {
+	    KalmanAxis_predict(&track->axis_x, deltaTime,
+			       tracker->process_noise);
+	    KalmanAxis_predict(&track->axis_y, deltaTime,
+			       tracker->process_noise);
+	}
+    }
+
+    // greedy nearest first assignment, optimal enough for N <= 10
+    Candidate candidates[MAX_CANDIDATES];
+    int candidateCount = 0;
+    for (int trackIndex = 0; trackIndex < TRACKER_MAX_TRACKS; ++trackIndex) {
+	const FingertipTrack *track = &tracker->tracks[trackIndex];
+	if (!track->active) {
+	    continue;
+	}
+	const int predictedX = roundToInt(track->axis_x.position);
+	const int predictedY = roundToInt(track->axis_y.position);
+	for (int detection = 0; detection < fingertipCount; ++detection) {
+	    const int distanceX = fingertips[detection].x - predictedX;
+	    const int distanceY = fingertips[detection].y - predictedY;
+	    const int distance =
+		(distanceX * distanceX) + (distanceY * distanceY);
+	    if (distance <= tracker->gate_distance_squared) {
+		candidates[candidateCount++] = (Candidate){
+		    .distance_squared = distance,
+		    .track = trackIndex,
+		    .detection = detection};
+	    }
+	}
+    }
+    qsort(candidates, (size_t)candidateCount, sizeof(Candidate),
+	  &compareCandidates);
+
+    bool trackMatched[TRACKER_MAX_TRACKS] = {0};
+    bool detectionMatched[TRACKER_MAX_TRACKS] = {0};
+    for (int i = 0; i < candidateCount; ++i) {
+	const Candidate *candidate = &candidates[i];
+	if (trackMatched[candidate->track] ||
+	    detectionMatched[candidate->detection]) {
+	    continue;
+	}
+	trackMatched[candidate->track] = true;
+	detectionMatched[candidate->detection] = true;
+
+	FingertipTrack *track = &tracker->tracks[candidate->track];
+	KalmanAxis_correct(&track->axis_x,
+			   (float)fingertips[candidate->detection].x,
+			   tracker->measurement_noise);
+	KalmanAxis_correct(&track->axis_y,
+			   (float)fingertips[candidate->detection].y,
+			   tracker->measurement_noise);
+	track->hits++;
+	track->missed = 0;
+    }
+
+    for (int trackIndex = 0; trackIndex < TRACKER_MAX_TRACKS; ++trackIndex) {
+	FingertipTrack *track = &tracker->tracks[trackIndex];
+	if (track->active && !trackMatched[trackIndex] &&
+	    ++track->missed > tracker->max_missed) {
+	    track->active = false;
+	}
+    }
+
+    int freeSlot = 0;
+    for (int detection = 0; detection < fingertipCount; ++detection) {
+	if (detectionMatched[detection]) {
+	    continue;
+	}
+	while (freeSlot < TRACKER_MAX_TRACKS &&
+	       tracker->tracks[freeSlot].active) {
+	    freeSlot++;
+	}
+	if (freeSlot == TRACKER_MAX_TRACKS) {
+	    break;
+	}
+
+	FingertipTrack *track = &tracker->tracks[freeSlot];
+	KalmanAxis_reset(&track->axis_x, (float)fingertips[detection].x,
+			 tracker->measurement_noise);
+	KalmanAxis_reset(&track->axis_y, (float)fingertips[detection].y,
+			 tracker->measurement_noise);
+	track->id = tracker->next_id++;
+	track->hits = 1;
+	track->missed = 0;
+	track->active = true;
+    }
+
+    int activeCount = 0;
+    for (int trackIndex = 0; trackIndex < TRACKER_MAX_TRACKS; ++trackIndex) {
+	FingertipTrack *track = &tracker->tracks[trackIndex];
+	if (track->active) {
+	    FingertipTrack_publish(track, deltaTime);
+	    activeCount++;
+	}
+    }
+    return activeCount;
+}
+
+bool FingertipTracker_searchRegion(const FingertipTracker *tracker,
+				   const unsigned int margin,
+				   const FrameDimensions dimensions,
+				   FrameRegion *region) {
+    int minX = (int)dimensions.width;
+    int minY = (int)dimensions.height;
+    int maxX = -1;
+    int maxY = -1;
+
+    for (int trackIndex = 0; trackIndex < TRACKER_MAX_TRACKS; ++trackIndex) {
+	const FingertipTrack *track = &tracker->tracks[trackIndex];
+	if (!track->active) {
+	    continue;
+	}
+	// a coasting track means a finger may be anywhere, search it all
+	if (track->missed > 0) {
+	    return false;
+	}
+	minX = track->predicted.x < minX ? track->predicted.x : minX;
+	minY = track->predicted.y < minY ? track->predicted.y : minY;
+	maxX = track->predicted.x > maxX ? track->predicted.x : maxX;
+	maxY = track->predicted.y > maxY ? track->predicted.y : maxY;
+    }
+
+    if (maxX < 0 || maxY < 0) {
+	return false;
+    }
+
+    minX = minX - (int)margin < 0 ? 0 : minX - (int)margin;
+    minY = minY - (int)margin < 0 ? 0 : minY - (int)margin;
+    maxX = maxX + (int)margin >= (int)dimensions.width
+	       ? (int)dimensions.width - 1
+	       : maxX + (int)margin;
+    maxY = maxY + (int)margin >= (int)dimensions.height
+	       ? (int)dimensions.height - 1
+	       : maxY + (int)margin;
+    if (minX > maxX || minY > maxY) {
+	return false;
+    }
+
+    region->x = (unsigned int)minX;
+    region->y = (unsigned int)minY;
+    region->width = (unsigned int)(maxX - minX + 1);
+    region->height = (unsigned int)(maxY - minY + 1);
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "recognize.h"
+#include "types.h"
+
+#define TRACKER_MAX_TRACKS 10
+
+typedef struct {
+    float position;
+    float velocity;
+    float variance_position;
+    float covariance;
+    float variance_velocity;
+} __attribute__((aligned(32))) KalmanAxis;
+
+typedef struct {
+    KalmanAxis axis_x;
+    KalmanAxis axis_y;
+    Point position;
+    Point predicted;
+    float velocity_x;
+    float velocity_y;
+    int id;
+    int hits;
+    int missed;
+    bool active;
+} __attribute__((aligned(128))) FingertipTrack;
+
+typedef struct {
+    FingertipTrack tracks[TRACKER_MAX_TRACKS];
+    float process_noise;
+    float measurement_noise;
+    int gate_distance_squared;
+    int max_missed;
+    int next_id;
+} __attribute__((aligned(64))) FingertipTracker;
+
+void FingertipTracker_init(FingertipTracker *tracker);
+
+int FingertipTracker_update(FingertipTracker *tracker, const Point *fingertips,
+			    int fingertipCount, float deltaTime);
+
+bool FingertipTracker_searchRegion(const FingertipTracker *tracker,
+				   unsigned int margin,
+				   FrameDimensions dimensions,
+				   FrameRegion *region);
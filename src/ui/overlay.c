@@ -0,0 +1,298 @@
+/*
+    Debug overlay drawn straight into the display buffer after the frame is
+    converted: mask tint, contour and hull polylines and fingertip markers
+    with their track ids. Only pixels under the mask or the shapes are
+    written, exposed api is in `overlay.h`
+*/
+
+#include "overlay.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "pipeline.h"
+#include "pointset.h"
+#include "recognize.h"
+#include "track.h"
+#include "types.h"
+
+#define GLYPH_WIDTH 3
+#define GLYPH_HEIGHT 5
+#define MAX_DIGITS 10
+
+static const int GLYPH_SCALE = 2;
+static const int MARKER_RADIUS = 6;
+
+// 3x5 digits, one row per 3 bits with the leftmost column in bit 2
+static const unsigned char DIGIT_GLYPHS[10][GLYPH_HEIGHT] = {
+    {7, 5, 5, 5, 7}, {2, 6, 2, 2, 7}, {7, 1, 7, 4, 7}, {7, 1, 7, 1, 7},
+    {5, 5, 7, 1, 1}, {7, 4, 7, 1, 7}, {7, 4, 7, 5, 7}, {7, 1, 1, 1, 1},
+    {7, 5, 7, 5, 7}, {7, 5, 7, 1, 7}};
+
+static const OverlayColor MASK_COLOR = {.green = 200, .alpha = 96};
+static const OverlayColor CONTOUR_COLOR = {
+    .green = 220, .red = 255, .alpha = 255};
+static const OverlayColor HULL_COLOR = {
+    .blue = 255, .green = 200, .alpha = 255};
+static const OverlayColor LABEL_COLOR = {
+    .blue = 255, .green = 255, .red = 255, .alpha = 255};
+static const OverlayColor TRACK_COLORS[] = {
+    {.blue = 60, .green = 60, .red = 255, .alpha = 255},
+    {.blue = 255, .green = 120, .red = 60, .alpha = 255},
+    {.blue = 60, .green = 200, .red = 60, .alpha = 255},
+    {.blue = 255, .green = 60, .red = 200, .alpha = 255},
+    {.blue = 40, .green = 160, .red = 255, .alpha = 255},
+};
+
+static int screenX(const OverlayTarget *target, const int x) {
+    return target->mirrored ? (int)target->dimensions.width - 1 - x : x;
+}
+
+static uint32_t packColor(const OverlayColor color) {
+    return (uint32_t)color.blue | ((uint32_t)color.green << 8) |
+	   ((uint32_t)color.red << 16);
+}
+
+// weights sum to 255 so the 16 bit products never overflow
+static unsigned char blendChannel(const unsigned char source,
+				  const unsigned char color,
+				  const unsigned char alpha) {
+    return (unsigned char)(((source * (255 - alpha)) + (color * alpha) + 128) >>
+			   8);
+}
+
+static void blendPixel(unsigned char *pixel, const OverlayColor color) {
+    pixel[0] = blendChannel(pixel[0], color.blue, color.alpha);
+    pixel[1] = blendChannel(pixel[1], color.green, color.alpha);
+    pixel[2] = blendChannel(pixel[2], color.red, color.alpha);
+}
+
+#ifdef __AVX2__
+// eight pixels, the masked lanes blended and the rest kept as they were
+static void blendEight(unsigned char *pixels, const __m128i maskBytes,
+		       const __m256i colorTerm, const __m256i sourceWeight) {
+    const __m256i rounding = _mm256_set1_epi16(128);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i source = _mm256_loadu_si256((const __m256i *)pixels);
+
+    __m256i low = _mm256_unpacklo_epi8(source, zero);
+    __m256i high = _mm256_unpackhi_epi8(source, zero);
+    low = _mm256_add_epi16(_mm256_mullo_epi16(low, sourceWeight), colorTerm);
+    high = _mm256_add_epi16(_mm256_mullo_epi16(high, sourceWeight), colorTerm);
+    low = _mm256_srli_epi16(_mm256_add_epi16(low, rounding), 8);
+    high = _mm256_srli_epi16(_mm256_add_epi16(high, rounding), 8);
+    const __m256i blended = _mm256_packus_epi16(low, high);
+
+    const __m256i select = _mm256_cmpgt_epi32(
+	_mm256_cvtepu8_epi32(maskBytes), _mm256_setzero_si256());
+    _mm256_storeu_si256((__m256i *)pixels,
+			_mm256_blendv_epi8(source, blended, select));
+}
+#endif
+
+/*
+    Blends color over every pixel whose mask byte is set inside region,
+    given in frame coordinates. Spans of eight empty mask bytes are skipped
+    without touching the display buffer.
+*/
+void Overlay_tintMask(const OverlayTarget *target, const unsigned char *mask,
+		      const FrameRegion region, const OverlayColor color) {
+    const unsigned int width = target->dimensions.width;
+    // the span as it lands on screen
+    const unsigned int first =
+	target->mirrored ? width - region.x - region.width : region.x;
+    const unsigned int last = first + region.width;
+
+#ifdef __AVX2__
+    const __m256i colorTerm = _mm256_set1_epi64x(
+	(long long)(((uint64_t)(color.blue * color.alpha)) |
+		    ((uint64_t)(color.green * color.alpha) << 16) |
+		    ((uint64_t)(color.red * color.alpha) << 32)));
+    const __m256i sourceWeight =
+	_mm256_set1_epi16((short)(255 - color.alpha));
+    const __m128i reverse =
+	_mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 8, 9, 10, 11, 12, 13, 14, 15);
+#endif
+
+    for (unsigned int row = region.y; row < region.y + region.height; ++row) {
+	const unsigned char *maskRow = mask + ((size_t)row * width);
+	unsigned char *pixelRow =
+	    target->pixels + ((size_t)row * width * 4);
+	unsigned int column = first;
+#ifdef __AVX2__
+	for (; column + 8 <= last; column += 8) {
+	    // mask bytes for screen columns column .. column + 7
+	    const unsigned int source =
+		target->mirrored ? width - column - 8 : column;
+	    uint64_t bits = 0;
+	    memcpy(&bits, maskRow + source, sizeof(bits));
+	    if (bits == 0) {
+		continue;
+	    }
+	    __m128i maskBytes = _mm_cvtsi64_si128((long long)bits);
+	    if (target->mirrored) {
+		maskBytes = _mm_shuffle_epi8(maskBytes, reverse);
+	    }
+	    blendEight(pixelRow + ((size_t)column * 4), maskBytes, colorTerm,
+		       sourceWeight);
+	}
+#endif
+	for (; column < last; ++column) {
+	    const unsigned int source =
+		target->mirrored ? width - 1 - column : column;
+	    if (maskRow[source] != 0) {
+		blendPixel(pixelRow + ((size_t)column * 4), color);
+	    }
+	}
+    }
+}
+
+// frame coordinates, clipped per pixel since shapes rarely leave the frame
+static void plot(const OverlayTarget *target, const int x, const int y,
+		 const uint32_t color) {
+    if ((unsigned int)x >= target->dimensions.width ||
+	(unsigned int)y >= target->dimensions.height) {
+	return;
+    }
+    const size_t index = ((size_t)y * target->dimensions.width) +
+			 (size_t)screenX(target, x);
+    memcpy(target->pixels + (index * 4), &color, sizeof(color));
+}
+
+static void line(const OverlayTarget *target, int x0, int y0, const int x1,
+		 const int y1, const uint32_t color) {
+    const int deltaX = x1 > x0 ? x1 - x0 : x0 - x1;
+    const int deltaY = y1 > y0 ? y0 - y1 : y1 - y0;
+    const int stepX = x0 < x1 ? 1 : -1;
+    const int stepY = y0 < y1 ? 1 : -1;
+    int error = deltaX + deltaY;
+
+    for (;;) {
+	plot(target, x0, y0, color);
+	if (x0 == x1 && y0 == y1) {
+	    break;
+	}
+	const int doubled = 2 * error;
+	if (doubled >= deltaY) {
+	    error += deltaY;
+	    x0 += stepX;
+	}
+	if (doubled <= deltaX) {
+	    error += deltaX;
+	    y0 += stepY;
+	}
+    }
+}
+
+// opaque Bresenham segments between consecutive points
+void Overlay_polyline(const OverlayTarget *target, const int *x, const int *y,
+		      const int count, const bool closed,
+		      const OverlayColor color) {
+    const uint32_t packed = packColor(color);
+    for (int index = 1; index < count; ++index) {
+	line(target, x[index - 1], y[index - 1], x[index], y[index], packed);
+    }
+    if (closed && count > 2) {
+	line(target, x[count - 1], y[count - 1], x[0], y[0], packed);
+    }
+}
+
+// screen coordinates, clipped to the buffer
+static void fillSpan(const OverlayTarget *target, int left, int right,
+		     const int y, const uint32_t color) {
+    if ((unsigned int)y >= target->dimensions.height) {
+	return;
+    }
+    left = left < 0 ? 0 : left;
+    right = right >= (int)target->dimensions.width
+		? (int)target->dimensions.width - 1
+		: right;
+    unsigned char *pixel =
+	target->pixels +
+	((((size_t)y * target->dimensions.width) + (size_t)left) * 4);
+    for (int x = left; x <= right; ++x, pixel += 4) {
+	memcpy(pixel, &color, sizeof(color));
+    }
+}
+
+void Overlay_marker(const OverlayTarget *target, const Point centre,
+		    const int radius, const OverlayColor color) {
+    const uint32_t packed = packColor(color);
+    const int x = screenX(target, centre.x);
+    int half = radius;
+    for (int dy = 0; dy <= radius; ++dy) {
+	while (half > 0 && (half * half) + (dy * dy) > radius * radius) {
+	    half--;
+	}
+	fillSpan(target, x - half, x + half, centre.y - dy, packed);
+	if (dy != 0) {
+	    fillSpan(target, x - half, x + half, centre.y + dy, packed);
+	}
+    }
+}
+
+// reads left to right on screen whether the target is mirrored or not
+void Overlay_number(const OverlayTarget *target, const Point origin,
+		    int number, const OverlayColor color) {
+    const uint32_t packed = packColor(color);
+    int digits[MAX_DIGITS];
+    int digitCount = 0;
+    number = number < 0 ? 0 : number;
+    do {
+	digits[digitCount++] = number % 10;
+	number /= 10;
+    } while (number > 0 && digitCount < MAX_DIGITS);
+
+    int x = screenX(target, origin.x);
+    for (int digit = digitCount - 1; digit >= 0; --digit) {
+	const unsigned char *glyph = DIGIT_GLYPHS[digits[digit]];
+	for (int row = 0; row < GLYPH_HEIGHT * GLYPH_SCALE; ++row) {
+	    const unsigned char bits = glyph[row / GLYPH_SCALE];
+	    for (int column = 0; column < GLYPH_WIDTH; ++column) {
+		if ((bits >> (GLYPH_WIDTH - 1 - column)) & 1U) {
+		    const int left = x + (column * GLYPH_SCALE);
+		    fillSpan(target, left, left + GLYPH_SCALE - 1,
+			     origin.y + row, packed);
+		}
+	    }
+	}
+	x += (GLYPH_WIDTH + 1) * GLYPH_SCALE;
+    }
+}
+
+/*
+    Mask, contour and hull come from the last full detection, the markers
+    from the tracker so they follow optical flow between detections.
+*/
+void Overlay_drawPipeline(const OverlayTarget *target,
+			  const HandPipeline *pipeline) {
+    Overlay_tintMask(target, pipeline->binary, pipeline->search_region,
+		     MASK_COLOR);
+    Overlay_polyline(target, pipeline->contour.x, pipeline->contour.y,
+		     pipeline->contour.count, true, CONTOUR_COLOR);
+    Overlay_polyline(target, pipeline->hull.x, pipeline->hull.y,
+		     pipeline->hull.count, true, HULL_COLOR);
+
+    const int colorCount =
+	(int)(sizeof(TRACK_COLORS) / sizeof(TRACK_COLORS[0]));
+    for (int index = 0; index < TRACKER_MAX_TRACKS; ++index) {
+	const FingertipTrack *track = &pipeline->tracker.tracks[index];
+	if (!track->active) {
+	    continue;
+	}
+	Overlay_marker(target, track->position, MARKER_RADIUS,
+		       TRACK_COLORS[track->id % colorCount]);
+	// the label sits right of the marker on screen
+	const int offset = MARKER_RADIUS + 2;
+	const Point label = {
+	    .x = target->mirrored ? track->position.x - offset
+				  : track->position.x + offset,
+	    .y = track->position.y - MARKER_RADIUS};
+	Overlay_number(target, label, track->id, LABEL_COLOR);
+    }
+}
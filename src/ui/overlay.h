@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "pipeline.h"
+#include "recognize.h"
+#include "types.h"
+
+// a BGRX display buffer, mirrored when it holds the flipped camera image
+// so callers keep passing frame coordinates
+typedef struct {
+    unsigned char *pixels;
+    FrameDimensions dimensions;
+    bool mirrored;
+} __attribute__((aligned(32))) OverlayTarget;
+
+typedef struct {
+    unsigned char blue;
+    unsigned char green;
+    unsigned char red;
+    unsigned char alpha;
+} __attribute__((aligned(4))) OverlayColor;
+
+void Overlay_tintMask(const OverlayTarget *target, const unsigned char *mask,
+		      FrameRegion region, OverlayColor color);
+
+void Overlay_polyline(const OverlayTarget *target, const int *x, const int *y,
+		      int count, bool closed, OverlayColor color);
+
+void Overlay_marker(const OverlayTarget *target, Point centre, int radius,
+		    OverlayColor color);
+
+void Overlay_number(const OverlayTarget *target, Point origin, int number,
+		    OverlayColor color);
+
+void Overlay_drawPipeline(const OverlayTarget *target,
+			  const HandPipeline *pipeline);
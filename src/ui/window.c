@@ -1,28 +1,184 @@
 /*
-    X11 (for now) window creation api, with an opaque exposed api, see
-   `window.h`
+    Display sinks behind one opaque api: an X11 window, or headless a null
+    sink, a raw BGRA stream to a file or pipe and decimated PPM snapshots,
+    see `window.h`
 */
 
+#define _XOPEN_SOURCE 700
+
 #include "window.h"
 
 #include <X11/X.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <unistd.h>
 
 #include "branch.h"
 #include "types.h"
 
+#define WINDOW_BUFFERS 2
+#define SNAPSHOT_PATH_LENGTH 4096
+
+typedef enum {
+    SINK_X11,
+    SINK_NULL,
+    SINK_STREAM,
+    SINK_SNAPSHOT
+} SinkKind;
+
+typedef struct {
+    XImage *image;
+    XShmSegmentInfo segment;
+    bool busy;
+} __attribute__((aligned(64))) PresentBuffer;
+
 struct BackendInternal {
+    SinkKind kind;
     Display *display;
     Window window;
     GC gc;
-    XImage *image;
+    Atom delete_message;
+    PresentBuffer buffers[WINDOW_BUFFERS];
+    int buffer_count;
+    int current;
+    int completion_event;
+    // headless sinks
+    unsigned char *pixels;
+    unsigned char *row;
+    char *prefix;
+    unsigned int interval;
+    unsigned int frames;
+    int file_descriptor;
+    bool shared;
+    bool closed;
 } __attribute__((aligned(32)));
 
+// XShmAttach fails asynchronously, e.g. on a remote display, so the error
+// only shows up through the handler while syncing right after it
+static bool shmAttachFailed = false;
+
+static int catchShmError(Display *display, XErrorEvent *event) {
+    (void)display;
+    (void)event;
+    shmAttachFailed = true;
+    return 0;
+}
+
+static void destroySharedBuffer(Display *display, PresentBuffer *buffer) {
+    if (buffer->image == NULL) {
+	return;
+    }
+    XShmDetach(display, &buffer->segment);
+    // the pixels belong to the segment, not to malloc
+    buffer->image->data = NULL;
+    XDestroyImage(buffer->image);
+    shmdt(buffer->segment.shmaddr);
+    buffer->image = NULL;
+}
+
+static bool createSharedBuffer(Display *display, Visual *visual,
+			       const FrameDimensions dimensions,
+			       PresentBuffer *buffer) {
+    buffer->busy = false;
+    buffer->image =
+	XShmCreateImage(display, visual, 24, ZPixmap, NULL, &buffer->segment,
+			dimensions.width, dimensions.height);
+    if (buffer->image == NULL) {
+	return false;
+    }
+    // converters write tightly packed rows straight into the segment
+    if (buffer->image->bytes_per_line != (int)dimensions.width * 4) {
+	XDestroyImage(buffer->image);
+	buffer->image = NULL;
+	return false;
+    }
+
+    buffer->segment.shmid =
+	shmget(IPC_PRIVATE,
+	       (size_t)buffer->image->bytes_per_line * dimensions.height,
+	       IPC_CREAT | 0600);
+    if (buffer->segment.shmid < 0) {
+	XDestroyImage(buffer->image);
+	buffer->image = NULL;
+	return false;
+    }
+    buffer->segment.shmaddr = (char *)shmat(buffer->segment.shmid, NULL, 0);
+    buffer->segment.readOnly = False;
+    if (buffer->segment.shmaddr == (char *)-1) {
+	shmctl(buffer->segment.shmid, IPC_RMID, NULL);
+	XDestroyImage(buffer->image);
+	buffer->image = NULL;
+	return false;
+    }
+    buffer->image->data = buffer->segment.shmaddr;
+
+    shmAttachFailed = false;
+    const XErrorHandler previous = XSetErrorHandler(catchShmError);
+    const Status attached = XShmAttach(display, &buffer->segment);
+    XSync(display, False);
+    XSetErrorHandler(previous);
+    // marked for removal now, it goes away once both sides detach
+    shmctl(buffer->segment.shmid, IPC_RMID, NULL);
+    if (!attached || shmAttachFailed) {
+	buffer->image->data = NULL;
+	XDestroyImage(buffer->image);
+	shmdt(buffer->segment.shmaddr);
+	buffer->image = NULL;
+	return false;
+    }
+    return true;
+}
+
+// double buffered shared memory when the server is local, a single
+// client side image pushed with XPutImage otherwise
+static ErrorCode createBuffers(BackendInternal *backend, Visual *visual,
+			       const FrameDimensions dimensions) {
+    Display *display = backend->display;
+    if (XShmQueryExtension(display)) {
+	backend->shared = true;
+	backend->completion_event = XShmGetEventBase(display) + ShmCompletion;
+	for (int index = 0; index < WINDOW_BUFFERS && backend->shared;
+	     ++index) {
+	    backend->shared = createSharedBuffer(display, visual, dimensions,
+						 &backend->buffers[index]);
+	}
+	if (backend->shared) {
+	    backend->buffer_count = WINDOW_BUFFERS;
+	    return ERROR_NONE;
+	}
+	for (int index = 0; index < WINDOW_BUFFERS; ++index) {
+	    destroySharedBuffer(display, &backend->buffers[index]);
+	}
+    }
+
+    backend->buffer_count = 1;
+    char *pixels =
+	(char *)malloc((size_t)dimensions.width * dimensions.height * 4);
+    if (UNLIKELY(pixels == NULL)) {
+	return ERROR_ALLOCATION_FAILED;
+    }
+    backend->buffers[0].image =
+	XCreateImage(display, visual, 24, ZPixmap, 0, pixels, dimensions.width,
+		     dimensions.height, 32, 0);
+    if (UNLIKELY(backend->buffers[0].image == NULL)) {
+	free(pixels);
+	return ERROR_ALLOCATION_FAILED;
+    }
+    return ERROR_NONE;
+}
+
 ErrorCode Window_create(WindowState *state, const char *title,
 			FrameDimensions dimensions) {
     state->internal = NULL;
@@ -41,64 +197,306 @@ ErrorCode Window_create(WindowState *state, const char *title,
     XStoreName(display, xWindow, title);
     XSelectInput(display, xWindow,
 		 ExposureMask | KeyPressMask | StructureNotifyMask);
+    // ask the window manager for a message instead of killing the client
+    Atom deleteMessage = XInternAtom(display, "WM_DELETE_WINDOW", False);
+    XSetWMProtocols(display, xWindow, &deleteMessage, 1);
     XMapWindow(display, xWindow);
 
     GC internal_gc = XCreateGC(display, xWindow, 0, NULL);
 
-    XImage *image = XCreateImage(
-	display, DefaultVisual(display, screen), 24, ZPixmap, 0,
-	(char *)malloc((size_t)dimensions.width * dimensions.height * 4),
-	dimensions.width, dimensions.height, 32, 0);
-    if (UNLIKELY(!image)) {
+    BackendInternal *internal = calloc(1, sizeof(struct BackendInternal));
+    if (UNLIKELY(!internal)) {
 	XFreeGC(display, internal_gc);
 	XDestroyWindow(display, xWindow);
 	XCloseDisplay(display);
 	return ERROR_ALLOCATION_FAILED;
     }
+    internal->kind = SINK_X11;
+    internal->display = display;
+    internal->window = xWindow;
+    internal->gc = internal_gc;
+    internal->delete_message = deleteMessage;
 
-    BackendInternal *internal = malloc(sizeof(struct BackendInternal));
-    if (UNLIKELY(!internal)) {
-	free(image->data);
-	XDestroyImage(image);
+    const ErrorCode error =
+	createBuffers(internal, DefaultVisual(display, screen), dimensions);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	free(internal);
 	XFreeGC(display, internal_gc);
 	XDestroyWindow(display, xWindow);
 	XCloseDisplay(display);
-	return ERROR_ALLOCATION_FAILED;
+	return error;
     }
-    internal->display = display;
-    internal->window = xWindow;
-    internal->gc = internal_gc;
-    internal->image = image;
 
     state->internal = internal;
     return ERROR_NONE;
 }
 
-void Window_draw(WindowState *state, const unsigned char *buffer) {
+static ErrorCode createHeadless(WindowState *state, const SinkKind kind,
+				FrameDimensions dimensions) {
+    state->dimensions = dimensions;
+    state->internal = calloc(1, sizeof(struct BackendInternal));
+    if (UNLIKELY(state->internal == NULL)) {
+	return ERROR_ALLOCATION_FAILED;
+    }
+    state->internal->kind = kind;
+    state->internal->file_descriptor = -1;
+    state->internal->interval = 1;
+    return ERROR_NONE;
+}
+
+static void destroyHeadless(WindowState *state) {
+    BackendInternal *backend = state->internal;
+    if (backend->file_descriptor > STDERR_FILENO) {
+	close(backend->file_descriptor);
+    }
+    free(backend->pixels);
+    free(backend->row);
+    free(backend->prefix);
+    free(backend);
+    state->internal = NULL;
+}
+
+// rows get converted into it with vector stores
+static unsigned char *allocatePixels(const FrameDimensions dimensions) {
+    const size_t size = (size_t)dimensions.width * dimensions.height * 4;
+    return (unsigned char *)aligned_alloc(64, (size + 63) & ~(size_t)63);
+}
+
+// never hands out a buffer, so callers skip converting frames entirely
+ErrorCode Window_openNull(WindowState *state, FrameDimensions dimensions) {
+    return createHeadless(state, SINK_NULL, dimensions);
+}
+
+/*
+    Every presented frame as width * height * 4 BGRX bytes with no header,
+    "-" is stdout. Writes block, so a slow reader throttles the caller; a
+    reader that goes away closes the sink like closing a window would.
+*/
+ErrorCode Window_openStream(WindowState *state, const char *path,
+			    FrameDimensions dimensions) {
+    ErrorCode error = createHeadless(state, SINK_STREAM, dimensions);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+    BackendInternal *backend = state->internal;
+    backend->file_descriptor =
+	strcmp(path, "-") == 0
+	    ? STDOUT_FILENO
+	    : open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    backend->pixels = allocatePixels(dimensions);
+    if (UNLIKELY(backend->file_descriptor < 0 || backend->pixels == NULL)) {
+	error = backend->pixels == NULL ? ERROR_ALLOCATION_FAILED
+					: ERROR_FILE_OPEN_FAILED;
+	destroyHeadless(state);
+    }
+    return error;
+}
+
+// one frame out of every interval goes to <prefix><frame number>.ppm
+ErrorCode Window_openSnapshots(WindowState *state, const char *prefix,
+			       const unsigned int interval,
+			       FrameDimensions dimensions) {
+    if (UNLIKELY(interval == 0)) {
+	return ERROR_INVALID_ARGUMENT;
+    }
+    const ErrorCode error = createHeadless(state, SINK_SNAPSHOT, dimensions);
+    if (UNLIKELY(error != ERROR_NONE)) {
+	return error;
+    }
+    BackendInternal *backend = state->internal;
+    backend->interval = interval;
+    backend->prefix = strdup(prefix);
+    backend->pixels = allocatePixels(dimensions);
+    backend->row = (unsigned char *)malloc((size_t)dimensions.width * 3);
+    if (UNLIKELY(backend->prefix == NULL || backend->pixels == NULL ||
+		 backend->row == NULL)) {
+	destroyHeadless(state);
+	return ERROR_ALLOCATION_FAILED;
+    }
+    return ERROR_NONE;
+}
+
+static bool writeAll(const int fileDescriptor, const unsigned char *data,
+		     size_t size) {
+    while (size > 0) {
+	const ssize_t written = write(fileDescriptor, data, size);
+	if (written < 0 && errno == EINTR) {
+	    continue;
+	}
+	if (UNLIKELY(written <= 0)) {
+	    return false;
+	}
+	data += written;
+	size -= (size_t)written;
+    }
+    return true;
+}
+
+// a failed snapshot is skipped, the next one may well succeed
+static void writeSnapshot(BackendInternal *backend,
+			  const FrameDimensions dimensions) {
+    char path[SNAPSHOT_PATH_LENGTH];
+    const int length = snprintf(path, sizeof(path), "%s%06u.ppm",
+				backend->prefix, backend->frames - 1);
+    if (UNLIKELY(length < 0 || length >= (int)sizeof(path))) {
+	return;
+    }
+    FILE *file = fopen(path, "wb");
+    if (UNLIKELY(file == NULL)) {
+	return;
+    }
+    (void)fprintf(file, "P6\n%u %u\n255\n", dimensions.width,
+		  dimensions.height);
+    const unsigned char *source = backend->pixels;
+    for (unsigned int y = 0; y < dimensions.height; ++y) {
+	for (unsigned int x = 0; x < dimensions.width; ++x) {
+	    backend->row[(x * 3) + 0] = source[(x * 4) + 2];
+	    backend->row[(x * 3) + 1] = source[(x * 4) + 1];
+	    backend->row[(x * 3) + 2] = source[(x * 4) + 0];
+	}
+	(void)fwrite(backend->row, 3, dimensions.width, file);
+	source += (size_t)dimensions.width * 4;
+    }
+    (void)fclose(file);
+}
+
+/*
+    Pixel buffer for the next frame, BGRX with rows of width * 4 bytes.
+    NULL while the server is still reading every shared buffer, the caller
+    should skip presenting that frame rather than wait. Headless sinks
+    return NULL for frames they would drop anyway.
+*/
+unsigned char *Window_frameBuffer(WindowState *state) {
     BackendInternal *backend = state->internal;
-    memcpy(backend->image->data, buffer,
-	   (size_t)state->dimensions.width * state->dimensions.height * 4);
-    XPutImage(backend->display, backend->window, backend->gc, backend->image, 0,
-	      0, 0, 0, state->dimensions.width, state->dimensions.height);
+    switch (backend->kind) {
+	case SINK_NULL:
+	    return NULL;
+	case SINK_STREAM:
+	case SINK_SNAPSHOT:
+	    // frames between snapshots are never converted
+	    return backend->frames++ % backend->interval == 0 ? backend->pixels
+							       : NULL;
+	case SINK_X11:
+	default:
+	    break;
+    }
+    PresentBuffer *buffer = &backend->buffers[backend->current];
+    if (buffer->busy) {
+	// completions may already be queued without a pollEvents in between
+	Window_pollEvents(state);
+	if (buffer->busy) {
+	    return NULL;
+	}
+    }
+    return (unsigned char *)buffer->image->data;
+}
+
+// shows what was rendered into the last Window_frameBuffer
+void Window_present(WindowState *state) {
+    BackendInternal *backend = state->internal;
+    switch (backend->kind) {
+	case SINK_NULL:
+	    return;
+	case SINK_STREAM:
+	    if (UNLIKELY(!writeAll(backend->file_descriptor, backend->pixels,
+				   (size_t)state->dimensions.width *
+				       state->dimensions.height * 4))) {
+		backend->closed = true;
+	    }
+	    return;
+	case SINK_SNAPSHOT:
+	    writeSnapshot(backend, state->dimensions);
+	    return;
+	case SINK_X11:
+	default:
+	    break;
+    }
+    PresentBuffer *buffer = &backend->buffers[backend->current];
+    if (backend->shared) {
+	XShmPutImage(backend->display, backend->window, backend->gc,
+		     buffer->image, 0, 0, 0, 0, state->dimensions.width,
+		     state->dimensions.height, True);
+	buffer->busy = true;
+	backend->current = (backend->current + 1) % backend->buffer_count;
+    } else {
+	XPutImage(backend->display, backend->window, backend->gc,
+		  buffer->image, 0, 0, 0, 0, state->dimensions.width,
+		  state->dimensions.height);
+    }
     XFlush(backend->display);
 }
 
+static void completePresent(BackendInternal *backend, const XEvent *event) {
+    const XShmCompletionEvent *completion =
+	(const XShmCompletionEvent *)event;
+    for (int index = 0; index < backend->buffer_count; ++index) {
+	if (backend->buffers[index].segment.shmseg == completion->shmseg) {
+	    backend->buffers[index].busy = false;
+	}
+    }
+}
+
+// escape and q quit like closing the window does
+static bool isQuitKey(XKeyEvent *event) {
+    const KeySym key = XLookupKeysym(event, 0);
+    return key == XK_Escape || key == XK_q;
+}
+
+// drains everything queued, true once the window is gone or asked to close
 bool Window_pollEvents(WindowState *state) {
     BackendInternal *backend = state->internal;
+    if (backend->kind != SINK_X11) {
+	return backend->closed;
+    }
     while (XPending(backend->display)) {
 	XEvent event;
 	XNextEvent(backend->display, &event);
 	if (event.type == DestroyNotify) {
-	    return true;
+	    backend->closed = true;
+	} else if (event.type == ClientMessage) {
+	    if ((Atom)event.xclient.data.l[0] == backend->delete_message) {
+		backend->closed = true;
+	    }
+	} else if (event.type == KeyPress) {
+	    if (isQuitKey(&event.xkey)) {
+		backend->closed = true;
+	    }
+	} else if (backend->shared &&
+		   event.type == backend->completion_event) {
+	    completePresent(backend, &event);
 	}
     }
-    return false;
+    // requests queued while handling events must reach the server before
+    // the caller sleeps on the connection
+    XFlush(backend->display);
+    return backend->closed;
+}
+
+// readable whenever the server sent something, for the caller's poll
+// loop, -1 for headless sinks which have nothing to wait on
+int Window_connection(const WindowState *state) {
+    if (state->internal->kind != SINK_X11) {
+	return -1;
+    }
+    return ConnectionNumber(state->internal->display);
 }
 
 void Window_destroy(WindowState *state) {
     if (LIKELY(state && state->internal)) {
 	BackendInternal *backend = state->internal;
-	XDestroyImage(backend->image);
+	if (backend->kind != SINK_X11) {
+	    destroyHeadless(state);
+	    return;
+	}
+	if (backend->shared) {
+	    // the server may still be reading a segment
+	    XSync(backend->display, False);
+	    for (int index = 0; index < backend->buffer_count; ++index) {
+		destroySharedBuffer(backend->display, &backend->buffers[index]);
+	    }
+	} else {
+	    XDestroyImage(backend->buffers[0].image);
+	}
 	XFreeGC(backend->display, backend->gc);
 	XDestroyWindow(backend->display, backend->window);
 	XCloseDisplay(backend->display);
@@ -15,8 +15,21 @@ typedef struct {
 ErrorCode Window_create(WindowState *state, const char *title,
 			FrameDimensions dimensions);
 
-void Window_draw(WindowState *state, const unsigned char *buffer);
+ErrorCode Window_openNull(WindowState *state, FrameDimensions dimensions);
+
+ErrorCode Window_openStream(WindowState *state, const char *path,
+			    FrameDimensions dimensions);
+
+ErrorCode Window_openSnapshots(WindowState *state, const char *prefix,
+			       unsigned int interval,
+			       FrameDimensions dimensions);
+
+unsigned char *Window_frameBuffer(WindowState *state);
+
+void Window_present(WindowState *state);
 
 bool Window_pollEvents(WindowState *state);
 
+int Window_connection(const WindowState *state);
+
 void Window_destroy(WindowState *state);
@@ -0,0 +1,227 @@
+/*
+    The audio engine into an unpaced WAV file with a recording renderer,
+    controls arrive in the order they were sent, a full ring drops and
+    counts what does not fit, and the file's header and length match the
+    blocks the engine says it rendered
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "engine.h"
+#include "output.h"
+#include "ring.h"
+#include "types.h"
+
+#define PATH_LENGTH 64
+#define HEADER_SIZE 44
+
+static const AudioFormat FORMAT = {
+    .sample_rate = 48000, .channels = 2, .block_frames = 64,
+    .buffer_blocks = 3};
+static const unsigned int DROPPED = 5;
+static const float FINAL_GAIN = 0.25F;
+// every block sleeps this long, so a real time audio thread cannot starve
+// the test on a single core
+static const long BLOCK_PAUSE = 50000L;
+static const long POLL_INTERVAL = 1000000L;
+static const int POLL_LIMIT = 5000;
+
+typedef struct {
+    ControlMessage seen[CONTROL_RING_CAPACITY + 1];
+    _Atomic unsigned int controls;
+    _Atomic bool held;
+    _Atomic bool entered;
+    float level;
+} __attribute__((aligned(64))) Recorder;
+
+static void recordControl(void *context, const ControlMessage *message) {
+    Recorder *recorder = (Recorder *)context;
+    const unsigned int count =
+	atomic_load_explicit(&recorder->controls, memory_order_relaxed);
+    if (count < CONTROL_RING_CAPACITY + 1) {
+	recorder->seen[count] = *message;
+    }
+    recorder->level = message->gain;
+    atomic_store_explicit(&recorder->controls, count + 1,
+			  memory_order_release);
+}
+
+// fills the block with the last gain, holding the thread while asked so the
+// ring is not drained
+static void renderLevel(void *context, float *block,
+			const unsigned int frames) {
+    Recorder *recorder = (Recorder *)context;
+    const struct timespec pause = {.tv_nsec = BLOCK_PAUSE};
+    atomic_store(&recorder->entered, true);
+    while (atomic_load(&recorder->held)) {
+	(void)nanosleep(&pause, NULL);
+    }
+    for (unsigned int frame = 0; frame < frames; ++frame) {
+	block[frame] = recorder->level;
+    }
+    (void)nanosleep(&pause, NULL);
+}
+
+// polls until condition holds, false if it never did
+static bool waitFor(bool (*condition)(const void *), const void *argument) {
+    const struct timespec interval = {.tv_nsec = POLL_INTERVAL};
+    for (int attempt = 0; attempt < POLL_LIMIT; ++attempt) {
+	if (condition(argument)) {
+	    return true;
+	}
+	(void)nanosleep(&interval, NULL);
+    }
+    return false;
+}
+
+static bool hasEntered(const void *argument) {
+    return atomic_load(&((const Recorder *)argument)->entered);
+}
+
+static unsigned int expectedControls = 0;
+
+static bool hasControls(const void *argument) {
+    return atomic_load_explicit(&((const Recorder *)argument)->controls,
+				memory_order_acquire) >= expectedControls;
+}
+
+static unsigned long long expectedBlocks = 0;
+
+static bool hasBlocks(const void *argument) {
+    return atomic_load(&((const AudioEngine *)argument)->blocks) >=
+	   expectedBlocks;
+}
+
+static unsigned int little32(const unsigned char *bytes) {
+    return (unsigned int)bytes[0] | ((unsigned int)bytes[1] << 8) |
+	   ((unsigned int)bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+}
+
+static unsigned int little16(const unsigned char *bytes) {
+    return (unsigned int)bytes[0] | ((unsigned int)bytes[1] << 8);
+}
+
+// with the renderer held nothing is drained, so exactly the ring's capacity
+// goes in and the rest is dropped
+static void checkFullRing(AudioEngine *engine, Recorder *recorder) {
+    CHECK(waitFor(hasEntered, recorder));
+    unsigned int accepted = 0;
+    for (unsigned int index = 0; index < CONTROL_RING_CAPACITY + DROPPED;
+	 ++index) {
+	const ControlMessage message = {
+	    .type = CONTROL_NOTE_ON,
+	    .voice = (int)index,
+	    .gain = (float)index / CONTROL_RING_CAPACITY};
+	accepted += AudioEngine_send(engine, &message);
+    }
+    CHECK(accepted == CONTROL_RING_CAPACITY);
+    CHECK(atomic_load(&engine->dropped_messages) == DROPPED);
+
+    atomic_store(&recorder->held, false);
+    expectedControls = CONTROL_RING_CAPACITY;
+    CHECK(waitFor(hasControls, recorder));
+    for (unsigned int index = 0; index < CONTROL_RING_CAPACITY; ++index) {
+	CHECK(recorder->seen[index].type == CONTROL_NOTE_ON &&
+	      recorder->seen[index].voice == (int)index &&
+	      recorder->seen[index].queued != 0);
+    }
+}
+
+// the last control's gain has to reach a block before the engine stops
+static void checkFinalControl(AudioEngine *engine, Recorder *recorder) {
+    const ControlMessage message = {
+	.type = CONTROL_NOTE_UPDATE, .voice = 0, .gain = FINAL_GAIN};
+    CHECK(AudioEngine_send(engine, &message));
+    expectedControls = CONTROL_RING_CAPACITY + 1;
+    CHECK(waitFor(hasControls, recorder));
+    expectedBlocks = atomic_load(&engine->blocks) + 2;
+    CHECK(waitFor(hasBlocks, engine));
+    CHECK(recorder->seen[CONTROL_RING_CAPACITY].type == CONTROL_NOTE_UPDATE);
+}
+
+static void checkFile(const char *path, const unsigned long long blocks) {
+    const int file = open(path, O_RDONLY | O_CLOEXEC);
+    CHECK(file >= 0);
+    if (file < 0) {
+	return;
+    }
+    const unsigned int frameBytes = FORMAT.channels * 2;
+    const unsigned long long dataBytes =
+	blocks * FORMAT.block_frames * frameBytes;
+    struct stat status;
+    CHECK(fstat(file, &status) == 0 &&
+	  (unsigned long long)status.st_size == HEADER_SIZE + dataBytes);
+
+    unsigned char header[HEADER_SIZE];
+    CHECK(pread(file, header, sizeof(header), 0) == (ssize_t)sizeof(header));
+    CHECK(memcmp(header, "RIFF", 4) == 0);
+    CHECK(little32(header + 4) == dataBytes + HEADER_SIZE - 8);
+    CHECK(memcmp(header + 8, "WAVEfmt ", 8) == 0);
+    CHECK(little32(header + 16) == 16 && little16(header + 20) == 1);
+    CHECK(little16(header + 22) == FORMAT.channels);
+    CHECK(little32(header + 24) == FORMAT.sample_rate);
+    CHECK(little32(header + 28) == FORMAT.sample_rate * frameBytes);
+    CHECK(little16(header + 32) == frameBytes && little16(header + 34) == 16);
+    CHECK(memcmp(header + 36, "data", 4) == 0);
+    CHECK(little32(header + 40) == dataBytes);
+
+    // the first block was rendered before any control was drained, the last
+    // after the final one, on every channel
+    const short expected = (short)(FINAL_GAIN * 32767.0F);
+    short first[2] = {-1, -1};
+    short last[2] = {0, 0};
+    CHECK(pread(file, first, sizeof(first), HEADER_SIZE) ==
+	  (ssize_t)sizeof(first));
+    CHECK(pread(file, last, sizeof(last),
+		(off_t)(HEADER_SIZE + dataBytes - frameBytes)) ==
+	  (ssize_t)sizeof(last));
+    CHECK(first[0] == 0 && first[1] == 0);
+    CHECK(last[0] == expected && last[1] == expected);
+    close(file);
+}
+
+int main(void) {
+    char path[PATH_LENGTH];
+    (void)snprintf(path, sizeof(path), "/tmp/hm-audio-test-%d.wav",
+		   (int)getpid());
+    static AudioOutput output;
+    static AudioEngine engine;
+    static Recorder recorder;
+    atomic_init(&recorder.controls, 0);
+    atomic_init(&recorder.held, true);
+    atomic_init(&recorder.entered, false);
+    if (AudioOutput_openWav(&output, path, FORMAT, false) != ERROR_NONE) {
+	CHECK(!"wav output failed to open");
+	return checkFailures;
+    }
+    const AudioRenderer renderer = {.context = &recorder,
+				    .control = recordControl,
+				    .render = renderLevel};
+    if (AudioEngine_start(&engine, &output, &renderer, -1) != ERROR_NONE) {
+	CHECK(!"engine failed to start");
+	AudioOutput_close(&output);
+	(void)unlink(path);
+	return checkFailures;
+    }
+
+    checkFullRing(&engine, &recorder);
+    checkFinalControl(&engine, &recorder);
+    AudioEngine_stop(&engine);
+    CHECK(AudioEngine_error(&engine) == ERROR_NONE);
+    const unsigned long long blocks = atomic_load(&engine.blocks);
+    AudioOutput_close(&output);
+
+    checkFile(path, blocks);
+    (void)unlink(path);
+    return checkFailures;
+}
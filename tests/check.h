@@ -0,0 +1,19 @@
+/*
+    Shared by the test programs, a failed CHECK reports where and counts the
+    failure, the program exits with the count so `make test` stops on it
+*/
+
+#pragma once
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+#define CHECK(condition)                                                  \
+    do {                                                                  \
+	if (!(condition)) {                                               \
+	    (void)fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__,  \
+			  __LINE__, #condition);                          \
+	    checkFailures++;                                              \
+	}                                                                 \
+    } while (0)
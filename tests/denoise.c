@@ -0,0 +1,168 @@
+/*
+    The temporal denoiser against a per pixel reference of its blend, at a
+    width that leaves both the gray and the YUYV loops a scalar tail, the
+    YUYV filter's luma against the gray filter's with its chroma and row
+    padding untouched, and steps past the motion threshold passing through
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "denoise.h"
+#include "types.h"
+
+#define WIDTH 37
+#define HEIGHT 3
+#define PADDING 6
+#define PIXELS (WIDTH * HEIGHT)
+#define STRIDE ((WIDTH * 2) + PADDING)
+#define FRAMES 4
+
+static const FrameDimensions DIMENSIONS = {
+    .width = WIDTH, .height = HEIGHT, .stride = STRIDE, .pixels = PIXELS};
+// the weight is 0 from this difference on
+static const int MOTION_EDGE = 36;
+static const int STEPS[] = {36, 37, 60, 200, -36, -45, -180};
+static const int SETTLED = 100;
+
+static unsigned int seed = 12345;
+
+static int nextRandom(const int range) {
+    seed = (seed * 1103515245U) + 12345U;
+    return (int)((seed >> 16) % (unsigned int)range);
+}
+
+static unsigned char clampByte(const int value) {
+    return (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+// what blendPixel computes, written out again from the header's description
+static unsigned char reference(const TemporalDenoiser *denoiser,
+			       const int current, const int history,
+			       const int maxWeight) {
+    const int difference = history - current;
+    const int magnitude = difference < 0 ? -difference : difference;
+    const int excess = magnitude > denoiser->noise_floor
+			   ? magnitude - denoiser->noise_floor
+			   : 0;
+    const int weight = maxWeight > excess * denoiser->motion_slope
+			   ? maxWeight - (excess * denoiser->motion_slope)
+			   : 0;
+    return (unsigned char)(current +
+			   (((difference * weight) +
+			     (1 << (DENOISE_WEIGHT_SHIFT - 1))) >>
+			    DENOISE_WEIGHT_SHIFT));
+}
+
+// each frame wanders from the one before by up to twice the motion edge,
+// so all of full weight, falling weight and pass through show up
+static void fillFrames(unsigned char frames[FRAMES][PIXELS]) {
+    for (int index = 0; index < PIXELS; ++index) {
+	frames[0][index] = (unsigned char)nextRandom(256);
+    }
+    for (int frame = 1; frame < FRAMES; ++frame) {
+	for (int index = 0; index < PIXELS; ++index) {
+	    frames[frame][index] =
+		clampByte(frames[frame - 1][index] +
+			  nextRandom((MOTION_EDGE * 4) + 1) -
+			  (MOTION_EDGE * 2));
+	}
+    }
+}
+
+static void toYuyv(const unsigned char *gray, unsigned char *yuyv) {
+    for (int row = 0; row < HEIGHT; ++row) {
+	for (int column = 0; column < WIDTH; ++column) {
+	    yuyv[(row * STRIDE) + (column * 2)] = gray[(row * WIDTH) + column];
+	    yuyv[(row * STRIDE) + (column * 2) + 1] =
+		(unsigned char)nextRandom(256);
+	}
+	for (int pad = WIDTH * 2; pad < STRIDE; ++pad) {
+	    yuyv[(row * STRIDE) + pad] = (unsigned char)nextRandom(256);
+	}
+    }
+}
+
+static void checkAgainstReference(unsigned char frames[FRAMES][PIXELS]) {
+    static TemporalDenoiser denoiser;
+    CHECK(TemporalDenoiser_create(&denoiser, DIMENSIONS) == ERROR_NONE);
+    unsigned char history[PIXELS] = {0};
+    unsigned char gray[PIXELS];
+    for (int frame = 0; frame < FRAMES; ++frame) {
+	memcpy(gray, frames[frame], sizeof(gray));
+	TemporalDenoiser_filterGray(&denoiser, gray);
+	// the first frame passes through and becomes the history
+	const int maxWeight = frame == 0 ? 0 : denoiser.max_weight;
+	for (int index = 0; index < PIXELS; ++index) {
+	    const unsigned char expected =
+		reference(&denoiser, frames[frame][index], history[index],
+			  maxWeight);
+	    CHECK(gray[index] == expected);
+	    history[index] = expected;
+	}
+    }
+    TemporalDenoiser_destroy(&denoiser);
+}
+
+static void checkYuyvMatchesGray(unsigned char frames[FRAMES][PIXELS]) {
+    static TemporalDenoiser grayDenoiser;
+    static TemporalDenoiser yuyvDenoiser;
+    CHECK(TemporalDenoiser_create(&grayDenoiser, DIMENSIONS) == ERROR_NONE);
+    CHECK(TemporalDenoiser_create(&yuyvDenoiser, DIMENSIONS) == ERROR_NONE);
+    unsigned char gray[PIXELS];
+    unsigned char yuyv[STRIDE * HEIGHT];
+    unsigned char original[STRIDE * HEIGHT];
+    for (int frame = 0; frame < FRAMES; ++frame) {
+	memcpy(gray, frames[frame], sizeof(gray));
+	toYuyv(gray, yuyv);
+	memcpy(original, yuyv, sizeof(yuyv));
+	TemporalDenoiser_filterGray(&grayDenoiser, gray);
+	TemporalDenoiser_filterYuyv(&yuyvDenoiser, yuyv);
+	for (int row = 0; row < HEIGHT; ++row) {
+	    for (int column = 0; column < WIDTH; ++column) {
+		const int luma = (row * STRIDE) + (column * 2);
+		CHECK(yuyv[luma] == gray[(row * WIDTH) + column]);
+		CHECK(yuyv[luma + 1] == original[luma + 1]);
+	    }
+	    CHECK(memcmp(yuyv + (row * STRIDE) + (WIDTH * 2),
+			 original + (row * STRIDE) + (WIDTH * 2),
+			 PADDING) == 0);
+	}
+    }
+    TemporalDenoiser_destroy(&grayDenoiser);
+    TemporalDenoiser_destroy(&yuyvDenoiser);
+}
+
+// a settled scene with a step in one half, both halves come out as they
+// went in, the settled half because it did not change, the step because
+// it is motion
+static void checkSteps(void) {
+    static TemporalDenoiser denoiser;
+    CHECK(TemporalDenoiser_create(&denoiser, DIMENSIONS) == ERROR_NONE);
+    unsigned char gray[PIXELS];
+    unsigned char stepped[PIXELS];
+    for (size_t step = 0; step < sizeof(STEPS) / sizeof(STEPS[0]); ++step) {
+	TemporalDenoiser_reset(&denoiser);
+	memset(gray, SETTLED, sizeof(gray));
+	TemporalDenoiser_filterGray(&denoiser, gray);
+	for (int index = 0; index < PIXELS; ++index) {
+	    stepped[index] = (unsigned char)(index % WIDTH < WIDTH / 2
+						 ? SETTLED
+						 : SETTLED + STEPS[step]);
+	}
+	memcpy(gray, stepped, sizeof(gray));
+	TemporalDenoiser_filterGray(&denoiser, gray);
+	CHECK(memcmp(gray, stepped, sizeof(gray)) == 0);
+    }
+    TemporalDenoiser_destroy(&denoiser);
+}
+
+int main(void) {
+    static unsigned char frames[FRAMES][PIXELS];
+    fillFrames(frames);
+    checkAgainstReference(frames);
+    checkYuyvMatchesGray(frames);
+    checkSteps();
+    return checkFailures;
+}
@@ -0,0 +1,61 @@
+/*
+    Distance transform palm estimates, the region border counts as
+    background on every side so a blob cut off by the top or the bottom of
+    the region gets the same radius and a mirrored centre
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "distance.h"
+#include "types.h"
+
+#define SIZE 64U
+// 24 rows by 41 columns, the largest inscribed distance is 12
+#define BLOB_ROWS 24U
+#define BLOB_LEFT 10U
+#define BLOB_RIGHT 50U
+#define BLOB_RADIUS 12
+
+static const FrameDimensions DIMENSIONS = {
+    .width = SIZE, .height = SIZE, .stride = SIZE, .pixels = SIZE * SIZE};
+
+static void fillBlob(unsigned char *mask, const unsigned int top) {
+    memset(mask, 0, DIMENSIONS.pixels);
+    for (unsigned int row = top; row < top + BLOB_ROWS; ++row) {
+	memset(mask + ((size_t)row * SIZE) + BLOB_LEFT, 0xFF,
+	       BLOB_RIGHT - BLOB_LEFT + 1);
+    }
+}
+
+static void estimate(DistanceTransform *transform, const unsigned char *mask,
+		     PalmEstimate *palm) {
+    const FrameRegion region = {.width = SIZE, .height = SIZE};
+    CHECK(DistanceTransform_compute(transform, mask, DIMENSIONS, region, 1,
+				    palm) == ERROR_NONE);
+}
+
+int main(void) {
+    static unsigned char mask[SIZE * SIZE];
+    DistanceTransform transform;
+    CHECK(DistanceTransform_create(&transform, DIMENSIONS) == ERROR_NONE);
+
+    PalmEstimate top = {0};
+    PalmEstimate bottom = {0};
+    fillBlob(mask, 0);
+    estimate(&transform, mask, &top);
+    fillBlob(mask, SIZE - BLOB_ROWS);
+    estimate(&transform, mask, &bottom);
+
+    CHECK(top.radius == BLOB_RADIUS);
+    CHECK(bottom.radius == BLOB_RADIUS);
+    // rows 11 and 12 tie at the top, 51 and 52 at the bottom
+    CHECK(top.centre.y == BLOB_RADIUS - 1 || top.centre.y == BLOB_RADIUS);
+    CHECK(bottom.centre.y == (int)SIZE - BLOB_RADIUS - 1 ||
+	  bottom.centre.y == (int)SIZE - BLOB_RADIUS);
+    CHECK(top.centre.x == bottom.centre.x);
+
+    DistanceTransform_destroy(&transform);
+    return checkFailures;
+}
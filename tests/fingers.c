@@ -0,0 +1,70 @@
+/*
+    The fingertip note model, every active slot sounds its own voice, a
+    fist releases them all and opening the hand brings the same fingers
+    back as new notes
+*/
+
+#include "check.h"
+#include "fingers.h"
+#include "gesture.h"
+#include "ring.h"
+#include "track.h"
+#include "types.h"
+
+static const FrameDimensions DIMENSIONS = {
+    .width = 640, .height = 480, .stride = 1280, .pixels = 640 * 480};
+static const int VOICE_BASE = 10;
+static const int FINGERS = 3;
+
+static int countType(const ControlMessage *messages, const int count,
+		     const ControlType type) {
+    int matching = 0;
+    for (int index = 0; index < count; ++index) {
+	matching += messages[index].type == type;
+    }
+    return matching;
+}
+
+int main(void) {
+    static FingertipTracker tracker;
+    static FingerControl control;
+    static ControlMessage messages[FINGER_MAX_MESSAGES];
+    FingertipTracker_init(&tracker);
+    FingerControl_init(&control, VOICE_BASE);
+    for (int slot = 0; slot < FINGERS; ++slot) {
+	FingertipTrack *track = &tracker.tracks[slot];
+	track->active = true;
+	track->id = slot + 1;
+	track->position = (Point){.x = 100 * slot, .y = 240};
+    }
+
+    int count = FingerControl_update(&control, &tracker, GESTURE_OPEN_PALM,
+				     DIMENSIONS, 1, messages);
+    CHECK(count == FINGERS);
+    CHECK(countType(messages, count, CONTROL_NOTE_ON) == FINGERS);
+    for (int index = 0; index < count; ++index) {
+	CHECK(messages[index].voice == VOICE_BASE + index);
+    }
+
+    // no gesture is not a fist, the notes carry on
+    count = FingerControl_update(&control, &tracker, GESTURE_NONE,
+				 DIMENSIONS, 2, messages);
+    CHECK(countType(messages, count, CONTROL_NOTE_UPDATE) == FINGERS);
+    CHECK(count == FINGERS);
+
+    count = FingerControl_update(&control, &tracker, GESTURE_FIST,
+				 DIMENSIONS, 3, messages);
+    CHECK(count == FINGERS);
+    CHECK(countType(messages, count, CONTROL_NOTE_OFF) == FINGERS);
+
+    // a held fist stays silent
+    count = FingerControl_update(&control, &tracker, GESTURE_FIST,
+				 DIMENSIONS, 4, messages);
+    CHECK(count == 0);
+
+    count = FingerControl_update(&control, &tracker, GESTURE_POINT,
+				 DIMENSIONS, 5, messages);
+    CHECK(count == FINGERS);
+    CHECK(countType(messages, count, CONTROL_NOTE_ON) == FINGERS);
+    return checkFailures;
+}
@@ -0,0 +1,95 @@
+/*
+    The baseline hull against the point set hull on random clouds, both
+    have to find the same vertices and every input point has to lie inside
+    or on the edges they give
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "pointset.h"
+#include "recognize.h"
+#include "types.h"
+
+#define MAX_POINTS 400
+
+static const int CLOUD_SIZE = 300;
+static const unsigned int SEEDS[] = {1, 17, 4242, 65521};
+
+static int comparePoints(const void *first, const void *second) {
+    const Point *a = (const Point *)first;
+    const Point *b = (const Point *)second;
+    return a->x != b->x ? a->x - b->x : a->y - b->y;
+}
+
+static long long cross(const Point origin, const Point to, const Point point) {
+    return ((long long)(to.x - origin.x) * (point.y - origin.y)) -
+	   ((long long)(to.y - origin.y) * (point.x - origin.x));
+}
+
+// every point on the same side of every edge as the hull's interior
+static void checkEnclosing(const Point *hull, const int hullCount,
+			   const Point *points, const int count) {
+    for (int edge = 0; edge < hullCount; ++edge) {
+	const Point from = hull[edge];
+	const Point to = hull[(edge + 1) % hullCount];
+	for (int index = 0; index < count; ++index) {
+	    if (cross(from, to, points[index]) < 0) {
+		CHECK(!"point outside the hull");
+		return;
+	    }
+	}
+    }
+}
+
+static void checkSeed(const unsigned int seed, PointSet *contour,
+		      PointSet *hullSet) {
+    static Point points[MAX_POINTS];
+    static Point hull[MAX_POINTS + 1];
+    static Point reference[MAX_POINTS + 1];
+    static Point scratch[MAX_POINTS];
+    unsigned int state = seed;
+    for (int index = 0; index < CLOUD_SIZE; ++index) {
+	state = (state * 1103515245U) + 12345U;
+	points[index].x = (int)((state >> 16) % 320U);
+	state = (state * 1103515245U) + 12345U;
+	points[index].y = (int)((state >> 16) % 240U);
+    }
+
+    const int hullCount = convexHull(points, hull, scratch, CLOUD_SIZE);
+    CHECK(hullCount >= 3);
+    if (hullCount < 3) {
+	return;
+    }
+    checkEnclosing(hull, hullCount, points, CLOUD_SIZE);
+
+    PointSet_fromPoints(contour, points, CLOUD_SIZE);
+    const int referenceCount = convexHullSet(contour, hullSet);
+    CHECK(referenceCount == hullCount);
+    for (int index = 0; index < referenceCount && index <= MAX_POINTS;
+	 ++index) {
+	reference[index] =
+	    (Point){.x = hullSet->x[index], .y = hullSet->y[index]};
+    }
+    if (referenceCount != hullCount) {
+	return;
+    }
+    qsort(hull, (size_t)hullCount, sizeof(Point), comparePoints);
+    qsort(reference, (size_t)hullCount, sizeof(Point), comparePoints);
+    CHECK(memcmp(hull, reference, (size_t)hullCount * sizeof(Point)) == 0);
+}
+
+int main(void) {
+    PointSet contour;
+    PointSet hullSet;
+    CHECK(PointSet_create(&contour, MAX_POINTS) == ERROR_NONE);
+    CHECK(PointSet_create(&hullSet, MAX_POINTS + 1) == ERROR_NONE);
+    for (size_t index = 0; index < sizeof(SEEDS) / sizeof(SEEDS[0]);
+	 ++index) {
+	checkSeed(SEEDS[index], &contour, &hullSet);
+    }
+    PointSet_destroy(&contour);
+    PointSet_destroy(&hullSet);
+    return checkFailures;
+}
@@ -0,0 +1,145 @@
+/*
+    The default mapping through a null sink, every tracker slot sounds its
+    own note on its own channel, a moved finger retriggers only its note
+    and the flush releases everything that is still sounding, and the
+    recognised gesture drives its controller only while there is one
+*/
+
+#include <string.h>
+
+#include "check.h"
+#include "event.h"
+#include "mapping.h"
+#include "sink.h"
+#include "track.h"
+#include "types.h"
+
+static const FrameDimensions DIMENSIONS = {
+    .width = 640, .height = 480, .stride = 1280, .pixels = 640 * 480};
+static const unsigned char NOTE_ON = 0x90;
+static const unsigned char NOTE_OFF = 0x80;
+static const unsigned char CONTROL_CHANGE = 0xB0;
+static const unsigned char GESTURE_CONTROLLER = 20;
+static const unsigned char STATUS_MASK = 0xF0;
+static const unsigned char CHANNEL_MASK = 0x0F;
+
+static void place(FingertipTracker *tracker, const int slot, const int x,
+		  const int y) {
+    FingertipTrack *track = &tracker->tracks[slot];
+    track->active = true;
+    track->id = slot + 1;
+    track->position = (Point){.x = x, .y = y};
+}
+
+static unsigned long long eventsSent = 0;
+
+static void send(MidiSink *sink, const MidiBatch *batch) {
+    CHECK(MidiSink_write(sink, batch) == ERROR_NONE);
+    eventsSent += (unsigned long long)batch->count;
+}
+
+static int countStatus(const MidiBatch *batch, const unsigned char status) {
+    int count = 0;
+    for (int index = 0; index < batch->count; ++index) {
+	count += (batch->events[index].status & STATUS_MASK) == status;
+    }
+    return count;
+}
+
+static void checkEverySlotSounds(MidiMapper *mapper, MidiSink *sink,
+				 MidiBatch *batch) {
+    static FingertipTracker tracker;
+    FingertipTracker_init(&tracker);
+    for (int slot = 0; slot < TRACKER_MAX_TRACKS; ++slot) {
+	place(&tracker, slot, 60 * slot, 240);
+    }
+    MidiMapper_update(mapper, &tracker, GESTURE_NONE, DIMENSIONS, 1, batch);
+    CHECK(countStatus(batch, NOTE_ON) == TRACKER_MAX_TRACKS);
+    unsigned int channels = 0;
+    for (int index = 0; index < batch->count; ++index) {
+	const MidiEvent *event = &batch->events[index];
+	if ((event->status & STATUS_MASK) == NOTE_ON) {
+	    channels |= 1U << (event->status & CHANNEL_MASK);
+	}
+    }
+    CHECK(__builtin_popcount(channels) == TRACKER_MAX_TRACKS);
+    send(sink, batch);
+
+    // an unchanged frame says nothing
+    MidiMapper_update(mapper, &tracker, GESTURE_NONE, DIMENSIONS, 2, batch);
+    CHECK(batch->count == 0);
+
+    // the last slot moving across retriggers its note alone
+    tracker.tracks[TRACKER_MAX_TRACKS - 1].position.x = 0;
+    MidiMapper_update(mapper, &tracker, GESTURE_NONE, DIMENSIONS, 3, batch);
+    CHECK(countStatus(batch, NOTE_OFF) == 1);
+    CHECK(countStatus(batch, NOTE_ON) == 1);
+    send(sink, batch);
+
+    MidiMapper_flush(mapper, 4, batch);
+    CHECK(countStatus(batch, NOTE_OFF) == TRACKER_MAX_TRACKS);
+    CHECK(countStatus(batch, NOTE_ON) == 0);
+    send(sink, batch);
+}
+
+// the controller value of the gesture row, -1 if the batch has none
+static int gestureValue(const MidiBatch *batch) {
+    int value = -1;
+    for (int index = 0; index < batch->count; ++index) {
+	const MidiEvent *event = &batch->events[index];
+	if ((event->status & STATUS_MASK) == CONTROL_CHANGE &&
+	    event->data1 == GESTURE_CONTROLLER) {
+	    value = event->data2;
+	}
+    }
+    return value;
+}
+
+static void checkGesture(MidiMapper *mapper, MidiBatch *batch) {
+    static FingertipTracker tracker;
+    FingertipTracker_init(&tracker);
+    MidiMapper_update(mapper, &tracker, GESTURE_NONE, DIMENSIONS, 5, batch);
+    CHECK(gestureValue(batch) == -1);
+    MidiMapper_update(mapper, &tracker, GESTURE_OPEN_PALM, DIMENSIONS, 6,
+		      batch);
+    CHECK(gestureValue(batch) == 0);
+    MidiMapper_update(mapper, &tracker, GESTURE_POINT, DIMENSIONS, 7, batch);
+    CHECK(gestureValue(batch) == 127);
+    MidiMapper_update(mapper, &tracker, GESTURE_FIST, DIMENSIONS, 8, batch);
+    const int fist = gestureValue(batch);
+    CHECK(fist > 0 && fist < 127);
+    // losing the gesture leaves the controller where it was
+    MidiMapper_update(mapper, &tracker, GESTURE_NONE, DIMENSIONS, 9, batch);
+    CHECK(gestureValue(batch) == -1);
+}
+
+static void checkFingerRange(MidiMapper *mapper) {
+    int count = 0;
+    const MidiMapping *defaults = MidiMapper_defaultTable(&count);
+    MidiMapping mapping = defaults[0];
+    mapping.finger = TRACKER_MAX_TRACKS;
+    CHECK(MidiMapper_init(mapper, &mapping, 1) == ERROR_INVALID_ARGUMENT);
+    mapping.finger = -1;
+    CHECK(MidiMapper_init(mapper, &mapping, 1) == ERROR_INVALID_ARGUMENT);
+    mapping.finger = TRACKER_MAX_TRACKS - 1;
+    CHECK(MidiMapper_init(mapper, &mapping, 1) == ERROR_NONE);
+}
+
+int main(void) {
+    static MidiMapper mapper;
+    static MidiBatch batch;
+    MidiSink sink;
+    int count = 0;
+    const MidiMapping *defaults = MidiMapper_defaultTable(&count);
+    CHECK(MidiMapper_init(&mapper, defaults, count) == ERROR_NONE);
+    CHECK(MidiSink_openNull(&sink) == ERROR_NONE);
+
+    checkEverySlotSounds(&mapper, &sink, &batch);
+    CHECK(eventsSent > (unsigned long long)(TRACKER_MAX_TRACKS * 2));
+    CHECK(sink.events_written == eventsSent);
+    MidiSink_close(&sink);
+
+    checkGesture(&mapper, &batch);
+    checkFingerRange(&mapper);
+    return checkFailures;
+}
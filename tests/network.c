@@ -0,0 +1,280 @@
+/*
+    int8 inference against a float reference of the same model, the
+    reference runs every layer as plain loops over the loaded weights and
+    only skips rounding activations to integers, so the two logit vectors
+    differ by quantisation error alone
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "network.h"
+#include "synthetic.h"
+#include "types.h"
+
+#define PATH_LENGTH 64
+
+// covers every layer type, a strided depthwise and more than one block of
+// padded channels
+static const SyntheticLayer LAYERS[] = {
+    {LAYER_CONV, 3, 1, 12},     {LAYER_DEPTHWISE, 3, 2, 0},
+    {LAYER_CONV, 3, 1, 40},     {LAYER_MAXPOOL, 2, 0, 0},
+    {LAYER_CONV, 1, 1, 24},     {LAYER_DENSE, 0, 0, 5},
+};
+static const unsigned int INPUT_SIZE = 24;
+static const unsigned int INPUT_CHANNELS = 3;
+static const unsigned int SEEDS[] = {1, 7, 1234, 99991};
+// of the largest float logit, rounding every activation to an integer
+// moves a logit by a few percent at most through these layers
+static const double TOLERANCE = 0.05;
+
+static size_t tensorSize(const TensorShape shape) {
+    return (size_t)shape.height * shape.width * shape.padded_channels;
+}
+
+static float activate(const double sum, const float scale) {
+    const double value = sum * (double)scale;
+    return (float)(value < 0.0 ? 0.0 : (value > 127.0 ? 127.0 : value));
+}
+
+static const float *pixelAt(const float *tensor, const TensorShape shape,
+			    const int y, const int x) {
+    if (y < 0 || y >= (int)shape.height || x < 0 || x >= (int)shape.width) {
+	return NULL;
+    }
+    return tensor + (((size_t)y * shape.width) + (size_t)x) *
+			shape.padded_channels;
+}
+
+static void referenceConv(const NetworkLayer *layer, const float *input,
+			  float *output) {
+    const TensorShape in = layer->input;
+    const TensorShape out = layer->output;
+    const int pad = (int)layer->kernel / 2;
+    const size_t kernelBytes =
+	(size_t)layer->kernel * layer->kernel * in.padded_channels;
+    for (unsigned int y = 0; y < out.height; ++y) {
+	for (unsigned int x = 0; x < out.width; ++x) {
+	    float *target =
+		output + (((size_t)y * out.width) + x) * out.padded_channels;
+	    for (unsigned int channel = 0; channel < out.channels; ++channel) {
+		const signed char *weights =
+		    layer->weights + (channel * kernelBytes);
+		double sum = layer->biases[channel];
+		for (unsigned int ky = 0; ky < layer->kernel; ++ky) {
+		    for (unsigned int kx = 0; kx < layer->kernel; ++kx) {
+			const float *source = pixelAt(
+			    input, in, (int)(y * layer->stride + ky) - pad,
+			    (int)(x * layer->stride + kx) - pad);
+			const signed char *tap =
+			    weights + ((ky * layer->kernel) + kx) *
+					  in.padded_channels;
+			for (unsigned int index = 0;
+			     source != NULL && index < in.channels; ++index) {
+			    sum += (double)source[index] * tap[index];
+			}
+		    }
+		}
+		target[channel] = activate(sum, layer->scale);
+	    }
+	}
+    }
+}
+
+// taps pair up byte interleaved, see the layout in network.h
+static int depthwiseWeight(const NetworkLayer *layer, const unsigned int tap,
+			   const unsigned int channel) {
+    const size_t pair = ((size_t)(tap / 2) * layer->input.padded_channels) +
+			channel;
+    return layer->weights[(pair * 2) + (tap % 2)];
+}
+
+static void referenceDepthwise(const NetworkLayer *layer, const float *input,
+			       float *output) {
+    const TensorShape in = layer->input;
+    const TensorShape out = layer->output;
+    for (unsigned int y = 0; y < out.height; ++y) {
+	for (unsigned int x = 0; x < out.width; ++x) {
+	    float *target =
+		output + (((size_t)y * out.width) + x) * out.padded_channels;
+	    for (unsigned int channel = 0; channel < out.channels; ++channel) {
+		double sum = layer->biases[channel];
+		for (unsigned int tap = 0; tap < 9; ++tap) {
+		    const int sourceY = (int)(y * layer->stride + tap / 3) - 1;
+		    const int sourceX = (int)(x * layer->stride + tap % 3) - 1;
+		    const float *source = pixelAt(input, in, sourceY, sourceX);
+		    if (source != NULL) {
+			sum += (double)source[channel] *
+			       depthwiseWeight(layer, tap, channel);
+		    }
+		}
+		target[channel] = activate(sum, layer->scale);
+	    }
+	}
+    }
+}
+
+static void referenceMaxPool(const NetworkLayer *layer, const float *input,
+			     float *output) {
+    const TensorShape out = layer->output;
+    for (unsigned int y = 0; y < out.height; ++y) {
+	for (unsigned int x = 0; x < out.width; ++x) {
+	    float *target =
+		output + (((size_t)y * out.width) + x) * out.padded_channels;
+	    for (unsigned int channel = 0; channel < out.channels; ++channel) {
+		float maximum = 0.0F;
+		for (unsigned int ky = 0; ky < layer->kernel; ++ky) {
+		    for (unsigned int kx = 0; kx < layer->kernel; ++kx) {
+			const float value = pixelAt(
+			    input, layer->input, (int)(y * layer->kernel + ky),
+			    (int)(x * layer->kernel + kx))[channel];
+			maximum = value > maximum ? value : maximum;
+		    }
+		}
+		target[channel] = maximum;
+	    }
+	}
+    }
+}
+
+static void referenceDense(const NetworkLayer *layer, const float *input,
+			   float *output, double *logits) {
+    const size_t inputSize = tensorSize(layer->input);
+    for (unsigned int channel = 0; channel < layer->output.channels;
+	 ++channel) {
+	double sum = layer->biases[channel];
+	for (size_t index = 0; index < inputSize; ++index) {
+	    sum += (double)input[index] *
+		   layer->weights[(channel * inputSize) + index];
+	}
+	if ((layer->flags & LAYER_FLAG_LOGITS) != 0) {
+	    logits[channel] = sum;
+	} else {
+	    output[channel] = activate(sum, layer->scale);
+	}
+    }
+}
+
+// input holds the same values as the network's input tensor
+static void runReference(const Network *network, float *buffers[2],
+			 double *logits) {
+    for (int index = 0; index < network->layer_count; ++index) {
+	const NetworkLayer *layer = &network->layers[index];
+	const float *input = buffers[index & 1];
+	float *output = buffers[(index + 1) & 1];
+	memset(output, 0, tensorSize(layer->output) * sizeof(float));
+	switch (layer->type) {
+	    case LAYER_CONV:
+		referenceConv(layer, input, output);
+		break;
+	    case LAYER_DEPTHWISE:
+		referenceDepthwise(layer, input, output);
+		break;
+	    case LAYER_MAXPOOL:
+		referenceMaxPool(layer, input, output);
+		break;
+	    case LAYER_DENSE:
+		referenceDense(layer, input, output, logits);
+		break;
+	    default:
+		CHECK(!"unknown layer type");
+	}
+    }
+}
+
+static size_t largestTensor(const Network *network) {
+    size_t largest = tensorSize(network->input);
+    for (int index = 0; index < network->layer_count; ++index) {
+	const size_t size = tensorSize(network->layers[index].output);
+	largest = size > largest ? size : largest;
+    }
+    return largest;
+}
+
+static void checkSeed(const char *path, const unsigned int seed) {
+    const SyntheticNetwork synthetic = {
+	.layers = LAYERS,
+	.layer_count = (int)(sizeof(LAYERS) / sizeof(LAYERS[0])),
+	.input_height = INPUT_SIZE,
+	.input_width = INPUT_SIZE,
+	.input_channels = INPUT_CHANNELS,
+	.seed = seed};
+    static Network network;
+    CHECK(SyntheticNetwork_write(&synthetic, path) == ERROR_NONE);
+    if (Network_load(&network, path) != ERROR_NONE) {
+	CHECK(!"model failed to load");
+	return;
+    }
+
+    const size_t largest = largestTensor(&network);
+    float *buffers[2] = {(float *)calloc(largest, sizeof(float)),
+			 (float *)calloc(largest, sizeof(float))};
+    unsigned char *input = Network_input(&network);
+    unsigned int state = seed;
+    for (size_t pixel = 0;
+	 pixel < (size_t)network.input.height * network.input.width;
+	 ++pixel) {
+	for (unsigned int channel = 0; channel < network.input.channels;
+	     ++channel) {
+	    state = (state * 1103515245U) + 12345U;
+	    const size_t index = (pixel * network.input.padded_channels) +
+				 channel;
+	    input[index] = (unsigned char)((state >> 16) % 128U);
+	    buffers[0][index] = (float)input[index];
+	}
+    }
+
+    int best = -1;
+    double logits[NETWORK_MAX_CLASSES] = {0};
+    CHECK(Network_run(&network, &best) == ERROR_NONE);
+    runReference(&network, buffers, logits);
+
+    double largestLogit = 0.0;
+    double largestError = 0.0;
+    int referenceBest = 0;
+    for (int index = 0; index < network.class_count; ++index) {
+	largestLogit = fmax(largestLogit, fabs(logits[index]));
+	largestError =
+	    fmax(largestError, fabs(network.logits[index] - logits[index]));
+	referenceBest = logits[index] > logits[referenceBest] ? index
+							      : referenceBest;
+    }
+    (void)printf("seed %u: largest logit %.0f, largest error %.0f (%.2f%%)\n",
+		 seed, largestLogit, largestError,
+		 largestLogit > 0.0 ? 100.0 * largestError / largestLogit
+				    : 0.0);
+    CHECK(largestLogit > 0.0);
+    CHECK(largestError <= TOLERANCE * largestLogit);
+    // a class only has to win in both when it wins by more than the error
+    double runnerUp = -INFINITY;
+    for (int index = 0; index < network.class_count; ++index) {
+	if (index != referenceBest) {
+	    runnerUp = fmax(runnerUp, logits[index]);
+	}
+    }
+    if (logits[referenceBest] - runnerUp > 2.0 * largestError) {
+	CHECK(best == referenceBest);
+    }
+
+    free(buffers[0]);
+    free(buffers[1]);
+    Network_unload(&network);
+}
+
+int main(void) {
+    char path[PATH_LENGTH];
+    (void)snprintf(path, sizeof(path), "/tmp/hm-network-test-%d.nn",
+		   (int)getpid());
+    for (size_t index = 0; index < sizeof(SEEDS) / sizeof(SEEDS[0]);
+	 ++index) {
+	checkSeed(path, SEEDS[index]);
+    }
+    (void)unlink(path);
+    return checkFailures;
+}
@@ -0,0 +1,184 @@
+/*
+    The publisher's socket path and handshake, a regular file or a socket
+    another instance still listens on where the socket should go is refused
+    and left alone, a socket a crashed run left behind is replaced, and the
+    segment a reader is handed cannot be written, not even after reopening
+    it read write through /proc
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "publisher.h"
+#include "results.h"
+#include "types.h"
+
+#define PATH_LENGTH 64
+
+static const FrameDimensions DIMENSIONS = {
+    .width = 640, .height = 480, .stride = 640 * 2, .pixels = 640 * 480};
+static const char CONTENT[] = "not a socket\n";
+
+static int bindSocket(const char *path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    (void)snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+    const int descriptor = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (descriptor >= 0 &&
+	bind(descriptor, (const struct sockaddr *)&address,
+	     sizeof(address)) < 0) {
+	close(descriptor);
+	return -1;
+    }
+    return descriptor;
+}
+
+static int connectSocket(const char *path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    (void)snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+    const int descriptor = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (descriptor >= 0 &&
+	connect(descriptor, (const struct sockaddr *)&address,
+		sizeof(address)) < 0) {
+	close(descriptor);
+	return -1;
+    }
+    return descriptor;
+}
+
+// what a reader that wants to write would try, true if any of it worked
+static bool writableThroughProc(const int segment) {
+    char path[PATH_LENGTH];
+    (void)snprintf(path, sizeof(path), "/proc/self/fd/%d", segment);
+    const int reopened = open(path, O_RDWR | O_CLOEXEC);
+    if (reopened < 0) {
+	return false;
+    }
+    void *mapping = mmap(NULL, sizeof(ResultsSegment),
+			 PROT_READ | PROT_WRITE, MAP_SHARED, reopened, 0);
+    const bool mapped = mapping != MAP_FAILED;
+    if (mapped) {
+	munmap(mapping, sizeof(ResultsSegment));
+    }
+    const uint32_t magic = 0;
+    const bool written = pwrite(reopened, &magic, sizeof(magic), 0) >= 0;
+    close(reopened);
+    return mapped || written;
+}
+
+static void checkRegularFile(const char *path) {
+    const int file = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+			  0600);
+    CHECK(file >= 0);
+    CHECK(write(file, CONTENT, sizeof(CONTENT)) == (ssize_t)sizeof(CONTENT));
+    close(file);
+
+    static Publisher publisher;
+    CHECK(Publisher_create(&publisher, path, DIMENSIONS) ==
+	  ERROR_INVALID_ARGUMENT);
+    struct stat status;
+    CHECK(lstat(path, &status) == 0 && S_ISREG(status.st_mode) &&
+	  status.st_size == (off_t)sizeof(CONTENT));
+    CHECK(unlink(path) == 0);
+}
+
+// the hello goes out before the publisher accepts, so one accept answers
+static int receiveSegment(Publisher *publisher, const int connection) {
+    unsigned char byte = 0;
+    struct iovec vector = {.iov_base = &byte, .iov_len = sizeof(byte)};
+    struct msghdr message = {.msg_iov = &vector, .msg_iovlen = 1};
+    if (sendmsg(connection, &message, MSG_NOSIGNAL) < 0) {
+	return -1;
+    }
+    Publisher_accept(publisher);
+
+    union {
+	char buffer[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    message = (struct msghdr){.msg_iov = &vector,
+			      .msg_iovlen = 1,
+			      .msg_control = control.buffer,
+			      .msg_controllen = sizeof(control.buffer)};
+    if (recvmsg(connection, &message, MSG_DONTWAIT) <= 0) {
+	return -1;
+    }
+    const struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header == NULL || header->cmsg_type != SCM_RIGHTS) {
+	return -1;
+    }
+    int descriptor = -1;
+    memcpy(&descriptor, CMSG_DATA(header), sizeof(descriptor));
+    return descriptor;
+}
+
+static void checkStaleSocket(const char *path) {
+    const int stale = bindSocket(path);
+    CHECK(stale >= 0);
+    close(stale);
+
+    static Publisher publisher;
+    CHECK(Publisher_create(&publisher, path, DIMENSIONS) == ERROR_NONE);
+    const int connection = connectSocket(path);
+    CHECK(connection >= 0);
+    const int segment =
+	connection >= 0 ? receiveSegment(&publisher, connection) : -1;
+    CHECK(segment >= 0);
+    if (segment >= 0) {
+	CHECK((fcntl(segment, F_GETFL) & O_ACCMODE) == O_RDONLY);
+	void *mapping = mmap(NULL, sizeof(ResultsSegment),
+			     PROT_READ | PROT_WRITE, MAP_SHARED, segment, 0);
+	CHECK(mapping == MAP_FAILED && errno == EACCES);
+	if (mapping != MAP_FAILED) {
+	    munmap(mapping, sizeof(ResultsSegment));
+	}
+	CHECK(!writableThroughProc(segment));
+	CHECK(publisher.segment->magic == RESULTS_MAGIC);
+	close(segment);
+    }
+    if (connection >= 0) {
+	close(connection);
+    }
+    Publisher_destroy(&publisher);
+    struct stat status;
+    CHECK(lstat(path, &status) < 0 && errno == ENOENT);
+}
+
+static void checkLiveSocket(const char *path) {
+    const int live = bindSocket(path);
+    CHECK(live >= 0 && listen(live, 1) == 0);
+
+    static Publisher publisher;
+    CHECK(Publisher_create(&publisher, path, DIMENSIONS) ==
+	  ERROR_INVALID_ARGUMENT);
+    const int connection = connectSocket(path);
+    CHECK(connection >= 0);
+    if (connection >= 0) {
+	close(connection);
+    }
+    close(live);
+    CHECK(unlink(path) == 0);
+}
+
+int main(void) {
+    char path[PATH_LENGTH];
+    (void)snprintf(path, sizeof(path), "/tmp/hm-publish-test-%d.sock",
+		   (int)getpid());
+    checkRegularFile(path);
+    checkLiveSocket(path);
+    checkStaleSocket(path);
+    (void)unlink(path);
+    return checkFailures;
+}
@@ -0,0 +1,189 @@
+/*
+    The reader library against a live publisher in the same process, what
+    a reader sees in order, after being lapped by more than RESULTS_SLOTS
+    publications, through latest, when a slot holds an older publication
+    than its position says, and whether wait wakes for new results
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "camera.h"
+#include "check.h"
+#include "publisher.h"
+#include "reader.h"
+#include "results.h"
+#include "types.h"
+
+#define PATH_LENGTH 64
+
+static const FrameDimensions DIMENSIONS = {
+    .width = 640, .height = 480, .stride = 640 * 2, .pixels = 640 * 480};
+static const unsigned long long LAPPED_BY = 20;
+static const long ACCEPT_INTERVAL = 1000000L;
+
+typedef struct {
+    ResultsReader reader;
+    const char *path;
+    ErrorCode error;
+    bool wakeups;
+    _Atomic bool done;
+} __attribute__((aligned(64))) Opening;
+
+static void *openReader(void *argument) {
+    Opening *opening = (Opening *)argument;
+    opening->error = ResultsReader_open(&opening->reader, opening->path,
+					opening->wakeups);
+    atomic_store(&opening->done, true);
+    return NULL;
+}
+
+// the reader blocks for the reply, the publisher answers from here
+static ErrorCode openAlongside(Publisher *publisher, Opening *opening) {
+    pthread_t thread;
+    atomic_init(&opening->done, false);
+    if (pthread_create(&thread, NULL, openReader, opening) != 0) {
+	return ERROR_UNSUPPORTED_OPERATION;
+    }
+    const struct timespec interval = {.tv_nsec = ACCEPT_INTERVAL};
+    while (!atomic_load(&opening->done)) {
+	Publisher_accept(publisher);
+	(void)nanosleep(&interval, NULL);
+    }
+    pthread_join(thread, NULL);
+    return opening->error;
+}
+
+// a result that says which publication it is through its timestamp and
+// its one fingertip's id
+static void publish(Publisher *publisher, const unsigned long long count) {
+    static CameraResult result;
+    for (unsigned long long index = 0; index < count; ++index) {
+	const unsigned long long publication = publisher->published;
+	memset(&result, 0, sizeof(result));
+	result.timestamp = publication + 1000;
+	result.camera = (int)(publication % 2);
+	result.tracker.tracks[0].active = true;
+	result.tracker.tracks[0].id = (int)publication;
+	Publisher_publish(publisher, &result);
+    }
+}
+
+static bool isPublication(const ResultsSlot *slot,
+			  const unsigned long long publication) {
+    return slot->index == publication &&
+	   slot->capture_timestamp == publication + 1000 &&
+	   slot->camera == publication % 2 && slot->fingertip_count == 1 &&
+	   slot->fingertips[0].id == (int32_t)publication;
+}
+
+static void checkInOrder(Publisher *publisher, ResultsReader *reader) {
+    static ResultsSlot slot;
+    const unsigned long long first = publisher->published;
+    CHECK(!ResultsReader_wait(reader, 0));
+    publish(publisher, 10);
+    CHECK(ResultsReader_wait(reader, 0));
+    for (unsigned long long index = first; index < first + 10; ++index) {
+	CHECK(ResultsReader_next(reader, &slot) && isPublication(&slot, index));
+    }
+    CHECK(!ResultsReader_next(reader, &slot));
+    CHECK(!ResultsReader_wait(reader, 0));
+    CHECK(reader->missed == 0);
+}
+
+// the oldest publication still in the ring comes first, everything the
+// publisher wrote over is counted
+static void checkLapped(Publisher *publisher, ResultsReader *reader) {
+    static ResultsSlot slot;
+    const unsigned long long missed = reader->missed;
+    publish(publisher, RESULTS_SLOTS + LAPPED_BY);
+    const unsigned long long head = publisher->published;
+    for (unsigned long long index = head - RESULTS_SLOTS; index < head;
+	 ++index) {
+	CHECK(ResultsReader_next(reader, &slot) && isPublication(&slot, index));
+    }
+    CHECK(!ResultsReader_next(reader, &slot));
+    CHECK(reader->missed == missed + LAPPED_BY);
+}
+
+static void checkLatest(Publisher *publisher, ResultsReader *reader) {
+    static ResultsSlot slot;
+    const unsigned long long missed = reader->missed;
+    publish(publisher, 5);
+    CHECK(ResultsReader_latest(reader, &slot) &&
+	  isPublication(&slot, publisher->published - 1));
+    CHECK(reader->missed == missed + 4);
+    CHECK(!ResultsReader_latest(reader, &slot));
+}
+
+// a slot whose index is not the one its position stands for is skipped,
+// the publisher's own mapping stands in for one that fell behind
+static void checkStaleSlot(Publisher *publisher, ResultsReader *reader) {
+    static ResultsSlot slot;
+    const unsigned long long missed = reader->missed;
+    const unsigned long long first = publisher->published;
+    publish(publisher, 3);
+    publisher->segment->slots[(first + 1) % RESULTS_SLOTS].index =
+	first + 1 - RESULTS_SLOTS;
+    CHECK(ResultsReader_next(reader, &slot) && isPublication(&slot, first));
+    CHECK(ResultsReader_next(reader, &slot) &&
+	  isPublication(&slot, first + 2));
+    CHECK(reader->missed == missed + 1);
+}
+
+static void checkPolling(Publisher *publisher, const char *path) {
+    static Opening opening;
+    static ResultsSlot slot;
+    opening.path = path;
+    opening.wakeups = false;
+    CHECK(openAlongside(publisher, &opening) == ERROR_NONE);
+    if (opening.error != ERROR_NONE) {
+	return;
+    }
+    ResultsReader *reader = &opening.reader;
+    CHECK(reader->wake_descriptor < 0);
+    CHECK(!ResultsReader_wait(reader, 0));
+    publish(publisher, 1);
+    CHECK(ResultsReader_wait(reader, 0));
+    CHECK(ResultsReader_next(reader, &slot) &&
+	  isPublication(&slot, publisher->published - 1));
+    ResultsReader_close(reader);
+}
+
+int main(void) {
+    char path[PATH_LENGTH];
+    (void)snprintf(path, sizeof(path), "/tmp/hm-results-test-%d.sock",
+		   (int)getpid());
+    static Publisher publisher;
+    if (Publisher_create(&publisher, path, DIMENSIONS) != ERROR_NONE) {
+	CHECK(!"publisher failed to start");
+	return checkFailures;
+    }
+    // the reader starts at the head, nothing before it is unread
+    publish(&publisher, 3);
+
+    static Opening opening;
+    opening.path = path;
+    opening.wakeups = true;
+    CHECK(openAlongside(&publisher, &opening) == ERROR_NONE);
+    if (opening.error == ERROR_NONE) {
+	ResultsReader *reader = &opening.reader;
+	CHECK(reader->wake_descriptor >= 0);
+	CHECK(reader->cursor == publisher.published);
+	checkInOrder(&publisher, reader);
+	checkLapped(&publisher, reader);
+	checkLatest(&publisher, reader);
+	checkStaleSlot(&publisher, reader);
+	ResultsReader_close(reader);
+    }
+    checkPolling(&publisher, path);
+
+    Publisher_destroy(&publisher);
+    return checkFailures;
+}
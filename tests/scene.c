@@ -0,0 +1,106 @@
+/*
+    The synthetic scene generator, the same frame number renders the same
+    image and truth whatever was rendered in between, each truth fingertip
+    sits on skin with background just past it along the finger, and noise
+    the table cannot hold is refused
+*/
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "scene.h"
+#include "types.h"
+
+static const FrameDimensions DIMENSIONS = {
+    .width = 640, .height = 480, .stride = 640 * 2, .pixels = 640 * 480};
+static const unsigned int FRAMES[] = {0, 17, 40, 75, 112};
+// half way between the default skin and background luma
+static const unsigned char SKIN_LUMA = 145;
+// far enough either side of the tip that the pixel centre is too
+static const float TIP_MARGIN = 1.5F;
+
+static bool isSkin(const unsigned char *yuyv, const float x, const float y) {
+    const int column = (int)floorf(x);
+    const int row = (int)floorf(y);
+    CHECK(column >= 0 && column < (int)DIMENSIONS.width && row >= 0 &&
+	  row < (int)DIMENSIONS.height);
+    if (column < 0 || column >= (int)DIMENSIONS.width || row < 0 ||
+	row >= (int)DIMENSIONS.height) {
+	return false;
+    }
+    return yuyv[((size_t)row * DIMENSIONS.stride) + ((size_t)column * 2)] >
+	   SKIN_LUMA;
+}
+
+// the fingers point away from the palm centre through their tips
+static void checkFingertips(const unsigned char *yuyv,
+			    const SceneTruth *truth) {
+    for (int finger = 0; finger < truth->fingertip_count; ++finger) {
+	const ScenePoint tip = truth->fingertips[finger];
+	const float dx = tip.x - truth->palm_centre.x;
+	const float dy = tip.y - truth->palm_centre.y;
+	const float length = sqrtf((dx * dx) + (dy * dy));
+	const float stepX = dx * TIP_MARGIN / length;
+	const float stepY = dy * TIP_MARGIN / length;
+	CHECK(isSkin(yuyv, tip.x - stepX, tip.y - stepY));
+	CHECK(!isSkin(yuyv, tip.x + stepX, tip.y + stepY));
+    }
+}
+
+static void checkRepeatable(const SceneGenerator *generator,
+			    unsigned char *first, unsigned char *second) {
+    SceneTruth firstTruth;
+    SceneTruth secondTruth;
+    // the padding has to match too
+    memset(&firstTruth, 0, sizeof(firstTruth));
+    memset(&secondTruth, 0, sizeof(secondTruth));
+    for (size_t index = 0; index < sizeof(FRAMES) / sizeof(FRAMES[0]);
+	 ++index) {
+	const unsigned int frame = FRAMES[index];
+	SceneGenerator_render(generator, frame, first, &firstTruth);
+	SceneGenerator_render(generator, frame + 1, second, NULL);
+	SceneGenerator_render(generator, frame, second, &secondTruth);
+	CHECK(memcmp(first, second, (size_t)DIMENSIONS.stride *
+					DIMENSIONS.height) == 0);
+	CHECK(memcmp(&firstTruth, &secondTruth, sizeof(firstTruth)) == 0);
+	CHECK(firstTruth.fingertip_count == SCENE_MAX_FINGERS);
+	checkFingertips(first, &firstTruth);
+    }
+}
+
+static void checkNoiseLimit(void) {
+    SceneParameters parameters;
+    SceneGenerator generator;
+    SceneGenerator_defaults(&parameters, SCENE_MAX_FINGERS);
+    parameters.noise = 128;
+    CHECK(SceneGenerator_create(&generator, &parameters, DIMENSIONS) ==
+	  ERROR_INVALID_ARGUMENT);
+    parameters.noise = 127;
+    CHECK(SceneGenerator_create(&generator, &parameters, DIMENSIONS) ==
+	  ERROR_NONE);
+    SceneGenerator_destroy(&generator);
+}
+
+int main(void) {
+    SceneParameters parameters;
+    static SceneGenerator generator;
+    SceneGenerator_defaults(&parameters, SCENE_MAX_FINGERS);
+    const size_t bytes = (size_t)DIMENSIONS.stride * DIMENSIONS.height;
+    unsigned char *first = (unsigned char *)malloc(bytes);
+    unsigned char *second = (unsigned char *)malloc(bytes);
+    if (first == NULL || second == NULL ||
+	SceneGenerator_create(&generator, &parameters, DIMENSIONS) !=
+	    ERROR_NONE) {
+	CHECK(!"scene setup failed");
+    } else {
+	checkRepeatable(&generator, first, second);
+	SceneGenerator_destroy(&generator);
+    }
+    free(first);
+    free(second);
+    checkNoiseLimit();
+    return checkFailures;
+}
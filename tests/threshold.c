@@ -0,0 +1,88 @@
+/*
+    The vector thresholds against a per pixel reference, at widths that
+    leave a scalar tail and for a region whose edges fall inside a 32
+    pixel step, with the thresholds at both ends of the range where off by
+    one comparisons show up
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "recognize.h"
+#include "types.h"
+
+static const unsigned char THRESHOLDS[] = {0, 1, 127, 128, 254, 255};
+static const unsigned int WIDTHS[] = {1, 31, 33, 97, 640};
+static const unsigned int HEIGHT = 7;
+
+static FrameDimensions dimensionsOf(const unsigned int width,
+				    const unsigned int height) {
+    return (FrameDimensions){.width = width,
+			     .height = height,
+			     .stride = width * 2,
+			     .pixels = width * height};
+}
+
+// every value appears in every frame wider than a few pixels
+static void fillGray(unsigned char *gray, const size_t pixels) {
+    for (size_t index = 0; index < pixels; ++index) {
+	gray[index] = (unsigned char)((index * 37U) + (index >> 8));
+    }
+}
+
+static void reference(const unsigned char *gray, unsigned char *binary,
+		      const FrameDimensions dimensions,
+		      const FrameRegion region, const unsigned char threshold) {
+    for (unsigned int y = 0; y < dimensions.height; ++y) {
+	for (unsigned int x = 0; x < dimensions.width; ++x) {
+	    const size_t index = ((size_t)y * dimensions.width) + x;
+	    const int inside = x >= region.x && x < region.x + region.width &&
+			       y >= region.y && y < region.y + region.height;
+	    binary[index] = inside && gray[index] > threshold ? 255 : 0;
+	}
+    }
+}
+
+static void checkWidth(const unsigned int width) {
+    const FrameDimensions dimensions = dimensionsOf(width, HEIGHT);
+    const FrameRegion whole = {.width = width, .height = HEIGHT};
+    const FrameRegion region = {.x = width / 3,
+				.y = 2,
+				.width = width - (width / 3) - (width / 5),
+				.height = HEIGHT - 3};
+    unsigned char *gray = (unsigned char *)malloc(dimensions.pixels);
+    unsigned char *binary = (unsigned char *)malloc(dimensions.pixels);
+    unsigned char *expected = (unsigned char *)malloc(dimensions.pixels);
+    if (gray == NULL || binary == NULL || expected == NULL) {
+	CHECK(!"allocation failed");
+	free(gray);
+	free(binary);
+	free(expected);
+	return;
+    }
+    fillGray(gray, dimensions.pixels);
+    for (size_t index = 0; index < sizeof(THRESHOLDS); ++index) {
+	const unsigned char threshold = THRESHOLDS[index];
+	reference(gray, expected, dimensions, whole, threshold);
+	memset(binary, 0x55, dimensions.pixels);
+	thresholdImage(gray, binary, dimensions, threshold);
+	CHECK(memcmp(binary, expected, dimensions.pixels) == 0);
+
+	reference(gray, expected, dimensions, region, threshold);
+	memset(binary, 0x55, dimensions.pixels);
+	thresholdImageRegion(gray, binary, dimensions, region, threshold);
+	CHECK(memcmp(binary, expected, dimensions.pixels) == 0);
+    }
+    free(gray);
+    free(binary);
+    free(expected);
+}
+
+int main(void) {
+    for (size_t index = 0; index < sizeof(WIDTHS) / sizeof(WIDTHS[0]);
+	 ++index) {
+	checkWidth(WIDTHS[index]);
+    }
+    return checkFailures;
+}